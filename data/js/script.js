@@ -216,7 +216,9 @@ function setupEventListeners() {
 const MAX_RETRIES = 2;
 const COMMAND_TIMEOUT = 3000; // 3 seconds timeout
 
-function sendCommand(message, retryCount = 0) {
+// Retries reuse the original commandId so the device can answer them from
+// its result cache instead of running the command again
+function sendCommand(message, retryCount = 0, commandId = Date.now()) {
   if (!socket || socket.readyState !== WebSocket.OPEN) {
     console.warn(
       `[Debug] WebSocket not ready (state: ${socket?.readyState}), command not sent`
@@ -227,7 +229,7 @@ function sendCommand(message, retryCount = 0) {
   try {
     const command = {
       type: "command",
-      commandId: Date.now(),
+      commandId: commandId,
       ...message,
     };
 
@@ -244,7 +246,7 @@ function sendCommand(message, retryCount = 0) {
             }) timed out, retry ${retryCount + 1}/${MAX_RETRIES}`
           );
           pendingCommands.delete(command.commandId);
-          sendCommand(message, retryCount + 1);
+          sendCommand(message, retryCount + 1, command.commandId);
         } else {
           console.error(
             `[Debug] Command ${command.commandId} (${command.cmd}) failed after ${MAX_RETRIES} retries`
@@ -0,0 +1,31 @@
+#ifndef ALLOC_GUARD_H
+#define ALLOC_GUARD_H
+
+#include <Arduino.h>
+#include "static_alloc.h"
+#include "bench.h"
+
+// Counts malloc/calloc/realloc calls once armed. The counting wrappers are
+// linked in with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, which
+// env:esp32dev_static and the bench envs pass. Allocations the SDK makes
+// through heap_caps_malloc directly (WiFi, lwIP pbufs) are not seen; on the
+// host neither are those made inside libstdc++ (operator new).
+#if STATIC_ALLOC_MODE || BENCH_ENABLED
+
+void allocGuardArm();
+void allocGuardDisarm();
+uint32_t allocGuardCount();
+// Return address of the first allocation seen while armed, for addr2line
+void *allocGuardFirstCaller();
+
+#endif // STATIC_ALLOC_MODE || BENCH_ENABLED
+
+#if STATIC_ALLOC_MODE
+
+// Runs the scripted command workload once to warm lazily-created state,
+// then again with the guard armed. Returns true if the heap was untouched.
+bool allocGuardSelfTest();
+
+#endif // STATIC_ALLOC_MODE
+
+#endif // ALLOC_GUARD_H
@@ -0,0 +1,74 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+// Micro-benchmarks of the firmware hot paths (src/bench.cpp). The same
+// suite runs on the host (env:bench) and on the device (env:esp32dev_bench,
+// from setup() before WiFi comes up). Time comes from the CPU cycle counter
+// on the ESP32 and the monotonic clock on the host. Allocations are counted
+// by the alloc_guard malloc wrappers, so both envs link with --wrap=malloc.
+#ifndef BENCH_ENABLED
+#define BENCH_ENABLED 0
+#endif
+
+// A case fails when its ns/op is this much above the stored baseline
+// (bench_baseline.h), or when it allocates more per op than the baseline.
+// Shared build hosts drift by tens of percent between runs, so the host
+// only catches larger slowdowns.
+#ifndef BENCH_THRESHOLD_PERCENT
+#if HAL_NATIVE
+#define BENCH_THRESHOLD_PERCENT 50
+#else
+#define BENCH_THRESHOLD_PERCENT 20
+#endif
+#endif
+
+// Also print the results as bench_baseline.h rows (device builds; the host
+// program takes --print-baseline). On the device this also re-records the
+// board's baseline in NVS.
+#ifndef BENCH_PRINT_BASELINE
+#define BENCH_PRINT_BASELINE 0
+#endif
+
+// Each sample runs a case for at least this long. The fastest sample is
+// what gets reported and compared: interrupts and other tasks only ever
+// add time, so it is the steadiest figure from run to run.
+#define BENCH_SAMPLE_US     10000
+#define BENCH_SAMPLES       7
+#define BENCH_CASE_MAX      16
+
+#if BENCH_ENABLED
+
+typedef struct {
+    const char *name;
+    double nsPerOp;
+    double cyclesPerOp;     // 0 on the host
+    double allocsPerOp;
+    uint32_t iterations;    // per sample
+} BenchResult;
+
+typedef struct {
+    const char *name;
+    float nsPerOp;          // 0 = none stored for this target
+    float allocsPerOp;
+} BenchBaseline;
+
+// Runs every case whose name contains filter (all when null); returns how
+// many results were written
+size_t benchRun(BenchResult *results, size_t max, const char *filter = nullptr);
+
+// Prints a RESULT line per case against this target's baseline and a
+// summary line; returns the number of regressions
+int benchCheck(const BenchResult *results, size_t count, float thresholdPercent);
+
+// The results as rows for bench_baseline.h
+void benchPrintBaseline(const BenchResult *results, size_t count);
+
+// benchRun + benchCheck; leaves the outputs as they were before the run
+int benchRunSuite(const char *filter = nullptr, float thresholdPercent = BENCH_THRESHOLD_PERCENT,
+                  bool printBaseline = false);
+
+#endif // BENCH_ENABLED
+
+#endif // BENCH_H
@@ -3,24 +3,31 @@
 
 #include <Arduino.h>
 #include "hardware_config.h"
+#include "input.h"
+#include "hal.h"
+#include "output_frame.h"
+
+// The UI uses Date.now() as its command id, which does not fit in 32 bits
+typedef uint64_t CommandId;
 
 // RPM constants
 #define RPM_1450 1450.0f
 #define RPM_1800 1800.0f
 #define RPM_2200 2200.0f
 
-// Debounce delay in milliseconds
-#define DEBOUNCE_DELAY 50
-
 // Function declarations for main operations
 void setupCKP();
 void updatePwmSignals();
-void startSystem(const char *systemType, unsigned long commandId = 0);
-void stopSystem(unsigned long commandId = 0);
+// The same generator changes, staged on a frame instead of applied
+void stagePwmSignals(OutputFrame &frame);
+// client is who sent the command; the response goes only to them
+void startSystem(const char *systemType, CommandId commandId = 0, ClientId client = 0);
+void stopSystem(CommandId commandId = 0, ClientId client = 0);
 void setSystemType(const char *type);
-void updateRPM();
-void handleSystemPresetChange(const char* systemType);
-void sendCommandResponse(unsigned long commandId, bool success, const char* message = nullptr);
+void handleButtonEvent(const ButtonEvent &event);
+// With a frame, a running system's CKP change is staged on it
+void handleSystemPresetChange(const char* systemType, OutputFrame *frame = nullptr);
+void sendCommandResponse(ClientId client, CommandId commandId, bool success, const char* message = nullptr);
 
 // Helper function declarations - renamed to avoid conflicts
 void ckp_stopAllOutputs();
@@ -29,7 +36,6 @@ void ckp_stopCarrierOutputs();
 float calculateSafeFrequency(float rpm);
 void startThermoKingOutputs(float frequency);
 void startCarrierOutputs(float frequency);
-bool handleButtonWithDebounce(int pin, bool &lastState, unsigned long &lastDebounceTime);
 
 // Notification function declaration - use the one from web_server.cpp
 void sendRpmChangeNotification();
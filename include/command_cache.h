@@ -0,0 +1,25 @@
+#ifndef COMMAND_CACHE_H
+#define COMMAND_CACHE_H
+
+#include <Arduino.h>
+#include "ckp_functions.h"
+
+// Recently completed commands per WebSocket client, so a retried command
+// is answered from the cache instead of running against the hardware again.
+// Only touched from the async_tcp task.
+#define COMMAND_CACHE_CLIENTS   8    // AsyncWebSocket's default client limit
+#define COMMAND_CACHE_ENTRIES   4    // Per client, least recently used evicted
+#define COMMAND_CACHE_TEXT_MAX  192  // Longer responses are not cached
+
+// Returns true and the stored response if this client already completed
+// commandId. On a miss the id is reserved so the response can be stored.
+// Hits and misses are counted in metrics.
+bool commandCacheLookup(uint32_t clientId, CommandId commandId, const char *&text, size_t &length);
+
+// Stores the response for a reserved id; ignored for anything else
+void commandCacheStore(uint32_t clientId, CommandId commandId, const char *text, size_t length);
+
+// Drops everything held for a client that disconnected
+void commandCacheForget(uint32_t clientId);
+
+#endif // COMMAND_CACHE_H
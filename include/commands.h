@@ -0,0 +1,46 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "metrics.h"
+#include "ckp_functions.h"
+#include "hal.h"
+
+// Fields each command may read besides "cmd" and "commandId"
+#define COMMAND_MAX_FIELDS  4
+// Longest command name copied out of the first parse pass
+#define COMMAND_NAME_MAX    24
+// Operations accepted in one {"cmd":"batch","ops":[...]} frame
+#define BATCH_MAX_OPS       16
+
+// Typed handler. args only hold the fields listed in the entry, and the
+// handler sends the command response to client itself (as startSystem
+// already does).
+typedef void (*CommandHandler)(JsonObjectConst args, ClientId client, CommandId commandId);
+
+typedef struct {
+    const char *name;
+    CommandHandler handler;
+    MetricCommand metric;
+    uint16_t maxLen;                        // Longest frame accepted, in bytes
+    uint8_t nesting;                        // ArduinoJson nesting limit
+    bool mutates;                           // Changes state: broadcast after, cache result
+    const char *fields[COMMAND_MAX_FIELDS]; // nullptr-terminated if shorter
+} CommandEntry;
+
+// Builds the per-command parse filters. Call once before the server starts.
+void commandsBegin();
+
+// First pass: pull out just "cmd" and "commandId". name is empty if absent.
+DeserializationError commandPeek(const char *data, size_t len, char *name, size_t nameSize,
+                                 CommandId &commandId);
+
+// Binary search over the sorted command table; nullptr if unknown
+const CommandEntry *commandLookup(const char *name);
+
+// Second pass: parse only the fields the command declared
+DeserializationError commandParse(const CommandEntry &entry, const char *data, size_t len,
+                                  JsonDocument &doc);
+
+#endif // COMMANDS_H
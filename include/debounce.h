@@ -0,0 +1,58 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+// Edge-triggered button debouncer. Free of Arduino/ESP-IDF calls so it can be
+// driven on a host with recorded edge traces.
+//
+// The first edge that changes the reported level is accepted immediately,
+// then further edges are ignored for the lockout window. When the window
+// ends the caller samples the pin and calls onTimer(); if the level moved
+// while locked out (bounce or a very short press) the change is reported
+// then. A press held longer than the hold time produces one HOLD event.
+
+enum ButtonEventType {
+    BUTTON_PRESS = 0,
+    BUTTON_RELEASE,
+    BUTTON_HOLD
+};
+
+typedef struct {
+    ButtonEventType type;
+    int64_t edgeMicros;   // timestamp of the edge (or timer) that caused it
+} DebounceEvent;
+
+// At most this many events come out of a single onTimer() call
+#define DEBOUNCE_MAX_EVENTS 2
+
+class ButtonDebouncer {
+public:
+    ButtonDebouncer(uint32_t lockoutMicros = 50000, uint32_t holdMicros = 1000000);
+
+    // Seed with the current level, e.g. at boot
+    void reset(bool pressed, int64_t nowMicros);
+
+    // Raw edge with its capture timestamp. Returns events written (0 or 1).
+    int onEdge(bool pressed, int64_t edgeMicros, DebounceEvent *out);
+
+    // Timer expiry with the level sampled now. Returns events written.
+    int onTimer(bool pressed, int64_t nowMicros, DebounceEvent *out);
+
+    // Absolute time the next onTimer() is due, or -1 if nothing is pending
+    int64_t nextDeadline() const;
+
+    bool isPressed() const { return reported; }
+
+private:
+    int emitChange(bool pressed, int64_t micros, DebounceEvent *out);
+
+    uint32_t lockout;
+    uint32_t hold;
+    bool reported;
+    bool holdSent;
+    int64_t lockoutUntil;   // -1 when not locked out
+    int64_t pressedAt;
+};
+
+#endif // DEBOUNCE_H
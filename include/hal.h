@@ -0,0 +1,122 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin interfaces between the control/serialization core and the hardware
+// it drives. The firmware binds them to MCPWM, SPI, GPIO, esp_timer and the
+// WebSocket/SSE servers (hal_esp32.cpp). The native build (env:native,
+// -DHAL_NATIVE=1) binds them to recording fakes (hal_fake.h), so the core
+// runs, and can be benchmarked, on a host without a board.
+#ifndef HAL_NATIVE
+#define HAL_NATIVE 0
+#endif
+
+// Who a command came from, as the transport knows them. 0 = nobody to
+// answer (buttons, HTTP routes, the boot self-test).
+typedef uint32_t ClientId;
+
+// CKP signal generators
+enum PwmChannel : uint8_t {
+    PWM_THERMO_KING = 0,      // IND_1/IND_2, also used for APU
+    PWM_CARRIER,              // HALL
+    PWM_CHANNEL_COUNT
+};
+
+// One MCP4251 wiper write
+typedef struct {
+    uint8_t csPin;
+    uint8_t wiper;
+    uint8_t value;
+} PotWrite;
+
+// Topics a client can subscribe to. The first WS_SNAPSHOT_TOPICS are
+// latest-wins snapshots, the rest are control class.
+enum WsTopic : uint8_t {
+    WS_TOPIC_STATUS = 0,      // "status"
+    WS_TOPIC_SENSORS,         // "sensorData"
+    WS_TOPIC_RPM,             // "rpmUpdate"
+    WS_TOPIC_EVENTS,          // "event"
+    WS_TOPIC_COUNT
+};
+
+#define WS_SNAPSHOT_TOPICS      3
+#define WS_TOPIC_BIT(topic)     (1u << (topic))
+#define WS_TOPICS_ALL           ((1u << WS_TOPIC_COUNT) - 1)  // Default for new clients
+
+class PwmOutput {
+public:
+    virtual void begin() = 0;
+    // 50% duty square wave; a running channel is retuned in place
+    virtual void start(PwmChannel channel, float frequency) = 0;
+    // Stops the generator and drives its pins low
+    virtual void stop(PwmChannel channel) = 0;
+};
+
+// Frames PotBus::queue() keeps in flight, and writes per frame
+#define POT_QUEUE_FRAMES        8
+#define POT_FRAME_MAX           4
+
+class PotBus {
+public:
+    virtual void begin() = 0;
+    // All writes inside one bus transaction, chip select toggled per write
+    virtual void write(const PotWrite *writes, uint8_t count) = 0;
+    // Hands the writes to the bus as one frame and returns without waiting
+    // for them. False when POT_QUEUE_FRAMES frames are still in flight.
+    virtual bool queue(const PotWrite *writes, uint8_t count) = 0;
+    // Finished frames, oldest first: the time each one's last write
+    // completed. Returns how many were collected.
+    virtual uint8_t reap(int64_t *doneAt, uint8_t max) = 0;
+};
+
+// A set of pot and CKP changes applied as one (output_frame.h)
+class FrameOutput {
+public:
+    // Applies the wiper writes, then the generator changes (bit per
+    // PwmChannel in pwmMask, frequency 0 stops it), back to back with
+    // interrupts held off. Returns the µs from the first change to the last.
+    virtual uint32_t commit(const PotWrite *writes, uint8_t count, uint8_t pwmMask, const float *frequency) = 0;
+};
+
+class Gpio {
+public:
+    virtual void mode(uint8_t pin, uint8_t mode) = 0;    // Arduino OUTPUT, INPUT_PULLUP, ...
+    virtual void write(uint8_t pin, uint8_t level) = 0;
+    virtual uint8_t read(uint8_t pin) = 0;
+};
+
+class Clock {
+public:
+    virtual uint32_t millis() = 0;
+    virtual int64_t micros() = 0;    // Same time base as esp_timer_get_time()
+};
+
+class Transport {
+public:
+    // Control class: a command response for one client, never dropped
+    virtual void reply(ClientId client, const char *message, size_t length) = 0;
+    // Control class to every subscriber of the topic
+    virtual void broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) = 0;
+    // Latest-wins state snapshot; subscribers may only see the newest copy
+    virtual void publish(WsTopic topic, const char *message, size_t length, uint32_t revision) = 0;
+    // False when nobody would receive the topic, so it need not be serialized
+    virtual bool wanted(WsTopic topic) = 0;
+    // Replaces the client's topics (WS_TOPIC_BIT mask)
+    virtual void subscribe(ClientId client, uint8_t topics) = 0;
+};
+
+typedef struct {
+    PwmOutput *pwm;
+    PotBus *pots;
+    FrameOutput *frames;
+    Gpio *gpio;
+    Clock *clock;
+    Transport *transport;
+} Hal;
+
+// Bound at static initialization, before setup() runs
+extern Hal hal;
+
+#endif // HAL_H
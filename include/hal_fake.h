@@ -0,0 +1,123 @@
+#ifndef HAL_FAKE_H
+#define HAL_FAKE_H
+
+#include "hal.h"
+
+#if HAL_NATIVE
+
+#include <string>
+
+// Recording fakes bound to hal in the native build. Each keeps the state a
+// test wants to assert on, and every change is appended to one shared trace
+// as a line of text ("pwm start thermoking 7516.7"), so two runs of the
+// same workload can be diffed. Outputs the control loop re-applies every
+// tick are only recorded when they change. Turn recording off to benchmark.
+#define FAKE_GPIO_PINS      40
+#define FAKE_POT_CS_PINS    40
+#define FAKE_CLIENTS        8
+
+class FakePwm : public PwmOutput {
+public:
+    void begin() override;
+    void start(PwmChannel channel, float frequency) override;
+    void stop(PwmChannel channel) override;
+
+    // Whole periods generated so far, up to the fake clock
+    double cycles(PwmChannel channel) const;
+
+    bool running[PWM_CHANNEL_COUNT];
+    float frequency[PWM_CHANNEL_COUNT];
+
+private:
+    void settle(PwmChannel channel);
+
+    double settledCycles[PWM_CHANNEL_COUNT];
+    int64_t settledAt[PWM_CHANNEL_COUNT];
+};
+
+class FakePotBus : public PotBus {
+public:
+    void begin() override;
+    void write(const PotWrite *writes, uint8_t count) override;
+    // A queued frame completes at once, at the fake clock. Streamed values
+    // are recorded only when a wiper changes.
+    bool queue(const PotWrite *writes, uint8_t count) override;
+    uint8_t reap(int64_t *doneAt, uint8_t max) override;
+
+    // Last value written per CS pin and wiper (0 = POT0_WIPER, 1 = POT1_WIPER)
+    uint8_t wipers[FAKE_POT_CS_PINS][2];
+    uint32_t transactions;
+    uint32_t queuedFrames;
+
+private:
+    int64_t doneAt[POT_QUEUE_FRAMES];
+    uint8_t finished;
+};
+
+// Applies a frame through fakePots and fakePwm, so it shows up in the
+// trace as the same lines separate writes would. Nothing happens between
+// the changes, so the skew is 0.
+class FakeFrameOutput : public FrameOutput {
+public:
+    uint32_t commit(const PotWrite *writes, uint8_t count, uint8_t pwmMask, const float *frequency) override;
+
+    uint32_t frames;
+};
+
+class FakeGpio : public Gpio {
+public:
+    void mode(uint8_t pin, uint8_t mode) override;
+    void write(uint8_t pin, uint8_t level) override;
+    uint8_t read(uint8_t pin) override;
+
+    // Inputs are pulled up until a test drives them
+    uint8_t levels[FAKE_GPIO_PINS];
+};
+
+// Time only moves when the test says so
+class FakeClock : public Clock {
+public:
+    uint32_t millis() override;
+    int64_t micros() override;
+
+    void advance(int64_t micros);
+
+    int64_t now;
+};
+
+// Every topic is wanted unless a test says otherwise, so all frames are
+// serialized. Frames are recorded, not delivered anywhere.
+class FakeTransport : public Transport {
+public:
+    void reply(ClientId client, const char *message, size_t length) override;
+    void broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) override;
+    void publish(WsTopic topic, const char *message, size_t length, uint32_t revision) override;
+    bool wanted(WsTopic topic) override;
+    void subscribe(ClientId client, uint8_t topics) override;
+
+    uint8_t wantedTopics;                 // WS_TOPIC_BIT mask
+    uint32_t frames;
+    size_t bytes;
+    uint32_t replies;                     // of frames, sent by reply()
+};
+
+extern FakePwm fakePwm;
+extern FakePotBus fakePots;
+extern FakeFrameOutput fakeFrames;
+extern FakeGpio fakeGpio;
+extern FakeClock fakeClock;
+extern FakeTransport fakeTransport;
+
+// Puts every fake back to its power-on state and clears the trace
+void halFakeReset();
+
+void halFakeRecord(bool enabled);
+const std::string &halFakeTrace();
+
+// Adds a line of the harness's own (an injected command, a button edge)
+// to the trace, stamped like the rest
+void halFakeNote(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // HAL_NATIVE
+
+#endif // HAL_FAKE_H
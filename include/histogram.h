@@ -0,0 +1,76 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Log2-bucketed latency histogram in microseconds. Bucket i holds values
+// whose bit length is i, i.e. [2^(i-1), 2^i - 1]; bucket 0 holds zero.
+// Recording is lock-free so it can stay enabled on hot paths.
+#define HISTOGRAM_BUCKETS 24  // last bucket also absorbs everything >= ~4 s
+
+struct LatencyHistogram {
+    std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> max;
+    std::atomic<uint64_t> sum;
+
+    LatencyHistogram() { reset(); }
+
+    static uint8_t bucketFor(uint32_t micros) {
+        uint8_t index = micros ? 32 - __builtin_clz(micros) : 0;
+        return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+    }
+
+    // Largest value that falls into a bucket
+    static uint32_t bucketUpperBound(uint8_t index) {
+        return (1u << index) - 1;
+    }
+
+    void record(uint32_t micros) {
+        buckets[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(micros, std::memory_order_relaxed);
+
+        uint32_t seen = max.load(std::memory_order_relaxed);
+        while (micros > seen &&
+               !max.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Upper bound of the bucket containing the given quantile (0..1),
+    // clamped to the observed maximum. Returns 0 when empty.
+    uint32_t percentile(float quantile) const {
+        uint32_t total = count.load(std::memory_order_relaxed);
+        if (total == 0) {
+            return 0;
+        }
+
+        uint32_t rank = (uint32_t)(quantile * total);
+        if (rank == 0) {
+            rank = 1;
+        }
+
+        uint32_t seen = 0;
+        uint32_t observedMax = max.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint32_t bound = bucketUpperBound(i);
+                return bound < observedMax ? bound : observedMax;
+            }
+        }
+        return observedMax;
+    }
+
+    void reset() {
+        for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+    }
+};
+
+#endif // HISTOGRAM_H
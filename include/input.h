@@ -0,0 +1,56 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <Arduino.h>
+#include "hardware_config.h"
+#include "debounce.h"
+#include "hal.h"
+
+// Physical buttons owned by the input subsystem
+enum ButtonId {
+    BUTTON_RPM_INC = 0,
+    BUTTON_STOP,
+    BUTTON_AUTO_RUN,
+    BUTTON_COUNT
+};
+
+// Debounce delay in milliseconds
+#define DEBOUNCE_DELAY 50
+
+// Lockout after an accepted edge, and how long a press must last to HOLD
+#define INPUT_LOCKOUT_US   ((uint32_t)DEBOUNCE_DELAY * 1000)
+#define INPUT_HOLD_US      1000000
+#define INPUT_QUEUE_LEN    32
+
+typedef struct {
+    ButtonId button;
+    ButtonEventType type;
+    int64_t edgeMicros;   // esp_timer time of the GPIO edge
+} ButtonEvent;
+
+// Attach GPIO interrupts to RPM_INC_PIN, STOP_PIN and AUTOMATIC_RUN_PIN.
+// Pins must already be configured as INPUT_PULLUP.
+void inputBegin();
+
+// Block until the next debounced event. Must always be called from the same
+// task - that task is the single owner of button state.
+bool inputWaitEvent(ButtonEvent &event, TickType_t timeout = portMAX_DELAY);
+
+// Debounced level as last reported to the owner
+bool inputIsPressed(ButtonId button);
+
+const char *inputButtonName(ButtonId button);
+
+#if HAL_NATIVE
+// The host stands in for the GPIO ISR and the debounce timer. Set the fake
+// pin first, then report the edge; inputWaitEvent() never blocks.
+void inputInjectEdge(ButtonId button, int64_t micros);
+void inputServiceTimer(int64_t micros);
+
+// Absolute time inputServiceTimer() is next due, or -1 if nothing is pending
+int64_t inputNextDeadline();
+
+uint8_t inputButtonPin(ButtonId button);
+#endif
+
+#endif // INPUT_H
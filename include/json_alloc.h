@@ -0,0 +1,58 @@
+#ifndef JSON_ALLOC_H
+#define JSON_ALLOC_H
+
+#include <ArduinoJson.h>
+#include "static_alloc.h"
+
+// Allocator handed to every JsonDocument:
+//   JsonArenaScope arena;
+//   JsonDocument doc(jsonAllocator());
+// Inside a scope the calling task borrows a bump arena from a small pool;
+// the arena is rewound when the scope closes, so a whole message costs no
+// malloc/free. Declare the scope before the documents so they die first.
+// Outside a scope, or when every arena is busy, documents use the backing
+// allocator: the heap in normal builds, a fixed block pool in static mode.
+ArduinoJson::Allocator *jsonAllocator();
+
+// Arenas checked out at once; each task in a scope holds one
+#define JSON_ARENA_COUNT        4
+// Sized for a parsed command plus the status broadcast it triggers
+#define JSON_ARENA_BYTES        4096
+
+class JsonArenaScope {
+public:
+    JsonArenaScope();
+    ~JsonArenaScope();
+
+    JsonArenaScope(const JsonArenaScope &) = delete;
+    JsonArenaScope &operator=(const JsonArenaScope &) = delete;
+
+private:
+    size_t mark;
+};
+
+// Most bytes any one arena has held at once
+size_t jsonArenaHighWater();
+// Allocations that overflowed an arena and went to the backing allocator
+uint32_t jsonArenaOverflows();
+// Scopes opened while every arena was checked out
+uint32_t jsonArenaExhausted();
+
+#if STATIC_ALLOC_MODE
+
+// Two size classes cover ArduinoJson's needs: short strings and slot pools
+// (ARDUINOJSON_POOL_CAPACITY * 8 bytes on 32-bit targets).
+#define JSON_POOL_SMALL_BLOCK   64
+#define JSON_POOL_SMALL_COUNT   96
+#define JSON_POOL_LARGE_BLOCK   1088
+#define JSON_POOL_LARGE_COUNT   8
+
+// Requests that did not fit any free block since boot
+uint32_t jsonPoolFailures();
+// Most blocks in use at once, per class
+uint16_t jsonPoolSmallHighWater();
+uint16_t jsonPoolLargeHighWater();
+
+#endif // STATIC_ALLOC_MODE
+
+#endif // JSON_ALLOC_H
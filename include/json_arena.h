@@ -0,0 +1,108 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+// Bump allocator for ArduinoJson documents. Allocation is a pointer bump,
+// deallocation is a no-op, and the whole arena is rewound once the message
+// that used it has been handled. Requests that do not fit go to a backing
+// allocator. Depends only on ArduinoJson so it also builds on a host.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    JsonArena(uint8_t *buffer, size_t capacity, ArduinoJson::Allocator *backing)
+        : buffer(buffer), capacity(capacity), used(0), highWater(0), fallbacks(0), backing(backing) {
+    }
+
+    void *allocate(size_t size) override {
+        size_t total = HEADER + align(size);
+        if (used + total > capacity) {
+            fallbacks++;
+            return backing->allocate(size);
+        }
+
+        uint8_t *block = buffer + used;
+        *(uint32_t *)block = size;
+        used += total;
+        if (used > highWater) {
+            highWater = used;
+        }
+        return block + HEADER;
+    }
+
+    void deallocate(void *ptr) override {
+        if (ptr && !owns(ptr)) {
+            backing->deallocate(ptr);
+        }
+        // Arena blocks are reclaimed by rewind()
+    }
+
+    void *reallocate(void *ptr, size_t newSize) override {
+        if (!ptr) {
+            return allocate(newSize);
+        }
+        if (!owns(ptr)) {
+            return backing->reallocate(ptr, newSize);
+        }
+
+        uint8_t *block = (uint8_t *)ptr - HEADER;
+        size_t oldSize = *(uint32_t *)block;
+
+        // The newest block can grow or shrink in place
+        if (block + HEADER + align(oldSize) == buffer + used &&
+            (size_t)(block - buffer) + HEADER + align(newSize) <= capacity) {
+            used = (block - buffer) + HEADER + align(newSize);
+            *(uint32_t *)block = newSize;
+            if (used > highWater) {
+                highWater = used;
+            }
+            return ptr;
+        }
+
+        if (newSize <= oldSize) {
+            return ptr;
+        }
+
+        void *moved = allocate(newSize);
+        if (moved) {
+            memcpy(moved, ptr, oldSize);
+        }
+        return moved;
+    }
+
+    // Position to rewind to once everything allocated after it is dead
+    size_t mark() const {
+        return used;
+    }
+
+    void rewind(size_t position) {
+        used = position < used ? position : used;
+    }
+
+    bool owns(const void *ptr) const {
+        const uint8_t *p = (const uint8_t *)ptr;
+        return p >= buffer && p < buffer + capacity;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesHighWater() const { return highWater; }
+    uint32_t fallbackCount() const { return fallbacks; }
+
+private:
+    // Every block carries its size so reallocate() can copy it
+    static const size_t HEADER = 8;
+
+    static size_t align(size_t size) {
+        return (size + 7) & ~(size_t)7;
+    }
+
+    uint8_t *buffer;
+    size_t capacity;
+    size_t used;
+    size_t highWater;
+    uint32_t fallbacks;
+    ArduinoJson::Allocator *backing;
+};
+
+#endif // JSON_ARENA_H
@@ -0,0 +1,47 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+#include "histogram.h"
+#include "metrics.h"
+
+class AsyncWebServerRequest;
+
+// Sources share their first entries with MetricCommand so a command table
+// entry maps straight across via CommandEntry::metric
+enum LatencySource {
+    LAT_SRC_RUN = METRIC_CMD_RUN,
+    LAT_SRC_STOP = METRIC_CMD_STOP,
+    LAT_SRC_PRESET = METRIC_CMD_PRESET,
+    LAT_SRC_UPDATE_SENSOR = METRIC_CMD_UPDATE_SENSOR,
+    LAT_SRC_ADJUST_POT = METRIC_CMD_ADJUST_POT,
+    LAT_SRC_BATCH = METRIC_CMD_BATCH,
+    LAT_SRC_OTHER = METRIC_CMD_OTHER,
+    LAT_SRC_BTN_RPM_INC,
+    LAT_SRC_BTN_STOP,
+    LAT_SRC_BTN_AUTO_RUN,
+    LAT_SRC_COUNT
+};
+
+// Each stage is measured from the moment the frame or button edge arrived
+enum LatencyStage {
+    LAT_STAGE_DISPATCH = 0,   // command identified, handler about to run
+    LAT_STAGE_OUTPUT,         // first MCPWM or SPI write
+    LAT_STAGE_ACK,            // response queued to the client
+    LAT_STAGE_COUNT
+};
+
+// Timing context is per task, so the WebSocket handler and the button task
+// can each have a command in flight without interfering.
+void latencyArrival();
+void latencyArrival(int64_t arrivalMicros);
+void latencyDispatch(LatencySource source);
+void latencyMark(LatencyStage stage);
+void latencyFinish();
+
+void latencyReset();
+
+// GET /latency returns p50/p99/max per source and stage; ?reset clears them
+void handleLatencyRequest(AsyncWebServerRequest *request);
+
+#endif // LATENCY_H
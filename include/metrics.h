@@ -0,0 +1,76 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "histogram.h"
+#include "hal.h"
+
+class AsyncWebServerRequest;
+
+// Command types tracked by the counters and latency histograms
+enum MetricCommand {
+    METRIC_CMD_RUN = 0,
+    METRIC_CMD_STOP,
+    METRIC_CMD_PRESET,
+    METRIC_CMD_UPDATE_SENSOR,
+    METRIC_CMD_ADJUST_POT,
+    METRIC_CMD_BATCH,
+    METRIC_CMD_OTHER,
+    METRIC_CMD_COUNT
+};
+
+#define METRICS_MAX_TASKS 8
+
+// Hot-path counters. All relaxed atomics, cheap enough to leave on.
+struct Metrics {
+    std::atomic<uint32_t> spiTransactions;
+    std::atomic<uint32_t> mcpwmReconfigs;
+    std::atomic<float> mcpwmFrequency[PWM_CHANNEL_COUNT];  // last applied, 0 = stopped
+    std::atomic<uint32_t> outputFrames;
+    // First to last output change of each frame (output_frame.h)
+    LatencyHistogram outputFrameSkew[METRIC_CMD_COUNT];
+    std::atomic<uint32_t> wsMessages;
+    std::atomic<uint32_t> wsParseErrors;
+    // Outbound, counted once per recipient
+    std::atomic<uint32_t> wsReplyFrames;
+    std::atomic<uint32_t> wsReplyBytes;
+    std::atomic<uint32_t> wsBroadcastFrames;
+    std::atomic<uint32_t> wsBroadcastBytes;
+    std::atomic<uint32_t> wsSnapshotFrames;
+    std::atomic<uint32_t> wsSnapshotBytes;
+    std::atomic<uint32_t> wsSnapshotsSuperseded;  // Pending copies replaced before sending
+    std::atomic<uint32_t> commandCacheHits;
+    std::atomic<uint32_t> commandCacheMisses;
+    std::atomic<uint32_t> commands[METRIC_CMD_COUNT];
+    LatencyHistogram commandLatency[METRIC_CMD_COUNT];
+};
+
+extern Metrics metrics;
+
+void metricsRegisterTask(const char *label, TaskHandle_t handle);
+const char *metricsCommandName(MetricCommand cmd);
+
+// Prometheus text exposition for GET /metrics
+void handleMetricsRequest(AsyncWebServerRequest *request);
+
+inline void metricsCountSpi() {
+    metrics.spiTransactions.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Every generator start, retune and stop goes through here (stops pass 0).
+// Only a start or a new frequency counts as a reconfiguration; the 10 ms
+// refresh reapplying what already runs does not.
+inline void metricsNotePwm(PwmChannel channel, float frequency) {
+    float previous = metrics.mcpwmFrequency[channel].exchange(frequency, std::memory_order_relaxed);
+    if (frequency > 0 && frequency != previous) {
+        metrics.mcpwmReconfigs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void metricsCountCommand(MetricCommand cmd, uint32_t micros) {
+    metrics.commands[cmd].fetch_add(1, std::memory_order_relaxed);
+    metrics.commandLatency[cmd].record(micros);
+}
+
+#endif // METRICS_H
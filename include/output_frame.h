@@ -0,0 +1,35 @@
+#ifndef OUTPUT_FRAME_H
+#define OUTPUT_FRAME_H
+
+#include <Arduino.h>
+#include "hal.h"
+#include "metrics.h"
+#include "sensors_function.h"
+
+// Everything a preset, a run or a batch changes on the outputs, staged
+// first and then applied by hal.frames->commit() in one burst with
+// interrupts held off. The controller never sees a half-applied preset:
+// no new sensor readings next to the old CKP frequency, and no timer or
+// stream frame landing between two of the writes.
+//
+// The skew, first change to last, is bounded by the wiper transfers: at
+// most POT_IC_COUNT * 2 writes of 16 bits at 1 MHz plus CS setup, about
+// 200 µs, and a few µs for the MCPWM registers. Each commit's skew goes
+// into metrics.outputFrameSkew for the command that made it.
+//
+// The periodic paths (CKP refresh, scenarios, the reefer model, pot
+// streaming) change one kind of output at a time and keep writing directly.
+
+typedef struct {
+    PotBurst pots;
+    uint8_t pwmMask;                            // bit per PwmChannel staged
+    float pwmFrequency[PWM_CHANNEL_COUNT];      // 0 stops the generator
+} OutputFrame;
+
+// Stages a generator change; a later one for the same channel replaces it
+void outputFramePwm(OutputFrame &frame, PwmChannel channel, float frequency);
+
+// Applies and clears the frame. Returns the skew in µs (0 when empty).
+uint32_t outputFrameCommit(OutputFrame &frame, MetricCommand source);
+
+#endif // OUTPUT_FRAME_H
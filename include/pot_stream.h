@@ -0,0 +1,85 @@
+#ifndef POT_STREAM_H
+#define POT_STREAM_H
+
+#include <Arduino.h>
+#include "hal.h"
+
+// Waveform streaming on the sensor pots, for controllers that filter
+// transducer pulsation. A streamed sensor rides a precomputed table, one
+// waveform period of wiper values around the sensor's reading. A periodic
+// timer steps a phase accumulator per channel and hands one frame of
+// wiper writes to hal.pots->queue() every POT_STREAM_PERIOD_US; the bus
+// runs it from its interrupt while the CPU moves on. A tick is a lookup
+// per channel and never waits, so it costs the same at any frequency.
+//
+// Setting the sensor (updateSensor, a scenario, the reefer model) moves
+// the centre of the waveform and rebuilds the table instead of writing
+// the wiper. A raw write to the wiper (adjustMCP4251, resetPots) ends the
+// stream with that value; stopping it puts the wiper back on the reading.
+// Both go out as the channel's last queued frame, so they land after
+// every streamed sample.
+//
+// Rate and jitter are measured where the frames finish on the bus.
+
+#define POT_STREAM_RATE_HZ      1000
+#define POT_STREAM_PERIOD_US    (1000000 / POT_STREAM_RATE_HZ)
+#define POT_STREAM_MAX_HZ       (POT_STREAM_RATE_HZ / 2)
+// Sensors streamed at once; each adds a write to every frame
+#define POT_STREAM_CHANNELS     2
+// One waveform period; the top 8 bits of the phase pick the entry
+#define POT_STREAM_TABLE_LEN    256
+// Achieved rate is counted over windows this long
+#define POT_STREAM_WINDOW_US    1000000
+
+enum PotWaveform : uint8_t {
+    POT_WAVE_SINE = 0,
+    POT_WAVE_TRIANGLE,
+    POT_WAVE_SQUARE,
+    POT_WAVE_SAWTOOTH,
+    POT_WAVE_COUNT
+};
+
+bool potWaveformFromName(const char *name, PotWaveform &waveform);
+
+void potStreamBegin();
+
+// Streams a sensor, or retunes it in phase when it is already streamed.
+// amplitude is the peak deviation in the sensor's unit (°F or PSI). False
+// for an unknown sensor, a frequency above POT_STREAM_MAX_HZ or no free
+// channel.
+bool potStreamStart(const char *sensorName, PotWaveform waveform, float frequency, float amplitude);
+// False when the sensor is not streamed
+bool potStreamStop(const char *sensorName);
+void potStreamStopAll();
+bool potStreamActive();
+
+// From setSensorValue: moves a streamed wiper's centre. False when the
+// wiper is not streamed and should be written as usual.
+bool potStreamRebase(uint8_t csPin, uint8_t wiper, float value);
+// From raw wiper writes: ends a stream with value as its last frame.
+// False when the wiper is not streamed.
+bool potStreamRelease(uint8_t csPin, uint8_t wiper, uint8_t value);
+
+// {"type":"potStream",...}: channels, achieved rate, jitter and tick cost
+size_t serializePotStreamStatus(char *out, size_t size);
+
+// One timer period: collects the finished frames for the rate and jitter
+// figures, then queues the next frame
+void potStreamTick(int64_t now);
+
+// Platform side (pot_stream_esp32.cpp, pot_stream_native.cpp). Start and
+// stop are called with the stream lock held.
+void potStreamTimerBegin();
+void potStreamTimerStart();
+void potStreamTimerStop();
+
+#if HAL_NATIVE
+
+// Host stand-in for the esp_timer: call potStreamServiceTimer() at
+// potStreamNextDeadline() (-1 while nothing is streamed)
+void potStreamServiceTimer(int64_t micros);
+int64_t potStreamNextDeadline();
+
+#endif // HAL_NATIVE
+
+#endif // POT_STREAM_H
@@ -0,0 +1,70 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "hal.h"
+#include "ckp_functions.h"
+#include "commands.h"
+
+// Transport-agnostic half of the web interface: command dispatch and every
+// frame the bench sends, serialized once and handed to hal.transport. Builds
+// in the native environment; the HTTP and WebSocket plumbing stays in
+// web_server.cpp.
+
+// Runs one text command from client. Returns the command table entry when
+// the command was recognised (whether or not it succeeded), else nullptr.
+const CommandEntry *protocolHandleCommand(ClientId client, const char *data, size_t len);
+// The same without recording it or counting it as an inbound frame, for
+// commands the bench holds and runs itself (schedule.h)
+const CommandEntry *protocolRunCommand(ClientId client, const char *data, size_t len);
+
+// The legacy HTTP control routes, without their reply text
+enum HttpCommand : uint8_t {
+    HTTP_CMD_START = 0,     // GET /start?type=
+    HTTP_CMD_STOP,          // GET /stop
+    HTTP_CMD_RPM,           // GET /rpm?mode=
+    HTTP_CMD_PAGE,          // GET / also stops the outputs
+    HTTP_CMD_COUNT
+};
+
+// Runs one of them; arg is the request parameter or nullptr if missing.
+// Returns false when it did nothing (/rpm while stopped or a bad mode).
+bool protocolHttpCommand(HttpCommand command, const char *arg);
+
+// A WebSocket client was accepted / went away
+void protocolClientConnected(ClientId client);
+void protocolClientGone(ClientId client);
+
+// Full "status" frame into out; returns its length
+size_t serializeStatus(char *out, size_t size);
+
+// The /status body: the legacy fields plus the revision for ?since=
+size_t serializeHttpStatus(char *out, size_t size, uint32_t revision);
+
+// Bumped on every state change or event pushed to clients; the SSE id
+uint32_t stateRevision();
+
+// Topic names, the same as the "type" field of the frames they carry
+const char *wsTopicName(WsTopic topic);
+bool wsTopicFromName(const char *name, WsTopic &topic);
+
+// Functions for handling WebSocket commands
+void handleSensorDataRequest(JsonDocument &doc);
+void sendRpmChangeNotification();
+void sendSystemStatus(ClientId client = 0);
+void sendSystemState();
+void sendBatchResponse(ClientId client, CommandId commandId, bool success, const char *const *results, size_t count);
+bool stageRpmMode(const char *mode);
+
+// System preset functions
+void loadSystemPreset(const char* systemType);
+
+// Notification functions
+void notifyEvent(const char* eventType, const char* message);
+void notifyRpmChange(float indRpm, float hallRpm);
+
+// Define a single notifyClients function with an optional parameter
+void notifyClients(const char* message = nullptr);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,175 @@
+#ifndef RECORD_FORMAT_H
+#define RECORD_FORMAT_H
+
+// Binary layout of the /record download: everything that entered the
+// command pipeline, plus the output changes it caused, so a host build can
+// replay the inputs and check it reaches the same outputs. Kept free of
+// Arduino includes so the replay engine and tools can share it.
+//
+// A RecordFileHeader is followed by header.bytes of records. Each record is
+//   tag      kind in the low nibble, a small detail field in the high one
+//   delta    zigzag varint, microseconds since the previous record (the
+//            first is relative to startMicros). Button edges carry their
+//            ISR timestamp, so a delta can be negative.
+//   payload  depends on kind, see below
+// Varints are LEB128, seven bits per byte, low bits first.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORD_MAGIC          0x44434552u  // "RECD" little-endian
+#define RECORD_FORMAT_VERSION 1
+
+enum RecordKind : uint8_t {
+    RECORD_WS = 0,       // varint client, varint length, frame text
+    RECORD_HTTP,         // detail = HttpCommand; varint length + 1 (0 = no parameter), text
+    RECORD_CONNECT,      // varint client
+    RECORD_DISCONNECT,   // varint client
+    RECORD_EDGE,         // detail = button << 1 | pressed; raw edge before debounce
+    RECORD_PWM,          // detail = PwmChannel; varint frequency in centi-Hz, 0 = stopped
+    RECORD_POT,          // csPin, wiper, value
+    RECORD_KIND_COUNT
+};
+
+static const char *const RECORD_KIND_NAMES[RECORD_KIND_COUNT] = {
+    "ws",
+    "http",
+    "connect",
+    "disconnect",
+    "edge",
+    "pwm",
+    "pot",
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;     // sizeof(RecordFileHeader)
+    uint64_t startMicros;    // clock when recording started
+    uint32_t recordCount;
+    uint32_t dropped;        // records refused because the buffer was full
+    uint32_t bytes;          // record bytes that follow
+    uint32_t reserved;
+} RecordFileHeader;
+
+// One decoded record. text points into the buffer it was decoded from.
+typedef struct {
+    RecordKind kind;
+    uint8_t detail;
+    int64_t micros;          // absolute, on the recording clock
+    uint32_t client;
+    const char *text;
+    size_t length;
+    bool hasText;            // RECORD_HTTP: the parameter was present
+    uint32_t centiHz;
+    uint8_t csPin;
+    uint8_t wiper;
+    uint8_t value;
+} RecordEntry;
+
+// Worst case for everything but the text: tag, delta and two varints
+#define RECORD_OVERHEAD_MAX   (1 + 10 + 5 + 5)
+
+static inline size_t recordPutVarint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return n;
+}
+
+static inline bool recordGetVarint(const uint8_t *data, size_t length, size_t &pos, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < length; shift += 7) {
+        uint8_t byte = data[pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint64_t recordZigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t recordUnzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Decodes the record at pos and advances pos and clock past it. Returns
+// false at the end of the data or on a malformed record.
+static inline bool recordNext(const uint8_t *data, size_t length, size_t &pos, int64_t &clock, RecordEntry &entry) {
+    if (pos >= length) {
+        return false;
+    }
+    uint8_t tag = data[pos++];
+    entry.kind = (RecordKind)(tag & 0x0F);
+    entry.detail = tag >> 4;
+    entry.text = nullptr;
+    entry.length = 0;
+    entry.hasText = false;
+
+    uint64_t value;
+    if (entry.kind >= RECORD_KIND_COUNT || !recordGetVarint(data, length, pos, value)) {
+        return false;
+    }
+    clock += recordUnzigzag(value);
+    entry.micros = clock;
+
+    switch (entry.kind) {
+        case RECORD_WS:
+            if (!recordGetVarint(data, length, pos, value)) {
+                return false;
+            }
+            entry.client = (uint32_t)value;
+            if (!recordGetVarint(data, length, pos, value) || value > length - pos) {
+                return false;
+            }
+            entry.text = (const char *)data + pos;
+            entry.length = (size_t)value;
+            entry.hasText = true;
+            pos += entry.length;
+            return true;
+        case RECORD_HTTP:
+            if (!recordGetVarint(data, length, pos, value) || (value > 0 && value - 1 > length - pos)) {
+                return false;
+            }
+            entry.hasText = value > 0;
+            entry.text = (const char *)data + pos;
+            entry.length = value > 0 ? (size_t)value - 1 : 0;
+            pos += entry.length;
+            return true;
+        case RECORD_CONNECT:
+        case RECORD_DISCONNECT:
+            if (!recordGetVarint(data, length, pos, value)) {
+                return false;
+            }
+            entry.client = (uint32_t)value;
+            return true;
+        case RECORD_EDGE:
+            return true;
+        case RECORD_PWM:
+            if (!recordGetVarint(data, length, pos, value)) {
+                return false;
+            }
+            entry.centiHz = (uint32_t)value;
+            return true;
+        case RECORD_POT:
+            if (length - pos < 3) {
+                return false;
+            }
+            entry.csPin = data[pos];
+            entry.wiper = data[pos + 1];
+            entry.value = data[pos + 2];
+            pos += 3;
+            return true;
+        default:
+            return false;
+    }
+}
+
+#endif // RECORD_FORMAT_H
@@ -0,0 +1,66 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <Arduino.h>
+#include "hal.h"
+#include "record_format.h"
+
+// Command and input recorder. From recorderBegin() on, every WebSocket
+// frame and HTTP control request that reaches the command pipeline, every
+// client connect/disconnect and every raw button edge is appended to a RAM
+// log with its timestamp, together with the PWM and pot changes they led
+// to. GET /record downloads it (layout in record_format.h) and the host
+// replay engine (src/replay.cpp, env:sim) feeds it back through the same
+// code. When the buffer fills, recording stops and later records are
+// counted as dropped, so the log always starts at boot or at the last clear.
+//
+// Build with -DRECORDER_ENABLED=0 to compile it out.
+#ifndef RECORDER_ENABLED
+#define RECORDER_ENABLED 1
+#endif
+
+#ifndef RECORDER_BUFFER_SIZE
+#if HAL_NATIVE
+#define RECORDER_BUFFER_SIZE  (1024 * 1024)
+#else
+#define RECORDER_BUFFER_SIZE  16384
+#endif
+#endif
+
+#if RECORDER_ENABLED
+
+// Clears the log and starts recording; timestamps come from hal.clock
+void recorderBegin();
+void recorderStop();
+bool recorderActive();
+
+void recorderCommand(ClientId client, const char *data, size_t length);
+// arg is the request parameter, nullptr when it was missing
+void recorderHttp(uint8_t command, const char *arg);
+void recorderConnect(ClientId client, bool connected);
+// Raw edge with the timestamp the GPIO ISR took
+void recorderEdge(uint8_t button, bool pressed, int64_t edgeMicros);
+// Outputs as applied by the HAL; a PWM channel re-applied unchanged is skipped
+void recorderPwm(PwmChannel channel, float frequency);
+void recorderPot(const PotWrite &write);
+
+// Snapshot of the log as a RecordFileHeader plus records. Returns the bytes
+// written, or 0 if out is too small.
+size_t recorderDump(uint8_t *out, size_t maxLen);
+size_t recorderDumpSize();
+
+#else
+
+inline void recorderBegin() {}
+inline void recorderStop() {}
+inline bool recorderActive() { return false; }
+inline void recorderCommand(ClientId, const char *, size_t) {}
+inline void recorderHttp(uint8_t, const char *) {}
+inline void recorderConnect(ClientId, bool) {}
+inline void recorderEdge(uint8_t, bool, int64_t) {}
+inline void recorderPwm(PwmChannel, float) {}
+inline void recorderPot(const PotWrite &) {}
+
+#endif // RECORDER_ENABLED
+
+#endif // RECORDER_H
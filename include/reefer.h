@@ -0,0 +1,42 @@
+#ifndef REEFER_H
+#define REEFER_H
+
+#include <Arduino.h>
+#include "reefer_model.h"
+
+// The reefer model (reefer_model.h) wired to the bench. The compressor and
+// engine follow state.systemRunning and the system type, speed follows the
+// RPM the CKP outputs are generating, ambient is the ambientTemp sensor,
+// and the model writes return, discharge and redundant air, coil, suction
+// and discharge pressure and coolant through the pot mapping. Sensors a
+// preset disables (APU air side, redundant air outside Carrier) and the
+// coolant of an electric container unit are left alone.
+//
+// Off at boot, so the presets hold until {"cmd":"reeferModel","action":"on"}.
+// While a scenario is loaded the model keeps integrating but the scenario
+// owns the outputs.
+
+// CPU allowed per service call for the steps and the pot writes. Time over
+// it is counted, not cut short: the work per call is bounded already.
+#define REEFER_BUDGET_US        250
+// Missed ticks made up in one call; beyond that the model lets time slip
+#define REEFER_MAX_CATCHUP      2
+// Status broadcasts while the model moves the outputs, at most this often
+#define REEFER_NOTIFY_US        1000000
+
+void reeferBegin();
+
+// Starts the model from the current sensor readings, or with warmBox from
+// everything at ambient (a pull-down from scratch). Takes effect on the
+// next service call.
+void reeferStart(bool warmBox);
+void reeferStop();
+bool reeferActive();
+
+// From the CKP task every 10 ms: steps the model when a tick is due
+void reeferService(int64_t now);
+
+// {"type":"reeferModel",...}: inputs, state, and step timing against the budget
+size_t serializeReeferStatus(char *out, size_t size);
+
+#endif // REEFER_H
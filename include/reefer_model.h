@@ -0,0 +1,118 @@
+#ifndef REEFER_MODEL_H
+#define REEFER_MODEL_H
+
+#include <stdint.h>
+
+// Lumped-parameter model of a reefer unit: box air, evaporator coil,
+// condenser and engine coolant, each a single heat capacity. Free of
+// Arduino/ESP-IDF calls so it runs unchanged on a host against reference
+// curves (src/reefer_main.cpp).
+//
+// Temperatures are °F and pressures PSI gauge, like the sensor pots.
+// Per second, with the compressor and fans on:
+//
+//   capacity = cool * speed * (coil - floor) / (ref - floor), >= 0
+//   box'       = leak * (ambient - box) + boxCoil * (coil - box)
+//   coil'      = coilBox * (box - coil) - capacity
+//   condenser' = reject * capacity - condAmbient * (condenser - ambient)
+//   coolant'   = engineHeat * speed - (coolIdle + coolRad * open) * (coolant - ambient)
+//
+// open is the thermostat, 0 below thermostat and 1 at thermostat + band.
+// Off, the compressor stops, the fans fall back to natural convection
+// and the two sides of the refrigerant circuit equalize over tauEqualize.
+// Pressures are the R-404A saturation curve at the coil (suction) and
+// condenser (discharge) temperatures.
+//
+// The state is integrated with forward Euler at a fixed tick in Q11.20
+// fixed point. A step has no float, no division and no data-dependent
+// loop, so it costs the same every time, and it gives bit-identical
+// results on the ESP32 and the host, where the reference check runs.
+
+// Fixed step, and the rate it is tuned for
+#define REEFER_TICK_US          100000
+
+// Q11.20: ±2048 with a resolution of about 1e-6. Per-tick rates are
+// Q1.30, since some are a few 1e-5.
+#define REEFER_FRAC_BITS        20
+#define REEFER_RATE_BITS        30
+
+typedef int32_t ReeferFixed;
+
+#define REEFER_FIXED(x)         ((ReeferFixed)((x) * (1 << REEFER_FRAC_BITS) + ((x) < 0 ? -0.5 : 0.5)))
+#define REEFER_TO_FLOAT(x)      ((float)(x) / (1 << REEFER_FRAC_BITS))
+
+// Physical constants in human units; rates are per second
+typedef struct {
+    float leak;             // box to ambient through the walls
+    float boxCoil;          // box to coil, evaporator fan on
+    float boxCoilOff;       // fan off
+    float coilBox;          // coil to box, fan on (small coil mass)
+    float coilBoxOff;
+    float cool;             // coil °F/s removed at speed 1 and the ref coil temperature
+    float coolFloor;        // coil temperature where capacity reaches 0
+    float coolRef;
+    float reject;           // condenser °F per coil °F removed
+    float condAmbient;      // condenser to ambient, condenser fan on
+    float condAmbientOff;
+    float engineHeat;       // coolant °F/s at speed 1
+    float coolIdle;         // coolant to ambient, thermostat closed
+    float coolRad;          // added by a fully open thermostat
+    float thermostat;
+    float thermostatBand;
+    float tauRun;           // s for the pressures to separate when started
+    float tauEqualize;      // s to equalize when stopped
+    float supplyMix;        // supply air = coil + supplyMix * (box - coil)
+    float satC0;            // saturation PSI = c0 + c1 * T + c2 * T^2
+    float satC1;
+    float satC2;
+} ReeferParams;
+
+// Tuned to a 30 ft trailer unit at 1800 RPM pulling down from 85 °F
+extern const ReeferParams REEFER_DEFAULT_PARAMS;
+
+typedef struct {
+    bool compressor;        // compressor and fans
+    bool engine;            // diesel running (not for electric standby)
+    ReeferFixed speed;      // RPM / 1800
+    ReeferFixed ambient;
+} ReeferInputs;
+
+typedef struct {
+    // Per-tick rates, Q1.30
+    int32_t leak, boxCoil, boxCoilOff, coilBox, coilBoxOff;
+    int32_t capacity;       // cool * dt / (ref - floor)
+    int32_t reject, condAmbient, condAmbientOff;
+    int32_t engineHeat, coolIdle, coolRad, thermostatGain;
+    int32_t runRate, equalizeRate;
+    int32_t supplyMix, satC1, satC2;
+    ReeferFixed coolFloor, thermostat, satC0;
+
+    // State
+    ReeferFixed box, coil, condenser, coolant;
+    ReeferFixed equalized;  // 0 running .. 1 fully equalized
+    bool compressor;
+} ReeferModel;
+
+typedef struct {
+    ReeferFixed returnAir;
+    ReeferFixed supplyAir;
+    ReeferFixed coil;
+    ReeferFixed suction;
+    ReeferFixed discharge;
+    ReeferFixed coolant;
+} ReeferOutputs;
+
+// Converts params to per-tick rates and starts from a warm box: everything
+// at ambient, off and equalized
+void reeferModelInit(ReeferModel &model, const ReeferParams &params, ReeferFixed ambient);
+
+// Starts from measured values instead (the bench's current sensor readings)
+void reeferModelSeed(ReeferModel &model, ReeferFixed box, ReeferFixed coil, ReeferFixed coolant,
+                     ReeferFixed ambient, bool compressor);
+
+// One REEFER_TICK_US step
+void reeferModelStep(ReeferModel &model, const ReeferInputs &inputs);
+
+void reeferModelOutputs(const ReeferModel &model, ReeferOutputs &outputs);
+
+#endif // REEFER_MODEL_H
@@ -0,0 +1,71 @@
+#ifndef REEFER_REFERENCE_H
+#define REEFER_REFERENCE_H
+
+#include <stdint.h>
+
+// Reefer model outputs every 10 minutes of each profile in src/reefer_main.cpp,
+// from the double-precision integration of the model's equations: °F and
+// PSI. Regenerate after a deliberate model change with
+//   .pio/build/reefer/program --print-reference
+typedef struct {
+    uint8_t profile;        // index into PROFILES in src/reefer_main.cpp
+    uint32_t seconds;
+    float returnAir;
+    float supplyAir;
+    float coil;
+    float suction;
+    float discharge;
+    float coolant;
+} ReeferReference;
+
+static const ReeferReference REEFER_REFERENCE[] = {
+    {0,     0,   85.00f,   85.00f,   85.00f,  192.68f,  192.68f,   85.00f},
+    {0,   600,   66.29f,   44.72f,   37.53f,   81.49f,  283.10f,  180.55f},
+    {0,  1200,   51.16f,   31.95f,   25.54f,   61.41f,  272.07f,  180.55f},
+    {0,  1800,   39.37f,   22.00f,   16.21f,   47.99f,  263.62f,  180.55f},
+    {0,  2400,   30.19f,   14.25f,    8.93f,   38.90f,  257.14f,  180.55f},
+    {0,  3000,   23.04f,    8.21f,    3.26f,   32.63f,  252.15f,  180.55f},
+    {0,  3600,   17.46f,    3.50f,   -1.15f,   28.25f,  248.30f,  180.55f},
+    {0,  4200,   13.12f,   -0.16f,   -4.59f,   25.14f,  245.32f,  180.55f},
+    {0,  4800,    9.74f,   -3.02f,   -7.27f,   22.90f,  243.01f,  180.55f},
+    {0,  5400,    7.11f,   -5.24f,   -9.36f,   21.27f,  241.21f,  180.55f},
+    {0,  6000,    5.05f,   -6.97f,  -10.98f,   20.06f,  239.82f,  180.55f},
+    {0,  6600,    3.45f,   -8.32f,  -12.25f,   19.16f,  238.74f,  180.55f},
+    {0,  7200,    2.21f,   -9.38f,  -13.24f,   18.49f,  237.90f,  180.55f},
+    {1,     0,   85.00f,   85.00f,   85.00f,  192.68f,  192.68f,   85.00f},
+    {1,   600,   63.35f,   38.69f,   30.47f,   69.28f,  297.53f,  180.69f},
+    {1,  1200,   46.28f,   24.74f,   17.56f,   49.82f,  282.64f,  180.69f},
+    {1,  1800,   33.29f,   14.12f,    7.73f,   37.51f,  271.58f,  180.69f},
+    {1,  2400,   23.41f,    6.05f,    0.26f,   29.60f,  263.32f,  180.69f},
+    {1,  3000,   15.90f,   -0.09f,   -5.42f,   24.42f,  257.12f,  180.69f},
+    {1,  3600,   10.18f,   -4.77f,   -9.75f,   20.97f,  252.46f,  180.69f},
+    {2,     0,   85.00f,   85.00f,   85.00f,  192.68f,  192.68f,   85.00f},
+    {2,   600,   66.29f,   44.72f,   37.53f,   81.49f,  283.10f,  180.55f},
+    {2,  1200,   51.16f,   31.95f,   25.54f,   61.41f,  272.07f,  180.55f},
+    {2,  1800,   39.37f,   22.00f,   16.21f,   47.99f,  263.62f,  180.55f},
+    {2,  2400,   30.19f,   14.25f,    8.93f,   38.90f,  257.14f,  180.55f},
+    {2,  3000,   23.04f,    8.21f,    3.26f,   32.63f,  252.15f,  180.55f},
+    {2,  3600,   17.46f,    3.50f,   -1.15f,   28.25f,  248.30f,  180.55f},
+    {2,  4200,   24.02f,   24.02f,   19.84f,  128.72f,  128.72f,  159.13f},
+    {2,  4800,   30.23f,   30.23f,   27.54f,  129.90f,  129.90f,  142.73f},
+    {2,  5400,   35.84f,   35.84f,   33.51f,  133.83f,  133.83f,  129.96f},
+    {2,  6000,   40.87f,   40.87f,   38.79f,  138.30f,  138.30f,  120.02f},
+    {2,  6600,   45.38f,   45.38f,   43.52f,  142.72f,  142.72f,  112.27f},
+    {2,  7200,   49.44f,   49.44f,   47.76f,  146.94f,  146.94f,  106.24f},
+    {3,     0,   95.00f,   95.00f,   95.00f,  222.54f,  222.54f,   95.00f},
+    {3,   600,   75.08f,   52.12f,   44.46f,   94.58f,  326.18f,   95.00f},
+    {3,  1200,   58.98f,   38.52f,   31.71f,   71.33f,  313.54f,   95.00f},
+    {3,  1800,   46.43f,   27.93f,   21.77f,   55.75f,  303.87f,   95.00f},
+    {3,  2400,   36.66f,   19.68f,   14.02f,   45.14f,  296.45f,   95.00f},
+    {3,  3000,   29.04f,   13.25f,    7.99f,   37.81f,  290.73f,   95.00f},
+    {3,  3600,   23.11f,    8.25f,    3.29f,   32.66f,  286.31f,   95.00f},
+    {4,     0,   85.00f,   85.00f,   85.00f,  192.68f,  192.68f,   85.00f},
+    {4,   600,   69.15f,   50.66f,   44.50f,   94.65f,  269.06f,  180.42f},
+    {4,  1200,   56.02f,   39.24f,   33.65f,   74.64f,  261.21f,  180.42f},
+    {4,  1800,   45.56f,   30.15f,   25.01f,   60.59f,  255.04f,  180.42f},
+    {4,  2400,   39.66f,   24.96f,   20.06f,   53.29f,  340.99f,  180.61f},
+    {4,  3000,   34.96f,   20.87f,   16.17f,   47.95f,  337.80f,  180.61f},
+    {4,  3600,   31.22f,   17.61f,   13.08f,   43.94f,  335.27f,  180.61f},
+};
+
+#endif // REEFER_REFERENCE_H
@@ -0,0 +1,50 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "sim.h"
+
+#if HAL_NATIVE
+
+#include <stdio.h>
+#include <vector>
+#include "record_format.h"
+
+// Replay of a /record download on the simulator (env:sim). Every input in
+// the log (commands, HTTP control requests, connects and raw button edges)
+// is scheduled at its recorded time, in recorded order, and runs through the
+// same pipeline as on the device. The recorder runs again during the replay,
+// so the outputs the replay produced can be compared, change by change,
+// with the outputs the bench recorded.
+
+// Runs on after the last input so debounce and hold timers can expire
+#define REPLAY_SETTLE_US    2000000
+
+typedef struct {
+    std::vector<uint8_t> data;         // header and records; entries point in here
+    RecordFileHeader header;
+    std::vector<RecordEntry> entries;
+    uint32_t commands;                 // WebSocket and HTTP
+    uint32_t edges;
+    uint32_t outputs;
+    int64_t lastInputMicros;
+} Recording;
+
+// Parses a whole dump (RecordFileHeader + records). Prints why on failure.
+bool replayParse(const uint8_t *data, size_t length, Recording &recording);
+bool replayLoad(const char *path, Recording &recording);
+
+// Schedules every input of the recording on the sim clock. Call after
+// simBoot(); recording must outlive the run.
+void replaySchedule(const Recording &recording);
+
+// Compares the output changes of two recordings in order, ignoring time.
+// Prints a summary and the first divergence to report; returns true when
+// both made the same changes.
+bool replayCompareOutputs(const Recording &recorded, const Recording &replayed, FILE *report);
+
+// One line per record, for reading a log by eye
+void replayPrint(const Recording &recording, FILE *out);
+
+#endif // HAL_NATIVE
+
+#endif // REPLAY_H
@@ -0,0 +1,118 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <Arduino.h>
+#include "hal.h"
+
+// Timed sensor and RPM playback. Scenario files live in SPIFFS under
+// /scenarios (data/scenarios in the repo; upload with pio run -t uploadfs),
+// one keyframe per line:
+//
+//   <time> <channel> <value> [<ramp>]
+//
+// time is script time in ms, or +ms after the previous line. At that time
+// the channel steps to value, or with ramp (ms) moves there linearly from
+// wherever it is then. Channels are the eight sensor names of updateSensor
+// plus indRpm and hallRpm. Lines must be in time order; '#' starts a comment.
+//
+// The file is streamed, never loaded whole. A periodic timer wakes the
+// scenario task, which applies the keyframes that are due, pushes every
+// channel that moved (pots in one SPI burst, MCPWM once) and then reads
+// ahead to refill a short keyframe queue. Keyframes are anchored to script
+// time, so tick jitter shows up as timing error, never as drift.
+
+// Output tick. Every keyframe lands on the first tick at or after its time.
+#define SCENARIO_TICK_US        20000
+// Keyframes read ahead of the tick
+#define SCENARIO_QUEUE_LEN      16
+#define SCENARIO_LINE_MAX       96
+// SPIFFS paths are at most 31 characters, "/scenarios/" included
+#define SCENARIO_NAME_MAX       20
+#define SCENARIO_DIR            "/scenarios"
+// Status broadcasts while playing, at most this often
+#define SCENARIO_NOTIFY_US      250000
+
+enum ScenarioChannel : uint8_t {
+    SCENARIO_RETURN_AIR = 0,
+    SCENARIO_DISCHARGE_AIR,
+    SCENARIO_AMBIENT,
+    SCENARIO_COOLANT,
+    SCENARIO_COIL,
+    SCENARIO_SUCTION_PRESSURE,
+    SCENARIO_DISCHARGE_PRESSURE,
+    SCENARIO_REDUNDANT_AIR,
+    SCENARIO_IND_RPM,
+    SCENARIO_HALL_RPM,
+    SCENARIO_CHANNEL_COUNT
+};
+
+enum ScenarioState : uint8_t {
+    SCENARIO_STOPPED = 0,
+    SCENARIO_LOADING,       // the reader is opening or seeking
+    SCENARIO_PLAYING,
+    SCENARIO_PAUSED,
+    SCENARIO_ENDED,         // past the last keyframe; channels hold
+};
+
+// Parsed line. at and ramp are in µs; at already includes the loop pass.
+typedef struct {
+    int64_t at;
+    uint32_t ramp;
+    float value;
+    uint8_t channel;
+} ScenarioKeyframe;
+
+// One line of a scenario file. lastMs is the previous line's time (for
+// +ms) and is updated. Returns 1 for a keyframe, 0 for a blank or comment
+// line, -1 for a line that does not parse.
+int scenarioParseLine(const char *line, uint32_t &lastMs, ScenarioKeyframe &keyframe);
+
+// Control, from any task. Opening and seeking happen on the scenario task;
+// play and seek return false for a bad name or a file that is not there.
+void scenarioBegin();
+bool scenarioPlay(const char *name, bool loop);
+bool scenarioPause();
+bool scenarioResume();
+// Jumps to positionMs of script time, keeping the play/pause state
+bool scenarioSeek(uint32_t positionMs);
+void scenarioStop();
+ScenarioState scenarioState();
+
+// {"type":"scenario",...}: state, position, and timing error against the script
+size_t serializeScenarioStatus(char *out, size_t size);
+
+// One timer period of the scenario task: handles a pending play, seek or
+// stop, applies the due keyframes and pushes the interpolated values, then
+// reads ahead until the queue is full
+void scenarioTick(int64_t now);
+
+// Platform side (scenario_esp32.cpp, scenario_native.cpp)
+bool scenarioSourceExists(const char *name);
+bool scenarioSourceOpen(const char *name);
+bool scenarioSourceReadLine(char *line, size_t size);    // false at end of file
+void scenarioSourceRewind();
+void scenarioSourceClose();
+void scenarioTimerBegin();
+void scenarioTimerStart();
+void scenarioTimerStop();
+
+#if !HAL_NATIVE
+
+// Body of the scenario task (main.cpp creates it); the tick timer wakes it
+// through scenarioTaskHandle
+void scenarioTask(void *parameter);
+extern TaskHandle_t scenarioTaskHandle;
+
+#else
+
+// Files are read from <root>/scenarios; env:sim passes its --data dir
+void scenarioSetRoot(const char *root);
+
+// Host stand-in for the esp_timer and the task it wakes: call
+// scenarioServiceTimer() at scenarioNextDeadline() (-1 while stopped)
+void scenarioServiceTimer(int64_t micros);
+int64_t scenarioNextDeadline();
+
+#endif // HAL_NATIVE
+
+#endif // SCENARIO_H
@@ -0,0 +1,90 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <Arduino.h>
+#include "hal.h"
+
+// Commands held for a future device time, for test steps that must land
+// a set time apart ("at T+2.000 s high RPM, at T+2.500 s drop suction")
+// whatever the network does in between:
+//
+//   {"cmd":"schedule","action":"add","at":<µs>,"command":{"cmd":"updateSensor",...}}
+//
+// at is on the device clock (esp_timer_get_time(), "nowUs" in the status
+// frame). The held command runs through the normal dispatcher as an
+// internal command, like a button press: it changes state for every client
+// but sends no response of its own. Instead, once it has run, the client
+// that scheduled it gets {"type":"scheduleFired",...} with the scheduling
+// error, the µs between at and the start of dispatch.
+//
+// Entries sit in a hashed timer wheel: SCHEDULE_WHEEL_SLOTS slots of
+// SCHEDULE_SLOT_US, an entry in the slot its time falls in whatever the
+// turn. Adding and cancelling are O(1) and the soonest entry is a bitmap
+// walk from the current slot. A one-shot timer is armed for it alone, so
+// nothing ticks while entries wait.
+//
+// On the device the timer wakes the schedule task SCHEDULE_LEAD_US early;
+// the task, above every other task of ours, spins out the rest and
+// dispatches on time. The error left is the spin's granularity plus
+// anything in an interrupt at that moment, a few µs.
+
+// Entries held at once, and the longest command one can hold
+#define SCHEDULE_MAX            16
+#define SCHEDULE_COMMAND_MAX    160
+// One turn of the wheel is 64 * 10 ms; later entries wait out the turns
+#define SCHEDULE_WHEEL_SLOTS    64
+#define SCHEDULE_SLOT_US        10000
+// Furthest ahead a command can be scheduled (one hour)
+#define SCHEDULE_HORIZON_US     3600000000LL
+// How early the device timer fires to cover waking the task. The host's
+// simulated clock jumps straight to the entry.
+#if HAL_NATIVE
+#define SCHEDULE_LEAD_US        0
+#else
+#define SCHEDULE_LEAD_US        200
+#endif
+// Pending entries listed in the status frame, soonest first
+#define SCHEDULE_LIST_MAX       8
+
+void scheduleBegin();
+
+// Holds command (terminated at length) for client. Returns the entry id,
+// or 0 with reason set: a time in the past or beyond the horizon, a command
+// that is unknown, too long or itself a schedule, or no free entry.
+uint32_t scheduleAdd(ClientId client, int64_t at, const char *command, size_t length, const char *&reason);
+// False when id is not pending
+bool scheduleCancel(uint32_t id);
+void scheduleCancelAll();
+
+// {"type":"schedule",...}: the device time, the soonest pending entries
+// and the scheduling error so far. added is reported when nonzero.
+size_t serializeScheduleStatus(char *out, size_t size, uint32_t added);
+
+// From the timer: runs every entry due by now (plus the lead), then arms
+// the timer for the next one
+void scheduleService(int64_t now);
+
+// Platform side (schedule_esp32.cpp, schedule_native.cpp). Arm replaces
+// any earlier deadline; -1 disarms. It is never called under the schedule
+// lock. WaitUntil returns the time it reached.
+void scheduleTimerBegin();
+void scheduleTimerArm(int64_t at);
+int64_t scheduleWaitUntil(int64_t at);
+
+#if !HAL_NATIVE
+
+// Body of the schedule task (main.cpp creates it); the timer wakes it
+// through scheduleTaskHandle
+void scheduleTask(void *parameter);
+extern TaskHandle_t scheduleTaskHandle;
+
+#else
+
+// Host stand-in for the timer and the task: call scheduleServiceTimer()
+// at scheduleNextDeadline() (-1 while nothing is pending)
+void scheduleServiceTimer(int64_t micros);
+int64_t scheduleNextDeadline();
+
+#endif // HAL_NATIVE
+
+#endif // SCHEDULE_H
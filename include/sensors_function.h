@@ -4,13 +4,46 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include "hardware_config.h"
-#include <SPI.h>
+#include "hal.h"
+
+// Number of MCP4251 chips (two wipers each)
+#define POT_IC_COUNT 5
+
+// Wiper writes (PotWrite, see hal.h) collected so they go out in a single
+// SPI transaction. A later write to the same wiper replaces the earlier one.
+typedef struct {
+    PotWrite writes[POT_IC_COUNT * 2];
+    uint8_t count;
+} PotBurst;
+
+void potBurstAdd(PotBurst &burst, uint8_t csPin, uint8_t wiper, uint8_t value);
+void potBurstFlush(PotBurst &burst);
 
 // Function declarations
 void setupSensors();
+uint8_t mapTemperatureToPot(float temperature);
+uint8_t mapPressureToPot(float pressure);
 void updateSensors();
-void processSensorWSCommand(const JsonDocument& doc);
-void handleSensorSystemPresetChange(const char* systemType);
+bool sensorExists(const char *sensorName);
+
+// The wiper behind a sensor and its current reading, for code that drives
+// the pot other than through setSensorValue
+typedef struct {
+    const char *name;       // static; safe to keep
+    uint8_t csPin;
+    uint8_t wiper;
+    bool pressure;          // mapPressureToPot, else mapTemperatureToPot
+    float value;
+} SensorPot;
+
+bool sensorPot(const char *sensorName, SensorPot &pot);
+// With a burst the wiper write is queued on it instead of sent immediately
+bool setSensorValue(const char *sensorName, float value, PotBurst *burst = nullptr);
+bool adjustPot(uint8_t icIndex, uint8_t wiperIndex, uint8_t value, PotBurst *burst = nullptr);
+void resetPots(PotBurst *burst = nullptr);
+// Sets and writes every sensor's preset reading; with a burst the wiper
+// writes are queued on it (an output frame's pots, output_frame.h)
+void handleSensorSystemPresetChange(const char* systemType, PotBurst *burst = nullptr);
 void updateSensorValues();
 void updateMCP4251(uint8_t pot, uint16_t value);
 void updateAllPotentiometers();
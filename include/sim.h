@@ -0,0 +1,61 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "hal_fake.h"
+#include "input.h"
+#include "protocol.h"
+
+#if HAL_NATIVE
+
+// Discrete-event twin of the bench for env:sim. The firmware's tasks run as
+// events on the fake clock instead of FreeRTOS delays, so virtual time jumps
+// straight from one event to the next. Events due at the same microsecond
+// run in the order they were scheduled, which keeps every run identical.
+//
+// Task periods match main.cpp: CKP 10 ms, web status 100 ms, LED 100 ms
+// while running and 1 s when stopped. The button task has no period; it
+// runs whenever an edge or the debounce timer produces an event.
+#define SIM_CKP_PERIOD_US           10000
+#define SIM_WEB_STATUS_PERIOD_US    100000
+#define SIM_LED_RUNNING_US          100000
+#define SIM_LED_IDLE_US             1000000
+
+// Gap between the extra edges of a bouncing contact
+#define SIM_BOUNCE_GAP_US           300
+
+typedef void (*SimHandler)(void *arg);
+
+// Clears the event queue and the counters. Call after halFakeReset().
+void simReset();
+
+// Schedule at an absolute virtual time; times in the past run next
+void simAt(int64_t at, SimHandler handler, void *arg);
+
+// Time of the earliest pending event, or -1 when the queue is empty
+int64_t simNextAt();
+
+// Runs every event due at or before until, then parks the clock there
+void simRunUntil(int64_t until);
+
+uint64_t simEventsRun();
+
+// Boot the control core and start the periodic tasks, as setup() does
+void simBoot();
+
+// A physical edge: sets the fake pin and hands the edge to the debouncer
+// like the GPIO ISR would. bounces adds that many extra contact bounces
+// before the level settles.
+void simButton(ButtonId button, bool pressed, uint8_t bounces = 0);
+
+// One inbound WebSocket text frame from client, at the current time
+void simCommand(ClientId client, const char *frame, size_t length);
+
+// One HTTP control request; arg is its parameter or nullptr
+bool simHttp(HttpCommand command, const char *arg);
+
+// A WebSocket client connects or goes away
+void simClient(ClientId client, bool connected);
+
+#endif // HAL_NATIVE
+
+#endif // SIM_H
@@ -0,0 +1,44 @@
+#ifndef SIM_SERVER_H
+#define SIM_SERVER_H
+
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+// Localhost front end for the twin: the data/ files, GET /status and the
+// /ws WebSocket speaking the device protocol, so the real UI and scripts can
+// drive a simulated bench. Frames still go through hal.transport and into
+// the trace; this transport also delivers them to the open sockets, with
+// the same control/snapshot split as ws_outbound. Live clients get ids from
+// SIM_LIVE_CLIENT_BASE up so they never collide with scripted ones.
+#define SIM_LIVE_CLIENT_BASE    1000
+#define SIM_MAX_CONNECTIONS     16
+#define SIM_HTTP_REQUEST_MAX    4096
+
+class SimTransport : public FakeTransport {
+public:
+    void reply(ClientId client, const char *message, size_t length) override;
+    void broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) override;
+    void publish(WsTopic topic, const char *message, size_t length, uint32_t revision) override;
+    void subscribe(ClientId client, uint8_t topics) override;
+};
+
+extern SimTransport simTransport;
+
+// Listens on 127.0.0.1:port and binds hal.transport to simTransport
+bool simServerBegin(uint16_t port, const char *dataDir);
+
+// Waits up to timeoutMs for socket activity; simServerService() handles it.
+// Split so the caller can bring virtual time up to date in between.
+void simServerWait(int timeoutMs);
+void simServerService();
+
+// Sends held-back snapshots to clients whose output has drained. The web
+// status task runs it; harmless when the server was never started.
+void simServerPump();
+
+size_t simServerClients();
+
+#endif // HAL_NATIVE
+
+#endif // SIM_SERVER_H
@@ -0,0 +1,28 @@
+#ifndef SSE_EVENTS_H
+#define SSE_EVENTS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "ws_outbound.h"
+
+// Read-only Server-Sent Events stream on /events for dashboards that never
+// send commands. It carries the same frames as the WebSocket broadcast: the
+// event name is the topic ("status", "rpmUpdate", ...) and the id is the
+// state revision. A browser that reconnects sends Last-Event-ID. It gets
+// back the events it missed from a short backlog, then the current status
+// if the state moved on.
+#define SSE_MAX_CLIENTS     4
+#define SSE_EVENT_BACKLOG   8       // Events kept for Last-Event-ID resume
+#define SSE_EVENT_TEXT_MAX  192     // Longer events are not kept
+#define SSE_RECONNECT_MS    2000    // Retry delay suggested to browsers
+
+// Registers /events on the server
+void sseBegin(AsyncWebServer &server);
+
+size_t sseClientCount();
+
+// Forwards a frame already serialized for the WebSocket broadcast. Events
+// go into the backlog whether or not a dashboard is connected.
+void ssePublish(WsTopic topic, const char *message, size_t length, uint32_t revision);
+
+#endif // SSE_EVENTS_H
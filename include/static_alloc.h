@@ -0,0 +1,29 @@
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include <Arduino.h>
+
+// Build with -DSTATIC_ALLOC_MODE=1 (see env:esp32dev_static) to take task
+// stacks, queues and JSON memory from storage reserved at boot, so nothing
+// on the command path touches the heap once setup() has finished.
+#ifndef STATIC_ALLOC_MODE
+#define STATIC_ALLOC_MODE 0
+#endif
+
+// Storage reserved for task stacks in static mode: the sum of every stack
+// main.cpp asks for (60384 bytes with the schedule task) rounded up. Raise
+// it with any new or larger task; running out stops the boot.
+#define STATIC_TASK_STACK_BYTES  (60 * 1024)
+#define STATIC_MAX_TASKS         8
+
+// Largest outbound WebSocket frame built on the stack
+#define WS_MESSAGE_MAX           512
+
+// Same arguments as xTaskCreatePinnedToCore. In static mode the stack and
+// TCB come from a boot-time arena instead of the heap, and a task that does
+// not fit aborts the boot rather than leaving its handle NULL.
+BaseType_t createPinnedTask(TaskFunction_t function, const char *name, uint32_t stackBytes,
+                            void *parameter, UBaseType_t priority, TaskHandle_t *handle,
+                            BaseType_t core);
+
+#endif // STATIC_ALLOC_H
@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "trace_format.h"
+
+// Build with -DTRACE_ENABLED=1 (see env:esp32dev_trace) to record events.
+// Without it every TRACE_* macro expands to nothing.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Events kept per core; older events are overwritten
+#define TRACE_RING_SIZE  1024
+#define TRACE_MAX_TASKS  16
+
+#if TRACE_ENABLED
+
+#include <xtensa/core-macros.h>
+
+void traceInit();
+void traceClear();
+void traceRecord(uint16_t id, uint8_t phase, uint32_t arg);
+
+// Snapshot all rings into a binary blob (see trace_format.h).
+// Returns the number of bytes written, or 0 if out is too small.
+size_t traceDump(uint8_t *out, size_t maxLen);
+size_t traceDumpSize();
+
+class TraceScope {
+public:
+    TraceScope(uint16_t id, uint32_t arg) : _id(id) {
+        traceRecord(id, TRACE_PHASE_BEGIN, arg);
+    }
+    ~TraceScope() {
+        traceRecord(_id, TRACE_PHASE_END, 0);
+    }
+private:
+    uint16_t _id;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(id, arg) TraceScope TRACE_CONCAT(_traceScope, __LINE__)((id), (uint32_t)(arg))
+#define TRACE_INSTANT(id, arg) traceRecord((id), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+
+#else
+
+#define TRACE_SCOPE(id, arg) ((void)0)
+#define TRACE_INSTANT(id, arg) ((void)0)
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_H
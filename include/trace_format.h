@@ -0,0 +1,68 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+// Binary layout of the /trace download. Kept free of Arduino includes so the
+// host-side converter (tools/trace2json.cpp) can share it with the firmware.
+
+#include <stdint.h>
+
+#define TRACE_MAGIC          0x43525452u  // "RTRC" little-endian
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_TASK_NAME_LEN  16
+
+// Event phases, mirroring the Chrome trace "ph" field
+#define TRACE_PHASE_BEGIN    0
+#define TRACE_PHASE_END      1
+#define TRACE_PHASE_INSTANT  2
+
+// Instrumented points
+enum TraceEventId {
+    TRACE_EVT_NONE = 0,
+    TRACE_EVT_WS_EVENT,          // onEvent, arg = AwsEventType
+    TRACE_EVT_WS_MESSAGE,        // handleWebSocketMessage, arg = frame length
+    TRACE_EVT_START_SYSTEM,      // startSystem
+    TRACE_EVT_UPDATE_PWM,        // updatePwmSignals, arg = 1 if running
+    TRACE_EVT_SET_POT,           // setPotValue, arg = cs << 16 | wiper << 8 | value
+    TRACE_EVT_NOTIFY_CLIENTS,    // notifyClients, arg = 1 if raw message
+    TRACE_EVT_COUNT
+};
+
+static const char *const TRACE_EVENT_NAMES[TRACE_EVT_COUNT] = {
+    "none",
+    "onEvent",
+    "handleWebSocketMessage",
+    "startSystem",
+    "updatePwmSignals",
+    "setPotValue",
+    "notifyClients",
+};
+
+// One recorded event (12 bytes)
+typedef struct {
+    uint32_t cycles;   // CCOUNT of the recording core
+    uint16_t id;       // TraceEventId
+    uint8_t task;      // index into the task name table
+    uint8_t phase;     // TRACE_PHASE_*
+    uint32_t arg;
+} TraceEvent;
+
+// File header, followed by taskCount names, then numCores blocks of
+// TraceCoreHeader + events (oldest first)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numCores;
+    uint32_t cpuMhz;
+    uint16_t taskCount;
+    uint16_t eventSize;
+} TraceFileHeader;
+
+typedef struct {
+    uint32_t anchorCycles;   // CCOUNT sampled on this core at dump time
+    uint32_t eventCount;     // events that follow
+    uint64_t anchorMicros;   // esp_timer_get_time() at the same instant
+    uint32_t dropped;        // events overwritten since the last clear
+    uint32_t reserved;
+} TraceCoreHeader;
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,57 @@
+#ifndef WS_CLIENTS_H
+#define WS_CLIENTS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// WebSocket client lifecycle: keepalive pings with RTT, eviction of dead
+// and backed-up clients, and a connection cap where control clients (any
+// client that has sent a state-changing command) outrank viewers.
+#define WS_MAX_CLIENTS          8
+#define WS_PING_INTERVAL_MS     5000
+#define WS_DEAD_AFTER_MS        15000   // Nothing heard for three ping periods
+#define WS_QUEUE_EVICT_DEPTH    24      // AsyncWebSocket queues at most 32
+#define WS_QUEUE_EVICT_CHECKS   3       // Consecutive service passes over the depth
+#define WS_SERVICE_INTERVAL_MS  1000
+
+enum WsClientRole : uint8_t {
+    WS_ROLE_VIEWER = 0,
+    WS_ROLE_CONTROL
+};
+
+enum WsEvictReason : uint8_t {
+    WS_EVICT_DEAD = 0,
+    WS_EVICT_SLOW,
+    WS_EVICT_CAPACITY,
+    WS_EVICT_COUNT
+};
+
+typedef struct {
+    uint32_t id;
+    WsClientRole role;
+    uint32_t rttMicros;       // Last ping round trip, 0 until the first pong
+    uint32_t rttAvgMicros;    // Smoothed (1/8 weight per sample)
+    uint32_t queueLen;
+    uint32_t idleMillis;
+} WsClientInfo;
+
+// Hooks from the WebSocket event handler (async_tcp task). OnConnect
+// returns false if the new client was turned away because the cap is full.
+bool wsClientsOnConnect(AsyncWebSocketClient *client);
+void wsClientsOnDisconnect(AsyncWebSocketClient *client);
+void wsClientsOnData(AsyncWebSocketClient *client);
+void wsClientsOnPong(AsyncWebSocketClient *client);
+void wsClientsMarkControl(AsyncWebSocketClient *client);
+
+// Pings, evicts and frees closed clients; call every WS_SERVICE_INTERVAL_MS
+void wsClientsService();
+
+// Ids of the admitted clients (not those being closed); returns how many
+size_t wsClientsIds(uint32_t *out, size_t max);
+
+// Copies the tracked clients for reporting; returns how many
+size_t wsClientsSnapshot(WsClientInfo *out, size_t max);
+uint32_t wsClientsEvictions(WsEvictReason reason);
+const char *wsEvictReasonName(WsEvictReason reason);
+
+#endif // WS_CLIENTS_H
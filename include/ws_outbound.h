@@ -0,0 +1,41 @@
+#ifndef WS_OUTBOUND_H
+#define WS_OUTBOUND_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "ws_clients.h"
+#include "hal.h"
+
+// Outbound WebSocket scheduling, two classes per client:
+//  - control (command responses, events) is queued at once and never dropped
+//  - snapshots (status, sensor and RPM state) are latest-wins: while a
+//    client's queue is backed up it only keeps a "pending" mark, and once
+//    the queue drains it gets the newest copy. Older copies are never sent.
+// A stalled client therefore holds at most WS_SNAPSHOT_QUEUE_MAX snapshots
+// plus its own control traffic, and acks are never stuck behind stale state.
+#define WS_SNAPSHOT_QUEUE_MAX   2    // Library queue depth at which snapshots wait
+#define WS_OUTBOUND_CLIENTS     (WS_MAX_CLIENTS + 2)
+
+// Control class. Replies always go out; broadcasts only to subscribers.
+void wsSendControl(AsyncWebSocketClient *client, const char *message, size_t length);
+void wsBroadcastControl(WsTopic topic, const char *message, size_t length);
+
+// Replaces the current snapshot of this topic and sends it to every
+// subscriber with room in its queue; the rest get it from a later
+// wsOutboundPump()
+void wsPublishSnapshot(WsTopic topic, const char *message, size_t length);
+
+// Delivers pending snapshots to clients whose queues have drained.
+// Call often (the web status task runs it every 100 ms).
+void wsOutboundPump();
+
+// Subscriptions. A topic nobody subscribes to is not worth serializing.
+// Topics are defined in hal.h, their names in protocol.h.
+void wsSetTopics(uint32_t clientId, uint8_t topics);
+bool wsTopicHasSubscribers(WsTopic topic);
+size_t wsTopicSubscribers(WsTopic topic);
+
+// Drops per-client state for a disconnected client
+void wsOutboundForget(uint32_t clientId);
+
+#endif // WS_OUTBOUND_H
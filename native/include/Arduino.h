@@ -0,0 +1,87 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Just enough of the Arduino core for the control and serialization code
+// to build on a host (env:native). Time comes from hal.clock, so the fake
+// clock drives everything; Serial goes to stderr and is off by default.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "hal.h"
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+
+#define IRAM_ATTR
+#define F(text)         (text)
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+inline unsigned long millis() {
+    return hal.clock->millis();
+}
+
+inline unsigned long micros() {
+    return (unsigned long)hal.clock->micros();
+}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t copy = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = 0;
+    }
+    return length;
+}
+#endif
+
+class NativeSerial {
+public:
+    bool enabled = false;
+
+    void begin(unsigned long) {}
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        if (!enabled) {
+            return 0;
+        }
+        va_list args;
+        va_start(args, format);
+        int written = vfprintf(stderr, format, args);
+        va_end(args);
+        return written < 0 ? 0 : written;
+    }
+
+    size_t print(const char *text) { return enabled ? fputs(text, stderr), strlen(text) : 0; }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(double value) { return printf("%.2f", value); }
+
+    size_t println() { return print("\n"); }
+    template <typename T>
+    size_t println(T value) {
+        size_t written = print(value);
+        return written + println();
+    }
+};
+
+extern NativeSerial Serial;
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,16 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NVS is not emulated on the host; values are accepted and dropped
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false) { return true; }
+    void end() {}
+    size_t putUChar(const char *key, uint8_t value) { return 1; }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return defaultValue; }
+};
+
+#endif // NATIVE_PREFERENCES_H
@@ -0,0 +1,31 @@
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+// FreeRTOS types and critical sections for the native build. The host
+// core runs on one thread, so a critical section only needs to be a
+// compiler barrier.
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+#define pdPASS          1
+#define pdFAIL          0
+#define pdTRUE          1
+#define pdFALSE         0
+
+typedef struct {
+    uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+// The lock is still named, so a lock only these guard counts as used
+#define portENTER_CRITICAL(mux)     do { (void)(mux); __atomic_signal_fence(__ATOMIC_SEQ_CST); } while (0)
+#define portEXIT_CRITICAL(mux)      do { (void)(mux); __atomic_signal_fence(__ATOMIC_SEQ_CST); } while (0)
+
+#endif // NATIVE_FREERTOS_H
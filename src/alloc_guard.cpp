@@ -0,0 +1,117 @@
+#include "alloc_guard.h"
+
+#if STATIC_ALLOC_MODE || BENCH_ENABLED
+
+#include <atomic>
+#include <string.h>
+#if STATIC_ALLOC_MODE
+#include "web_server.h"
+#endif
+
+static std::atomic<bool> armed(false);
+static std::atomic<uint32_t> allocations(0);
+static std::atomic<void *> firstCaller(nullptr);
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static inline void noteAllocation(void *caller) {
+    if (!armed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (allocations.fetch_add(1, std::memory_order_relaxed) == 0) {
+        firstCaller.store(caller, std::memory_order_relaxed);
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    noteAllocation(__builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    noteAllocation(__builtin_return_address(0));
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    noteAllocation(__builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+}
+
+void allocGuardArm() {
+    allocations.store(0);
+    firstCaller.store(nullptr);
+    armed.store(true);
+}
+
+void allocGuardDisarm() {
+    armed.store(false);
+}
+
+uint32_t allocGuardCount() {
+    return allocations.load();
+}
+
+void *allocGuardFirstCaller() {
+    return firstCaller.load();
+}
+
+#endif // STATIC_ALLOC_MODE || BENCH_ENABLED
+
+#if STATIC_ALLOC_MODE
+
+// Frames fed straight into handleWebSocketMessage, as the UI would send them
+static const char *const WORKLOAD[] = {
+    "{\"cmd\":\"preset\",\"systemType\":\"carrier\",\"commandId\":1}",
+    "{\"cmd\":\"run\",\"systemType\":\"carrier\",\"commandId\":2}",
+    "{\"cmd\":\"preset\",\"systemType\":\"thermoking\",\"commandId\":3}",
+    "{\"cmd\":\"run\",\"systemType\":\"thermoking\",\"commandId\":4}",
+    "{\"cmd\":\"stop\",\"commandId\":5}",
+    "{\"cmd\":\"preset\",\"systemType\":\"carrier\",\"commandId\":6}",
+    "{\"cmd\":\"batch\",\"commandId\":7,\"ops\":["
+    "{\"cmd\":\"updateSensor\",\"sensor\":\"coilTemp\",\"value\":40},"
+    "{\"cmd\":\"updateSensor\",\"sensor\":\"ambientTemp\",\"value\":90}]}",
+};
+
+static void runWorkload() {
+    // handleWebSocketMessage terminates the frame in place, so copy it
+    static char frame[256];
+
+    for (const char *message : WORKLOAD) {
+        size_t len = strlen(message);
+        memcpy(frame, message, len + 1);
+
+        AwsFrameInfo info;
+        memset(&info, 0, sizeof(info));
+        info.final = 1;
+        info.opcode = WS_TEXT;
+        info.len = len;
+
+        handleWebSocketMessage(nullptr, &info, (uint8_t *)frame, len);
+    }
+}
+
+bool allocGuardSelfTest() {
+    Serial.println("Alloc guard: warm-up pass");
+    runWorkload();
+
+    allocGuardArm();
+    runWorkload();
+    allocGuardDisarm();
+
+    uint32_t count = allocGuardCount();
+    if (count == 0) {
+        Serial.println("Alloc guard: PASS - no heap allocations during workload");
+        return true;
+    }
+
+    Serial.printf("Alloc guard: FAIL - %u allocations, first from %p\n",
+                  count, allocGuardFirstCaller());
+    return false;
+}
+
+#endif // STATIC_ALLOC_MODE
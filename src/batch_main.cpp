@@ -0,0 +1,150 @@
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:batch. Sends one full sensor frame, eight
+// readings, through protocolHandleCommand() first as eight updateSensor
+// frames and then as one batch frame, and reports per update what the
+// fakes saw: pot bus transactions, response and broadcast frames, bytes
+// out and time. Exits 1 when the batch took more than one bus transaction
+// or one response. SPI and MCPWM time are not modelled on the host; on the
+// device compare reefer_command_duration_us{cmd="batch"} with eight
+// updateSensor samples.
+//
+//   pio run -e batch && .pio/build/batch/program [iterations]
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "commands.h"
+#include "protocol.h"
+#include "command_cache.h"
+#include "input.h"
+
+#define BATCH_CLIENT        1
+#define BATCH_FRAME_MAX     1100
+
+static const char *const SENSORS[] = {
+    "returnAirTemp", "dischargeAirTemp", "ambientTemp", "coolantTemp",
+    "coilTemp", "suctionPressure", "dischargePressure", "redundantAirTemp",
+};
+static const int SENSOR_COUNT = sizeof(SENSORS) / sizeof(SENSORS[0]);
+
+// Two value sets, alternated so every update moves the wipers
+static char singles[2][SENSOR_COUNT][160];
+static char batches[2][BATCH_FRAME_MAX];
+
+typedef struct {
+    const char *name;
+    uint32_t framesIn;
+    size_t bytesIn;
+    double transactions;
+    double replies;
+    double broadcasts;
+    double bytesOut;
+    double nsPerUpdate;
+} BatchResult;
+
+static void buildFrames() {
+    for (int set = 0; set < 2; set++) {
+        int used = snprintf(batches[set], BATCH_FRAME_MAX,
+                            "{\"type\":\"command\",\"commandId\":100,\"cmd\":\"batch\",\"ops\":[");
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            int value = 40 + i + set * 20;
+            used += snprintf(batches[set] + used, BATCH_FRAME_MAX - used,
+                             "%s{\"cmd\":\"updateSensor\",\"sensor\":\"%s\",\"value\":%d}", i ? "," : "", SENSORS[i],
+                             value);
+            snprintf(singles[set][i], sizeof(singles[set][i]),
+                     "{\"type\":\"command\",\"commandId\":%d,\"cmd\":\"updateSensor\",\"sensor\":\"%s\",\"value\":%d}",
+                     101 + i, SENSORS[i], value);
+        }
+        snprintf(batches[set] + used, BATCH_FRAME_MAX - used, "]}");
+    }
+}
+
+// The dispatcher expects a terminated, writable copy like the socket's
+static void send(const char *frame) {
+    static char buffer[BATCH_FRAME_MAX];
+    size_t len = strlen(frame);
+    memcpy(buffer, frame, len + 1);
+    protocolHandleCommand(BATCH_CLIENT, buffer, len);
+}
+
+static void sendSingles(long update) {
+    for (const char *frame : singles[update & 1]) {
+        send(frame);
+    }
+}
+
+static void sendBatch(long update) {
+    send(batches[update & 1]);
+}
+
+static BatchResult measure(const char *name, void (*update)(long), long iterations) {
+    BatchResult result = {};
+    result.name = name;
+    bool batch = update == sendBatch;
+    result.framesIn = batch ? 1 : SENSOR_COUNT;
+    result.bytesIn = batch ? strlen(batches[0]) : 0;
+    for (int i = 0; !batch && i < SENSOR_COUNT; i++) {
+        result.bytesIn += strlen(singles[0][i]);
+    }
+
+    uint32_t transactions = fakePots.transactions;
+    uint32_t frames = fakeTransport.frames;
+    uint32_t replies = fakeTransport.replies;
+    size_t bytes = fakeTransport.bytes;
+    auto started = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        update(i);
+        // Otherwise every later update is answered from the result cache
+        commandCacheForget(BATCH_CLIENT);
+    }
+    double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+
+    result.transactions = (double)(fakePots.transactions - transactions) / iterations;
+    result.replies = (double)(fakeTransport.replies - replies) / iterations;
+    result.broadcasts = (double)(fakeTransport.frames - frames) / iterations - result.replies;
+    result.bytesOut = (double)(fakeTransport.bytes - bytes) / iterations;
+    result.nsPerUpdate = nanos / iterations;
+    return result;
+}
+
+static void print(const BatchResult &result) {
+    printf("RESULT batch path=%s frames_in=%u bytes_in=%zu spi_transactions=%.2f replies=%.2f broadcasts=%.2f "
+           "bytes_out=%.0f ns_per_update=%.0f\n",
+           result.name, result.framesIn, result.bytesIn, result.transactions, result.replies, result.broadcasts,
+           result.bytesOut, result.nsPerUpdate);
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: program [iterations]\n");
+        return 2;
+    }
+
+    halFakeReset();
+    halFakeRecord(false);
+    commandsBegin();
+    setupCKP();
+    setupSensors();
+    inputBegin();
+    buildFrames();
+
+    BatchResult singlesResult = measure("updateSensor_x8", sendSingles, iterations);
+    BatchResult batchResult = measure("batch", sendBatch, iterations);
+    print(singlesResult);
+    print(batchResult);
+
+    bool ok = batchResult.transactions == 1.0 && batchResult.replies == 1.0;
+    printf("RESULT batch_summary speedup=%.2fx %s\n", singlesResult.nsPerUpdate / batchResult.nsPerUpdate,
+           ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,384 @@
+#include "bench.h"
+
+#if BENCH_ENABLED
+
+#include <algorithm>
+#include <string.h>
+#include "alloc_guard.h"
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "command_cache.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "static_alloc.h"
+#include "reefer_model.h"
+#include "pot_stream.h"
+#include "bench_baseline.h"
+
+#if HAL_NATIVE
+#include <time.h>
+#define BENCH_TARGET "host"
+#define BENCH_PRINTF printf
+#else
+#include <Preferences.h>
+#define BENCH_TARGET "esp32"
+#define BENCH_PRINTF Serial.printf
+#endif
+
+extern SystemState state;
+
+// Commands come from this client so responses are built and sent
+#define BENCH_CLIENT 1
+
+typedef void (*BenchFunction)(uint32_t iterations);
+
+typedef struct {
+    const char *name;
+    BenchFunction run;
+} BenchCase;
+
+// Keeps results of pure functions from being optimised away
+static volatile uint32_t sink;
+
+// Elapsed time of one call to run(iterations), in ns, and in cycles on the device
+static double timeCase(BenchFunction run, uint32_t iterations, double &cycles) {
+#if HAL_NATIVE
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run(iterations);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cycles = 0;
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+#else
+    uint32_t start = ESP.getCycleCount();
+    run(iterations);
+    cycles = (uint32_t)(ESP.getCycleCount() - start);
+    return cycles * 1000.0 / ESP.getCpuFreqMHz();
+#endif
+}
+
+static void benchSafeFrequency(uint32_t iterations) {
+    static const float RPMS[] = {0, RPM_1450, RPM_1800, RPM_2200, 950.5f, 3100};
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += (uint32_t)calculateSafeFrequency(RPMS[i % 6]);
+    }
+    sink = sum;
+}
+
+// Steady state of the 10 ms CKP refresh: same type, same RPM
+static void benchUpdatePwm(uint32_t iterations) {
+    state.systemRunning = true;
+    strlcpy(state.systemType, SYSTEM_CARRIER, sizeof(state.systemType));
+    state.hallRpm = RPM_1800;
+    for (uint32_t i = 0; i < iterations; i++) {
+        updatePwmSignals();
+    }
+}
+
+static void benchMapTemperature(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += mapTemperatureToPot((float)(i % 220));
+    }
+    sink = sum;
+}
+
+static void benchMapPressure(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += mapPressureToPot((float)(i % 520));
+    }
+    sink = sum;
+}
+
+// One 100 ms step of the thermal model, compressor and engine on
+static void benchReeferStep(uint32_t iterations) {
+    static ReeferModel model;
+    reeferModelInit(model, REEFER_DEFAULT_PARAMS, REEFER_FIXED(85));
+    ReeferInputs inputs = {true, true, REEFER_FIXED(1), REEFER_FIXED(85)};
+    for (uint32_t i = 0; i < iterations; i++) {
+        reeferModelStep(model, inputs);
+    }
+    sink = model.box;
+}
+
+// One 1 ms stream tick with both channels streaming: collect the finished
+// frames, look up the next samples and queue them. The bench drives the
+// tick itself, so the stream timer is stopped, and the streams end with
+// the wipers back on their readings.
+static void benchPotStreamTick(uint32_t iterations) {
+    potStreamStart("suctionPressure", POT_WAVE_SINE, 25, 4);
+    potStreamStart("dischargePressure", POT_WAVE_SINE, 25, 10);
+    potStreamTimerStop();
+    for (uint32_t i = 0; i < iterations; i++) {
+        potStreamTick(hal.clock->micros());
+    }
+    potStreamStopAll();
+    potStreamTick(hal.clock->micros());
+}
+
+static void benchSerializeStatus(uint32_t iterations) {
+    char out[WS_MESSAGE_MAX];
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink = serializeStatus(out, sizeof(out));
+    }
+}
+
+// Body of GET /status
+static void benchSerializeHttpStatus(uint32_t iterations) {
+    char out[WS_MESSAGE_MAX];
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink = serializeHttpStatus(out, sizeof(out), stateRevision());
+    }
+}
+
+// Skips serialization when nobody subscribes to status, so on a device
+// without clients this is the cost of finding that out
+static void benchNotifyClients(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        notifyClients();
+    }
+}
+
+static void benchSendSystemStatus(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        sendSystemStatus(BENCH_CLIENT);
+    }
+}
+
+// handleWebSocketMessage is a frame check around protocolHandleCommand,
+// which is what the host can run
+static void runFrame(const char *frame, uint32_t iterations, bool mutates) {
+    static char buffer[256];
+    size_t len = strlen(frame);
+    for (uint32_t i = 0; i < iterations; i++) {
+        memcpy(buffer, frame, len + 1);
+        protocolHandleCommand(BENCH_CLIENT, buffer, len);
+        if (mutates) {
+            // Otherwise every later run is answered from the result cache
+            commandCacheForget(BENCH_CLIENT);
+        }
+    }
+}
+
+static void benchCommandGetState(uint32_t iterations) {
+    runFrame("{\"type\":\"command\",\"commandId\":7,\"cmd\":\"getState\"}", iterations, false);
+}
+
+static void benchCommandUpdateSensor(uint32_t iterations) {
+    runFrame("{\"type\":\"command\",\"commandId\":8,\"cmd\":\"updateSensor\",\"sensor\":\"coilTemp\",\"value\":42}",
+             iterations, true);
+}
+
+// A switch of system type: parse, response, then the status, event and
+// RPM broadcasts, every document in the caller's JSON arena
+static void benchCommandRun(uint32_t iterations) {
+    static const char *const FRAMES[] = {
+        "{\"type\":\"command\",\"commandId\":10,\"cmd\":\"run\",\"systemType\":\"thermoking\"}",
+        "{\"type\":\"command\",\"commandId\":11,\"cmd\":\"run\",\"systemType\":\"carrier\"}",
+    };
+    for (uint32_t i = 0; i < iterations; i++) {
+        runFrame(FRAMES[i & 1], 1, true);
+    }
+}
+
+static void benchCommandUnknown(uint32_t iterations) {
+    runFrame("{\"type\":\"command\",\"commandId\":9,\"cmd\":\"nope\"}", iterations, false);
+}
+
+static const BenchCase CASES[] = {
+    {"calculateSafeFrequency", benchSafeFrequency},
+    {"updatePwmSignals", benchUpdatePwm},
+    {"mapTemperatureToPot", benchMapTemperature},
+    {"mapPressureToPot", benchMapPressure},
+    {"reeferModelStep", benchReeferStep},
+    {"potStreamTick", benchPotStreamTick},
+    {"serializeStatus", benchSerializeStatus},
+    {"serializeHttpStatus", benchSerializeHttpStatus},
+    {"notifyClients", benchNotifyClients},
+    {"sendSystemStatus", benchSendSystemStatus},
+    {"command_getState", benchCommandGetState},
+    {"command_updateSensor", benchCommandUpdateSensor},
+    {"command_run", benchCommandRun},
+    {"command_unknown", benchCommandUnknown},
+};
+
+size_t benchRun(BenchResult *results, size_t max, const char *filter) {
+    size_t count = 0;
+    for (const BenchCase &benchCase : CASES) {
+        if (count >= max) {
+            break;
+        }
+        if (filter && !strstr(benchCase.name, filter)) {
+            continue;
+        }
+
+        // Doubling up to one sample's worth also warms caches and lazy state
+        uint32_t iterations = 1;
+        double cycles;
+        while (timeCase(benchCase.run, iterations, cycles) < BENCH_SAMPLE_US * 1000.0 && iterations < (1u << 30)) {
+            iterations *= 2;
+        }
+
+        double nsPerOp[BENCH_SAMPLES];
+        double cyclesPerOp[BENCH_SAMPLES];
+        allocGuardArm();
+        for (int sample = 0; sample < BENCH_SAMPLES; sample++) {
+            nsPerOp[sample] = timeCase(benchCase.run, iterations, cycles) / iterations;
+            cyclesPerOp[sample] = cycles / iterations;
+        }
+        allocGuardDisarm();
+
+        BenchResult &result = results[count++];
+        result.name = benchCase.name;
+        result.nsPerOp = *std::min_element(nsPerOp, nsPerOp + BENCH_SAMPLES);
+        result.cyclesPerOp = *std::min_element(cyclesPerOp, cyclesPerOp + BENCH_SAMPLES);
+        result.allocsPerOp = (double)allocGuardCount() / ((double)iterations * BENCH_SAMPLES);
+        result.iterations = iterations;
+    }
+    return count;
+}
+
+static const size_t CASE_COUNT = sizeof(CASES) / sizeof(CASES[0]);
+static_assert(CASE_COUNT <= BENCH_CASE_MAX, "raise BENCH_CASE_MAX");
+
+#if !HAL_NATIVE
+
+static size_t caseIndex(const char *name) {
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        if (strcmp(CASES[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return CASE_COUNT;
+}
+
+// ns/op this board measured on its first full run, in CASES order, for the
+// rows bench_baseline.h has no device number for. Kept in NVS so later
+// boots, and later firmware, are held to it; dropped when the cases change.
+static float boardNs[BENCH_CASE_MAX];
+static bool boardRecorded = false;
+
+static void loadBoardBaseline() {
+    Preferences prefs;
+    if (prefs.begin("bench", true)) {
+        boardRecorded = prefs.getUChar("cases", 0) == CASE_COUNT &&
+                        prefs.getBytes("ns", boardNs, CASE_COUNT * sizeof(float)) == CASE_COUNT * sizeof(float);
+        prefs.end();
+    }
+}
+
+static void storeBoardBaseline(const BenchResult *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        size_t index = caseIndex(results[i].name);
+        if (index < CASE_COUNT) {
+            boardNs[index] = results[i].nsPerOp;
+        }
+    }
+    Preferences prefs;
+    if (!prefs.begin("bench", false)) {
+        return;
+    }
+    prefs.putBytes("ns", boardNs, CASE_COUNT * sizeof(float));
+    prefs.putUChar("cases", CASE_COUNT);
+    prefs.end();
+    boardRecorded = true;
+    BENCH_PRINTF("RESULT bench_baseline target=" BENCH_TARGET " cases=%u stored=nvs\n", (unsigned)count);
+}
+
+#endif // !HAL_NATIVE
+
+// Stored ns/op for a case, 0 when this target has none
+static float baselineNs(const BenchBaseline *baseline, const char *name) {
+    if (baseline && baseline->nsPerOp > 0) {
+        return baseline->nsPerOp;
+    }
+#if !HAL_NATIVE
+    size_t index = caseIndex(name);
+    if (boardRecorded && index < CASE_COUNT) {
+        return boardNs[index];
+    }
+#endif
+    return 0;
+}
+
+static const BenchBaseline *findBaseline(const char *name) {
+    for (const BenchBaseline &baseline : BENCH_BASELINE) {
+        if (strcmp(baseline.name, name) == 0) {
+            return &baseline;
+        }
+    }
+    return nullptr;
+}
+
+int benchCheck(const BenchResult *results, size_t count, float thresholdPercent) {
+    int regressions = 0;
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult &result = results[i];
+        const BenchBaseline *baseline = findBaseline(result.name);
+        float storedNs = baselineNs(baseline, result.name);
+        const char *status = "no_baseline";
+        double change = 0;
+        if (baseline) {
+            // Allocation counts do not jitter, so any increase counts
+            bool regressed = result.allocsPerOp > baseline->allocsPerOp + 0.001;
+            if (storedNs > 0) {
+                change = (result.nsPerOp / storedNs - 1.0) * 100.0;
+                regressed |= change > thresholdPercent;
+            }
+            status = regressed ? "REGRESSED" : "ok";
+            regressions += regressed;
+        }
+        BENCH_PRINTF("RESULT bench target=" BENCH_TARGET " case=%s ns_per_op=%.1f cycles_per_op=%.1f "
+                     "allocs_per_op=%.3f iterations=%u baseline_ns=%.1f baseline_allocs=%.3f change_pct=%.1f "
+                     "status=%s\n",
+                     result.name, result.nsPerOp, result.cyclesPerOp, result.allocsPerOp, result.iterations,
+                     storedNs, baseline ? baseline->allocsPerOp : 0.0, change, status);
+    }
+    BENCH_PRINTF("RESULT bench_summary target=" BENCH_TARGET " cases=%u regressions=%d threshold_pct=%.0f %s\n",
+                 (unsigned)count, regressions, thresholdPercent, regressions ? "FAIL" : "PASS");
+    return regressions;
+}
+
+void benchPrintBaseline(const BenchResult *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        BENCH_PRINTF("    {\"%s\", %.1ff, %.3ff},\n", results[i].name, results[i].nsPerOp, results[i].allocsPerOp);
+    }
+}
+
+int benchRunSuite(const char *filter, float thresholdPercent, bool printBaseline) {
+    // The cases drive the real outputs and the command path; keep them out
+    // of the recorder and put the state back afterwards
+    SystemState saved = state;
+    bool recording = recorderActive();
+    recorderStop();
+
+    static BenchResult results[BENCH_CASE_MAX];
+    size_t count = benchRun(results, BENCH_CASE_MAX, filter);
+
+    state = saved;
+    updatePwmSignals();
+    setSensorValue("coilTemp", saved.coilTemp);
+    if (recording) {
+        recorderBegin();
+    }
+
+#if !HAL_NATIVE
+    loadBoardBaseline();
+#endif
+    int regressions = benchCheck(results, count, thresholdPercent);
+    if (printBaseline) {
+        benchPrintBaseline(results, count);
+    }
+#if !HAL_NATIVE
+    // The first full run records the board's numbers; printing the
+    // baseline also refreshes them
+    if (!filter && (!boardRecorded || printBaseline)) {
+        storeBoardBaseline(results, count);
+    }
+#endif
+    return regressions;
+}
+
+#endif // BENCH_ENABLED
@@ -0,0 +1,50 @@
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:bench. Boots the control core against the fakes
+// with trace recording off and runs the micro-benchmark suite (bench.cpp).
+// Exits 1 when a case regressed against bench_baseline.h.
+//
+//   pio run -e bench && .pio/build/bench/program
+//   .pio/build/bench/program --threshold 30 --filter command
+//   .pio/build/bench/program --print-baseline    rows for bench_baseline.h
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "ckp_functions.h"
+#include "commands.h"
+#include "input.h"
+
+int main(int argc, char **argv) {
+    const char *filter = nullptr;
+    float threshold = BENCH_THRESHOLD_PERCENT;
+    bool printBaseline = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--print-baseline") == 0) {
+            printBaseline = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            Serial.enabled = true;
+        } else {
+            fprintf(stderr, "usage: program [--filter name] [--threshold percent] [--print-baseline] [-v]\n");
+            return 2;
+        }
+    }
+
+    halFakeReset();
+    halFakeRecord(false);
+    hal.pots->begin();
+    setupCKP();
+    inputBegin();
+    commandsBegin();
+
+    return benchRunSuite(filter, threshold, printBaseline) ? 1 : 0;
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,157 @@
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:buttons. Replays recorded button edge traces,
+// contact bounce included, through the fake GPIO and clock into the
+// debouncers and handleButtonEvent(), with the debounce timer serviced at
+// each deadline as the device timer would. Every debounced event is logged
+// with the system state it left behind and compared to the expected log.
+// Exits 1 when a trace produced anything else.
+//
+//   pio run -e buttons && .pio/build/buttons/program [-v]
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "commands.h"
+#include "input.h"
+
+extern SystemState state;
+
+#define TRACE_MAX_EDGES     12
+
+typedef struct {
+    uint32_t atUs;          // from the start of the trace
+    ButtonId button;
+    bool pressed;
+} TraceEdge;
+
+typedef struct {
+    const char *name;
+    bool running;           // carrier running before the first edge
+    uint32_t endUs;
+    TraceEdge edges[TRACE_MAX_EDGES];   // unused edges have atUs 0
+    const char *expected;
+} ButtonTrace;
+
+// Edge times as captured on the bench, contact bounce left in
+static const ButtonTrace TRACES[] = {
+    {"auto_run_bounce", false, 500000,
+     {{0, BUTTON_AUTO_RUN, true}, {400, BUTTON_AUTO_RUN, false}, {900, BUTTON_AUTO_RUN, true},
+      {2500, BUTTON_AUTO_RUN, false}, {3100, BUTTON_AUTO_RUN, true},
+      {300000, BUTTON_AUTO_RUN, false}, {300600, BUTTON_AUTO_RUN, true}, {301500, BUTTON_AUTO_RUN, false}},
+     "AUTO_RUN PRESS@0 run=1 auto=1 hall=1450; AUTO_RUN RELEASE@300000 run=1 auto=1 hall=1450"},
+
+    {"rpm_held", true, 1700000,
+     {{0, BUTTON_RPM_INC, true}, {300, BUTTON_RPM_INC, false}, {800, BUTTON_RPM_INC, true},
+      {1500000, BUTTON_RPM_INC, false}, {1500500, BUTTON_RPM_INC, true}, {1501200, BUTTON_RPM_INC, false}},
+     "RPM_INC PRESS@0 run=1 auto=0 hall=1800; RPM_INC HOLD@0 run=1 auto=0 hall=1800; "
+     "RPM_INC RELEASE@1500000 run=1 auto=0 hall=1450"},
+
+    {"rpm_short_of_hold", true, 1200000,
+     {{0, BUTTON_RPM_INC, true}, {999000, BUTTON_RPM_INC, false}},
+     "RPM_INC PRESS@0 run=1 auto=0 hall=1800; RPM_INC RELEASE@999000 run=1 auto=0 hall=1450"},
+
+    {"stop_double", true, 400000,
+     {{0, BUTTON_STOP, true}, {200, BUTTON_STOP, false}, {600, BUTTON_STOP, true},
+      {80000, BUTTON_STOP, false}, {80300, BUTTON_STOP, true}, {80900, BUTTON_STOP, false},
+      {150000, BUTTON_STOP, true}, {150400, BUTTON_STOP, false}, {151000, BUTTON_STOP, true},
+      {230000, BUTTON_STOP, false}},
+     "STOP PRESS@0 run=0 auto=0 hall=0; STOP RELEASE@80000 run=0 auto=0 hall=0; "
+     "STOP PRESS@150000 run=0 auto=0 hall=0; STOP RELEASE@230000 run=0 auto=0 hall=0"},
+
+    // Released inside the lockout: the release is seen when it runs out
+    {"stop_glitch", true, 200000,
+     {{0, BUTTON_STOP, true}, {20000, BUTTON_STOP, false}},
+     "STOP PRESS@0 run=0 auto=0 hall=0; STOP RELEASE@50000 run=0 auto=0 hall=0"},
+};
+
+static const size_t TRACE_COUNT = sizeof(TRACES) / sizeof(TRACES[0]);
+
+static const char *const EVENT_NAMES[] = {"PRESS", "RELEASE", "HOLD"};
+
+static void drainButtons(int64_t start, std::string &log) {
+    ButtonEvent event;
+    while (inputWaitEvent(event, 0)) {
+        handleButtonEvent(event);
+
+        char line[96];
+        snprintf(line, sizeof(line), "%s%s %s@%lld run=%d auto=%d hall=%.0f", log.empty() ? "" : "; ",
+                 inputButtonName(event.button), EVENT_NAMES[event.type], (long long)(event.edgeMicros - start),
+                 state.systemRunning, state.autoRunEnabled, state.hallRpm);
+        log += line;
+    }
+}
+
+// The debounce timer fires at every deadline up to until
+static void serviceUntil(int64_t until, int64_t start, std::string &log) {
+    for (int64_t deadline = inputNextDeadline(); deadline >= 0 && deadline <= until;
+         deadline = inputNextDeadline()) {
+        fakeClock.now = deadline;
+        inputServiceTimer(deadline);
+        drainButtons(start, log);
+    }
+    fakeClock.now = until;
+}
+
+static std::string replay(const ButtonTrace &trace) {
+    halFakeReset();
+    commandsBegin();
+    setupCKP();
+    setupSensors();
+    inputBegin();
+    state.autoRunEnabled = false;
+    if (trace.running) {
+        startSystem(SYSTEM_CARRIER);
+    }
+
+    // Well clear of boot so no lockout is left over
+    int64_t start = fakeClock.micros() + 1000000;
+    std::string log;
+    serviceUntil(start, start, log);
+
+    for (size_t i = 0; i < TRACE_MAX_EDGES; i++) {
+        const TraceEdge &edge = trace.edges[i];
+        if (i > 0 && edge.atUs == 0) {
+            break;
+        }
+        serviceUntil(start + edge.atUs, start, log);
+        fakeGpio.levels[inputButtonPin(edge.button)] = edge.pressed ? LOW : HIGH;
+        inputInjectEdge(edge.button, fakeClock.micros());
+        drainButtons(start, log);
+    }
+    serviceUntil(start + trace.endUs, start, log);
+    return log;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            Serial.enabled = true;
+        } else {
+            fprintf(stderr, "usage: program [-v]\n");
+            return 2;
+        }
+    }
+    halFakeRecord(false);
+
+    int failures = 0;
+    for (size_t i = 0; i < TRACE_COUNT; i++) {
+        std::string log = replay(TRACES[i]);
+        bool ok = log == TRACES[i].expected;
+        failures += !ok;
+        printf("RESULT buttons trace=%s status=%s\n", TRACES[i].name, ok ? "ok" : "MISMATCH");
+        if (!ok) {
+            printf("  expected: %s\n  got:      %s\n", TRACES[i].expected, log.c_str());
+        }
+    }
+    printf("RESULT buttons_summary traces=%u failures=%d %s\n", (unsigned)TRACE_COUNT, failures,
+           failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
+
+#endif // HAL_NATIVE
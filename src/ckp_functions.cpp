@@ -2,37 +2,34 @@
 #include "hardware_config.h"
 #include <Arduino.h>
 #include <string.h>
-#include "driver/mcpwm.h"
-#include "web_server.h"
+#include "protocol.h"
+#include "trace.h"
+#include "metrics.h"
+#include "latency.h"
+#include "output_frame.h"
 #include <math.h>
 
 // Define the global state variable
 SystemState state;
 void (*notificationCallback)(void) = nullptr;
 
-// Track previous state to detect changes
-static bool lastSystemRunning = false;
-static float lastIndRpm = 0.0f;
-static float lastHallRpm = 0.0f;
-static char lastSystemType[20] = "";
-
 void setupCKP() {
     // Configure GPIO pins with explicit pull-up resistors
-    pinMode(IND_1_PIN, OUTPUT); // Thermo King & apu output signal 1
-    pinMode(IND_2_PIN, OUTPUT); // Thermo King & apu output signal 2
-    pinMode(HALL_PIN, OUTPUT);  // Carrier output signal
-    pinMode(LED_PIN, OUTPUT);
+    hal.gpio->mode(IND_1_PIN, OUTPUT); // Thermo King & apu output signal 1
+    hal.gpio->mode(IND_2_PIN, OUTPUT); // Thermo King & apu output signal 2
+    hal.gpio->mode(HALL_PIN, OUTPUT);  // Carrier output signal
+    hal.gpio->mode(LED_PIN, OUTPUT);
 
     // Use explicit pull-up configuration for input pins
-    pinMode(RPM_INC_PIN, INPUT_PULLUP);
-    pinMode(AUTOMATIC_RUN_PIN, INPUT_PULLUP);
-    pinMode(STOP_PIN, INPUT_PULLUP);
+    hal.gpio->mode(RPM_INC_PIN, INPUT_PULLUP);
+    hal.gpio->mode(AUTOMATIC_RUN_PIN, INPUT_PULLUP);
+    hal.gpio->mode(STOP_PIN, INPUT_PULLUP);
 
     // Initialize all outputs to LOW (idle state)
-    digitalWrite(IND_1_PIN, LOW);
-    digitalWrite(IND_2_PIN, LOW);
-    digitalWrite(HALL_PIN, LOW);
-    digitalWrite(LED_PIN, LOW);
+    hal.gpio->write(IND_1_PIN, LOW);
+    hal.gpio->write(IND_2_PIN, LOW);
+    hal.gpio->write(HALL_PIN, LOW);
+    hal.gpio->write(LED_PIN, LOW);
 
     // Initialize system state
     state.systemRunning = false;
@@ -45,56 +42,32 @@ void setupCKP() {
     strcpy(state.systemType, SYSTEM_CARRIER);
     Serial.println("Default system type set to Carrier");
 
-    // Initialize MCPWM for Thermo King (IND pins)
-    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0A, IND_1_PIN);
-    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0B, IND_2_PIN);
-
-    // Initialize MCPWM for Carrier (HALL pin)
-    mcpwm_gpio_init(MCPWM_UNIT_1, MCPWM0A, HALL_PIN);
-
-    mcpwm_config_t pwm_config;
-    pwm_config.frequency = 205;
-    pwm_config.cmpr_a = 50.0;
-    pwm_config.cmpr_b = 50.0;
-    pwm_config.counter_mode = MCPWM_UP_COUNTER;
-    pwm_config.duty_mode = MCPWM_DUTY_MODE_0;
-
-    // Initialize both MCPWM units with the same configuration
-    mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &pwm_config); // Thermo King & apu
-    mcpwm_init(MCPWM_UNIT_1, MCPWM_TIMER_0, &pwm_config); // Carrier
-
-    // Initially stop both PWM outputs
-    mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0); // Thermo King & apu
-    mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0); // Carrier
-
-    // Set initial duty cycle to 0
-    mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 0); // Thermo King & apu signal 1
-    mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_B, 0); // Thermo King & apu signal 2
-    mcpwm_set_duty(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 0); // Carrier signal
+    // Both generators configured and left stopped
+    hal.pwm->begin();
+    metricsNotePwm(PWM_THERMO_KING, 0.0f);
+    metricsNotePwm(PWM_CARRIER, 0.0f);
 
     Serial.println(F("CKP system setup complete"));
 }
 
 // Helper functions for PWM signal management - renamed to avoid conflicts
 void ckp_stopAllOutputs() {
-    mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0); // Thermo King & APU
-    mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0); // Carrier
-    
-    // Set all output pins to LOW
-    digitalWrite(IND_1_PIN, LOW);
-    digitalWrite(IND_2_PIN, LOW);
-    digitalWrite(HALL_PIN, LOW);
+    // Stops both generators and sets all output pins to LOW
+    hal.pwm->stop(PWM_THERMO_KING); // Thermo King & APU
+    hal.pwm->stop(PWM_CARRIER);     // Carrier
+    metricsNotePwm(PWM_THERMO_KING, 0.0f);
+    metricsNotePwm(PWM_CARRIER, 0.0f);
+    latencyMark(LAT_STAGE_OUTPUT);
 }
 
 void ckp_stopThermoKingOutputs() {
-    mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0);
-    digitalWrite(IND_1_PIN, LOW);
-    digitalWrite(IND_2_PIN, LOW);
+    hal.pwm->stop(PWM_THERMO_KING);
+    metricsNotePwm(PWM_THERMO_KING, 0.0f);
 }
 
 void ckp_stopCarrierOutputs() {
-    mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
-    digitalWrite(HALL_PIN, LOW);
+    hal.pwm->stop(PWM_CARRIER);
+    metricsNotePwm(PWM_CARRIER, 0.0f);
 }
 
 float calculateSafeFrequency(float rpm) {
@@ -110,10 +83,9 @@ void startThermoKingOutputs(float frequency) {
         return;
     }
     
-    mcpwm_set_frequency(MCPWM_UNIT_0, MCPWM_TIMER_0, frequency);
-    mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 50);
-    mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_B, 50);
-    mcpwm_start(MCPWM_UNIT_0, MCPWM_TIMER_0);
+    metricsNotePwm(PWM_THERMO_KING, frequency);
+    hal.pwm->start(PWM_THERMO_KING, frequency);
+    latencyMark(LAT_STAGE_OUTPUT);
 }
 
 void startCarrierOutputs(float frequency) {
@@ -122,71 +94,91 @@ void startCarrierOutputs(float frequency) {
         return;
     }
     
-    mcpwm_set_frequency(MCPWM_UNIT_1, MCPWM_TIMER_0, frequency);
-    mcpwm_set_duty(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 50);
-    mcpwm_start(MCPWM_UNIT_1, MCPWM_TIMER_0);
+    metricsNotePwm(PWM_CARRIER, frequency);
+    hal.pwm->start(PWM_CARRIER, frequency);
+    latencyMark(LAT_STAGE_OUTPUT);
 }
 
-void updatePwmSignals() {
+// Generator frequencies for the current state, 0 = stopped
+static void pwmTargets(float frequency[PWM_CHANNEL_COUNT]) {
+    frequency[PWM_THERMO_KING] = 0.0f;
+    frequency[PWM_CARRIER] = 0.0f;
+
     // Safety check - stop all signals if system is not running
     if (!state.systemRunning) {
-        ckp_stopAllOutputs();
         return;
     }
 
-    // Calculate frequencies based on RPM values
-    float thermokingFreq = calculateSafeFrequency(state.indRpm);
-    float carrierFreq = calculateSafeFrequency(state.hallRpm);
-
     // Handle different system types
     if (strcmp(state.systemType, SYSTEM_CARRIER) == 0) {
         // Carrier only - HALL signal
-        ckp_stopThermoKingOutputs();
-        startCarrierOutputs(carrierFreq);
+        frequency[PWM_CARRIER] = calculateSafeFrequency(state.hallRpm);
     }
     else if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0) {
         // Thermo King only - IND signals
-        ckp_stopCarrierOutputs();
-        startThermoKingOutputs(thermokingFreq);
+        frequency[PWM_THERMO_KING] = calculateSafeFrequency(state.indRpm);
     }
     else if (strcmp(state.systemType, SYSTEM_APU) == 0) {
         // APU - Only Thermo King signal at fixed 2200 RPM
         // Force indRpm to be 2200 for APU type
-        if (state.indRpm != RPM_2200) {
-            state.indRpm = RPM_2200;
-            thermokingFreq = calculateSafeFrequency(state.indRpm);
-        }
-        
-        ckp_stopCarrierOutputs();
-        startThermoKingOutputs(thermokingFreq);
+        state.indRpm = RPM_2200;
+        frequency[PWM_THERMO_KING] = calculateSafeFrequency(state.indRpm);
     }
     else if (strcmp(state.systemType, SYSTEM_CONTAINER) == 0) {
         // Container - no signals needed
-        ckp_stopAllOutputs();
     }
     else {
         // Default case - treat as Carrier if system type is unknown
         Serial.println("Unknown system type, defaulting to Carrier");
+        frequency[PWM_CARRIER] = calculateSafeFrequency(state.hallRpm);
+    }
+}
+
+void updatePwmSignals() {
+    TRACE_SCOPE(TRACE_EVT_UPDATE_PWM, state.systemRunning);
+
+    float frequency[PWM_CHANNEL_COUNT];
+    pwmTargets(frequency);
+
+    if (frequency[PWM_THERMO_KING] <= 0 && frequency[PWM_CARRIER] <= 0) {
+        ckp_stopAllOutputs();
+        return;
+    }
+    // Stop the unused generator before starting the other
+    if (frequency[PWM_THERMO_KING] <= 0) {
         ckp_stopThermoKingOutputs();
-        startCarrierOutputs(carrierFreq);
+        startCarrierOutputs(frequency[PWM_CARRIER]);
+    } else {
+        ckp_stopCarrierOutputs();
+        startThermoKingOutputs(frequency[PWM_THERMO_KING]);
     }
 }
 
-void startSystem(const char *systemType, unsigned long commandId) {
+void stagePwmSignals(OutputFrame &frame) {
+    float frequency[PWM_CHANNEL_COUNT];
+    pwmTargets(frequency);
+    outputFramePwm(frame, PWM_THERMO_KING, frequency[PWM_THERMO_KING]);
+    outputFramePwm(frame, PWM_CARRIER, frequency[PWM_CARRIER]);
+}
+
+void startSystem(const char *systemType, CommandId commandId, ClientId client) {
+    TRACE_SCOPE(TRACE_EVT_START_SYSTEM, (uint32_t)commandId);
+
     Serial.printf("Starting system with type: %s\n", systemType);
     
-    // Apply system preset
-    handleSystemPresetChange(systemType);
-    handleSensorSystemPresetChange(systemType);
+    // Preset sensors and CKP signals go out as one frame
+    OutputFrame frame = {};
+    handleSystemPresetChange(systemType, &frame);
+    handleSensorSystemPresetChange(systemType, &frame.pots);
     
     // Update system state
     state.systemRunning = true;
     
-    // Update PWM signals
-    updatePwmSignals();
+    stagePwmSignals(frame);
+    outputFrameCommit(frame, METRIC_CMD_RUN);
     
     // Send command response first
-    sendCommandResponse(commandId, true);
+    sendCommandResponse(client, commandId, true);
     
     // Then send notifications
     sendRpmChangeNotification();
@@ -194,7 +186,7 @@ void startSystem(const char *systemType, unsigned long commandId) {
     Serial.println("System started successfully");
 }
 
-void stopSystem(unsigned long commandId) {
+void stopSystem(CommandId commandId, ClientId client) {
     Serial.println("Stopping system");
     
     state.systemRunning = false;
@@ -206,7 +198,7 @@ void stopSystem(unsigned long commandId) {
     ckp_stopAllOutputs();  // Changed from stopAllOutputs to ckp_stopAllOutputs
     
     // Send command response first
-    sendCommandResponse(commandId, true);
+    sendCommandResponse(client, commandId, true);
     
     // Then send notifications
     sendRpmChangeNotification();
@@ -214,161 +206,90 @@ void stopSystem(unsigned long commandId) {
     Serial.println("System stopped successfully");
 }
 
-// Helper function for button debouncing
-bool handleButtonWithDebounce(int pin, bool &lastState, unsigned long &lastDebounceTime) {
-    bool currentState = (digitalRead(pin) == LOW); // LOW = pressed
-    unsigned long currentMillis = millis();
-    
-    if (currentState != lastState && (currentMillis - lastDebounceTime > DEBOUNCE_DELAY)) {
-        lastDebounceTime = currentMillis;
-        lastState = currentState;
-        return currentState; // Return true if button is pressed (LOW)
+// Apply the debounced RPM button level to the running system
+static void applyRpmButton(bool pressed) {
+    if (!state.systemRunning) {
+        return;
     }
-    return false; // No change or debounce in progress
-}
 
-void updateRPM() {
-    unsigned long currentMillis = millis();
-    static float lastReportedHallRpm = 0.0f;
-    static float lastReportedIndRpm = 0.0f;
-    static unsigned long lastRpmNotificationTime = 0;
-    const unsigned long RPM_NOTIFICATION_INTERVAL = 200; // ms
-    
-    // Button state tracking variables
-    static bool lastRpmButtonState = false;
-    static unsigned long lastRpmButtonChangeTime = 0;
-    static bool lastAutoRunState = false;
-    static unsigned long lastAutoRunDebounceTime = 0;
-    static bool lastStopState = false;
-    static unsigned long lastStopDebounceTime = 0;
-
-    // Process RPM changes based on current button state
-    bool rpmButtonPressed = (digitalRead(RPM_INC_PIN) == LOW); // LOW = pressed
-
-    // Handle Auto Run toggle switch with debouncing
-    bool autoRunButtonPressed = handleButtonWithDebounce(
-        AUTOMATIC_RUN_PIN, lastAutoRunState, lastAutoRunDebounceTime);
-    
-    if (autoRunButtonPressed) {
-        // Toggle auto run state
-        state.autoRunEnabled = !state.autoRunEnabled;
-        
-        Serial.printf("Auto run toggle switch changed - auto run now %s\n",
-                      state.autoRunEnabled ? "ENABLED" : "DISABLED");
-        
-        if (state.autoRunEnabled) {
-            // Auto run enabled - start system if not already running
-            if (!state.systemRunning) {
-                startSystem(state.systemType, 0);
-                // Explicitly notify clients of state change
-                notifyClients(nullptr);
-            }
-        }
+    float indRpm;
+    float hallRpm;
+
+    if (strcmp(state.systemType, SYSTEM_CARRIER) == 0) {
+        indRpm = 0.0f;
+        hallRpm = pressed ? RPM_1800 : RPM_1450;
+    } else if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0) {
+        indRpm = pressed ? RPM_2200 : RPM_1450;
+        hallRpm = 0.0f;
+    } else {
+        // APU is fixed at 2200 RPM and Container has no CKP signal
+        return;
     }
-    
-    // Handle Stop button with debouncing
-    bool stopButtonPressed = handleButtonWithDebounce(
-        STOP_PIN, lastStopState, lastStopDebounceTime);
-    
-    if (stopButtonPressed) {
-        if (state.systemRunning) {
-            stopSystem(0);
-            // Explicitly notify clients of state change
-            notifyClients(nullptr);
-        }
+
+    if (indRpm == state.indRpm && hallRpm == state.hallRpm) {
+        return;
     }
-    
-    // Process RPM changes based on current button state, not just transitions
-    if (state.systemRunning) {
-        // Special handling for APU - always force to 2200 RPM
-        if (strcmp(state.systemType, SYSTEM_APU) == 0) {
-            // For APU, always ensure RPM is 2200
-            state.indRpm = RPM_2200;
-            state.hallRpm = 0.0f;
-            updatePwmSignals(); // Make sure to update signals
-            return;             // Exit early for APU
-        }
-        
-                // For non-APU systems, set RPM based on button state
-                if (strcmp(state.systemType, SYSTEM_APU) != 0) {
-                    if (rpmButtonPressed) {
-                        // Button is currently pressed - use high RPM
-                        if (strcmp(state.systemType, SYSTEM_CARRIER) == 0) {
-                            if (state.hallRpm != RPM_1800) {
-                                state.indRpm = 0.0f;
-                                state.hallRpm = RPM_1800;
-                                updatePwmSignals();
-                                Serial.printf("Carrier system: Setting HIGH hallRpm=%.1f\n", state.hallRpm);
-                            }
-                        } else if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0) {
-                            if (state.indRpm != RPM_2200) {
-                                state.indRpm = RPM_2200;
-                                state.hallRpm = 0.0f;
-                                updatePwmSignals();
-                                Serial.println("THERMO KING: SETTING HIGH RPM (2200)");
-                            }
-                        }
-                    } else {
-                        // Button released - use low RPM
-                        if (strcmp(state.systemType, SYSTEM_CARRIER) == 0) {
-                            if (state.hallRpm != RPM_1450) {
-                                state.indRpm = 0.0f;
-                                state.hallRpm = RPM_1450;
-                                updatePwmSignals();
-                                Serial.println("CARRIER: SETTING LOW RPM (1450)");
-                            }
-                        } else if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0) {
-                            if (state.indRpm != RPM_1450) {
-                                state.indRpm = RPM_1450;
-                                state.hallRpm = 0.0f;
-                                updatePwmSignals();
-                                Serial.println("THERMO KING: SETTING LOW RPM (1450)");
-                            }
-                        }
-                    }
-                }
-            }
-            
-            // Keep the button state change detection for debugging
-            if (rpmButtonPressed != lastRpmButtonState &&
-                (currentMillis - lastRpmButtonChangeTime > DEBOUNCE_DELAY)) {
-                lastRpmButtonChangeTime = currentMillis;
-                Serial.printf("RPM button state changed to: %s\n",
-                              rpmButtonPressed ? "PRESSED (LOW)" : "RELEASED (HIGH)");
-                lastRpmButtonState = rpmButtonPressed;
-            }
-            
-            // Throttle RPM change notifications
-            if ((state.hallRpm != lastReportedHallRpm || state.indRpm != lastReportedIndRpm) &&
-                (currentMillis - lastRpmNotificationTime >= RPM_NOTIFICATION_INTERVAL)) {
-                
-                Serial.printf("[EVENT] RPM Changed - hallRpm=%.1f, indRpm=%.1f\n",
-                    state.hallRpm, state.indRpm);
-                lastReportedHallRpm = state.hallRpm;
-                lastReportedIndRpm = state.indRpm;
-                lastRpmNotificationTime = currentMillis;
-                
-                // Send notification when RPM values change
-                sendRpmChangeNotification();
-            }
-            
-            // Handle LED blinking for system running state
-            static unsigned long lastLedUpdate = 0;
-            if (currentMillis - lastLedUpdate >= 100) {
-                // Blink when system is running
+
+    state.indRpm = indRpm;
+    state.hallRpm = hallRpm;
+    updatePwmSignals();
+
+    Serial.printf("[EVENT] RPM Changed - hallRpm=%.1f, indRpm=%.1f\n", state.hallRpm, state.indRpm);
+    sendRpmChangeNotification();
+}
+
+// Single owner of the physical buttons - called from buttonTask
+void handleButtonEvent(const ButtonEvent &event) {
+    static const char *const TYPE_NAMES[] = {"PRESSED", "RELEASED", "HELD"};
+    Serial.printf("Button %s %s\n", inputButtonName(event.button), TYPE_NAMES[event.type]);
+
+    // No hold actions are assigned yet
+    if (event.type == BUTTON_HOLD) {
+        return;
+    }
+
+    latencyArrival(event.edgeMicros);
+
+    switch (event.button) {
+        case BUTTON_RPM_INC:
+            // Held = high RPM, released = low RPM
+            latencyDispatch(LAT_SRC_BTN_RPM_INC);
+            applyRpmButton(event.type == BUTTON_PRESS);
+            break;
+
+        case BUTTON_STOP:
+            if (event.type == BUTTON_PRESS) {
+                latencyDispatch(LAT_SRC_BTN_STOP);
                 if (state.systemRunning) {
-                    // Toggle LED every 100ms when system is running
-                    state.ledState = !state.ledState;
-                    digitalWrite(LED_PIN, state.ledState);
+                    stopSystem(0);
+                    notifyClients(nullptr);
                 }
-                else if (!state.systemRunning && state.ledState) {
-                    // Turn off LED if system isn't running
-                    state.ledState = false;
-                    digitalWrite(LED_PIN, LOW);
+            }
+            break;
+
+        case BUTTON_AUTO_RUN:
+            // Each press toggles auto run; enabling it starts the system
+            if (event.type == BUTTON_PRESS) {
+                latencyDispatch(LAT_SRC_BTN_AUTO_RUN);
+                state.autoRunEnabled = !state.autoRunEnabled;
+
+                Serial.printf("Auto run now %s\n", state.autoRunEnabled ? "ENABLED" : "DISABLED");
+
+                if (state.autoRunEnabled && !state.systemRunning) {
+                    startSystem(state.systemType, 0);
+                    // Pick up the RPM button if it is already held
+                    applyRpmButton(inputIsPressed(BUTTON_RPM_INC));
                 }
-                lastLedUpdate = currentMillis;
+                notifyClients(nullptr);
             }
-        }
+            break;
+
+        default:
+            break;
+    }
+
+    latencyFinish();
+}
         
         void setSystemType(const char *type) {
             // Validate system type
@@ -392,7 +313,7 @@ void updateRPM() {
             }
         }
         
-        void handleSystemPresetChange(const char* systemType) {
+        void handleSystemPresetChange(const char* systemType, OutputFrame *frame) {
             // First, update the system type
             setSystemType(systemType);
             
@@ -432,7 +353,11 @@ void updateRPM() {
             
             // If system is running, update the PWM signals
             if (state.systemRunning) {
-                updatePwmSignals();
+                if (frame) {
+                    stagePwmSignals(*frame);
+                } else {
+                    updatePwmSignals();
+                }
             }
             
             Serial.printf("Applied preset values for: %s\n", systemType);
@@ -0,0 +1,107 @@
+#include "command_cache.h"
+#include "metrics.h"
+#include <string.h>
+
+typedef struct {
+    CommandId commandId;   // 0 = empty
+    uint32_t lastUse;
+    uint16_t length;       // 0 = reserved, response not stored yet
+    char text[COMMAND_CACHE_TEXT_MAX];
+} CachedResult;
+
+typedef struct {
+    uint32_t clientId;     // 0 = free (AsyncWebSocket ids start at 1)
+    uint32_t lastUse;
+    CachedResult entries[COMMAND_CACHE_ENTRIES];
+} ClientCache;
+
+static ClientCache caches[COMMAND_CACHE_CLIENTS];
+static uint32_t useClock = 0;
+
+static ClientCache *findClient(uint32_t clientId) {
+    for (ClientCache &cache : caches) {
+        if (cache.clientId == clientId) {
+            return &cache;
+        }
+    }
+    return nullptr;
+}
+
+// Free slot if there is one, otherwise the client idle the longest
+static ClientCache *claimClient(uint32_t clientId) {
+    ClientCache *victim = &caches[0];
+    for (ClientCache &cache : caches) {
+        if (cache.clientId == 0) {
+            victim = &cache;
+            break;
+        }
+        if (cache.lastUse < victim->lastUse) {
+            victim = &cache;
+        }
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->clientId = clientId;
+    return victim;
+}
+
+static CachedResult *findEntry(ClientCache &cache, CommandId commandId) {
+    for (CachedResult &entry : cache.entries) {
+        if (entry.commandId == commandId) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool commandCacheLookup(uint32_t clientId, CommandId commandId, const char *&text, size_t &length) {
+    ClientCache *cache = findClient(clientId);
+    if (!cache) {
+        cache = claimClient(clientId);
+    }
+    cache->lastUse = ++useClock;
+
+    CachedResult *entry = findEntry(*cache, commandId);
+    if (entry && entry->length > 0) {
+        entry->lastUse = useClock;
+        text = entry->text;
+        length = entry->length;
+        metrics.commandCacheHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    metrics.commandCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    // Reserve the least recently used entry for this command's response
+    if (!entry) {
+        entry = &cache->entries[0];
+        for (CachedResult &candidate : cache->entries) {
+            if (candidate.lastUse < entry->lastUse) {
+                entry = &candidate;
+            }
+        }
+    }
+    entry->commandId = commandId;
+    entry->lastUse = useClock;
+    entry->length = 0;
+    return false;
+}
+
+void commandCacheStore(uint32_t clientId, CommandId commandId, const char *text, size_t length) {
+    ClientCache *cache = findClient(clientId);
+    if (!cache) {
+        return;
+    }
+    CachedResult *entry = findEntry(*cache, commandId);
+    if (!entry || entry->length > 0 || length > sizeof(entry->text)) {
+        return;
+    }
+    memcpy(entry->text, text, length);
+    entry->length = length;
+}
+
+void commandCacheForget(uint32_t clientId) {
+    ClientCache *cache = findClient(clientId);
+    if (cache) {
+        memset(cache, 0, sizeof(*cache));
+    }
+}
@@ -0,0 +1,421 @@
+#include "commands.h"
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "json_alloc.h"
+#include "protocol.h"
+#include "scenario.h"
+#include "reefer.h"
+#include "pot_stream.h"
+#include "output_frame.h"
+#include "schedule.h"
+#include <string.h>
+
+extern SystemState state;
+
+static void handlePreset(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *systemType = args["systemType"] | "";
+    if (strlen(systemType) == 0) {
+        sendCommandResponse(client, commandId, false, "Invalid system type");
+        return;
+    }
+    OutputFrame frame = {};
+    handleSystemPresetChange(systemType, &frame);
+    handleSensorSystemPresetChange(systemType, &frame.pots);
+    outputFrameCommit(frame, METRIC_CMD_PRESET);
+    sendCommandResponse(client, commandId, true);
+}
+
+static void handleRun(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *systemType = args["systemType"] | state.systemType;
+    startSystem(systemType, commandId, client);
+}
+
+static void handleStop(JsonObjectConst args, ClientId client, CommandId commandId) {
+    stopSystem(commandId, client);
+}
+
+// Only the asking client needs the state
+static void handleGetState(JsonObjectConst args, ClientId client, CommandId commandId) {
+    sendSystemStatus(client);
+    sendCommandResponse(client, commandId, true);
+}
+
+static void handleUpdateSensor(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *sensor = args["sensor"];
+    if (!sensor || !args["value"].is<float>()) {
+        sendCommandResponse(client, commandId, false, "Missing sensor or value");
+        return;
+    }
+    bool ok = setSensorValue(sensor, args["value"].as<float>());
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : "Unknown sensor");
+}
+
+static void handleAdjustPot(JsonObjectConst args, ClientId client, CommandId commandId) {
+    bool ok = adjustPot(args["icIndex"] | 0, args["wiper"] | 0, args["value"] | 0);
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : "Invalid IC index");
+}
+
+static void handleResetPots(JsonObjectConst args, ClientId client, CommandId commandId) {
+    resetPots();
+    sendCommandResponse(client, commandId, true);
+}
+
+// {"cmd":"subscribe","topics":["status","rpmUpdate"]} replaces the
+// client's topics; an empty list leaves only command responses
+static void handleSubscribe(JsonObjectConst args, ClientId client, CommandId commandId) {
+    JsonArrayConst topics = args["topics"];
+    if (!client || topics.isNull()) {
+        sendCommandResponse(client, commandId, false, "Missing topics");
+        return;
+    }
+
+    uint8_t mask = 0;
+    for (JsonVariantConst name : topics) {
+        WsTopic topic;
+        if (!name.is<const char *>() || !wsTopicFromName(name.as<const char *>(), topic)) {
+            sendCommandResponse(client, commandId, false, "Unknown topic");
+            return;
+        }
+        mask |= WS_TOPIC_BIT(topic);
+    }
+    hal.transport->subscribe(client, mask);
+
+    // Status subscribers start from the current state, not the next change
+    if (mask & WS_TOPIC_BIT(WS_TOPIC_STATUS)) {
+        sendSystemStatus(client);
+    }
+    sendCommandResponse(client, commandId, true);
+}
+
+// {"cmd":"scenario","action":"play","name":"pulldown.txt","loop":true}
+// Actions: play, pause, resume, seek (positionMs), stop, status. Every
+// action answers with the scenario status frame before the response.
+static void handleScenario(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *action = args["action"] | "";
+    bool ok;
+    const char *error = nullptr;
+    if (strcmp(action, "play") == 0) {
+        ok = scenarioPlay(args["name"] | "", args["loop"] | false);
+        error = "Unknown scenario";
+    } else if (strcmp(action, "pause") == 0) {
+        ok = scenarioPause();
+        error = "Not playing";
+    } else if (strcmp(action, "resume") == 0) {
+        ok = scenarioResume();
+        error = "Not paused";
+    } else if (strcmp(action, "seek") == 0) {
+        ok = args["positionMs"].is<uint32_t>() && scenarioSeek(args["positionMs"].as<uint32_t>());
+        error = "Nothing to seek";
+    } else if (strcmp(action, "stop") == 0) {
+        scenarioStop();
+        ok = true;
+    } else if (strcmp(action, "status") == 0) {
+        ok = true;
+    } else {
+        ok = false;
+        error = "Unknown action";
+    }
+
+    if (client) {
+        char status[WS_MESSAGE_MAX];
+        size_t length = serializeScenarioStatus(status, sizeof(status));
+        hal.transport->reply(client, status, length);
+    }
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : error);
+}
+
+// {"cmd":"reeferModel","action":"on"} runs the thermal model from the current
+// readings, "reset" from a warm box, "off" leaves the outputs where they
+// are. Every action answers with the model status frame.
+static void handleReeferModel(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *action = args["action"] | "";
+    bool ok = true;
+    if (strcmp(action, "on") == 0) {
+        reeferStart(false);
+    } else if (strcmp(action, "reset") == 0) {
+        reeferStart(true);
+    } else if (strcmp(action, "off") == 0) {
+        reeferStop();
+    } else if (strcmp(action, "status") != 0) {
+        ok = false;
+    }
+
+    if (client) {
+        char status[WS_MESSAGE_MAX];
+        size_t length = serializeReeferStatus(status, sizeof(status));
+        hal.transport->reply(client, status, length);
+    }
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : "Unknown action");
+}
+
+// {"cmd":"schedule","action":"add","at":<device µs>,"command":{...}} holds
+// a command until then; "cancel" drops the entry with "id", or all of them
+// without one; "list" only reports. Every action answers with the schedule
+// status frame.
+static void handleSchedule(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *action = args["action"] | "";
+    bool ok = true;
+    const char *error = nullptr;
+    uint32_t added = 0;
+    if (strcmp(action, "add") == 0) {
+        JsonObjectConst command = args["command"];
+        if (!args["at"].is<int64_t>() || command.isNull()) {
+            ok = false;
+            error = "Missing at or command";
+        } else if (measureJson(command) > SCHEDULE_COMMAND_MAX) {
+            ok = false;
+            error = "Command too large";
+        } else {
+            char text[SCHEDULE_COMMAND_MAX + 1];
+            size_t length = serializeJson(command, text, sizeof(text));
+            added = scheduleAdd(client, args["at"].as<int64_t>(), text, length, error);
+            ok = added != 0;
+        }
+    } else if (strcmp(action, "cancel") == 0) {
+        if (args["id"].is<uint32_t>()) {
+            ok = scheduleCancel(args["id"].as<uint32_t>());
+            error = "Not scheduled";
+        } else {
+            scheduleCancelAll();
+        }
+    } else if (strcmp(action, "list") != 0) {
+        ok = false;
+        error = "Unknown action";
+    }
+
+    if (client) {
+        char status[WS_MESSAGE_MAX];
+        size_t length = serializeScheduleStatus(status, sizeof(status), added);
+        hal.transport->reply(client, status, length);
+    }
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : error);
+}
+
+// {"cmd":"potStream","sensor":"suctionPressure","waveform":"sine","frequency":25,"amplitude":4}
+// streams a sensor; "waveform":"off" stops it, or every stream without a
+// sensor. Every call answers with the stream status frame.
+static void handlePotStream(JsonObjectConst args, ClientId client, CommandId commandId) {
+    const char *sensor = args["sensor"];
+    const char *waveformName = args["waveform"] | "";
+    bool ok = true;
+    const char *error = nullptr;
+    PotWaveform waveform;
+    if (strcmp(waveformName, "off") == 0) {
+        if (sensor) {
+            ok = potStreamStop(sensor);
+            error = "Not streamed";
+        } else {
+            potStreamStopAll();
+        }
+    } else if (sensor) {
+        if (!potWaveformFromName(waveformName, waveform)) {
+            ok = false;
+            error = "Unknown waveform";
+        } else {
+            ok = potStreamStart(sensor, waveform, args["frequency"] | 0.0f, args["amplitude"] | 0.0f);
+            error = "Unknown sensor, bad frequency or no free channel";
+        }
+    }
+
+    if (client) {
+        char status[WS_MESSAGE_MAX];
+        size_t length = serializePotStreamStatus(status, sizeof(status));
+        hal.transport->reply(client, status, length);
+    }
+    sendCommandResponse(client, commandId, ok, ok ? nullptr : error);
+}
+
+// Operations accepted inside a batch. Every op is validated before any is
+// applied, so a batch lands completely or not at all. Pot writes and the
+// MCPWM change are staged and committed as one output frame at the end.
+typedef struct {
+    OutputFrame frame;
+    bool outputsChanged;
+} BatchContext;
+
+typedef struct {
+    const char *name;
+    const char *(*validate)(JsonObjectConst op); // nullptr when valid
+    void (*apply)(JsonObjectConst op, BatchContext &batch);
+} BatchOp;
+
+static const char *validateSensor(JsonObjectConst op) {
+    const char *sensor = op["sensor"];
+    if (!sensor || !op["value"].is<float>()) {
+        return "Missing sensor or value";
+    }
+    return sensorExists(sensor) ? nullptr : "Unknown sensor";
+}
+
+static void applySensor(JsonObjectConst op, BatchContext &batch) {
+    setSensorValue(op["sensor"], op["value"].as<float>(), &batch.frame.pots);
+}
+
+static const char *validatePot(JsonObjectConst op) {
+    uint8_t icIndex = op["icIndex"] | 0;
+    return (icIndex >= 1 && icIndex <= POT_IC_COUNT) ? nullptr : "Invalid IC index";
+}
+
+static void applyPot(JsonObjectConst op, BatchContext &batch) {
+    adjustPot(op["icIndex"] | 0, op["wiper"] | 0, op["value"] | 0, &batch.frame.pots);
+}
+
+static const char *validateResetPots(JsonObjectConst op) {
+    return nullptr;
+}
+
+static void applyResetPots(JsonObjectConst op, BatchContext &batch) {
+    resetPots(&batch.frame.pots);
+}
+
+static const char *validateRpmMode(JsonObjectConst op) {
+    const char *mode = op["mode"] | "";
+    if (strcmp(mode, "high") != 0 && strcmp(mode, "low") != 0) {
+        return "Mode must be high or low";
+    }
+    if (!state.systemRunning || strcmp(state.systemType, SYSTEM_CONTAINER) == 0) {
+        return "RPM mode not applicable";
+    }
+    return nullptr;
+}
+
+static void applyRpmMode(JsonObjectConst op, BatchContext &batch) {
+    stageRpmMode(op["mode"]);
+    batch.outputsChanged = true;
+}
+
+static const BatchOp BATCH_OPS[] = {
+    {"updateSensor",  validateSensor,    applySensor},
+    {"adjustMCP4251", validatePot,       applyPot},
+    {"resetPots",     validateResetPots, applyResetPots},
+    {"rpmMode",       validateRpmMode,   applyRpmMode},
+};
+
+static const BatchOp *findBatchOp(const char *name) {
+    for (const BatchOp &op : BATCH_OPS) {
+        if (strcmp(name, op.name) == 0) {
+            return &op;
+        }
+    }
+    return nullptr;
+}
+
+static void handleBatch(JsonObjectConst args, ClientId client, CommandId commandId) {
+    JsonArrayConst ops = args["ops"];
+    size_t count = ops.size();
+    if (count == 0 || count > BATCH_MAX_OPS) {
+        sendCommandResponse(client, commandId, false, "Batch needs 1 to 16 ops");
+        return;
+    }
+
+    const BatchOp *kinds[BATCH_MAX_OPS];
+    const char *results[BATCH_MAX_OPS];
+    bool valid = true;
+    size_t i = 0;
+    for (JsonVariantConst op : ops) {
+        kinds[i] = findBatchOp(op["cmd"] | "");
+        results[i] = kinds[i] ? kinds[i]->validate(op.as<JsonObjectConst>()) : "Unknown op";
+        valid = valid && results[i] == nullptr;
+        i++;
+    }
+
+    if (!valid) {
+        sendBatchResponse(client, commandId, false, results, count);
+        return;
+    }
+
+    BatchContext batch = {};
+    i = 0;
+    for (JsonVariantConst op : ops) {
+        kinds[i++]->apply(op.as<JsonObjectConst>(), batch);
+    }
+
+    if (batch.outputsChanged) {
+        stagePwmSignals(batch.frame);
+    }
+    outputFrameCommit(batch.frame, METRIC_CMD_BATCH);
+    sendBatchResponse(client, commandId, true, results, count);
+}
+
+// Must stay sorted by name (strcmp order); commandsBegin() checks it
+static const CommandEntry COMMANDS[] = {
+    {"adjustMCP4251", handleAdjustPot,    METRIC_CMD_ADJUST_POT,    128,  2, true,  {"icIndex", "wiper", "value"}},
+    {"batch",         handleBatch,        METRIC_CMD_BATCH,         1024, 3, true,  {"ops"}},
+    {"getState",      handleGetState,     METRIC_CMD_OTHER,         96,   2, false, {}},
+    {"potStream",     handlePotStream,    METRIC_CMD_OTHER,         160,  2, true,  {"sensor", "waveform", "frequency", "amplitude"}},
+    {"preset",        handlePreset,       METRIC_CMD_PRESET,        128,  2, true,  {"systemType"}},
+    {"reeferModel",   handleReeferModel,  METRIC_CMD_OTHER,         96,   2, true,  {"action"}},
+    {"resetPots",     handleResetPots,    METRIC_CMD_OTHER,         96,   2, true,  {}},
+    {"run",           handleRun,          METRIC_CMD_RUN,           128,  2, true,  {"systemType"}},
+    {"scenario",      handleScenario,     METRIC_CMD_OTHER,         160,  2, true,  {"action", "name", "loop", "positionMs"}},
+    {"schedule",      handleSchedule,     METRIC_CMD_OTHER,         256,  4, true,  {"action", "at", "command", "id"}},
+    {"stop",          handleStop,         METRIC_CMD_STOP,          96,   2, true,  {}},
+    {"subscribe",     handleSubscribe,    METRIC_CMD_OTHER,         160,  2, false, {"topics"}},
+    {"updateSensor",  handleUpdateSensor, METRIC_CMD_UPDATE_SENSOR, 128,  2, true,  {"sensor", "value"}},
+};
+
+static const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+// Built once at boot on the heap; read-only afterwards. Handed to Filter()
+// as JsonVariantConst: passing the document itself shrinks it to fit on
+// every parse, a heap write racing between the tasks that dispatch.
+static JsonDocument peekFilter;
+static JsonDocument filters[COMMAND_COUNT];
+
+void commandsBegin() {
+    peekFilter["cmd"] = true;
+    peekFilter["commandId"] = true;
+
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        if (i > 0 && strcmp(COMMANDS[i - 1].name, COMMANDS[i].name) >= 0) {
+            Serial.printf("Command table out of order at %s\n", COMMANDS[i].name);
+        }
+
+        filters[i]["commandId"] = true;
+        for (const char *field : COMMANDS[i].fields) {
+            if (!field) {
+                break;
+            }
+            filters[i][field] = true;
+        }
+    }
+}
+
+DeserializationError commandPeek(const char *data, size_t len, char *name, size_t nameSize,
+                                 CommandId &commandId) {
+    // Nothing parsed here outlives the call, so give the arena space back
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    DeserializationError error =
+        deserializeJson(doc, data, len, DeserializationOption::Filter(peekFilter.as<JsonVariantConst>()));
+
+    const char *cmd = doc["cmd"] | "";
+    strlcpy(name, cmd, nameSize);
+    commandId = doc["commandId"].as<CommandId>();
+    return error;
+}
+
+const CommandEntry *commandLookup(const char *name) {
+    size_t low = 0;
+    size_t high = COMMAND_COUNT;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = strcmp(name, COMMANDS[mid].name);
+        if (order == 0) {
+            return &COMMANDS[mid];
+        }
+        if (order < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return nullptr;
+}
+
+DeserializationError commandParse(const CommandEntry &entry, const char *data, size_t len,
+                                  JsonDocument &doc) {
+    size_t index = &entry - COMMANDS;
+    return deserializeJson(doc, data, len, DeserializationOption::Filter(filters[index].as<JsonVariantConst>()),
+                           DeserializationOption::NestingLimit(entry.nesting));
+}
@@ -0,0 +1,76 @@
+#include "debounce.h"
+
+ButtonDebouncer::ButtonDebouncer(uint32_t lockoutMicros, uint32_t holdMicros)
+    : lockout(lockoutMicros),
+      hold(holdMicros),
+      reported(false),
+      holdSent(true),
+      lockoutUntil(-1),
+      pressedAt(0) {
+}
+
+void ButtonDebouncer::reset(bool pressed, int64_t nowMicros) {
+    reported = pressed;
+    lockoutUntil = -1;
+    pressedAt = nowMicros;
+    // A button already held at boot does not produce a HOLD
+    holdSent = true;
+}
+
+int ButtonDebouncer::emitChange(bool pressed, int64_t micros, DebounceEvent *out) {
+    reported = pressed;
+    lockoutUntil = micros + lockout;
+
+    if (pressed) {
+        pressedAt = micros;
+        holdSent = false;
+    }
+
+    out->type = pressed ? BUTTON_PRESS : BUTTON_RELEASE;
+    out->edgeMicros = micros;
+    return 1;
+}
+
+int ButtonDebouncer::onEdge(bool pressed, int64_t edgeMicros, DebounceEvent *out) {
+    // Bounces inside the lockout window are resolved by onTimer()
+    if (lockoutUntil >= 0 && edgeMicros < lockoutUntil) {
+        return 0;
+    }
+    if (pressed == reported) {
+        return 0;
+    }
+    return emitChange(pressed, edgeMicros, out);
+}
+
+int ButtonDebouncer::onTimer(bool pressed, int64_t nowMicros, DebounceEvent *out) {
+    int count = 0;
+
+    if (lockoutUntil >= 0 && nowMicros >= lockoutUntil) {
+        lockoutUntil = -1;
+        // Level changed while we were ignoring edges
+        if (pressed != reported) {
+            count += emitChange(pressed, nowMicros, &out[count]);
+        }
+    }
+
+    if (reported && !holdSent && nowMicros - pressedAt >= (int64_t)hold) {
+        holdSent = true;
+        out[count].type = BUTTON_HOLD;
+        out[count].edgeMicros = pressedAt;
+        count++;
+    }
+
+    return count;
+}
+
+int64_t ButtonDebouncer::nextDeadline() const {
+    int64_t deadline = lockoutUntil;
+
+    if (reported && !holdSent) {
+        int64_t holdAt = pressedAt + hold;
+        if (deadline < 0 || holdAt < deadline) {
+            deadline = holdAt;
+        }
+    }
+    return deadline;
+}
@@ -0,0 +1,328 @@
+#include "hal.h"
+
+#if !HAL_NATIVE
+
+#include <Arduino.h>
+#include "driver/mcpwm.h"
+#include "driver/spi_master.h"
+#include "soc/gpio_struct.h"
+#include "esp_timer.h"
+#include "hardware_config.h"
+#include "web_server.h"
+#include "ws_outbound.h"
+#include "sse_events.h"
+#include "recorder.h"
+
+// Thermo King/APU on MCPWM unit 0 (IND_1 on A, IND_2 on B), Carrier on
+// unit 1 (HALL on A). Both run timer 0.
+class Esp32Pwm : public PwmOutput {
+public:
+    void begin() override {
+        mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0A, IND_1_PIN);
+        mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0B, IND_2_PIN);
+        mcpwm_gpio_init(MCPWM_UNIT_1, MCPWM0A, HALL_PIN);
+
+        mcpwm_config_t pwm_config;
+        pwm_config.frequency = 205;
+        pwm_config.cmpr_a = 50.0;
+        pwm_config.cmpr_b = 50.0;
+        pwm_config.counter_mode = MCPWM_UP_COUNTER;
+        pwm_config.duty_mode = MCPWM_DUTY_MODE_0;
+
+        // Initialize both MCPWM units with the same configuration
+        mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &pwm_config);
+        mcpwm_init(MCPWM_UNIT_1, MCPWM_TIMER_0, &pwm_config);
+
+        // Initially stopped with the duty cycle at 0
+        mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0);
+        mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
+        mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 0);
+        mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_B, 0);
+        mcpwm_set_duty(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 0);
+    }
+
+    void start(PwmChannel channel, float frequency) override {
+        apply(channel, frequency);
+        recorderPwm(channel, frequency);
+    }
+
+    void stop(PwmChannel channel) override {
+        apply(channel, 0.0f);
+        recorderPwm(channel, 0.0f);
+    }
+
+    // Register updates only, so it can run inside a frame's critical section
+    void apply(PwmChannel channel, float frequency) {
+        if (frequency <= 0) {
+            if (channel == PWM_THERMO_KING) {
+                mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0);
+                digitalWrite(IND_1_PIN, LOW);
+                digitalWrite(IND_2_PIN, LOW);
+            } else {
+                mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
+                digitalWrite(HALL_PIN, LOW);
+            }
+        } else if (channel == PWM_THERMO_KING) {
+            mcpwm_set_frequency(MCPWM_UNIT_0, MCPWM_TIMER_0, frequency);
+            mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 50);
+            mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_B, 50);
+            mcpwm_start(MCPWM_UNIT_0, MCPWM_TIMER_0);
+        } else {
+            mcpwm_set_frequency(MCPWM_UNIT_1, MCPWM_TIMER_0, frequency);
+            mcpwm_set_duty(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 50);
+            mcpwm_start(MCPWM_UNIT_1, MCPWM_TIMER_0);
+        }
+    }
+};
+
+// Transaction user field: the CS pin, and on a queued frame's last write
+// its slot + 1 in bits 8 and up
+#define POT_USER(csPin, slot)   ((void *)(uintptr_t)((csPin) | ((slot) << 8)))
+
+static volatile int64_t frameDoneAt[POT_QUEUE_FRAMES];
+
+// The CS pins are all below 32, so one register write selects a chip.
+// Both callbacks run from the SPI interrupt for queued frames.
+static void IRAM_ATTR potSelect(spi_transaction_t *transaction) {
+    GPIO.out_w1tc = 1u << ((uintptr_t)transaction->user & 0xFF);
+}
+
+static void IRAM_ATTR potDeselect(spi_transaction_t *transaction) {
+    uintptr_t user = (uintptr_t)transaction->user;
+    GPIO.out_w1ts = 1u << (user & 0xFF);
+    if (user >> 8) {
+        frameDoneAt[(user >> 8) - 1] = esp_timer_get_time();
+    }
+}
+
+// MCP4251 wipers on the VSPI pins through the ESP-IDF SPI master. The
+// controller has three hardware CS lines and we have five chips, so CS is
+// driven from the transaction callbacks. Two devices share the bus:
+// write() polls under the bus lock, queue() hands frames to the driver's
+// queue for the streaming timer (pot_stream.h) and returns at once.
+class Esp32PotBus : public PotBus {
+public:
+    void begin() override {
+        for (uint8_t pin : CS_PINS) {
+            pinMode(pin, OUTPUT);
+            digitalWrite(pin, HIGH);
+        }
+
+        spi_bus_config_t bus = {};
+        bus.mosi_io_num = SPI_MOSI_PIN;
+        bus.miso_io_num = SPI_MISO_PIN;
+        bus.sclk_io_num = SPI_SCK_PIN;
+        bus.quadwp_io_num = -1;
+        bus.quadhd_io_num = -1;
+        spi_bus_initialize(VSPI_HOST, &bus, SPI_DMA_DISABLED);
+
+        spi_device_interface_config_t device = {};
+        device.mode = 0;
+        device.clock_speed_hz = 1000000;
+        device.spics_io_num = -1;
+        device.pre_cb = potSelect;
+        device.post_cb = potDeselect;
+        device.queue_size = 1;
+        spi_bus_add_device(VSPI_HOST, &device, &commandDevice);
+        device.queue_size = POT_QUEUE_FRAMES * POT_FRAME_MAX;
+        spi_bus_add_device(VSPI_HOST, &device, &streamDevice);
+    }
+
+    void write(const PotWrite *writes, uint8_t count) override {
+        acquire();
+        for (uint8_t i = 0; i < count; i++) {
+            transmit(writes[i]);
+        }
+        release();
+        for (uint8_t i = 0; i < count; i++) {
+            recorderPot(writes[i]);
+        }
+    }
+
+    // With the bus held by the command device, queued stream frames wait
+    // and transmit() never blocks, so it can run with interrupts off
+    void acquire() {
+        spi_device_acquire_bus(commandDevice, portMAX_DELAY);
+    }
+
+    // Command byte (wiper address) then data byte: value 0-255
+    void transmit(const PotWrite &write) {
+        spi_transaction_t transaction;
+        fill(transaction, write, 0);
+        spi_device_polling_transmit(commandDevice, &transaction);
+    }
+
+    void release() {
+        spi_device_release_bus(commandDevice);
+    }
+
+    // Streamed frames are not recorded; 1 kHz would swamp the recording.
+    // Frames go out in order, so the slots are reused in order too.
+    bool queue(const PotWrite *writes, uint8_t count) override {
+        if (inFlight >= POT_QUEUE_FRAMES || count == 0 || count > POT_FRAME_MAX) {
+            return false;
+        }
+        uint8_t slot = nextSlot;
+        for (uint8_t i = 0; i < count; i++) {
+            spi_transaction_t &transaction = frames[slot][i];
+            fill(transaction, writes[i], i + 1 == count ? slot + 1 : 0);
+            // Never waits: inFlight keeps the driver queue from filling
+            spi_device_queue_trans(streamDevice, &transaction, 0);
+        }
+        nextSlot = (slot + 1) % POT_QUEUE_FRAMES;
+        inFlight++;
+        return true;
+    }
+
+    uint8_t reap(int64_t *doneAt, uint8_t max) override {
+        uint8_t count = 0;
+        spi_transaction_t *transaction;
+        while (count < max && spi_device_get_trans_result(streamDevice, &transaction, 0) == ESP_OK) {
+            uintptr_t user = (uintptr_t)transaction->user;
+            if (user >> 8) {
+                doneAt[count++] = frameDoneAt[(user >> 8) - 1];
+                inFlight--;
+            }
+        }
+        return count;
+    }
+
+private:
+    static void fill(spi_transaction_t &transaction, const PotWrite &write, uint8_t frameEnd) {
+        transaction = {};
+        transaction.flags = SPI_TRANS_USE_TXDATA;
+        transaction.length = 16;
+        transaction.tx_data[0] = write.wiper;
+        transaction.tx_data[1] = write.value;
+        transaction.user = POT_USER(write.csPin, frameEnd);
+    }
+
+    static constexpr uint8_t CS_PINS[] = {SPI_CS_IC_1, SPI_CS_IC_2, SPI_CS_IC_3, SPI_CS_IC_4, SPI_CS_IC_5};
+    spi_device_handle_t commandDevice = NULL;
+    spi_device_handle_t streamDevice = NULL;
+    spi_transaction_t frames[POT_QUEUE_FRAMES][POT_FRAME_MAX];
+    uint8_t nextSlot = 0;
+    uint8_t inFlight = 0;
+};
+
+constexpr uint8_t Esp32PotBus::CS_PINS[];
+
+// Everything that can wait (taking the SPI bus, filling transactions,
+// the recorder) happens outside the critical section; inside it are only
+// the wiper transfers and the MCPWM register updates.
+class Esp32FrameOutput : public FrameOutput {
+public:
+    Esp32FrameOutput(Esp32PotBus &pots, Esp32Pwm &pwm) : pots(pots), pwm(pwm) {}
+
+    uint32_t commit(const PotWrite *writes, uint8_t count, uint8_t pwmMask, const float *frequency) override {
+        if (count > 0) {
+            pots.acquire();
+        }
+        portENTER_CRITICAL(&lock);
+        int64_t first = esp_timer_get_time();
+        for (uint8_t i = 0; i < count; i++) {
+            pots.transmit(writes[i]);
+        }
+        // Stops before starts, as updatePwmSignals() does
+        for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+            if ((pwmMask & (1 << i)) && frequency[i] <= 0) {
+                pwm.apply((PwmChannel)i, 0.0f);
+            }
+        }
+        for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+            if ((pwmMask & (1 << i)) && frequency[i] > 0) {
+                pwm.apply((PwmChannel)i, frequency[i]);
+            }
+        }
+        int64_t last = esp_timer_get_time();
+        portEXIT_CRITICAL(&lock);
+        if (count > 0) {
+            pots.release();
+        }
+
+        for (uint8_t i = 0; i < count; i++) {
+            recorderPot(writes[i]);
+        }
+        for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+            if (pwmMask & (1 << i)) {
+                recorderPwm((PwmChannel)i, frequency[i] > 0 ? frequency[i] : 0.0f);
+            }
+        }
+        return (uint32_t)(last - first);
+    }
+
+private:
+    Esp32PotBus &pots;
+    Esp32Pwm &pwm;
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+class Esp32Gpio : public Gpio {
+public:
+    void mode(uint8_t pin, uint8_t mode) override {
+        pinMode(pin, mode);
+    }
+
+    void write(uint8_t pin, uint8_t level) override {
+        digitalWrite(pin, level);
+    }
+
+    uint8_t read(uint8_t pin) override {
+        return digitalRead(pin);
+    }
+};
+
+class Esp32Clock : public Clock {
+public:
+    uint32_t millis() override {
+        return ::millis();
+    }
+
+    int64_t micros() override {
+        return esp_timer_get_time();
+    }
+};
+
+// WebSocket clients (ws_outbound) and /events dashboards (sse_events).
+// Frames are serialized once by the caller and fanned out to both.
+class Esp32Transport : public Transport {
+public:
+    void reply(ClientId client, const char *message, size_t length) override {
+        AsyncWebSocketClient *socket = ws.client(client);
+        if (socket && socket->status() == WS_CONNECTED) {
+            wsSendControl(socket, message, length);
+        }
+    }
+
+    void broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) override {
+        wsBroadcastControl(topic, message, length);
+        ssePublish(topic, message, length, revision);
+    }
+
+    void publish(WsTopic topic, const char *message, size_t length, uint32_t revision) override {
+        wsPublishSnapshot(topic, message, length);
+        ssePublish(topic, message, length, revision);
+    }
+
+    // Events always are: the SSE backlog keeps them for a dashboard that
+    // reconnects with Last-Event-ID, even while nobody is connected. The
+    // WebSocket fan-out still skips clients not subscribed to the topic.
+    bool wanted(WsTopic topic) override {
+        return topic == WS_TOPIC_EVENTS || wsTopicHasSubscribers(topic) || sseClientCount() > 0;
+    }
+
+    void subscribe(ClientId client, uint8_t topics) override {
+        wsSetTopics(client, topics);
+    }
+};
+
+static Esp32Pwm esp32Pwm;
+static Esp32PotBus esp32Pots;
+static Esp32FrameOutput esp32Frames(esp32Pots, esp32Pwm);
+static Esp32Gpio esp32Gpio;
+static Esp32Clock esp32Clock;
+static Esp32Transport esp32Transport;
+
+Hal hal = {&esp32Pwm, &esp32Pots, &esp32Frames, &esp32Gpio, &esp32Clock, &esp32Transport};
+
+#endif // !HAL_NATIVE
@@ -0,0 +1,263 @@
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "hardware_config.h"
+#include "protocol.h"
+#include "static_alloc.h"
+#include "recorder.h"
+
+FakePwm fakePwm;
+FakePotBus fakePots;
+FakeFrameOutput fakeFrames;
+FakeGpio fakeGpio;
+FakeClock fakeClock;
+FakeTransport fakeTransport;
+
+Hal hal = {&fakePwm, &fakePots, &fakeFrames, &fakeGpio, &fakeClock, &fakeTransport};
+
+// native/include/Arduino.h
+NativeSerial Serial;
+
+static std::string trace;
+static bool recording = true;
+
+static const char *const CHANNEL_NAMES[PWM_CHANNEL_COUNT] = {
+    "thermoking",
+    "carrier",
+};
+
+// One line per change, prefixed with the fake clock in microseconds
+static void recordv(const char *format, va_list args) {
+    char line[WS_MESSAGE_MAX + 64];
+    int prefix = snprintf(line, sizeof(line), "%lld ", (long long)fakeClock.now);
+    vsnprintf(line + prefix, sizeof(line) - prefix, format, args);
+    trace += line;
+    trace += '\n';
+}
+
+static void record(const char *format, ...) {
+    if (!recording) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    recordv(format, args);
+    va_end(args);
+}
+
+void FakePwm::begin() {
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        running[i] = false;
+        frequency[i] = 0.0f;
+        settledCycles[i] = 0.0;
+        settledAt[i] = fakeClock.now;
+    }
+    record("pwm begin");
+}
+
+// Fold the time spent at the current frequency into the cycle count
+void FakePwm::settle(PwmChannel channel) {
+    if (running[channel]) {
+        settledCycles[channel] += frequency[channel] * (fakeClock.now - settledAt[channel]) / 1e6;
+    }
+    settledAt[channel] = fakeClock.now;
+}
+
+// Every call goes to the recorder, which keeps only changes, exactly as the
+// device's driver does
+void FakePwm::start(PwmChannel channel, float hz) {
+    recorderPwm(channel, hz);
+    if (running[channel] && frequency[channel] == hz) {
+        return;
+    }
+    settle(channel);
+    running[channel] = true;
+    frequency[channel] = hz;
+    record("pwm start %s %.1f", CHANNEL_NAMES[channel], hz);
+}
+
+void FakePwm::stop(PwmChannel channel) {
+    recorderPwm(channel, 0.0f);
+    if (!running[channel]) {
+        return;
+    }
+    settle(channel);
+    running[channel] = false;
+    record("pwm stop %s", CHANNEL_NAMES[channel]);
+}
+
+double FakePwm::cycles(PwmChannel channel) const {
+    double total = settledCycles[channel];
+    if (running[channel]) {
+        total += frequency[channel] * (fakeClock.now - settledAt[channel]) / 1e6;
+    }
+    return floor(total);
+}
+
+void FakePotBus::begin() {
+    memset(wipers, 0, sizeof(wipers));
+    transactions = 0;
+    queuedFrames = 0;
+    finished = 0;
+    record("pot begin");
+}
+
+void FakePotBus::write(const PotWrite *writes, uint8_t count) {
+    transactions++;
+    for (uint8_t i = 0; i < count; i++) {
+        if (writes[i].csPin < FAKE_POT_CS_PINS) {
+            wipers[writes[i].csPin][writes[i].wiper == POT1_WIPER] = writes[i].value;
+        }
+        record("pot cs=%u wiper=0x%02X value=%u", writes[i].csPin, writes[i].wiper, writes[i].value);
+        recorderPot(writes[i]);
+    }
+}
+
+bool FakePotBus::queue(const PotWrite *writes, uint8_t count) {
+    if (finished >= POT_QUEUE_FRAMES) {
+        return false;
+    }
+    queuedFrames++;
+    for (uint8_t i = 0; i < count; i++) {
+        if (writes[i].csPin >= FAKE_POT_CS_PINS) {
+            continue;
+        }
+        uint8_t &wiper = wipers[writes[i].csPin][writes[i].wiper == POT1_WIPER];
+        if (wiper != writes[i].value) {
+            wiper = writes[i].value;
+            record("pot stream cs=%u wiper=0x%02X value=%u", writes[i].csPin, writes[i].wiper, writes[i].value);
+        }
+    }
+    doneAt[finished++] = fakeClock.now;
+    return true;
+}
+
+uint8_t FakePotBus::reap(int64_t *out, uint8_t max) {
+    uint8_t count = finished < max ? finished : max;
+    memcpy(out, doneAt, count * sizeof(doneAt[0]));
+    memmove(doneAt, doneAt + count, (finished - count) * sizeof(doneAt[0]));
+    finished -= count;
+    return count;
+}
+
+// Stops before starts, the order updatePwmSignals() uses
+uint32_t FakeFrameOutput::commit(const PotWrite *writes, uint8_t count, uint8_t pwmMask, const float *frequency) {
+    frames++;
+    if (count > 0) {
+        fakePots.write(writes, count);
+    }
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        if ((pwmMask & (1 << i)) && frequency[i] <= 0) {
+            fakePwm.stop((PwmChannel)i);
+        }
+    }
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        if ((pwmMask & (1 << i)) && frequency[i] > 0) {
+            fakePwm.start((PwmChannel)i, frequency[i]);
+        }
+    }
+    return 0;
+}
+
+void FakeGpio::mode(uint8_t pin, uint8_t mode) {
+    if (pin < FAKE_GPIO_PINS && mode == INPUT_PULLUP) {
+        levels[pin] = HIGH;
+    }
+}
+
+void FakeGpio::write(uint8_t pin, uint8_t level) {
+    if (pin < FAKE_GPIO_PINS) {
+        if (levels[pin] == level) {
+            return;
+        }
+        levels[pin] = level;
+    }
+    record("gpio %u %u", pin, level);
+}
+
+uint8_t FakeGpio::read(uint8_t pin) {
+    return pin < FAKE_GPIO_PINS ? levels[pin] : LOW;
+}
+
+uint32_t FakeClock::millis() {
+    return (uint32_t)(now / 1000);
+}
+
+int64_t FakeClock::micros() {
+    return now;
+}
+
+void FakeClock::advance(int64_t micros) {
+    now += micros;
+}
+
+void FakeTransport::reply(ClientId client, const char *message, size_t length) {
+    frames++;
+    replies++;
+    bytes += length;
+    record("reply %u %.*s", client, (int)length, message);
+}
+
+void FakeTransport::broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) {
+    frames++;
+    bytes += length;
+    record("broadcast %s %u %.*s", wsTopicName(topic), revision, (int)length, message);
+}
+
+void FakeTransport::publish(WsTopic topic, const char *message, size_t length, uint32_t revision) {
+    frames++;
+    bytes += length;
+    record("publish %s %u %.*s", wsTopicName(topic), revision, (int)length, message);
+}
+
+bool FakeTransport::wanted(WsTopic topic) {
+    return wantedTopics & WS_TOPIC_BIT(topic);
+}
+
+void FakeTransport::subscribe(ClientId client, uint8_t topics) {
+    record("subscribe %u 0x%02X", client, topics);
+}
+
+void halFakeReset() {
+    fakeClock.now = 0;
+    fakePwm.begin();
+    fakePots.begin();
+    fakeFrames.frames = 0;
+    for (uint8_t &level : fakeGpio.levels) {
+        level = LOW;
+    }
+    // Buttons idle released, held high by their pull-ups
+    fakeGpio.levels[RPM_INC_PIN] = HIGH;
+    fakeGpio.levels[STOP_PIN] = HIGH;
+    fakeGpio.levels[AUTOMATIC_RUN_PIN] = HIGH;
+    fakeTransport.wantedTopics = WS_TOPICS_ALL;
+    fakeTransport.frames = 0;
+    fakeTransport.bytes = 0;
+    fakeTransport.replies = 0;
+    trace.clear();
+}
+
+void halFakeRecord(bool enabled) {
+    recording = enabled;
+}
+
+const std::string &halFakeTrace() {
+    return trace;
+}
+
+void halFakeNote(const char *format, ...) {
+    if (!recording) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    recordv(format, args);
+    va_end(args);
+}
+
+#endif // HAL_NATIVE
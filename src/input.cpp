@@ -0,0 +1,161 @@
+#include "input.h"
+#include "static_alloc.h"
+#include "recorder.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// Raw items pushed by the GPIO ISR and the debounce timer
+enum RawInputKind : uint8_t {
+    RAW_EDGE = 0,
+    RAW_TIMER
+};
+
+typedef struct {
+    RawInputKind kind;
+    uint8_t button;
+    uint8_t pressed;
+    int64_t micros;
+} RawInput;
+
+static const uint8_t BUTTON_PINS[BUTTON_COUNT] = {
+    RPM_INC_PIN,
+    STOP_PIN,
+    AUTOMATIC_RUN_PIN,
+};
+
+static const char *const BUTTON_NAMES[BUTTON_COUNT] = {
+    "RPM_INC",
+    "STOP",
+    "AUTO_RUN",
+};
+
+static QueueHandle_t rawQueue = NULL;
+static esp_timer_handle_t debounceTimer = NULL;
+static ButtonDebouncer debouncers[BUTTON_COUNT];
+
+// Events produced but not yet handed to the owner
+static ButtonEvent pending[BUTTON_COUNT * DEBOUNCE_MAX_EVENTS];
+static uint8_t pendingHead = 0;
+static uint8_t pendingCount = 0;
+
+static inline bool readPressed(uint8_t pin) {
+    return digitalRead(pin) == LOW; // LOW = pressed
+}
+
+static void IRAM_ATTR onButtonEdge(void *arg) {
+    uint8_t button = (uint8_t)(uintptr_t)arg;
+
+    RawInput raw;
+    raw.kind = RAW_EDGE;
+    raw.button = button;
+    raw.pressed = readPressed(BUTTON_PINS[button]);
+    raw.micros = esp_timer_get_time();
+
+    // A full queue only drops bounce edges; the timer resamples the level
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(rawQueue, &raw, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void onDebounceTimer(void *arg) {
+    RawInput raw;
+    raw.kind = RAW_TIMER;
+    raw.button = 0;
+    raw.pressed = 0;
+    raw.micros = esp_timer_get_time();
+    xQueueSend(rawQueue, &raw, 0);
+}
+
+static void pushEvents(ButtonId button, const DebounceEvent *events, int count) {
+    for (int i = 0; i < count; i++) {
+        if (pendingCount >= sizeof(pending) / sizeof(pending[0])) {
+            return;
+        }
+        ButtonEvent &ev = pending[(pendingHead + pendingCount) % (sizeof(pending) / sizeof(pending[0]))];
+        ev.button = button;
+        ev.type = events[i].type;
+        ev.edgeMicros = events[i].edgeMicros;
+        pendingCount++;
+    }
+}
+
+// Re-arm the one-shot timer for the earliest debounce or hold deadline
+static void armTimer(int64_t now) {
+    int64_t next = -1;
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        int64_t deadline = debouncers[i].nextDeadline();
+        if (deadline >= 0 && (next < 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+
+    esp_timer_stop(debounceTimer);
+    if (next >= 0) {
+        int64_t delay = next - now;
+        esp_timer_start_once(debounceTimer, delay > 0 ? delay : 1);
+    }
+}
+
+void inputBegin() {
+#if STATIC_ALLOC_MODE
+    static uint8_t queueStorage[INPUT_QUEUE_LEN * sizeof(RawInput)];
+    static StaticQueue_t queueControl;
+    rawQueue = xQueueCreateStatic(INPUT_QUEUE_LEN, sizeof(RawInput), queueStorage, &queueControl);
+#else
+    rawQueue = xQueueCreate(INPUT_QUEUE_LEN, sizeof(RawInput));
+#endif
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onDebounceTimer;
+    timerArgs.name = "debounce";
+    esp_timer_create(&timerArgs, &debounceTimer);
+
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        debouncers[i] = ButtonDebouncer(INPUT_LOCKOUT_US, INPUT_HOLD_US);
+        debouncers[i].reset(readPressed(BUTTON_PINS[i]), now);
+        attachInterruptArg(BUTTON_PINS[i], onButtonEdge, (void *)(uintptr_t)i, CHANGE);
+
+        Serial.printf("Button %s on pin %d initial state: %s\n", BUTTON_NAMES[i], BUTTON_PINS[i],
+                      debouncers[i].isPressed() ? "PRESSED" : "RELEASED");
+    }
+}
+
+bool inputWaitEvent(ButtonEvent &event, TickType_t timeout) {
+    while (pendingCount == 0) {
+        RawInput raw;
+        if (xQueueReceive(rawQueue, &raw, timeout) != pdTRUE) {
+            return false;
+        }
+
+        DebounceEvent produced[DEBOUNCE_MAX_EVENTS];
+        if (raw.kind == RAW_EDGE) {
+            recorderEdge(raw.button, raw.pressed, raw.micros);
+            int count = debouncers[raw.button].onEdge(raw.pressed, raw.micros, produced);
+            pushEvents((ButtonId)raw.button, produced, count);
+        } else {
+            for (int i = 0; i < BUTTON_COUNT; i++) {
+                int count = debouncers[i].onTimer(readPressed(BUTTON_PINS[i]), raw.micros, produced);
+                pushEvents((ButtonId)i, produced, count);
+            }
+        }
+
+        armTimer(esp_timer_get_time());
+    }
+
+    event = pending[pendingHead];
+    pendingHead = (pendingHead + 1) % (sizeof(pending) / sizeof(pending[0]));
+    pendingCount--;
+    return true;
+}
+
+bool inputIsPressed(ButtonId button) {
+    return button < BUTTON_COUNT && debouncers[button].isPressed();
+}
+
+const char *inputButtonName(ButtonId button) {
+    return button < BUTTON_COUNT ? BUTTON_NAMES[button] : "?";
+}
@@ -0,0 +1,109 @@
+#include "input.h"
+#include "recorder.h"
+
+#if HAL_NATIVE
+
+// Host side of input.h. There are no interrupts or esp_timer here: whoever
+// drives the fake pins reports each edge with inputInjectEdge() and calls
+// inputServiceTimer() at inputNextDeadline(), which is what the ISR and the
+// one-shot debounce timer do on the device. The debouncers are the same.
+
+static const uint8_t BUTTON_PINS[BUTTON_COUNT] = {
+    RPM_INC_PIN,
+    STOP_PIN,
+    AUTOMATIC_RUN_PIN,
+};
+
+static const char *const BUTTON_NAMES[BUTTON_COUNT] = {
+    "RPM_INC",
+    "STOP",
+    "AUTO_RUN",
+};
+
+static ButtonDebouncer debouncers[BUTTON_COUNT];
+
+static ButtonEvent pending[BUTTON_COUNT * DEBOUNCE_MAX_EVENTS];
+static uint8_t pendingHead = 0;
+static uint8_t pendingCount = 0;
+
+static inline bool readPressed(uint8_t pin) {
+    return hal.gpio->read(pin) == LOW; // LOW = pressed
+}
+
+static void pushEvents(ButtonId button, const DebounceEvent *events, int count) {
+    for (int i = 0; i < count; i++) {
+        if (pendingCount >= sizeof(pending) / sizeof(pending[0])) {
+            return;
+        }
+        ButtonEvent &ev = pending[(pendingHead + pendingCount) % (sizeof(pending) / sizeof(pending[0]))];
+        ev.button = button;
+        ev.type = events[i].type;
+        ev.edgeMicros = events[i].edgeMicros;
+        pendingCount++;
+    }
+}
+
+void inputBegin() {
+    int64_t now = hal.clock->micros();
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        debouncers[i] = ButtonDebouncer(INPUT_LOCKOUT_US, INPUT_HOLD_US);
+        debouncers[i].reset(readPressed(BUTTON_PINS[i]), now);
+    }
+    pendingHead = 0;
+    pendingCount = 0;
+}
+
+bool inputWaitEvent(ButtonEvent &event, TickType_t timeout) {
+    // Nothing else can produce edges while the caller waits, so never block
+    if (pendingCount == 0) {
+        return false;
+    }
+    event = pending[pendingHead];
+    pendingHead = (pendingHead + 1) % (sizeof(pending) / sizeof(pending[0]));
+    pendingCount--;
+    return true;
+}
+
+void inputInjectEdge(ButtonId button, int64_t micros) {
+    if (button >= BUTTON_COUNT) {
+        return;
+    }
+    bool pressed = readPressed(BUTTON_PINS[button]);
+    recorderEdge(button, pressed, micros);
+    DebounceEvent produced[DEBOUNCE_MAX_EVENTS];
+    int count = debouncers[button].onEdge(pressed, micros, produced);
+    pushEvents(button, produced, count);
+}
+
+void inputServiceTimer(int64_t micros) {
+    DebounceEvent produced[DEBOUNCE_MAX_EVENTS];
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        int count = debouncers[i].onTimer(readPressed(BUTTON_PINS[i]), micros, produced);
+        pushEvents((ButtonId)i, produced, count);
+    }
+}
+
+int64_t inputNextDeadline() {
+    int64_t next = -1;
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        int64_t deadline = debouncers[i].nextDeadline();
+        if (deadline >= 0 && (next < 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+    return next;
+}
+
+uint8_t inputButtonPin(ButtonId button) {
+    return button < BUTTON_COUNT ? BUTTON_PINS[button] : 0;
+}
+
+bool inputIsPressed(ButtonId button) {
+    return button < BUTTON_COUNT && debouncers[button].isPressed();
+}
+
+const char *inputButtonName(ButtonId button) {
+    return button < BUTTON_COUNT ? BUTTON_NAMES[button] : "?";
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,232 @@
+#include "json_alloc.h"
+#include "json_arena.h"
+#include "freertos/FreeRTOS.h"
+
+#if STATIC_ALLOC_MODE
+
+#include <string.h>
+
+// Fixed-size block pool with one free list per size class. Documents are
+// built from several tasks, so the free lists are guarded by a spinlock.
+template <size_t BlockSize, uint16_t BlockCount>
+struct BlockClass {
+    uint8_t blocks[BlockCount][BlockSize] __attribute__((aligned(8)));
+    uint16_t freeList[BlockCount];
+    uint16_t freeCount;
+    uint16_t highWater;
+
+    void init() {
+        for (uint16_t i = 0; i < BlockCount; i++) {
+            freeList[i] = BlockCount - 1 - i;
+        }
+        freeCount = BlockCount;
+        highWater = 0;
+    }
+
+    bool owns(const void *ptr) const {
+        const uint8_t *p = (const uint8_t *)ptr;
+        return p >= &blocks[0][0] && p < &blocks[0][0] + sizeof(blocks);
+    }
+
+    void *take() {
+        if (freeCount == 0) {
+            return nullptr;
+        }
+        uint16_t index = freeList[--freeCount];
+        uint16_t inUse = BlockCount - freeCount;
+        if (inUse > highWater) {
+            highWater = inUse;
+        }
+        return blocks[index];
+    }
+
+    void give(void *ptr) {
+        uint16_t index = ((uint8_t *)ptr - &blocks[0][0]) / BlockSize;
+        freeList[freeCount++] = index;
+    }
+};
+
+class BlockPoolAllocator : public ArduinoJson::Allocator {
+public:
+    BlockPoolAllocator() : failures(0) {
+        small.init();
+        large.init();
+    }
+
+    void *allocate(size_t size) override {
+        void *ptr = nullptr;
+        portENTER_CRITICAL(&lock);
+        if (size <= JSON_POOL_SMALL_BLOCK) {
+            ptr = small.take();
+        }
+        if (!ptr && size <= JSON_POOL_LARGE_BLOCK) {
+            ptr = large.take();
+        }
+        if (!ptr) {
+            failures++;
+        }
+        portEXIT_CRITICAL(&lock);
+        return ptr;
+    }
+
+    void deallocate(void *ptr) override {
+        if (!ptr) {
+            return;
+        }
+        portENTER_CRITICAL(&lock);
+        if (small.owns(ptr)) {
+            small.give(ptr);
+        } else if (large.owns(ptr)) {
+            large.give(ptr);
+        }
+        portEXIT_CRITICAL(&lock);
+    }
+
+    void *reallocate(void *ptr, size_t newSize) override {
+        if (!ptr) {
+            return allocate(newSize);
+        }
+
+        // Shrinking or growing within the block keeps it in place
+        size_t capacity = small.owns(ptr) ? JSON_POOL_SMALL_BLOCK : JSON_POOL_LARGE_BLOCK;
+        if (newSize <= capacity) {
+            return ptr;
+        }
+
+        void *grown = allocate(newSize);
+        if (grown) {
+            memcpy(grown, ptr, capacity);
+            deallocate(ptr);
+        }
+        return grown;
+    }
+
+    BlockClass<JSON_POOL_SMALL_BLOCK, JSON_POOL_SMALL_COUNT> small;
+    BlockClass<JSON_POOL_LARGE_BLOCK, JSON_POOL_LARGE_COUNT> large;
+    uint32_t failures;
+
+private:
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+static BlockPoolAllocator blockPool;
+
+static ArduinoJson::Allocator *backingAllocator() {
+    return &blockPool;
+}
+
+uint32_t jsonPoolFailures() {
+    return blockPool.failures;
+}
+
+uint16_t jsonPoolSmallHighWater() {
+    return blockPool.small.highWater;
+}
+
+uint16_t jsonPoolLargeHighWater() {
+    return blockPool.large.highWater;
+}
+
+#else
+
+static ArduinoJson::Allocator *backingAllocator() {
+    return ArduinoJson::detail::DefaultAllocator::instance();
+}
+
+#endif // STATIC_ALLOC_MODE
+
+struct ArenaSlot {
+    uint8_t buffer[JSON_ARENA_BYTES] __attribute__((aligned(8)));
+    JsonArena arena;
+    bool busy;
+
+    ArenaSlot() : arena(buffer, sizeof(buffer), backingAllocator()), busy(false) {
+    }
+};
+
+static ArenaSlot arenaSlots[JSON_ARENA_COUNT];
+static portMUX_TYPE arenaLock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t exhausted = 0;
+
+// Arena borrowed by the running task and how many scopes deep it is
+struct TaskArena {
+    JsonArena *arena;
+    uint16_t depth;
+};
+
+static thread_local TaskArena current = {nullptr, 0};
+
+static JsonArena *checkoutArena() {
+    JsonArena *arena = nullptr;
+    portENTER_CRITICAL(&arenaLock);
+    for (ArenaSlot &slot : arenaSlots) {
+        if (!slot.busy) {
+            slot.busy = true;
+            arena = &slot.arena;
+            break;
+        }
+    }
+    if (!arena) {
+        exhausted++;
+    }
+    portEXIT_CRITICAL(&arenaLock);
+    return arena;
+}
+
+static void returnArena(JsonArena *arena) {
+    arena->rewind(0);
+    portENTER_CRITICAL(&arenaLock);
+    for (ArenaSlot &slot : arenaSlots) {
+        if (&slot.arena == arena) {
+            slot.busy = false;
+        }
+    }
+    portEXIT_CRITICAL(&arenaLock);
+}
+
+JsonArenaScope::JsonArenaScope() {
+    if (current.depth++ == 0) {
+        current.arena = checkoutArena();
+    }
+    mark = current.arena ? current.arena->mark() : 0;
+}
+
+JsonArenaScope::~JsonArenaScope() {
+    // Nested scopes only give back what they allocated
+    if (current.arena) {
+        current.arena->rewind(mark);
+    }
+    if (--current.depth == 0 && current.arena) {
+        returnArena(current.arena);
+        current.arena = nullptr;
+    }
+}
+
+ArduinoJson::Allocator *jsonAllocator() {
+    if (current.arena) {
+        return current.arena;
+    }
+    return backingAllocator();
+}
+
+size_t jsonArenaHighWater() {
+    size_t highWater = 0;
+    for (const ArenaSlot &slot : arenaSlots) {
+        if (slot.arena.bytesHighWater() > highWater) {
+            highWater = slot.arena.bytesHighWater();
+        }
+    }
+    return highWater;
+}
+
+uint32_t jsonArenaOverflows() {
+    uint32_t overflows = 0;
+    for (const ArenaSlot &slot : arenaSlots) {
+        overflows += slot.arena.fallbackCount();
+    }
+    return overflows;
+}
+
+uint32_t jsonArenaExhausted() {
+    return exhausted;
+}
@@ -0,0 +1,115 @@
+#include "latency.h"
+#include <ArduinoJson.h>
+#include "json_alloc.h"
+#include "hal.h"
+
+#if !HAL_NATIVE
+#include <ESPAsyncWebServer.h>
+#endif
+
+static LatencyHistogram histograms[LAT_SRC_COUNT][LAT_STAGE_COUNT];
+
+static const char *const SOURCE_NAMES[LAT_SRC_COUNT] = {
+    "run",
+    "stop",
+    "preset",
+    "updateSensor",
+    "adjustMCP4251",
+    "batch",
+    "other",
+    "buttonRpmInc",
+    "buttonStop",
+    "buttonAutoRun",
+};
+
+static const char *const STAGE_NAMES[LAT_STAGE_COUNT] = {
+    "dispatch",
+    "output",
+    "ack",
+};
+
+typedef struct {
+    int64_t arrival;   // 0 when nothing is in flight
+    int8_t source;     // -1 until dispatched
+    uint8_t marked;    // bit per stage already recorded
+} LatencyContext;
+
+static thread_local LatencyContext context = {0, -1, 0};
+
+static void record(LatencyStage stage) {
+    uint8_t bit = 1 << stage;
+    if (context.source < 0 || (context.marked & bit)) {
+        return;
+    }
+    context.marked |= bit;
+    histograms[context.source][stage].record((uint32_t)(hal.clock->micros() - context.arrival));
+}
+
+void latencyArrival() {
+    latencyArrival(hal.clock->micros());
+}
+
+void latencyArrival(int64_t arrivalMicros) {
+    context.arrival = arrivalMicros;
+    context.source = -1;
+    context.marked = 0;
+}
+
+void latencyDispatch(LatencySource source) {
+    if (context.arrival == 0) {
+        context.arrival = hal.clock->micros();
+        context.marked = 0;
+    }
+    context.source = source;
+    record(LAT_STAGE_DISPATCH);
+}
+
+void latencyMark(LatencyStage stage) {
+    record(stage);
+}
+
+void latencyFinish() {
+    context.arrival = 0;
+    context.source = -1;
+    context.marked = 0;
+}
+
+void latencyReset() {
+    for (int src = 0; src < LAT_SRC_COUNT; src++) {
+        for (int stage = 0; stage < LAT_STAGE_COUNT; stage++) {
+            histograms[src][stage].reset();
+        }
+    }
+}
+
+#if !HAL_NATIVE
+
+void handleLatencyRequest(AsyncWebServerRequest *request) {
+    if (request->hasParam("reset")) {
+        latencyReset();
+        request->send(200, "text/plain", "Latency histograms reset");
+        return;
+    }
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["unit"] = "us";
+
+    for (int src = 0; src < LAT_SRC_COUNT; src++) {
+        JsonObject source = doc[SOURCE_NAMES[src]].to<JsonObject>();
+        for (int stage = 0; stage < LAT_STAGE_COUNT; stage++) {
+            const LatencyHistogram &hist = histograms[src][stage];
+            JsonObject entry = source[STAGE_NAMES[stage]].to<JsonObject>();
+            entry["count"] = hist.count.load(std::memory_order_relaxed);
+            entry["p50"] = hist.percentile(0.50f);
+            entry["p99"] = hist.percentile(0.99f);
+            entry["max"] = hist.max.load(std::memory_order_relaxed);
+        }
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+#endif // !HAL_NATIVE
@@ -4,10 +4,24 @@
 #include <ESPAsyncWebServer.h>
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
-#include <SPI.h>
 #include "hardware_config.h"
+#include "hal.h"
 #include "ckp_functions.h"
 #include "wifi_manager.h"
+#include "trace.h"
+#include "metrics.h"
+#include "input.h"
+#include "static_alloc.h"
+#include "alloc_guard.h"
+#include "ws_clients.h"
+#include "ws_outbound.h"
+#include "recorder.h"
+#include "bench.h"
+#include "commands.h"
+#include "scenario.h"
+#include "reefer.h"
+#include "pot_stream.h"
+#include "schedule.h"
 
 // Function prototypes
 void setupWebServer(); // Add this prototype at the top
@@ -30,63 +44,38 @@ void ledTask(void *parameter);
 void ckpTask(void *parameter) {
     for (;;) {
         updatePwmSignals();
+        reeferService(hal.clock->micros());
         vTaskDelay(pdMS_TO_TICKS(10));  
     }
 }
 
-// Button monitoring task function
+// Button task - sole owner of the debounced button events
 void buttonTask(void *parameter) {
     Serial.println("Button monitoring task started");
     
-    // Print initial button state for debugging
-    Serial.print("Initial RPM_INC_PIN state: ");
-    Serial.println(digitalRead(RPM_INC_PIN) == HIGH ? "HIGH (not pressed)" : "LOW (pressed)");
-    
     for (;;) {
-        updateRPM();  // Call the function that handles RPM button
-        vTaskDelay(pdMS_TO_TICKS(20));  // Check every 20ms
+        ButtonEvent event;
+        if (inputWaitEvent(event)) {
+            handleButtonEvent(event);
+        }
     }
 }
 
 // Web status task function
 void webStatusTask(void *parameter) {
-    static bool lastAutoRunState = false;
-    
     for (;;) {
-        // Check automatic run pin
-        bool currentAutoRunState = (digitalRead(AUTOMATIC_RUN_PIN) == LOW);
-        
-        // If auto run state changed
-        if (currentAutoRunState != lastAutoRunState) {
-            lastAutoRunState = currentAutoRunState;
-            
-            if (currentAutoRunState) {
-                // Auto run enabled - start system if not already running
-                if (!state.systemRunning) {
-                    startSystem(state.systemType);
-                    
-                }
-                state.autoRunEnabled = true;
-            } else {
-                // Auto run disabled - update state but don't stop system
-                state.autoRunEnabled = false;
-              
-            }
-            
-            Serial.printf("Auto run state changed to: %s\n", 
-                         state.autoRunEnabled ? "ENABLED" : "DISABLED");
-        }
-        
         // Update sensor values periodically
         static unsigned long lastSensorUpdate = 0;
         unsigned long currentMillis = millis();
         
-        if (currentMillis - lastSensorUpdate >= 1000) { // Every second
-           
-
+        if (currentMillis - lastSensorUpdate >= WS_SERVICE_INTERVAL_MS) { // Every second
+            wsClientsService();
             lastSensorUpdate = currentMillis;
         }
         
+        // Snapshots held back for clients whose queues were full
+        wsOutboundPump();
+
         vTaskDelay(pdMS_TO_TICKS(100)); // 100ms check rate
     }
 }
@@ -104,10 +93,10 @@ void ledTask(void *parameter) {
     for(;;) {
         if (state.systemRunning) {
             state.ledState = !state.ledState;
-            digitalWrite(LED_PIN, state.ledState);
+            hal.gpio->write(LED_PIN, state.ledState);
             vTaskDelay(pdMS_TO_TICKS(100));
         } else {
-            digitalWrite(LED_PIN, LOW);
+            hal.gpio->write(LED_PIN, LOW);
             vTaskDelay(pdMS_TO_TICKS(1000));
         }
     }
@@ -118,27 +107,39 @@ void setup() {
      
     Serial.println("\n\n----- Reefer Diag Bench starting up -----");
 
-    // Initialize SPI for digital potentiometer control
-    SPI.begin(SPI_SCK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN);
+#if TRACE_ENABLED
+    traceInit();
+#endif
 
-    // Set CS pins as outputs and initialize to HIGH (inactive)
-    pinMode(SPI_CS_IC_1, OUTPUT);
-    pinMode(SPI_CS_IC_2, OUTPUT);
-    pinMode(SPI_CS_IC_3, OUTPUT);
-    pinMode(SPI_CS_IC_4, OUTPUT);
-    pinMode(SPI_CS_IC_5, OUTPUT);
+    // Commands and button edges are kept from boot on (GET /record)
+    recorderBegin();
 
-    digitalWrite(SPI_CS_IC_1, HIGH);
-    digitalWrite(SPI_CS_IC_2, HIGH);
-    digitalWrite(SPI_CS_IC_3, HIGH);
-    digitalWrite(SPI_CS_IC_4, HIGH);
-    digitalWrite(SPI_CS_IC_5, HIGH);
+    // Initialize SPI for digital potentiometer control, CS pins inactive
+    hal.pots->begin();
 
    
 
     // Setup CKP functionality
     setupCKP();
 
+    // Button edges are captured by GPIO interrupts from here on
+    inputBegin();
+
+    // Thermal model, off until a client turns it on
+    reeferBegin();
+
+    // Waveform streaming on the pots; its timer only runs while streaming
+    potStreamBegin();
+
+    // Timed commands; the timer is only armed while one is pending
+    scheduleBegin();
+
+#if BENCH_ENABLED
+    // Before WiFi and the tasks, so nothing else competes for the CPU
+    commandsBegin();
+    benchRunSuite(nullptr, BENCH_THRESHOLD_PERCENT, BENCH_PRINT_BASELINE);
+#endif
+
     Serial.println("CKP initialized, waiting 1 second before continuing...");
     delay(1000); // Add another delay
 
@@ -162,12 +163,15 @@ void setup() {
         }
     }
 
+    // Scenario playback reads from SPIFFS; the tick timer is created here
+    scenarioBegin();
+
     // Initialize WiFi using the WiFi manager
     Serial.println("Initializing WiFi...");
     bool wifiConnected = wifiManager.begin();
 
     // Create a WiFi management task regardless of connection status
-    xTaskCreatePinnedToCore(
+    createPinnedTask(
         wifiTask,
         "WiFi Task",
         8000,
@@ -193,7 +197,7 @@ void setup() {
         }
 
         // Create web status task
-        xTaskCreatePinnedToCore(
+        createPinnedTask(
             webStatusTask,
             "Web Status Task",
             16000, // Increased stack size
@@ -208,7 +212,7 @@ void setup() {
     Serial.println("Creating tasks...");
 
     // Create CKP task
-    if (xTaskCreatePinnedToCore(
+    if (createPinnedTask(
         ckpTask,
         "CKP Task",
         16000,
@@ -219,18 +223,43 @@ void setup() {
         Serial.println("Failed to create CKP task!");
     }
         
-    // Create button monitoring task
-    xTaskCreatePinnedToCore(
+    // Create button monitoring task. Above the CKP task so a press
+    // reaches the outputs without waiting for its 10 ms refresh.
+    createPinnedTask(
         buttonTask,
         "Button Task",
         4000,
         NULL,
-        1,
+        3,
         &buttonTaskHandle,
         0);
 
+    // Create scenario playback task. Same priority as the CKP task: both
+    // drive outputs, and it only wakes on the tick timer while a scenario
+    // is loaded.
+    createPinnedTask(
+        scenarioTask,
+        "Scenario Task",
+        6144, // Builds the status broadcast
+        NULL,
+        2,
+        &scenarioTaskHandle,
+        0);
+
+    // Create the schedule task. Above every other task of ours, so a held
+    // command runs on time rather than after a refresh or a button; it
+    // only wakes when one is due.
+    createPinnedTask(
+        scheduleTask,
+        "Schedule Task",
+        8192, // Runs any command, as the AsyncTCP task does
+        NULL,
+        4,
+        &scheduleTaskHandle,
+        0);
+
     // Create LED task
-    xTaskCreatePinnedToCore(
+    createPinnedTask(
         ledTask,
         "LED Task",
         2048,
@@ -239,7 +268,21 @@ void setup() {
         &ledTaskHandle,
         0);
 
+    // Report stack usage of our tasks on /metrics
+    metricsRegisterTask("CKP", ckpTaskHandle);
+    metricsRegisterTask("Button", buttonTaskHandle);
+    metricsRegisterTask("LED", ledTaskHandle);
+    metricsRegisterTask("Scenario", scenarioTaskHandle);
+    metricsRegisterTask("Schedule", scheduleTaskHandle);
+    metricsRegisterTask("WiFi", wifiTaskHandle);
+    metricsRegisterTask("Web Status", webStatusTaskHandle);
+
     Serial.println("System ready!");
+
+#if STATIC_ALLOC_MODE && defined(ALLOC_GUARD_SELFTEST)
+    // Scripted command workload must not touch the heap from here on
+    allocGuardSelfTest();
+#endif
 }
 
 void loop() {
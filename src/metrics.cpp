@@ -0,0 +1,201 @@
+#include "metrics.h"
+#include "hal.h"
+#include "freertos/FreeRTOS.h"
+
+#if !HAL_NATIVE
+#include "web_server.h"
+#include "json_alloc.h"
+#include "ws_clients.h"
+#include "ws_outbound.h"
+#include "sse_events.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+#endif
+
+Metrics metrics;
+
+// Tasks reported in the stack high-water section
+static const char *taskLabels[METRICS_MAX_TASKS];
+static TaskHandle_t taskHandles[METRICS_MAX_TASKS];
+static uint8_t taskCount = 0;
+
+static const char *const COMMAND_NAMES[METRIC_CMD_COUNT] = {
+    "run",
+    "stop",
+    "preset",
+    "updateSensor",
+    "adjustMCP4251",
+    "batch",
+    "other",
+};
+
+void metricsRegisterTask(const char *label, TaskHandle_t handle) {
+    if (handle == NULL || taskCount >= METRICS_MAX_TASKS) {
+        return;
+    }
+    taskLabels[taskCount] = label;
+    taskHandles[taskCount] = handle;
+    taskCount++;
+}
+
+const char *metricsCommandName(MetricCommand cmd) {
+    return cmd < METRIC_CMD_COUNT ? COMMAND_NAMES[cmd] : "other";
+}
+
+#if !HAL_NATIVE
+
+static void writeHeader(AsyncResponseStream *out, const char *name, const char *type, const char *help) {
+    out->printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void writeHistogram(AsyncResponseStream *out, const char *name, const char *labelName,
+                           const char *labelValue, const LatencyHistogram &hist) {
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+        cumulative += hist.buckets[i].load(std::memory_order_relaxed);
+        out->printf("%s_bucket{%s=\"%s\",le=\"%u\"} %u\n", name, labelName, labelValue,
+                    LatencyHistogram::bucketUpperBound(i), cumulative);
+    }
+    uint32_t count = hist.count.load(std::memory_order_relaxed);
+    out->printf("%s_bucket{%s=\"%s\",le=\"+Inf\"} %u\n", name, labelName, labelValue, count);
+    out->printf("%s_sum{%s=\"%s\"} %llu\n", name, labelName, labelValue,
+                (unsigned long long)hist.sum.load(std::memory_order_relaxed));
+    out->printf("%s_count{%s=\"%s\"} %u\n", name, labelName, labelValue, count);
+}
+
+static void writeTaskRuntime(AsyncResponseStream *out) {
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+    static TaskStatus_t statuses[24];
+    uint32_t totalRuntime = 0;
+    UBaseType_t count = uxTaskGetSystemState(statuses, 24, &totalRuntime);
+
+    writeHeader(out, "reefer_task_runtime_ticks_total", "counter",
+                "Run-time counter per task from FreeRTOS run-time stats");
+    for (UBaseType_t i = 0; i < count; i++) {
+        out->printf("reefer_task_runtime_ticks_total{task=\"%s\",core=\"%d\"} %u\n",
+                    statuses[i].pcTaskName,
+                    statuses[i].xCoreID == tskNO_AFFINITY ? -1 : (int)statuses[i].xCoreID,
+                    statuses[i].ulRunTimeCounter);
+    }
+    writeHeader(out, "reefer_runtime_ticks_total", "counter", "Total run-time counter");
+    out->printf("reefer_runtime_ticks_total %u\n", totalRuntime);
+#else
+    // Needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS in the SDK config
+    (void)out;
+#endif
+}
+
+void handleMetricsRequest(AsyncWebServerRequest *request) {
+    AsyncResponseStream *out = request->beginResponseStream("text/plain; version=0.0.4");
+
+    // Heap
+    writeHeader(out, "reefer_heap_free_bytes", "gauge", "Free heap");
+    out->printf("reefer_heap_free_bytes %u\n", ESP.getFreeHeap());
+    writeHeader(out, "reefer_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    out->printf("reefer_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+    writeHeader(out, "reefer_heap_largest_block_bytes", "gauge", "Largest free heap block");
+    out->printf("reefer_heap_largest_block_bytes %u\n",
+                (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    writeHeader(out, "reefer_uptime_seconds", "counter", "Seconds since boot");
+    out->printf("reefer_uptime_seconds %lu\n", millis() / 1000);
+
+    // JSON arenas
+    writeHeader(out, "reefer_json_arena_high_water_bytes", "gauge", "Most bytes one JSON arena has held");
+    out->printf("reefer_json_arena_high_water_bytes %u\n", (unsigned)jsonArenaHighWater());
+    writeHeader(out, "reefer_json_arena_overflows_total", "counter", "JSON allocations that spilled past an arena");
+    out->printf("reefer_json_arena_overflows_total %u\n", jsonArenaOverflows());
+    writeHeader(out, "reefer_json_arena_exhausted_total", "counter", "JSON scopes opened with no free arena");
+    out->printf("reefer_json_arena_exhausted_total %u\n", jsonArenaExhausted());
+
+    // Tasks
+    writeHeader(out, "reefer_task_stack_free_bytes", "gauge", "Stack high-water mark per task");
+    for (uint8_t i = 0; i < taskCount; i++) {
+        out->printf("reefer_task_stack_free_bytes{task=\"%s\"} %u\n", taskLabels[i],
+                    (unsigned)uxTaskGetStackHighWaterMark(taskHandles[i]));
+    }
+    writeTaskRuntime(out);
+
+    // WebSocket
+    size_t queued = 0;
+    size_t maxQueued = 0;
+    for (AsyncWebSocketClient &client : ws.getClients()) {
+        size_t len = client.queueLen();
+        queued += len;
+        if (len > maxQueued) {
+            maxQueued = len;
+        }
+    }
+    writeHeader(out, "reefer_ws_clients", "gauge", "Connected WebSocket clients");
+    out->printf("reefer_ws_clients %u\n", (unsigned)ws.count());
+    writeHeader(out, "reefer_sse_clients", "gauge", "Connected /events dashboards");
+    out->printf("reefer_sse_clients %u\n", (unsigned)sseClientCount());
+    writeHeader(out, "reefer_ws_queued_messages", "gauge", "Messages queued across all clients");
+    out->printf("reefer_ws_queued_messages %u\n", (unsigned)queued);
+    writeHeader(out, "reefer_ws_max_client_queue", "gauge", "Deepest single client queue");
+    out->printf("reefer_ws_max_client_queue %u\n", (unsigned)maxQueued);
+    writeHeader(out, "reefer_ws_messages_total", "counter", "Inbound WebSocket text frames");
+    out->printf("reefer_ws_messages_total %u\n", metrics.wsMessages.load());
+    writeHeader(out, "reefer_ws_parse_errors_total", "counter", "Frames that failed to parse");
+    out->printf("reefer_ws_parse_errors_total %u\n", metrics.wsParseErrors.load());
+    writeHeader(out, "reefer_ws_sent_frames_total", "counter", "Outbound frames per recipient");
+    out->printf("reefer_ws_sent_frames_total{kind=\"reply\"} %u\n", metrics.wsReplyFrames.load());
+    out->printf("reefer_ws_sent_frames_total{kind=\"broadcast\"} %u\n", metrics.wsBroadcastFrames.load());
+    out->printf("reefer_ws_sent_frames_total{kind=\"snapshot\"} %u\n", metrics.wsSnapshotFrames.load());
+    writeHeader(out, "reefer_ws_sent_bytes_total", "counter", "Outbound payload bytes per recipient");
+    out->printf("reefer_ws_sent_bytes_total{kind=\"reply\"} %u\n", metrics.wsReplyBytes.load());
+    out->printf("reefer_ws_sent_bytes_total{kind=\"broadcast\"} %u\n", metrics.wsBroadcastBytes.load());
+    out->printf("reefer_ws_sent_bytes_total{kind=\"snapshot\"} %u\n", metrics.wsSnapshotBytes.load());
+    writeHeader(out, "reefer_ws_snapshots_superseded_total", "counter", "Unsent state snapshots replaced by a newer one");
+    out->printf("reefer_ws_snapshots_superseded_total %u\n", metrics.wsSnapshotsSuperseded.load());
+
+    WsClientInfo clients[WS_MAX_CLIENTS];
+    size_t clientCount = wsClientsSnapshot(clients, WS_MAX_CLIENTS);
+    writeHeader(out, "reefer_ws_client_rtt_us", "gauge", "Smoothed ping round trip per client");
+    for (size_t i = 0; i < clientCount; i++) {
+        out->printf("reefer_ws_client_rtt_us{client=\"%u\",role=\"%s\"} %u\n", clients[i].id,
+                    clients[i].role == WS_ROLE_CONTROL ? "control" : "viewer", clients[i].rttAvgMicros);
+    }
+    writeHeader(out, "reefer_ws_client_queue", "gauge", "Queued messages per client at the last service pass");
+    for (size_t i = 0; i < clientCount; i++) {
+        out->printf("reefer_ws_client_queue{client=\"%u\"} %u\n", clients[i].id, clients[i].queueLen);
+    }
+    writeHeader(out, "reefer_ws_topic_subscribers", "gauge", "Clients subscribed to each broadcast topic");
+    for (int i = 0; i < WS_TOPIC_COUNT; i++) {
+        out->printf("reefer_ws_topic_subscribers{topic=\"%s\"} %u\n", wsTopicName((WsTopic)i),
+                    (unsigned)wsTopicSubscribers((WsTopic)i));
+    }
+    writeHeader(out, "reefer_ws_evictions_total", "counter", "Clients closed by the lifecycle manager");
+    for (int i = 0; i < WS_EVICT_COUNT; i++) {
+        out->printf("reefer_ws_evictions_total{reason=\"%s\"} %u\n", wsEvictReasonName((WsEvictReason)i),
+                    wsClientsEvictions((WsEvictReason)i));
+    }
+
+    // Hardware
+    writeHeader(out, "reefer_spi_transactions_total", "counter", "MCP4251 wiper writes");
+    out->printf("reefer_spi_transactions_total %u\n", metrics.spiTransactions.load());
+    writeHeader(out, "reefer_mcpwm_reconfigs_total", "counter", "MCPWM generator starts and frequency changes");
+    out->printf("reefer_mcpwm_reconfigs_total %u\n", metrics.mcpwmReconfigs.load());
+    writeHeader(out, "reefer_output_frames_total", "counter", "Pot and CKP changes committed as one frame");
+    out->printf("reefer_output_frames_total %u\n", metrics.outputFrames.load());
+    writeHeader(out, "reefer_output_frame_skew_us", "histogram", "First to last output change within a frame");
+    for (int i = 0; i < METRIC_CMD_COUNT; i++) {
+        writeHistogram(out, "reefer_output_frame_skew_us", "cmd", COMMAND_NAMES[i], metrics.outputFrameSkew[i]);
+    }
+
+    // Commands
+    writeHeader(out, "reefer_command_cache_total", "counter", "Retried commands answered from the result cache");
+    out->printf("reefer_command_cache_total{result=\"hit\"} %u\n", metrics.commandCacheHits.load());
+    out->printf("reefer_command_cache_total{result=\"miss\"} %u\n", metrics.commandCacheMisses.load());
+    writeHeader(out, "reefer_commands_total", "counter", "Commands processed by type");
+    for (int i = 0; i < METRIC_CMD_COUNT; i++) {
+        out->printf("reefer_commands_total{cmd=\"%s\"} %u\n", COMMAND_NAMES[i], metrics.commands[i].load());
+    }
+    writeHeader(out, "reefer_command_duration_us", "histogram", "Command handling time in microseconds");
+    for (int i = 0; i < METRIC_CMD_COUNT; i++) {
+        writeHistogram(out, "reefer_command_duration_us", "cmd", COMMAND_NAMES[i], metrics.commandLatency[i]);
+    }
+
+    request->send(out);
+}
+
+#endif // !HAL_NATIVE
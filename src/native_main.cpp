@@ -0,0 +1,130 @@
+#include "hal_fake.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:native. Boots the control core against the
+// recording fakes, feeds it a scripted session of WebSocket commands and
+// button edges, and prints what reached the hardware and the clients. The
+// output is deterministic, so a change in behaviour shows up as a diff.
+//
+//   pio run -e native && .pio/build/native/program > session.txt
+//   .pio/build/native/program --bench 20000    commands/s, recording off
+//   .pio/build/native/program -v               also show Serial output
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "commands.h"
+#include "protocol.h"
+#include "command_cache.h"
+#include "input.h"
+
+extern SystemState state;
+
+#define SESSION_CLIENT          1
+#define SESSION_STEP_US         1000
+
+// Same frames as the UI sends, in the order an operator would
+static const char *const SESSION[] = {
+    "{\"cmd\":\"subscribe\",\"topics\":[\"status\",\"rpmUpdate\",\"event\"],\"commandId\":1}",
+    "{\"cmd\":\"preset\",\"systemType\":\"carrier\",\"commandId\":2}",
+    "{\"cmd\":\"run\",\"systemType\":\"carrier\",\"commandId\":3}",
+    "{\"cmd\":\"updateSensor\",\"sensor\":\"coilTemp\",\"value\":40,\"commandId\":4}",
+    "{\"cmd\":\"adjustMCP4251\",\"icIndex\":5,\"wiper\":1,\"value\":200,\"commandId\":5}",
+    "{\"cmd\":\"batch\",\"commandId\":6,\"ops\":["
+    "{\"cmd\":\"updateSensor\",\"sensor\":\"ambientTemp\",\"value\":90},"
+    "{\"cmd\":\"rpmMode\",\"mode\":\"high\"}]}",
+    "{\"cmd\":\"run\",\"systemType\":\"carrier\",\"commandId\":3}",
+    "{\"cmd\":\"preset\",\"systemType\":\"thermoking\",\"commandId\":7}",
+    "{\"cmd\":\"getState\",\"commandId\":8}",
+    "{\"cmd\":\"nope\",\"commandId\":9}",
+    "{\"cmd\":\"stop\",\"commandId\":10}",
+};
+
+static void runCommand(const char *frame) {
+    // The dispatcher expects a terminated, writable copy like the socket's
+    static char buffer[1100];
+    size_t len = strlen(frame);
+    memcpy(buffer, frame, len + 1);
+    protocolHandleCommand(SESSION_CLIENT, buffer, len);
+    fakeClock.advance(SESSION_STEP_US);
+}
+
+static void drainButtons() {
+    ButtonEvent event;
+    while (inputWaitEvent(event, 0)) {
+        handleButtonEvent(event);
+    }
+}
+
+// A clean edge, then the debounce lockout runs out like the device timer
+static void pressButton(ButtonId button, bool pressed) {
+    fakeGpio.levels[inputButtonPin(button)] = pressed ? LOW : HIGH;
+    inputInjectEdge(button, fakeClock.micros());
+    drainButtons();
+    fakeClock.advance(INPUT_LOCKOUT_US);
+    inputServiceTimer(fakeClock.micros());
+    drainButtons();
+}
+
+static void runSession() {
+    for (const char *frame : SESSION) {
+        runCommand(frame);
+    }
+
+    // Auto run from the front panel, RPM button held then released, stop
+    pressButton(BUTTON_AUTO_RUN, true);
+    pressButton(BUTTON_AUTO_RUN, false);
+    pressButton(BUTTON_RPM_INC, true);
+    pressButton(BUTTON_RPM_INC, false);
+    pressButton(BUTTON_STOP, true);
+    pressButton(BUTTON_STOP, false);
+}
+
+static void boot() {
+    halFakeReset();
+    commandsBegin();
+    setupCKP();
+    setupSensors();
+    inputBegin();
+}
+
+int main(int argc, char **argv) {
+    long benchRounds = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            Serial.enabled = true;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            benchRounds = atol(argv[++i]);
+        }
+    }
+
+    if (benchRounds <= 0) {
+        boot();
+        runSession();
+        fputs(halFakeTrace().c_str(), stdout);
+        return 0;
+    }
+
+    halFakeRecord(false);
+    boot();
+    auto started = std::chrono::steady_clock::now();
+    for (long round = 0; round < benchRounds; round++) {
+        for (const char *frame : SESSION) {
+            runCommand(frame);
+        }
+        // Otherwise every later round is answered from the result cache
+        commandCacheForget(SESSION_CLIENT);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    long commands = benchRounds * (long)(sizeof(SESSION) / sizeof(SESSION[0]));
+    printf("RESULT commands=%ld seconds=%.3f commands_per_s=%.0f frames=%u bytes=%zu\n", commands, seconds,
+           commands / seconds, fakeTransport.frames, fakeTransport.bytes);
+    return 0;
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,29 @@
+#include "output_frame.h"
+#include "latency.h"
+
+void outputFramePwm(OutputFrame &frame, PwmChannel channel, float frequency) {
+    frame.pwmMask |= 1 << channel;
+    frame.pwmFrequency[channel] = frequency;
+}
+
+uint32_t outputFrameCommit(OutputFrame &frame, MetricCommand source) {
+    uint8_t pots = frame.pots.count;
+    if (pots == 0 && frame.pwmMask == 0) {
+        return 0;
+    }
+
+    uint32_t skew = hal.frames->commit(frame.pots.writes, pots, frame.pwmMask, frame.pwmFrequency);
+
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        if (frame.pwmMask & (1 << i)) {
+            metricsNotePwm((PwmChannel)i, frame.pwmFrequency[i]);
+        }
+    }
+    metrics.spiTransactions.fetch_add(pots, std::memory_order_relaxed);
+    metrics.outputFrames.fetch_add(1, std::memory_order_relaxed);
+    metrics.outputFrameSkew[source].record(skew);
+    latencyMark(LAT_STAGE_OUTPUT);
+
+    frame = {};
+    return skew;
+}
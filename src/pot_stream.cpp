@@ -0,0 +1,369 @@
+#include "pot_stream.h"
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "sensors_function.h"
+#include "histogram.h"
+#include "json_alloc.h"
+
+static const char *const WAVEFORM_NAMES[POT_WAVE_COUNT] = {"sine", "triangle", "square", "sawtooth"};
+
+typedef struct {
+    const char *sensor;     // nullptr when the channel is free
+    uint8_t csPin;
+    uint8_t wiper;
+    bool pressure;
+    bool stopping;          // the next frame is the last and sends finalValue
+    uint8_t finalValue;
+    PotWaveform waveform;
+    float frequency;
+    float amplitude;
+    float centre;
+    uint32_t phase;         // one period is 2^32
+    uint32_t step;          // phase advance per tick
+    uint8_t table[POT_STREAM_TABLE_LEN];
+} StreamChannel;
+
+typedef struct {
+    uint32_t ticks;
+    uint32_t frames;        // queued
+    uint32_t framesDone;
+    uint32_t queueFull;     // ticks whose frame did not fit; the phase moves on
+    float rateHz;           // last full window
+    int64_t tickMaxUs;
+    uint64_t tickTotalUs;
+} StreamStats;
+
+static portMUX_TYPE streamLock = portMUX_INITIALIZER_UNLOCKED;
+static StreamChannel channels[POT_STREAM_CHANNELS];
+static bool running = false;
+static bool restarted = false;
+static StreamStats stats;
+
+// Timer side: |finish interval - period| of consecutive frames
+static LatencyHistogram jitter;
+static int64_t lastDoneAt = -1;
+static int64_t windowStart = -1;
+static uint32_t windowFrames = 0;
+
+bool potWaveformFromName(const char *name, PotWaveform &waveform) {
+    for (uint8_t i = 0; i < POT_WAVE_COUNT; i++) {
+        if (strcmp(name, WAVEFORM_NAMES[i]) == 0) {
+            waveform = (PotWaveform)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// -1..1 at fraction x of the period, starting upwards from 0 like a sine
+static float waveformAt(PotWaveform waveform, float x) {
+    switch (waveform) {
+    case POT_WAVE_TRIANGLE:
+        return x < 0.25f ? 4 * x : (x < 0.75f ? 2 - 4 * x : 4 * x - 4);
+    case POT_WAVE_SQUARE:
+        return x < 0.5f ? 1 : -1;
+    case POT_WAVE_SAWTOOTH:
+        return x < 0.5f ? 2 * x : 2 * x - 2;
+    default:
+        return sinf(2 * (float)M_PI * x);
+    }
+}
+
+static uint8_t potFor(float value, bool pressure) {
+    return pressure ? mapPressureToPot(value) : mapTemperatureToPot(value);
+}
+
+// Through the same mapping as setSensorValue, so the waveform is centred
+// where the static reading would be
+static void buildTable(uint8_t *table, PotWaveform waveform, float centre, float amplitude, bool pressure) {
+    for (int i = 0; i < POT_STREAM_TABLE_LEN; i++) {
+        float x = (float)i / POT_STREAM_TABLE_LEN;
+        table[i] = potFor(centre + amplitude * waveformAt(waveform, x), pressure);
+    }
+}
+
+// Callers hold streamLock
+static StreamChannel *findChannel(uint8_t csPin, uint8_t wiper) {
+    for (StreamChannel &channel : channels) {
+        if (channel.sensor && channel.csPin == csPin && channel.wiper == wiper) {
+            return &channel;
+        }
+    }
+    return nullptr;
+}
+
+static StreamChannel *freeChannel() {
+    for (StreamChannel &channel : channels) {
+        if (!channel.sensor) {
+            return &channel;
+        }
+    }
+    return nullptr;
+}
+
+static bool anyChannel() {
+    for (const StreamChannel &channel : channels) {
+        if (channel.sensor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void stopChannel(StreamChannel &channel, uint8_t finalValue) {
+    channel.stopping = true;
+    channel.finalValue = finalValue;
+}
+
+void potStreamBegin() {
+    portENTER_CRITICAL(&streamLock);
+    memset(channels, 0, sizeof(channels));
+    running = false;
+    portEXIT_CRITICAL(&streamLock);
+    potStreamTimerBegin();
+}
+
+bool potStreamStart(const char *sensorName, PotWaveform waveform, float frequency, float amplitude) {
+    SensorPot pot;
+    if (!sensorPot(sensorName, pot) || waveform >= POT_WAVE_COUNT || !(frequency > 0) ||
+        frequency > POT_STREAM_MAX_HZ || !(amplitude >= 0)) {
+        return false;
+    }
+
+    // Built before taking the lock; only the copy happens inside
+    uint8_t table[POT_STREAM_TABLE_LEN];
+    buildTable(table, waveform, pot.value, amplitude, pot.pressure);
+    uint32_t step = (uint32_t)(frequency / POT_STREAM_RATE_HZ * 4294967296.0 + 0.5);
+
+    portENTER_CRITICAL(&streamLock);
+    StreamChannel *channel = findChannel(pot.csPin, pot.wiper);
+    if (!channel) {
+        channel = freeChannel();
+        if (!channel) {
+            portEXIT_CRITICAL(&streamLock);
+            Serial.printf("No free stream channel for %s\n", sensorName);
+            return false;
+        }
+        channel->sensor = pot.name;
+        channel->csPin = pot.csPin;
+        channel->wiper = pot.wiper;
+        channel->pressure = pot.pressure;
+        channel->phase = 0;
+    }
+    // A retune keeps the phase, so the waveform does not jump
+    channel->stopping = false;
+    channel->waveform = waveform;
+    channel->frequency = frequency;
+    channel->amplitude = amplitude;
+    channel->centre = pot.value;
+    channel->step = step;
+    memcpy(channel->table, table, sizeof(table));
+    if (!running) {
+        running = true;
+        restarted = true;
+        stats = {};
+        potStreamTimerStart();
+    }
+    portEXIT_CRITICAL(&streamLock);
+
+    Serial.printf("Streaming %s: %s %.1f Hz, ±%.1f\n", pot.name, WAVEFORM_NAMES[waveform], frequency, amplitude);
+    return true;
+}
+
+bool potStreamStop(const char *sensorName) {
+    bool found = false;
+    portENTER_CRITICAL(&streamLock);
+    for (StreamChannel &channel : channels) {
+        if (channel.sensor && !channel.stopping && strcmp(channel.sensor, sensorName) == 0) {
+            stopChannel(channel, potFor(channel.centre, channel.pressure));
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&streamLock);
+    return found;
+}
+
+void potStreamStopAll() {
+    portENTER_CRITICAL(&streamLock);
+    for (StreamChannel &channel : channels) {
+        if (channel.sensor && !channel.stopping) {
+            stopChannel(channel, potFor(channel.centre, channel.pressure));
+        }
+    }
+    portEXIT_CRITICAL(&streamLock);
+}
+
+bool potStreamActive() {
+    portENTER_CRITICAL(&streamLock);
+    bool active = running;
+    portEXIT_CRITICAL(&streamLock);
+    return active;
+}
+
+bool potStreamRebase(uint8_t csPin, uint8_t wiper, float value) {
+    portENTER_CRITICAL(&streamLock);
+    StreamChannel *channel = findChannel(csPin, wiper);
+    if (!channel || channel->stopping) {
+        portEXIT_CRITICAL(&streamLock);
+        return false;
+    }
+    if (channel->centre == value) {
+        portEXIT_CRITICAL(&streamLock);
+        return true;
+    }
+    PotWaveform waveform = channel->waveform;
+    float amplitude = channel->amplitude;
+    bool pressure = channel->pressure;
+    portEXIT_CRITICAL(&streamLock);
+
+    uint8_t table[POT_STREAM_TABLE_LEN];
+    buildTable(table, waveform, value, amplitude, pressure);
+
+    // Dropped if the stream was retuned or ended meanwhile; a retune
+    // already centred it on the new reading
+    portENTER_CRITICAL(&streamLock);
+    channel = findChannel(csPin, wiper);
+    bool streamed = channel && !channel->stopping;
+    if (streamed && channel->waveform == waveform && channel->amplitude == amplitude) {
+        memcpy(channel->table, table, sizeof(table));
+        channel->centre = value;
+    }
+    portEXIT_CRITICAL(&streamLock);
+    return streamed;
+}
+
+bool potStreamRelease(uint8_t csPin, uint8_t wiper, uint8_t value) {
+    portENTER_CRITICAL(&streamLock);
+    StreamChannel *channel = findChannel(csPin, wiper);
+    if (channel) {
+        stopChannel(*channel, value);
+    }
+    portEXIT_CRITICAL(&streamLock);
+    return channel != nullptr;
+}
+
+// Rate and jitter from when the frames actually finished on the bus
+static void frameFinished(int64_t doneAt) {
+    if (lastDoneAt < 0) {
+        windowStart = doneAt;
+        windowFrames = 0;
+    } else {
+        int64_t deviation = doneAt - lastDoneAt - POT_STREAM_PERIOD_US;
+        jitter.record((uint32_t)(deviation < 0 ? -deviation : deviation));
+        windowFrames++;
+    }
+    lastDoneAt = doneAt;
+
+    if (doneAt - windowStart >= POT_STREAM_WINDOW_US) {
+        float rate = windowFrames * 1e6f / (float)(doneAt - windowStart);
+        portENTER_CRITICAL(&streamLock);
+        stats.rateHz = rate;
+        portEXIT_CRITICAL(&streamLock);
+        windowStart = doneAt;
+        windowFrames = 0;
+    }
+}
+
+void potStreamTick(int64_t now) {
+    int64_t started = hal.clock->micros();
+
+    int64_t doneAt[POT_QUEUE_FRAMES];
+    uint8_t finished = hal.pots->reap(doneAt, POT_QUEUE_FRAMES);
+
+    PotWrite writes[POT_STREAM_CHANNELS];
+    uint8_t finalValues[POT_STREAM_CHANNELS];
+    uint8_t stopping = 0;       // bit per channel sending its last frame
+    uint8_t count = 0;
+    portENTER_CRITICAL(&streamLock);
+    bool fresh = restarted;
+    restarted = false;
+    for (uint8_t i = 0; i < POT_STREAM_CHANNELS; i++) {
+        StreamChannel &channel = channels[i];
+        if (!channel.sensor) {
+            continue;
+        }
+        channel.phase += channel.step;
+        uint8_t value = channel.table[channel.phase >> 24];
+        if (channel.stopping) {
+            value = channel.finalValue;
+            finalValues[i] = value;
+            stopping |= 1 << i;
+        }
+        writes[count++] = {channel.csPin, channel.wiper, value};
+    }
+    portEXIT_CRITICAL(&streamLock);
+
+    // Frames still finishing from before a stop are not part of this run
+    if (fresh) {
+        jitter.reset();
+        lastDoneAt = -1;
+    } else {
+        for (uint8_t i = 0; i < finished; i++) {
+            frameFinished(doneAt[i]);
+        }
+    }
+
+    bool queued = count > 0 && hal.pots->queue(writes, count);
+    int64_t elapsed = hal.clock->micros() - started;
+
+    portENTER_CRITICAL(&streamLock);
+    // A channel is freed once its last frame is on the bus, unless it was
+    // restarted or given another last value meanwhile
+    for (uint8_t i = 0; queued && i < POT_STREAM_CHANNELS; i++) {
+        StreamChannel &channel = channels[i];
+        if ((stopping & (1 << i)) && channel.stopping && channel.finalValue == finalValues[i]) {
+            channel.sensor = nullptr;
+        }
+    }
+    stats.ticks++;
+    stats.frames += queued;
+    stats.framesDone += fresh ? 0 : finished;
+    stats.queueFull += count > 0 && !queued;
+    stats.tickTotalUs += elapsed;
+    stats.tickMaxUs = elapsed > stats.tickMaxUs ? elapsed : stats.tickMaxUs;
+    if (!anyChannel()) {
+        running = false;
+        potStreamTimerStop();
+    }
+    portEXIT_CRITICAL(&streamLock);
+}
+
+size_t serializePotStreamStatus(char *out, size_t size) {
+    StreamChannel copies[POT_STREAM_CHANNELS];
+    portENTER_CRITICAL(&streamLock);
+    for (uint8_t i = 0; i < POT_STREAM_CHANNELS; i++) {
+        copies[i] = channels[i];
+    }
+    bool active = running;
+    StreamStats copy = stats;
+    portEXIT_CRITICAL(&streamLock);
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "potStream";
+    doc["active"] = active;
+    JsonArray list = doc["channels"].to<JsonArray>();
+    for (const StreamChannel &channel : copies) {
+        if (!channel.sensor || channel.stopping) {
+            continue;
+        }
+        JsonObject entry = list.add<JsonObject>();
+        entry["sensor"] = channel.sensor;
+        entry["waveform"] = WAVEFORM_NAMES[channel.waveform];
+        entry["frequency"] = channel.frequency;
+        entry["amplitude"] = channel.amplitude;
+        entry["centre"] = channel.centre;
+    }
+    doc["targetHz"] = POT_STREAM_RATE_HZ;
+    doc["rateHz"] = copy.rateHz;
+    doc["frames"] = copy.frames;
+    doc["framesDone"] = copy.framesDone;
+    doc["queueFull"] = copy.queueFull;
+    doc["jitterP50Us"] = jitter.percentile(0.5f);
+    doc["jitterP99Us"] = jitter.percentile(0.99f);
+    doc["jitterMaxUs"] = jitter.max.load(std::memory_order_relaxed);
+    doc["tickMeanUs"] = copy.ticks ? (float)copy.tickTotalUs / copy.ticks : 0.0f;
+    doc["tickMaxUs"] = copy.tickMaxUs;
+    return serializeJson(doc, out, size);
+}
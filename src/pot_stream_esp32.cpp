@@ -0,0 +1,37 @@
+#include "pot_stream.h"
+
+#if !HAL_NATIVE
+
+#include "esp_timer.h"
+
+// Device side of pot_stream.h. The tick runs straight from the esp_timer
+// callback: it only looks up table entries and queues SPI transactions,
+// which the bus interrupt then clocks out, so there is no task to wake
+// and nothing in it can block.
+
+static esp_timer_handle_t streamTimer = NULL;
+
+static void onStreamTimer(void *arg) {
+    potStreamTick(esp_timer_get_time());
+}
+
+void potStreamTimerBegin() {
+    if (streamTimer) {
+        return;
+    }
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onStreamTimer;
+    timerArgs.name = "potStream";
+    esp_timer_create(&timerArgs, &streamTimer);
+}
+
+// esp_timer's own lock nests inside the stream lock
+void potStreamTimerStart() {
+    esp_timer_start_periodic(streamTimer, POT_STREAM_PERIOD_US);
+}
+
+void potStreamTimerStop() {
+    esp_timer_stop(streamTimer);
+}
+
+#endif // !HAL_NATIVE
@@ -0,0 +1,36 @@
+#include "pot_stream.h"
+
+#if HAL_NATIVE
+
+// Host side of pot_stream.h: the periodic timer is a deadline the
+// simulator services, like the scenario tick
+
+static int64_t nextTickAt = -1;
+
+void potStreamTimerBegin() {
+    nextTickAt = -1;
+}
+
+void potStreamTimerStart() {
+    if (nextTickAt < 0) {
+        nextTickAt = hal.clock->micros() + POT_STREAM_PERIOD_US;
+    }
+}
+
+void potStreamTimerStop() {
+    nextTickAt = -1;
+}
+
+void potStreamServiceTimer(int64_t micros) {
+    if (nextTickAt < 0 || micros < nextTickAt) {
+        return;
+    }
+    nextTickAt += POT_STREAM_PERIOD_US;
+    potStreamTick(micros);
+}
+
+int64_t potStreamNextDeadline() {
+    return nextTickAt;
+}
+
+#endif // HAL_NATIVE
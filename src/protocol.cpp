@@ -0,0 +1,527 @@
+#include "protocol.h"
+#include "sensors_function.h"
+#include "trace.h"
+#include "metrics.h"
+#include "latency.h"
+#include "json_alloc.h"
+#include "command_cache.h"
+#include "recorder.h"
+#include <atomic>
+#include <string.h>
+
+// External variable
+extern SystemState state;
+
+// Same names as the "type" field of the frames they carry
+static const char *const TOPIC_NAMES[WS_TOPIC_COUNT] = {
+    "status",
+    "sensorData",
+    "rpmUpdate",
+    "event",
+};
+
+const char *wsTopicName(WsTopic topic) {
+    return topic < WS_TOPIC_COUNT ? TOPIC_NAMES[topic] : "?";
+}
+
+bool wsTopicFromName(const char *name, WsTopic &topic) {
+    for (int i = 0; i < WS_TOPIC_COUNT; i++) {
+        if (strcmp(name, TOPIC_NAMES[i]) == 0) {
+            topic = (WsTopic)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets the RPM state for "high" or "low" without touching MCPWM.
+// Returns false if the mode does not apply right now.
+bool stageRpmMode(const char *mode)
+{
+    if (!state.systemRunning)
+        return false;
+
+    // For container, don't change RPM
+    if (strcmp(state.systemType, SYSTEM_CONTAINER) == 0)
+    {
+        Serial.println(F("RPM control not applicable for Container"));
+        return false;
+    }
+
+    bool high = strcmp(mode, "high") == 0;
+    if (!high && strcmp(mode, "low") != 0)
+        return false;
+
+    if (strcmp(state.systemType, SYSTEM_CARRIER) == 0)
+    {
+        state.hallRpm = high ? RPM_1800 : RPM_1450;
+        state.indRpm = 0.0f;
+    }
+    else if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0)
+    {
+        state.indRpm = high ? RPM_2200 : RPM_1450;
+        state.hallRpm = 0.0f;
+    }
+    else
+    {
+        // APU (and anything else) stays at 2200
+        state.indRpm = RPM_2200;
+        state.hallRpm = 0.0f;
+    }
+    return true;
+}
+
+// In the loadSystemPreset function
+void loadSystemPreset(const char *systemType)
+{
+    // Use the handleSystemPresetChange function from ckp_functions.cpp
+    OutputFrame frame = {};
+    handleSystemPresetChange(systemType, &frame);
+
+    // Also update the sensor system, in the same output frame
+    handleSensorSystemPresetChange(systemType, &frame.pots);
+    outputFrameCommit(frame, METRIC_CMD_PRESET);
+
+    Serial.print(F("Loaded preset values for: "));
+    Serial.println(systemType);
+}
+
+// Monotonic revision of everything pushed to clients (state and events).
+// Bumped even when nobody is listening, so it always moves with the state.
+static std::atomic<uint32_t> revisionCounter(0);
+
+static uint32_t bumpRevision()
+{
+    return revisionCounter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+uint32_t stateRevision()
+{
+    return revisionCounter.load(std::memory_order_relaxed);
+}
+
+// The full "status" frame
+size_t serializeStatus(char *out, size_t size)
+{
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+
+    // System status
+    doc["systemRunning"] = state.systemRunning;
+    doc["autoRunEnabled"] = state.autoRunEnabled;
+    doc["systemType"] = state.systemType;
+
+    // RPM values
+    doc["indRpm"] = state.indRpm;
+    doc["hallRpm"] = state.hallRpm;
+
+    // LED state
+    doc["ledState"] = state.ledState;
+
+    // Add sensor values
+    doc["returnAirTemp"] = state.returnAirTemp;
+    doc["dischargeAirTemp"] = state.dischargeAirTemp;
+    doc["ambientTemp"] = state.ambientTemp;
+    doc["coolantTemp"] = state.coolantTemp;
+    doc["coilTemp"] = state.coilTemp;
+    doc["suctionPressure"] = state.suctionPressure;
+    doc["dischargePressure"] = state.dischargePressure;
+
+    // Only include redundantAirTemp if it's visible (not -1)
+    if (state.redundantAirTemp >= 0)
+    {
+        doc["redundantAirTemp"] = state.redundantAirTemp;
+    }
+    else
+    {
+        // Use null to indicate this sensor should be hidden
+        doc["redundantAirTemp"] = nullptr;
+    }
+
+    // Add message type for client to identify the type of message
+    doc["type"] = "status";
+
+    return serializeJson(doc, out, size);
+}
+
+// Same fields legacy scripts have always parsed, plus the revision to pass
+// back as ?since=
+size_t serializeHttpStatus(char *out, size_t size, uint32_t revision)
+{
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["revision"] = revision;
+    doc["systemRunning"] = state.systemRunning;
+    doc["autoRunEnabled"] = state.autoRunEnabled;
+    doc["indRpm"] = state.indRpm;
+    doc["hallRpm"] = state.hallRpm;
+    doc["systemType"] = state.systemType;
+    doc["returnAirTemp"] = state.returnAirTemp;
+    doc["dischargeAirTemp"] = state.dischargeAirTemp;
+    doc["ambientTemp"] = state.ambientTemp;
+    doc["coolantTemp"] = state.coolantTemp;
+    doc["coilTemp"] = state.coilTemp;
+    doc["suctionPressure"] = state.suctionPressure;
+    doc["dischargePressure"] = state.dischargePressure;
+    doc["redundantAirTemp"] = state.redundantAirTemp;
+    return serializeJson(doc, out, size);
+}
+
+// Single implementation of notifyClients with optional parameter
+void notifyClients(const char *message)
+{
+    TRACE_SCOPE(TRACE_EVT_NOTIFY_CLIENTS, message != nullptr);
+    uint32_t revision = bumpRevision();
+
+    // Nobody to tell - skip the serialization entirely
+    if (!hal.transport->wanted(WS_TOPIC_STATUS))
+    {
+        return;
+    }
+
+    if (message)
+    {
+        // Send the provided message directly
+        hal.transport->broadcast(WS_TOPIC_STATUS, message, strlen(message), revision);
+    }
+    else
+    {
+        // If no message is provided, send the current state
+        char jsonString[WS_MESSAGE_MAX];
+        size_t length = serializeStatus(jsonString, sizeof(jsonString));
+
+        // Latest wins: a client still busy with the last one gets this later
+        hal.transport->publish(WS_TOPIC_STATUS, jsonString, length, revision);
+    }
+}
+
+// Command responses go only to the client that sent the command
+void sendCommandResponse(ClientId client, CommandId commandId, bool success, const char* message) {
+    if (commandId == 0) return;  // Don't send response for commandId 0
+    if (!client) return;         // Button or internal command - nobody to answer
+
+    JsonArenaScope arena;
+    JsonDocument response(jsonAllocator());
+    response["type"] = "response";
+    response["commandId"] = commandId;
+    response["status"] = success ? "success" : "error";
+    if (message) {
+        response["message"] = message;
+    }
+
+    char responseStr[WS_MESSAGE_MAX];
+    size_t length = serializeJson(response, responseStr, sizeof(responseStr));
+    hal.transport->reply(client, responseStr, length);
+    commandCacheStore(client, commandId, responseStr, length);
+    latencyMark(LAT_STAGE_ACK);
+
+    Serial.print("Sent command response: ");
+    Serial.println(responseStr);
+}
+
+// One response for a whole batch; results[i] is nullptr for ops that
+// succeeded, otherwise the reason that op failed
+void sendBatchResponse(ClientId client, CommandId commandId, bool success, const char *const *results, size_t count) {
+    if (commandId == 0) return;
+    if (!client) return;
+
+    JsonArenaScope arena;
+    JsonDocument response(jsonAllocator());
+    response["type"] = "response";
+    response["commandId"] = commandId;
+    response["status"] = success ? "success" : "error";
+    if (!success) {
+        response["message"] = "Batch rejected, nothing applied";
+    }
+    JsonArray list = response["results"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        list.add(results[i] ? results[i] : "ok");
+    }
+
+    char responseStr[WS_MESSAGE_MAX];
+    size_t length = serializeJson(response, responseStr, sizeof(responseStr));
+    hal.transport->reply(client, responseStr, length);
+    commandCacheStore(client, commandId, responseStr, length);
+    latencyMark(LAT_STAGE_ACK);
+
+    Serial.printf("Sent batch response for %u ops\n", (unsigned)count);
+}
+
+// data must be terminated at len
+const CommandEntry *protocolHandleCommand(ClientId client, const char *data, size_t len) {
+    recorderCommand(client, data, len);
+    metrics.wsMessages.fetch_add(1, std::memory_order_relaxed);
+    return protocolRunCommand(client, data, len);
+}
+
+const CommandEntry *protocolRunCommand(ClientId client, const char *data, size_t len) {
+    int64_t startMicros = hal.clock->micros();
+    JsonArenaScope arena;
+    char cmd[COMMAND_NAME_MAX];
+    CommandId commandId = 0;
+    DeserializationError error = commandPeek(data, len, cmd, sizeof(cmd), commandId);
+
+    if (error) {
+        metrics.wsParseErrors.fetch_add(1, std::memory_order_relaxed);
+        latencyFinish();
+        Serial.print(F("deserializeJson() failed: "));
+        Serial.println(error.c_str());
+        return nullptr;
+    }
+
+    const CommandEntry *entry = commandLookup(cmd);
+    if (!entry) {
+        Serial.printf("Unknown command: %s\n", cmd);
+        sendCommandResponse(client, commandId, false, "Unknown command");
+        latencyFinish();
+        return nullptr;
+    }
+
+    latencyDispatch((LatencySource)entry->metric);
+
+    if (len > entry->maxLen) {
+        Serial.printf("Command %s too large: %u bytes\n", entry->name, (unsigned)len);
+        sendCommandResponse(client, commandId, false, "Command too large");
+        latencyFinish();
+        return entry;
+    }
+
+    // A retry of a command this client already completed gets the
+    // stored answer and never reaches the hardware
+    if (entry->mutates && client && commandId != 0) {
+        const char *cached;
+        size_t cachedLength;
+        if (commandCacheLookup(client, commandId, cached, cachedLength)) {
+            hal.transport->reply(client, cached, cachedLength);
+            latencyMark(LAT_STAGE_ACK);
+            latencyFinish();
+            return entry;
+        }
+    }
+
+    // Only the fields this command declared are kept
+    JsonDocument doc(jsonAllocator());
+    error = commandParse(*entry, data, len, doc);
+    if (error) {
+        metrics.wsParseErrors.fetch_add(1, std::memory_order_relaxed);
+        sendCommandResponse(client, commandId, false, "Invalid command arguments");
+        latencyFinish();
+        return entry;
+    }
+
+    entry->handler(doc.as<JsonObjectConst>(), client, commandId);
+
+    // State changes still go to every client
+    if (entry->mutates) {
+        notifyClients(nullptr);
+    }
+
+    metricsCountCommand(entry->metric, (uint32_t)(hal.clock->micros() - startMicros));
+    latencyFinish();
+    return entry;
+}
+
+bool protocolHttpCommand(HttpCommand command, const char *arg) {
+    recorderHttp(command, arg);
+
+    bool applied = true;
+    switch (command) {
+        case HTTP_CMD_START:
+            startSystem(arg ? arg : "apu");  // APU when no type is given
+            break;
+        case HTTP_CMD_STOP:
+            stopSystem(0);
+            break;
+        case HTTP_CMD_RPM:
+            applied = arg && stageRpmMode(arg);
+            if (applied) {
+                updatePwmSignals();
+                Serial.println(strcmp(arg, "high") == 0 ? F("High RPM mode activated") : F("Low RPM mode activated"));
+            }
+            break;
+        case HTTP_CMD_PAGE:
+            // Outputs go quiet until the next CKP refresh; state is untouched
+            hal.pwm->stop(PWM_THERMO_KING);
+            hal.pwm->stop(PWM_CARRIER);
+            metricsNotePwm(PWM_THERMO_KING, 0.0f);
+            metricsNotePwm(PWM_CARRIER, 0.0f);
+            hal.gpio->write(LED_PIN, LOW);
+            return true;
+        default:
+            return false;
+    }
+
+    notifyClients(nullptr);
+    return applied;
+}
+
+void protocolClientConnected(ClientId client) {
+    recorderConnect(client, true);
+    sendSystemStatus(client);
+}
+
+void protocolClientGone(ClientId client) {
+    recorderConnect(client, false);
+    commandCacheForget(client);
+}
+
+// Handle sensor data requests separately from sensor updates
+void handleSensorDataRequest(JsonDocument &doc)
+{
+    uint32_t revision = bumpRevision();
+    if (!hal.transport->wanted(WS_TOPIC_SENSORS))
+    {
+        return;
+    }
+
+    // Create a response document with sensor data
+    JsonArenaScope arena;
+    JsonDocument response(jsonAllocator());
+
+    // Add all sensor values
+    response["returnAirTemp"] = state.returnAirTemp;
+    response["dischargeAirTemp"] = state.dischargeAirTemp;
+    response["ambientTemp"] = state.ambientTemp;
+    response["coolantTemp"] = state.coolantTemp;
+    response["coilTemp"] = state.coilTemp;
+    response["suctionPressure"] = state.suctionPressure;
+    response["dischargePressure"] = state.dischargePressure;
+    response["redundantAirTemp"] = state.redundantAirTemp;
+
+    // Add message type
+    response["type"] = "sensorData";
+
+    // Serialize and send
+    char jsonString[WS_MESSAGE_MAX];
+    size_t length = serializeJson(response, jsonString, sizeof(jsonString));
+    hal.transport->publish(WS_TOPIC_SENSORS, jsonString, length, revision);
+}
+
+// Clean implementation of sendRpmChangeNotification
+void sendRpmChangeNotification()
+{
+    // Get the current RPM value and system type
+    float rpmValue = 0.0f;
+    const char *speedMessage = NULL;
+    const char *systemTypeName = NULL;
+
+    // Get RPM based on system type
+    if (strcmp(state.systemType, SYSTEM_CARRIER) == 0)
+    {
+        rpmValue = state.hallRpm;
+        systemTypeName = "Carrier";
+    }
+    else
+    {
+        rpmValue = state.indRpm;
+        systemTypeName = "Thermo King";
+    }
+
+    // Determine speed message based on RPM threshold
+    if (rpmValue >= 1800.0f)
+    {
+        speedMessage = "High speed";
+    }
+    else
+    {
+        speedMessage = "Low speed";
+    }
+
+    // Create notification message
+    char notificationMsg[80];
+    sprintf(notificationMsg, "%s is ON (%.0f RPM) - %s", speedMessage, rpmValue, systemTypeName);
+
+    // Send event notification
+    notifyEvent("rpmChanged", notificationMsg);
+
+    // Also send an RPM update notification
+    notifyRpmChange(state.indRpm, state.hallRpm);
+
+    // Log to serial (print, not printf - long lines make printf allocate)
+    Serial.print("RPM Change Notification: ");
+    Serial.println(notificationMsg);
+}
+
+// Send system status to a specific client or all clients
+void sendSystemStatus(ClientId client)
+{
+    if (client)
+    {
+        char jsonString[WS_MESSAGE_MAX];
+        size_t length = serializeStatus(jsonString, sizeof(jsonString));
+
+        // Send to specific client
+        hal.transport->reply(client, jsonString, length);
+    }
+    else
+    {
+        // Send to all clients
+        notifyClients(nullptr); // Explicitly pass nullptr to avoid ambiguity
+    }
+}
+
+// Add this function to support older code
+void sendSystemState()
+{
+    // Redirect to notifyClients for backward compatibility
+    notifyClients(nullptr);
+}
+
+// Specialized notification for events
+void notifyEvent(const char *eventType, const char *message)
+{
+    uint32_t revision = bumpRevision();
+    if (!hal.transport->wanted(WS_TOPIC_EVENTS))
+    {
+        return;
+    }
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "event";
+    doc["eventType"] = eventType;
+    doc["message"] = message;
+
+    // Add timestamp
+    unsigned long currentMillis = hal.clock->millis();
+    doc["timestamp"] = currentMillis;
+
+    char output[WS_MESSAGE_MAX];
+    size_t length = serializeJson(doc, output, sizeof(output));
+    hal.transport->broadcast(WS_TOPIC_EVENTS, output, length, revision);
+
+    Serial.print("Event notification: ");
+    Serial.print(eventType);
+    Serial.print(" - ");
+    Serial.println(message);
+}
+
+// Specialized notification for RPM changes
+void notifyRpmChange(float indRpm, float hallRpm)
+{
+    uint32_t revision = bumpRevision();
+    if (!hal.transport->wanted(WS_TOPIC_RPM))
+    {
+        return;
+    }
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "rpmUpdate";
+    doc["indRpm"] = indRpm;
+    doc["hallRpm"] = hallRpm;
+
+    // Add active RPM value for easier UI consumption
+    if (strcmp(state.systemType, SYSTEM_CARRIER) == 0)
+    {
+        doc["activeRpm"] = hallRpm;
+    }
+    else
+    {
+        doc["activeRpm"] = indRpm;
+    }
+
+    char output[WS_MESSAGE_MAX];
+    size_t length = serializeJson(doc, output, sizeof(output));
+    hal.transport->publish(WS_TOPIC_RPM, output, length, revision);
+}
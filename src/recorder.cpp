@@ -0,0 +1,170 @@
+#include "recorder.h"
+
+#if RECORDER_ENABLED
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+// Writers are the async_tcp task (commands), the button task (edges) and
+// whichever task drives the outputs, so appends take a short spinlock
+static uint8_t buffer[RECORDER_BUFFER_SIZE];
+static size_t used = 0;
+static uint32_t recordCount = 0;
+static uint32_t dropped = 0;
+static int64_t startMicros = 0;
+static int64_t lastMicros = 0;
+static bool active = false;
+static portMUX_TYPE recorderMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Last frequency recorded per channel in centi-Hz; -1 = nothing yet
+static int64_t lastPwm[PWM_CHANNEL_COUNT];
+
+static inline uint8_t *reserve(size_t worstCase) {
+    if (!active) {
+        return nullptr;
+    }
+    if (RECORDER_BUFFER_SIZE - used < worstCase) {
+        dropped++;
+        return nullptr;
+    }
+    return buffer + used;
+}
+
+// Tag and timestamp; the caller appends the payload and calls commit()
+static inline size_t putHeader(uint8_t *p, RecordKind kind, uint8_t detail, int64_t micros) {
+    p[0] = (uint8_t)(kind | (detail << 4));
+    size_t n = 1 + recordPutVarint(p + 1, recordZigzag(micros - lastMicros));
+    lastMicros = micros;
+    return n;
+}
+
+static inline void commit(size_t length) {
+    used += length;
+    recordCount++;
+}
+
+static void recordText(RecordKind kind, uint8_t detail, bool hasClient, ClientId client, const char *text,
+                       size_t length, uint64_t lengthField) {
+    int64_t now = hal.clock->micros();
+    portENTER_CRITICAL(&recorderMux);
+    uint8_t *p = reserve(RECORD_OVERHEAD_MAX + length);
+    if (p) {
+        size_t n = putHeader(p, kind, detail, now);
+        if (hasClient) {
+            n += recordPutVarint(p + n, client);
+        }
+        n += recordPutVarint(p + n, lengthField);
+        memcpy(p + n, text, length);
+        commit(n + length);
+    }
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+void recorderBegin() {
+    portENTER_CRITICAL(&recorderMux);
+    used = 0;
+    recordCount = 0;
+    dropped = 0;
+    startMicros = hal.clock->micros();
+    lastMicros = startMicros;
+    for (int i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        lastPwm[i] = -1;
+    }
+    active = true;
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+void recorderStop() {
+    active = false;
+}
+
+bool recorderActive() {
+    return active;
+}
+
+void recorderCommand(ClientId client, const char *data, size_t length) {
+    recordText(RECORD_WS, 0, true, client, data, length, length);
+}
+
+void recorderHttp(uint8_t command, const char *arg) {
+    size_t length = arg ? strlen(arg) : 0;
+    recordText(RECORD_HTTP, command, false, 0, arg, length, arg ? length + 1 : 0);
+}
+
+void recorderConnect(ClientId client, bool connected) {
+    int64_t now = hal.clock->micros();
+    portENTER_CRITICAL(&recorderMux);
+    uint8_t *p = reserve(RECORD_OVERHEAD_MAX);
+    if (p) {
+        size_t n = putHeader(p, connected ? RECORD_CONNECT : RECORD_DISCONNECT, 0, now);
+        commit(n + recordPutVarint(p + n, client));
+    }
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+void recorderEdge(uint8_t button, bool pressed, int64_t edgeMicros) {
+    portENTER_CRITICAL(&recorderMux);
+    uint8_t *p = reserve(RECORD_OVERHEAD_MAX);
+    if (p) {
+        commit(putHeader(p, RECORD_EDGE, (uint8_t)(button << 1 | (pressed ? 1 : 0)), edgeMicros));
+    }
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+void recorderPwm(PwmChannel channel, float frequency) {
+    int64_t centiHz = frequency > 0 ? (int64_t)(frequency * 100.0f + 0.5f) : 0;
+    int64_t now = hal.clock->micros();
+    portENTER_CRITICAL(&recorderMux);
+    if (lastPwm[channel] != centiHz) {
+        uint8_t *p = reserve(RECORD_OVERHEAD_MAX);
+        if (p) {
+            lastPwm[channel] = centiHz;
+            size_t n = putHeader(p, RECORD_PWM, channel, now);
+            commit(n + recordPutVarint(p + n, (uint64_t)centiHz));
+        }
+    }
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+void recorderPot(const PotWrite &write) {
+    int64_t now = hal.clock->micros();
+    portENTER_CRITICAL(&recorderMux);
+    uint8_t *p = reserve(RECORD_OVERHEAD_MAX);
+    if (p) {
+        size_t n = putHeader(p, RECORD_POT, 0, now);
+        p[n++] = write.csPin;
+        p[n++] = write.wiper;
+        p[n++] = write.value;
+        commit(n);
+    }
+    portEXIT_CRITICAL(&recorderMux);
+}
+
+size_t recorderDumpSize() {
+    return sizeof(RecordFileHeader) + RECORDER_BUFFER_SIZE;
+}
+
+size_t recorderDump(uint8_t *out, size_t maxLen) {
+    if (maxLen < recorderDumpSize()) {
+        return 0;
+    }
+
+    // Records are only ever appended, so copying under the lock gives a
+    // consistent prefix even while recording continues
+    portENTER_CRITICAL(&recorderMux);
+    RecordFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORD_MAGIC;
+    header.version = RECORD_FORMAT_VERSION;
+    header.headerSize = sizeof(RecordFileHeader);
+    header.startMicros = (uint64_t)startMicros;
+    header.recordCount = recordCount;
+    header.dropped = dropped;
+    header.bytes = (uint32_t)used;
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), buffer, used);
+    portEXIT_CRITICAL(&recorderMux);
+    return sizeof(header) + header.bytes;
+}
+
+#endif // RECORDER_ENABLED
@@ -0,0 +1,252 @@
+#include "reefer.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "hardware_config.h"
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "protocol.h"
+#include "scenario.h"
+#include "json_alloc.h"
+
+extern SystemState state;
+
+enum ReeferOutput : uint8_t {
+    REEFER_OUT_RETURN_AIR = 0,
+    REEFER_OUT_DISCHARGE_AIR,
+    REEFER_OUT_COIL,
+    REEFER_OUT_SUCTION,
+    REEFER_OUT_DISCHARGE,
+    REEFER_OUT_COOLANT,
+    REEFER_OUT_REDUNDANT_AIR,
+    REEFER_OUT_COUNT
+};
+
+#define REEFER_BIT(output)      (1u << (output))
+#define REEFER_ALL              ((1u << REEFER_OUT_COUNT) - 1)
+
+typedef struct {
+    const char *name;
+    float SystemState::*field;
+    ReeferFixed ReeferOutputs::*value;
+    bool pressure;
+} ReeferChannel;
+
+// Same order as ReeferOutput
+static const ReeferChannel CHANNELS[REEFER_OUT_COUNT] = {
+    {"returnAirTemp",     &SystemState::returnAirTemp,     &ReeferOutputs::returnAir, false},
+    {"dischargeAirTemp",  &SystemState::dischargeAirTemp,  &ReeferOutputs::supplyAir, false},
+    {"coilTemp",          &SystemState::coilTemp,          &ReeferOutputs::coil,      false},
+    {"suctionPressure",   &SystemState::suctionPressure,   &ReeferOutputs::suction,   true},
+    {"dischargePressure", &SystemState::dischargePressure, &ReeferOutputs::discharge, true},
+    {"coolantTemp",       &SystemState::coolantTemp,       &ReeferOutputs::coolant,   false},
+    {"redundantAirTemp",  &SystemState::redundantAirTemp,  &ReeferOutputs::returnAir, false},
+};
+
+typedef struct {
+    uint32_t steps;
+    uint32_t droppedSteps;
+    uint32_t overruns;
+    int64_t serviceMaxUs;
+} ReeferStats;
+
+static portMUX_TYPE reeferLock = portMUX_INITIALIZER_UNLOCKED;
+static bool active = false;
+static uint8_t startRequest = 0;    // 1 from the readings, 2 from a warm box
+static ReeferStats stats;
+
+// CKP task side
+static ReeferModel model;
+static ReeferInputs inputs;
+static int64_t nextStepAt = -1;
+static int64_t lastNotifyAt = 0;
+// A driven reading changed since the last notify; held over the throttle
+// so stateRevision() never stays behind state
+static bool notifyPending = false;
+static int16_t potValues[REEFER_OUT_COUNT];
+
+// Which sensors the model drives for the current system type, matching
+// what handleSensorSystemPresetChange() disables
+static uint8_t drivenOutputs() {
+    if (strcmp(state.systemType, SYSTEM_APU) == 0) {
+        return REEFER_BIT(REEFER_OUT_COOLANT);
+    }
+    if (strcmp(state.systemType, SYSTEM_CONTAINER) == 0) {
+        return REEFER_ALL & ~REEFER_BIT(REEFER_OUT_REDUNDANT_AIR) & ~REEFER_BIT(REEFER_OUT_COOLANT);
+    }
+    if (strcmp(state.systemType, SYSTEM_THERMO_KING) == 0) {
+        return REEFER_ALL & ~REEFER_BIT(REEFER_OUT_REDUNDANT_AIR);
+    }
+    return REEFER_ALL;
+}
+
+// The CKP outputs give the engine speed; a container runs on shore power
+// at a fixed compressor speed
+static void readInputs(ReeferInputs &in) {
+    bool container = strcmp(state.systemType, SYSTEM_CONTAINER) == 0;
+    bool apu = strcmp(state.systemType, SYSTEM_APU) == 0;
+    float rpm;
+    if (container) {
+        rpm = state.systemRunning ? RPM_1800 : 0;
+    } else if (strcmp(state.systemType, SYSTEM_CARRIER) == 0) {
+        rpm = state.hallRpm;
+    } else {
+        rpm = state.indRpm;
+    }
+
+    bool turning = state.systemRunning && rpm > 0;
+    in.compressor = turning && !apu;
+    in.engine = turning && !container;
+    in.speed = REEFER_FIXED(rpm / RPM_1800);
+    in.ambient = REEFER_FIXED(state.ambientTemp);
+}
+
+static void start(bool warmBox, int64_t now) {
+    readInputs(inputs);
+    reeferModelInit(model, REEFER_DEFAULT_PARAMS, inputs.ambient);
+    if (!warmBox) {
+        reeferModelSeed(model, REEFER_FIXED(state.returnAirTemp), REEFER_FIXED(state.coilTemp),
+                        REEFER_FIXED(state.coolantTemp), inputs.ambient, inputs.compressor);
+    }
+    for (int16_t &value : potValues) {
+        value = -1;
+    }
+    nextStepAt = now;
+    lastNotifyAt = now - REEFER_NOTIFY_US;
+    notifyPending = false;
+}
+
+// Like a scenario, only pots whose wiper step changed are written, all in
+// one SPI burst. Returns true when any driven reading in state changed,
+// whether or not its wiper moved.
+static bool writeOutputs() {
+    ReeferOutputs outputs;
+    reeferModelOutputs(model, outputs);
+    uint8_t driven = drivenOutputs();
+
+    PotBurst burst = {};
+    bool changed = false;
+    for (int i = 0; i < REEFER_OUT_COUNT; i++) {
+        if (!(driven & REEFER_BIT(i))) {
+            continue;
+        }
+        float value = REEFER_TO_FLOAT(outputs.*CHANNELS[i].value);
+        changed |= state.*CHANNELS[i].field != value;
+        uint8_t potValue = CHANNELS[i].pressure ? mapPressureToPot(value) : mapTemperatureToPot(value);
+        if (potValue != potValues[i]) {
+            setSensorValue(CHANNELS[i].name, value, &burst);
+            potValues[i] = potValue;
+        } else {
+            state.*CHANNELS[i].field = value;
+        }
+    }
+    potBurstFlush(burst);
+    return changed;
+}
+
+void reeferBegin() {
+    portENTER_CRITICAL(&reeferLock);
+    active = false;
+    startRequest = 0;
+    stats = {};
+    portEXIT_CRITICAL(&reeferLock);
+    nextStepAt = -1;
+}
+
+void reeferStart(bool warmBox) {
+    portENTER_CRITICAL(&reeferLock);
+    active = true;
+    startRequest = warmBox ? 2 : 1;
+    portEXIT_CRITICAL(&reeferLock);
+}
+
+void reeferStop() {
+    portENTER_CRITICAL(&reeferLock);
+    active = false;
+    startRequest = 0;
+    portEXIT_CRITICAL(&reeferLock);
+}
+
+bool reeferActive() {
+    return active;
+}
+
+void reeferService(int64_t now) {
+    portENTER_CRITICAL(&reeferLock);
+    bool running = active;
+    uint8_t request = startRequest;
+    startRequest = 0;
+    if (request) {
+        stats = {};
+    }
+    portEXIT_CRITICAL(&reeferLock);
+
+    if (!running) {
+        return;
+    }
+    if (request) {
+        start(request == 2, now);
+    }
+    if (now < nextStepAt) {
+        return;
+    }
+
+    int64_t started = hal.clock->micros();
+    readInputs(inputs);
+    uint32_t steps = 0;
+    while (now >= nextStepAt && steps < REEFER_MAX_CATCHUP) {
+        reeferModelStep(model, inputs);
+        nextStepAt += REEFER_TICK_US;
+        steps++;
+    }
+    uint32_t dropped = 0;
+    if (now >= nextStepAt) {
+        dropped = (uint32_t)((now - nextStepAt) / REEFER_TICK_US) + 1;
+        nextStepAt += (int64_t)dropped * REEFER_TICK_US;
+    }
+
+    ScenarioState scenario = scenarioState();
+    if (scenario == SCENARIO_STOPPED || scenario == SCENARIO_ENDED) {
+        notifyPending |= writeOutputs();
+    }
+    int64_t elapsed = hal.clock->micros() - started;
+
+    portENTER_CRITICAL(&reeferLock);
+    stats.steps += steps;
+    stats.droppedSteps += dropped;
+    stats.overruns += elapsed > REEFER_BUDGET_US;
+    stats.serviceMaxUs = elapsed > stats.serviceMaxUs ? elapsed : stats.serviceMaxUs;
+    portEXIT_CRITICAL(&reeferLock);
+
+    if (notifyPending && now - lastNotifyAt >= REEFER_NOTIFY_US) {
+        notifyClients();
+        lastNotifyAt = now;
+        notifyPending = false;
+    }
+}
+
+size_t serializeReeferStatus(char *out, size_t size) {
+    portENTER_CRITICAL(&reeferLock);
+    bool running = active;
+    ReeferStats copy = stats;
+    portEXIT_CRITICAL(&reeferLock);
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "reeferModel";
+    doc["active"] = running;
+    if (running) {
+        doc["compressor"] = inputs.compressor;
+        doc["engine"] = inputs.engine;
+        doc["speed"] = REEFER_TO_FLOAT(inputs.speed);
+        doc["box"] = REEFER_TO_FLOAT(model.box);
+        doc["coil"] = REEFER_TO_FLOAT(model.coil);
+        doc["condenser"] = REEFER_TO_FLOAT(model.condenser);
+        doc["coolant"] = REEFER_TO_FLOAT(model.coolant);
+    }
+    doc["steps"] = copy.steps;
+    doc["droppedSteps"] = copy.droppedSteps;
+    doc["serviceMaxUs"] = copy.serviceMaxUs;
+    doc["budgetUs"] = REEFER_BUDGET_US;
+    doc["overruns"] = copy.overruns;
+    return serializeJson(doc, out, size);
+}
@@ -0,0 +1,247 @@
+#include "reefer_model.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:reefer. Runs the fixed-point reefer model
+// through a set of operating profiles and holds its outputs to the
+// reference curves in reefer_reference.h. The curves come from integrating
+// the same equations in double precision, so the check catches both
+// fixed-point error and any change to the model's behaviour. Exits 1 when
+// a sample is off by more than the tolerance.
+//
+//   pio run -e reefer && .pio/build/reefer/program [-v]
+//   .pio/build/reefer/program --print-reference    rows for reefer_reference.h
+//
+// After a deliberate change to the model or its parameters, regenerate the
+// curves with --print-reference and review the diff.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "reefer_reference.h"
+
+#define REEFER_TOLERANCE_F      0.5
+#define REEFER_TOLERANCE_PSI    2.0
+#define REEFER_SAMPLE_S         600
+#define REEFER_MAX_PHASES       2
+
+typedef struct {
+    uint32_t seconds;
+    bool compressor;
+    bool engine;
+    double speed;
+    double ambient;
+} ReeferPhase;
+
+typedef struct {
+    const char *name;
+    ReeferPhase phases[REEFER_MAX_PHASES];  // unused phases have 0 seconds
+} ReeferProfile;
+
+// Every profile starts from a warm box at the first phase's ambient
+static const ReeferProfile PROFILES[] = {
+    {"pulldown_1800", {{7200, true, true, 1.0, 85}}},
+    {"pulldown_2200", {{3600, true, true, 2200.0 / 1800, 85}}},
+    {"off_cycle", {{3600, true, true, 1.0, 85}, {3600, false, false, 0, 85}}},
+    {"container", {{3600, true, false, 1.0, 95}}},
+    {"ambient_step", {{1800, true, true, 1450.0 / 1800, 85}, {1800, true, true, 1450.0 / 1800, 110}}},
+};
+
+#define PROFILE_COUNT (sizeof(PROFILES) / sizeof(PROFILES[0]))
+
+typedef struct {
+    double returnAir, supplyAir, coil, suction, discharge, coolant;
+} Sample;
+
+// The equations of reefer_model.h in double precision with the same step
+typedef struct {
+    double box, coil, condenser, coolant, equalized;
+    bool compressor;
+} ReferenceModel;
+
+static void referenceStep(ReferenceModel &m, const ReeferParams &p, const ReeferPhase &in) {
+    double dt = REEFER_TICK_US / 1e6;
+    bool on = in.compressor;
+    double capacity = 0;
+    if (on) {
+        double above = m.coil - p.coolFloor;
+        capacity = p.cool / (p.coolRef - p.coolFloor) * in.speed * (above > 0 ? above : 0);
+    }
+    double dBox = p.leak * (in.ambient - m.box) + (on ? p.boxCoil : p.boxCoilOff) * (m.coil - m.box);
+    double dCoil = (on ? p.coilBox : p.coilBoxOff) * (m.box - m.coil) - capacity;
+    double dCondenser = p.reject * capacity - (on ? p.condAmbient : p.condAmbientOff) * (m.condenser - in.ambient);
+    double open = (m.coolant - p.thermostat) / p.thermostatBand;
+    open = open < 0 ? 0 : (open > 1 ? 1 : open);
+    double dCoolant = (in.engine ? p.engineHeat * in.speed : 0) -
+                      (p.coolIdle + p.coolRad * open) * (m.coolant - in.ambient);
+    double dEqualized = on ? -m.equalized / p.tauRun : (1 - m.equalized) / p.tauEqualize;
+
+    m.box += dBox * dt;
+    m.coil += dCoil * dt;
+    m.condenser += dCondenser * dt;
+    m.coolant += dCoolant * dt;
+    m.equalized += dEqualized * dt;
+    m.compressor = on;
+}
+
+static double referenceSaturation(const ReeferParams &p, double t) {
+    t = t < -40 ? -40 : t;
+    double pressure = p.satC0 + p.satC1 * t + p.satC2 * t * t;
+    return pressure > 0 ? pressure : 0;
+}
+
+static Sample referenceSample(const ReferenceModel &m, const ReeferParams &p) {
+    Sample s;
+    s.returnAir = m.box;
+    s.supplyAir = m.compressor ? m.coil + p.supplyMix * (m.box - m.coil) : m.box;
+    s.coil = m.coil;
+    double suction = referenceSaturation(p, m.coil);
+    double discharge = referenceSaturation(p, m.condenser);
+    double middle = (suction + discharge) / 2;
+    s.suction = suction + m.equalized * (middle - suction);
+    s.discharge = discharge + m.equalized * (middle - discharge);
+    s.coolant = m.coolant;
+    return s;
+}
+
+static Sample fixedSample(const ReeferModel &model) {
+    ReeferOutputs out;
+    reeferModelOutputs(model, out);
+    return {REEFER_TO_FLOAT(out.returnAir), REEFER_TO_FLOAT(out.supplyAir), REEFER_TO_FLOAT(out.coil),
+            REEFER_TO_FLOAT(out.suction), REEFER_TO_FLOAT(out.discharge), REEFER_TO_FLOAT(out.coolant)};
+}
+
+static ReeferInputs fixedInputs(const ReeferPhase &phase) {
+    return {phase.compressor, phase.engine, REEFER_FIXED(phase.speed), REEFER_FIXED(phase.ambient)};
+}
+
+typedef void (*SampleSink)(size_t profile, uint32_t seconds, const Sample &sample, void *context);
+
+// Runs one profile on the fixed-point model (or the reference) and hands
+// over a sample every REEFER_SAMPLE_S, time 0 included
+static void runProfile(size_t index, bool reference, SampleSink sink, void *context) {
+    const ReeferProfile &profile = PROFILES[index];
+    const ReeferParams &params = REEFER_DEFAULT_PARAMS;
+    double ambient = profile.phases[0].ambient;
+
+    ReeferModel model;
+    reeferModelInit(model, params, REEFER_FIXED(ambient));
+    ReferenceModel ref = {ambient, ambient, ambient, ambient, 1.0, false};
+
+    const uint32_t ticksPerSecond = 1000000 / REEFER_TICK_US;
+    uint32_t seconds = 0;
+    sink(index, 0, reference ? referenceSample(ref, params) : fixedSample(model), context);
+    for (const ReeferPhase &phase : profile.phases) {
+        ReeferInputs inputs = fixedInputs(phase);
+        for (uint32_t s = 0; s < phase.seconds; s++) {
+            for (uint32_t tick = 0; tick < ticksPerSecond; tick++) {
+                if (reference) {
+                    referenceStep(ref, params, phase);
+                } else {
+                    reeferModelStep(model, inputs);
+                }
+            }
+            seconds++;
+            if (seconds % REEFER_SAMPLE_S == 0) {
+                sink(index, seconds, reference ? referenceSample(ref, params) : fixedSample(model), context);
+            }
+        }
+    }
+}
+
+static void printRow(size_t profile, uint32_t seconds, const Sample &s, void *context) {
+    printf("    {%u, %5u, %7.2ff, %7.2ff, %7.2ff, %7.2ff, %7.2ff, %7.2ff},\n", (unsigned)profile,
+           (unsigned)seconds, s.returnAir, s.supplyAir, s.coil, s.suction, s.discharge, s.coolant);
+}
+
+typedef struct {
+    size_t next;            // index into REEFER_REFERENCE
+    size_t checked;
+    double maxTemperatureError;
+    double maxPressureError;
+    bool verbose;
+    bool missing;
+} CheckContext;
+
+static void checkRow(size_t profile, uint32_t seconds, const Sample &s, void *context) {
+    CheckContext &check = *(CheckContext *)context;
+    const size_t rows = sizeof(REEFER_REFERENCE) / sizeof(REEFER_REFERENCE[0]);
+    while (check.next < rows && (REEFER_REFERENCE[check.next].profile != profile ||
+                                 REEFER_REFERENCE[check.next].seconds != seconds)) {
+        check.next++;
+    }
+    if (check.next >= rows) {
+        check.missing = true;
+        return;
+    }
+    const ReeferReference &ref = REEFER_REFERENCE[check.next++];
+    double temperature = fmax(fmax(fabs(s.returnAir - ref.returnAir), fabs(s.supplyAir - ref.supplyAir)),
+                              fmax(fabs(s.coil - ref.coil), fabs(s.coolant - ref.coolant)));
+    double pressure = fmax(fabs(s.suction - ref.suction), fabs(s.discharge - ref.discharge));
+    check.maxTemperatureError = fmax(check.maxTemperatureError, temperature);
+    check.maxPressureError = fmax(check.maxPressureError, pressure);
+    check.checked++;
+    if (check.verbose) {
+        printf("%-14s %5us box %6.1f supply %6.1f coil %6.1f suction %5.1f discharge %5.1f coolant %5.1f\n",
+               PROFILES[profile].name, (unsigned)seconds, s.returnAir, s.supplyAir, s.coil, s.suction,
+               s.discharge, s.coolant);
+    }
+}
+
+// Host cost of one step; the ESP32 figure comes from env:esp32dev_bench
+static double nsPerStep() {
+    ReeferModel model;
+    reeferModelInit(model, REEFER_DEFAULT_PARAMS, REEFER_FIXED(85));
+    ReeferInputs inputs = fixedInputs(PROFILES[0].phases[0]);
+    const uint32_t steps = 1000000;
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < steps; i++) {
+        reeferModelStep(model, inputs);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    volatile ReeferFixed sink = model.box;
+    (void)sink;
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / steps;
+}
+
+int main(int argc, char **argv) {
+    bool printReference = false;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--print-reference") == 0) {
+            printReference = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "usage: program [--print-reference] [-v]\n");
+            return 2;
+        }
+    }
+
+    if (printReference) {
+        for (size_t i = 0; i < PROFILE_COUNT; i++) {
+            runProfile(i, true, printRow, nullptr);
+        }
+        return 0;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < PROFILE_COUNT; i++) {
+        CheckContext check = {};
+        check.verbose = verbose;
+        runProfile(i, false, checkRow, &check);
+        bool ok = !check.missing && check.checked > 0 && check.maxTemperatureError <= REEFER_TOLERANCE_F &&
+                  check.maxPressureError <= REEFER_TOLERANCE_PSI;
+        failures += !ok;
+        printf("RESULT reefer profile=%s samples=%u max_temp_err_f=%.3f max_pressure_err_psi=%.3f status=%s\n",
+               PROFILES[i].name, (unsigned)check.checked, check.maxTemperatureError, check.maxPressureError,
+               check.missing ? "NO_REFERENCE" : (ok ? "ok" : "DEVIATED"));
+    }
+    printf("RESULT reefer_summary profiles=%u failures=%d ns_per_step=%.1f %s\n", (unsigned)PROFILE_COUNT, failures,
+           nsPerStep(), failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,146 @@
+#include "reefer_model.h"
+
+#define REEFER_ONE      ((ReeferFixed)1 << REEFER_FRAC_BITS)
+
+// R-404A saturation, fitted from -40 to 120 °F to within 4 PSI. Below
+// -40 °F the fit turns back up, so colder coils read as -40 °F.
+#define REEFER_SAT_MIN  REEFER_FIXED(-40)
+
+const ReeferParams REEFER_DEFAULT_PARAMS = {
+    1.0f / 5400,    // leak
+    1.0f / 900,     // boxCoil
+    1.0f / 9000,    // boxCoilOff
+    1.0f / 25,      // coilBox
+    1.0f / 250,     // coilBoxOff
+    1.2f,           // cool
+    -70.0f,         // coolFloor
+    40.0f,          // coolRef
+    0.8f,           // reject
+    1.0f / 30,      // condAmbient
+    1.0f / 400,     // condAmbientOff
+    0.25f,          // engineHeat
+    1.0f / 2400,    // coolIdle
+    1.0f / 25,      // coolRad
+    180.0f,         // thermostat
+    10.0f,          // thermostatBand
+    5.0f,           // tauRun
+    60.0f,          // tauEqualize
+    0.25f,          // supplyMix
+    29.35f,         // satC0
+    0.9688f,        // satC1
+    0.011208f,      // satC2
+};
+
+// Per-second rate to a per-tick Q1.30 factor
+static int32_t tickRate(double perSecond) {
+    double perTick = perSecond * REEFER_TICK_US / 1e6;
+    return (int32_t)(perTick * ((int64_t)1 << REEFER_RATE_BITS) + 0.5);
+}
+
+// Dimensionless Q1.30 factor
+static int32_t factor(double value) {
+    return (int32_t)(value * ((int64_t)1 << REEFER_RATE_BITS) + (value < 0 ? -0.5 : 0.5));
+}
+
+// Q1.30 times Q11.20, rounded
+static inline ReeferFixed scale(int32_t rate, ReeferFixed x) {
+    return (ReeferFixed)(((int64_t)rate * x + ((int64_t)1 << (REEFER_RATE_BITS - 1))) >> REEFER_RATE_BITS);
+}
+
+static inline ReeferFixed mul(ReeferFixed a, ReeferFixed b) {
+    return (ReeferFixed)(((int64_t)a * b + (1 << (REEFER_FRAC_BITS - 1))) >> REEFER_FRAC_BITS);
+}
+
+static inline ReeferFixed clamp(ReeferFixed x, ReeferFixed low, ReeferFixed high) {
+    return x < low ? low : (x > high ? high : x);
+}
+
+void reeferModelInit(ReeferModel &model, const ReeferParams &params, ReeferFixed ambient) {
+    model.leak = tickRate(params.leak);
+    model.boxCoil = tickRate(params.boxCoil);
+    model.boxCoilOff = tickRate(params.boxCoilOff);
+    model.coilBox = tickRate(params.coilBox);
+    model.coilBoxOff = tickRate(params.coilBoxOff);
+    model.capacity = tickRate(params.cool / (params.coolRef - params.coolFloor));
+    model.reject = factor(params.reject);
+    model.condAmbient = tickRate(params.condAmbient);
+    model.condAmbientOff = tickRate(params.condAmbientOff);
+    model.engineHeat = tickRate(params.engineHeat);
+    model.coolIdle = tickRate(params.coolIdle);
+    model.coolRad = tickRate(params.coolRad);
+    model.thermostatGain = factor(1.0 / params.thermostatBand);
+    model.runRate = tickRate(1.0 / params.tauRun);
+    model.equalizeRate = tickRate(1.0 / params.tauEqualize);
+    model.supplyMix = factor(params.supplyMix);
+    model.satC1 = factor(params.satC1);
+    model.satC2 = factor(params.satC2);
+    model.coolFloor = REEFER_FIXED(params.coolFloor);
+    model.thermostat = REEFER_FIXED(params.thermostat);
+    model.satC0 = REEFER_FIXED(params.satC0);
+
+    reeferModelSeed(model, ambient, ambient, ambient, ambient, false);
+}
+
+void reeferModelSeed(ReeferModel &model, ReeferFixed box, ReeferFixed coil, ReeferFixed coolant,
+                     ReeferFixed ambient, bool compressor) {
+    model.box = box;
+    model.coil = coil;
+    model.condenser = ambient;
+    model.coolant = coolant;
+    model.equalized = compressor ? 0 : REEFER_ONE;
+    model.compressor = compressor;
+}
+
+void reeferModelStep(ReeferModel &model, const ReeferInputs &inputs) {
+    bool on = inputs.compressor;
+    ReeferFixed ambient = inputs.ambient;
+
+    ReeferFixed capacity = 0;
+    if (on) {
+        ReeferFixed above = model.coil - model.coolFloor;
+        capacity = scale(model.capacity, mul(inputs.speed, above > 0 ? above : 0));
+    }
+
+    // All derivatives from the old state, then one update (explicit Euler)
+    ReeferFixed box = model.box;
+    ReeferFixed coil = model.coil;
+    ReeferFixed dBox = scale(model.leak, ambient - box) + scale(on ? model.boxCoil : model.boxCoilOff, coil - box);
+    ReeferFixed dCoil = scale(on ? model.coilBox : model.coilBoxOff, box - coil) - capacity;
+    ReeferFixed dCondenser = scale(model.reject, capacity) -
+                             scale(on ? model.condAmbient : model.condAmbientOff, model.condenser - ambient);
+
+    ReeferFixed open = clamp(scale(model.thermostatGain, model.coolant - model.thermostat), 0, REEFER_ONE);
+    int32_t coolRate = model.coolIdle + (int32_t)(((int64_t)model.coolRad * open) >> REEFER_FRAC_BITS);
+    ReeferFixed dCoolant = (inputs.engine ? scale(model.engineHeat, inputs.speed) : 0) -
+                           scale(coolRate, model.coolant - ambient);
+
+    ReeferFixed dEqualized = on ? -scale(model.runRate, model.equalized)
+                                : scale(model.equalizeRate, REEFER_ONE - model.equalized);
+
+    model.box += dBox;
+    model.coil += dCoil;
+    model.condenser += dCondenser;
+    model.coolant += dCoolant;
+    model.equalized += dEqualized;
+    model.compressor = on;
+}
+
+static ReeferFixed saturation(const ReeferModel &model, ReeferFixed temperature) {
+    ReeferFixed t = temperature < REEFER_SAT_MIN ? REEFER_SAT_MIN : temperature;
+    ReeferFixed pressure = model.satC0 + scale(model.satC1, t) + mul(scale(model.satC2, t), t);
+    return pressure > 0 ? pressure : 0;
+}
+
+void reeferModelOutputs(const ReeferModel &model, ReeferOutputs &outputs) {
+    outputs.returnAir = model.box;
+    // With the fans stopped the supply sensor sits in still box air
+    outputs.supplyAir = model.compressor ? model.coil + scale(model.supplyMix, model.box - model.coil) : model.box;
+    outputs.coil = model.coil;
+
+    ReeferFixed suction = saturation(model, model.coil);
+    ReeferFixed discharge = saturation(model, model.condenser);
+    ReeferFixed middle = (suction + discharge) / 2;
+    outputs.suction = suction + mul(model.equalized, middle - suction);
+    outputs.discharge = discharge + mul(model.equalized, middle - discharge);
+    outputs.coolant = model.coolant;
+}
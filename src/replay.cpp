@@ -0,0 +1,241 @@
+#include "replay.h"
+
+#if HAL_NATIVE
+
+#include <Arduino.h>
+#include <string.h>
+#include <string>
+#include "protocol.h"
+
+static const char *const HTTP_NAMES[HTTP_CMD_COUNT] = {
+    "start",
+    "stop",
+    "rpm",
+    "page",
+};
+
+static const char *const CHANNEL_NAMES[PWM_CHANNEL_COUNT] = {
+    "thermoking",
+    "carrier",
+};
+
+static bool isOutput(const RecordEntry &entry) {
+    return entry.kind == RECORD_PWM || entry.kind == RECORD_POT;
+}
+
+bool replayParse(const uint8_t *data, size_t length, Recording &recording) {
+    recording.data.assign(data, data + length);
+    recording.entries.clear();
+    recording.commands = 0;
+    recording.edges = 0;
+    recording.outputs = 0;
+    recording.lastInputMicros = 0;
+
+    if (length < sizeof(RecordFileHeader)) {
+        fprintf(stderr, "replay: too short for a record header\n");
+        return false;
+    }
+    memcpy(&recording.header, recording.data.data(), sizeof(RecordFileHeader));
+    const RecordFileHeader &header = recording.header;
+    if (header.magic != RECORD_MAGIC || header.version != RECORD_FORMAT_VERSION ||
+        header.headerSize != sizeof(RecordFileHeader)) {
+        fprintf(stderr, "replay: not a version %d record dump\n", RECORD_FORMAT_VERSION);
+        return false;
+    }
+    if (header.bytes > length - header.headerSize) {
+        fprintf(stderr, "replay: dump truncated (%u of %u record bytes)\n",
+                (unsigned)(length - header.headerSize), header.bytes);
+        return false;
+    }
+
+    const uint8_t *records = recording.data.data() + header.headerSize;
+    size_t pos = 0;
+    int64_t clock = (int64_t)header.startMicros;
+    RecordEntry entry;
+    while (recordNext(records, header.bytes, pos, clock, entry)) {
+        recording.entries.push_back(entry);
+        if (entry.kind == RECORD_WS || entry.kind == RECORD_HTTP) {
+            recording.commands++;
+        } else if (entry.kind == RECORD_EDGE) {
+            recording.edges++;
+        }
+        if (isOutput(entry)) {
+            recording.outputs++;
+        } else if (entry.micros > recording.lastInputMicros) {
+            recording.lastInputMicros = entry.micros;
+        }
+    }
+    if (pos != header.bytes || recording.entries.size() != header.recordCount) {
+        fprintf(stderr, "replay: bad record %zu at offset %zu\n", recording.entries.size(), pos);
+        return false;
+    }
+    if (header.dropped) {
+        fprintf(stderr, "replay: the recorder ran out of room; %u later records are missing\n", header.dropped);
+    }
+    return true;
+}
+
+bool replayLoad(const char *path, Recording &recording) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "replay: cannot open %s\n", path);
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    fclose(file);
+    return replayParse(data.data(), data.size(), recording);
+}
+
+static void runInput(void *arg) {
+    const RecordEntry &entry = *(const RecordEntry *)arg;
+    switch (entry.kind) {
+        case RECORD_WS:
+            simCommand(entry.client, entry.text, entry.length);
+            break;
+        case RECORD_HTTP: {
+            std::string param(entry.text, entry.length);
+            simHttp((HttpCommand)entry.detail, entry.hasText ? param.c_str() : nullptr);
+            break;
+        }
+        case RECORD_CONNECT:
+        case RECORD_DISCONNECT:
+            simClient(entry.client, entry.kind == RECORD_CONNECT);
+            break;
+        case RECORD_EDGE:
+            simButton((ButtonId)(entry.detail >> 1), entry.detail & 1);
+            break;
+        default:
+            break;
+    }
+}
+
+void replaySchedule(const Recording &recording) {
+    // Button edges carry their ISR time and can be stamped a little before
+    // the record ahead of them; recorded order is what the device ran
+    int64_t at = 0;
+    for (const RecordEntry &entry : recording.entries) {
+        if (isOutput(entry)) {
+            continue;
+        }
+        if (entry.micros > at) {
+            at = entry.micros;
+        }
+        simAt(at, runInput, (void *)&entry);
+    }
+}
+
+static void describe(const RecordEntry &entry, char *out, size_t size) {
+    switch (entry.kind) {
+        case RECORD_PWM:
+            if (entry.centiHz == 0) {
+                snprintf(out, size, "pwm %s stop", CHANNEL_NAMES[entry.detail % PWM_CHANNEL_COUNT]);
+            } else {
+                snprintf(out, size, "pwm %s %u.%02u Hz", CHANNEL_NAMES[entry.detail % PWM_CHANNEL_COUNT],
+                         entry.centiHz / 100, entry.centiHz % 100);
+            }
+            break;
+        case RECORD_POT:
+            snprintf(out, size, "pot cs=%u wiper=0x%02X value=%u", entry.csPin, entry.wiper, entry.value);
+            break;
+        default:
+            snprintf(out, size, "%s", RECORD_KIND_NAMES[entry.kind]);
+            break;
+    }
+}
+
+static bool sameOutput(const RecordEntry &a, const RecordEntry &b) {
+    if (a.kind != b.kind) {
+        return false;
+    }
+    if (a.kind == RECORD_PWM) {
+        return a.detail == b.detail && a.centiHz == b.centiHz;
+    }
+    return a.csPin == b.csPin && a.wiper == b.wiper && a.value == b.value;
+}
+
+bool replayCompareOutputs(const Recording &recorded, const Recording &replayed, FILE *report) {
+    std::vector<const RecordEntry *> expected;
+    std::vector<const RecordEntry *> actual;
+    for (const RecordEntry &entry : recorded.entries) {
+        if (isOutput(entry)) {
+            expected.push_back(&entry);
+        }
+    }
+    for (const RecordEntry &entry : replayed.entries) {
+        if (isOutput(entry)) {
+            actual.push_back(&entry);
+        }
+    }
+
+    // Matching changes are expected to happen a little apart (task phase,
+    // timer latency); the largest gap is worth knowing
+    size_t matched = 0;
+    int64_t maxSkew = 0;
+    while (matched < expected.size() && matched < actual.size() && sameOutput(*expected[matched], *actual[matched])) {
+        int64_t skew = actual[matched]->micros - expected[matched]->micros;
+        if (llabs(skew) > llabs(maxSkew)) {
+            maxSkew = skew;
+        }
+        matched++;
+    }
+
+    bool same = matched == expected.size() && matched == actual.size();
+    fprintf(report, "outputs: recorded=%zu replayed=%zu matched=%zu max_skew_us=%lld %s\n", expected.size(),
+            actual.size(), matched, (long long)maxSkew, same ? "identical" : "DIVERGED");
+    if (!same) {
+        char want[64] = "(none)";
+        char got[64] = "(none)";
+        long long wantAt = -1;
+        long long gotAt = -1;
+        if (matched < expected.size()) {
+            describe(*expected[matched], want, sizeof(want));
+            wantAt = expected[matched]->micros;
+        }
+        if (matched < actual.size()) {
+            describe(*actual[matched], got, sizeof(got));
+            gotAt = actual[matched]->micros;
+        }
+        fprintf(report, "first divergence at output #%zu:\n  recorded %lld us: %s\n  replayed %lld us: %s\n",
+                matched, wantAt, want, gotAt, got);
+    }
+    return same;
+}
+
+void replayPrint(const Recording &recording, FILE *out) {
+    const RecordFileHeader &header = recording.header;
+    fprintf(out, "# start_us=%llu records=%u dropped=%u bytes=%u\n", (unsigned long long)header.startMicros,
+            header.recordCount, header.dropped, header.bytes);
+    for (const RecordEntry &entry : recording.entries) {
+        fprintf(out, "%lld ", (long long)entry.micros);
+        switch (entry.kind) {
+            case RECORD_WS:
+                fprintf(out, "ws %u %.*s\n", entry.client, (int)entry.length, entry.text);
+                break;
+            case RECORD_HTTP:
+                fprintf(out, "http %s %.*s\n", entry.detail < HTTP_CMD_COUNT ? HTTP_NAMES[entry.detail] : "?",
+                        entry.hasText ? (int)entry.length : 1, entry.hasText ? entry.text : "-");
+                break;
+            case RECORD_CONNECT:
+            case RECORD_DISCONNECT:
+                fprintf(out, "%s %u\n", RECORD_KIND_NAMES[entry.kind], entry.client);
+                break;
+            case RECORD_EDGE:
+                fprintf(out, "edge %s %s\n", inputButtonName((ButtonId)(entry.detail >> 1)),
+                        (entry.detail & 1) ? "down" : "up");
+                break;
+            default: {
+                char text[64];
+                describe(entry, text, sizeof(text));
+                fprintf(out, "%s\n", text);
+                break;
+            }
+        }
+    }
+}
+
+#endif // HAL_NATIVE
@@ -0,0 +1,594 @@
+#include "scenario.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "ckp_functions.h"
+#include "sensors_function.h"
+#include "protocol.h"
+#include "json_alloc.h"
+
+extern SystemState state;
+
+typedef struct {
+    const char *name;
+    float SystemState::*field;
+    bool pressure;
+} ScenarioChannelInfo;
+
+// Same order as ScenarioChannel. The sensor names are the ones
+// setSensorValue() takes.
+static const ScenarioChannelInfo CHANNELS[SCENARIO_CHANNEL_COUNT] = {
+    {"returnAirTemp",     &SystemState::returnAirTemp,     false},
+    {"dischargeAirTemp",  &SystemState::dischargeAirTemp,  false},
+    {"ambientTemp",       &SystemState::ambientTemp,       false},
+    {"coolantTemp",       &SystemState::coolantTemp,       false},
+    {"coilTemp",          &SystemState::coilTemp,          false},
+    {"suctionPressure",   &SystemState::suctionPressure,   true},
+    {"dischargePressure", &SystemState::dischargePressure, true},
+    {"redundantAirTemp",  &SystemState::redundantAirTemp,  false},
+    {"indRpm",            &SystemState::indRpm,            false},
+    {"hallRpm",           &SystemState::hallRpm,           false},
+};
+
+static const char *const STATE_NAMES[] = {"stopped", "loading", "playing", "paused", "ended"};
+
+// Where a channel is heading, in script time. Before its first keyframe a
+// channel is not driven and keeps whatever the bench set.
+typedef struct {
+    float from;
+    float to;
+    int64_t start;
+    uint32_t ramp;
+    float applied;
+    int16_t potValue;   // wiper value last written, -1 for none
+    bool driven;
+    bool dirty;         // push even if the value did not move (after a seek)
+} Segment;
+
+typedef struct {
+    uint32_t events;
+    uint32_t badLines;
+    uint32_t passes;
+    uint32_t starvedTicks;
+    int64_t lateMaxUs;
+    int64_t lateSumUs;
+    int64_t jitterMaxUs;
+    int64_t applyMaxUs;
+} ScenarioStats;
+
+// Control side, written by any task under the lock
+static portMUX_TYPE scenarioLock = portMUX_INITIALIZER_UNLOCKED;
+static ScenarioState current = SCENARIO_STOPPED;
+static char playingName[SCENARIO_NAME_MAX + 1] = "";
+static bool looping = false;
+static bool loadRequested = false;
+static bool closeRequested = false;
+static bool playAfterLoad = false;
+static int64_t origin = 0;          // clock time of script time 0
+static int64_t heldPosition = 0;    // script time while loading, paused or ended
+static int64_t lengthUs = -1;       // one pass, once the reader has seen the end
+static const char *lastError = nullptr;
+static ScenarioStats stats;
+
+// Scenario task side
+static ScenarioKeyframe queue[SCENARIO_QUEUE_LEN];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+static bool sourceOpen = false;
+static bool sourceEnded = false;
+static uint32_t lastMs = 0;
+static int64_t passOffset = 0;
+static Segment segments[SCENARIO_CHANNEL_COUNT];
+static float baseline[SCENARIO_CHANNEL_COUNT];
+static int64_t lastTickAt = -1;
+static int64_t lastNotifyAt = 0;
+
+static int findChannel(const char *name, size_t length) {
+    for (int i = 0; i < SCENARIO_CHANNEL_COUNT; i++) {
+        if (strlen(CHANNELS[i].name) == length && strncmp(CHANNELS[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char *skipSpaces(const char *p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+static bool lineEnds(const char *p) {
+    p = skipSpaces(p);
+    return *p == 0 || *p == '#' || *p == '\r' || *p == '\n';
+}
+
+int scenarioParseLine(const char *line, uint32_t &lastMs, ScenarioKeyframe &keyframe) {
+    const char *p = skipSpaces(line);
+    if (lineEnds(p)) {
+        return 0;
+    }
+
+    bool relative = *p == '+';
+    if (relative) {
+        p++;
+    }
+    if (!isdigit((unsigned char)*p)) {
+        return -1;
+    }
+    char *end;
+    unsigned long time = strtoul(p, &end, 10);
+    p = skipSpaces(end);
+
+    const char *name = p;
+    while (*p && !isspace((unsigned char)*p)) {
+        p++;
+    }
+    int channel = findChannel(name, p - name);
+    if (channel < 0) {
+        return -1;
+    }
+
+    float value = strtof(p, &end);
+    if (end == p) {
+        return -1;
+    }
+    p = skipSpaces(end);
+
+    unsigned long ramp = 0;
+    if (isdigit((unsigned char)*p)) {
+        ramp = strtoul(p, &end, 10);
+        p = end;
+    }
+    if (!lineEnds(p)) {
+        return -1;
+    }
+
+    uint32_t ms = relative ? lastMs + time : time;
+    if (ms < lastMs) {
+        return -1;
+    }
+    lastMs = ms;
+    keyframe.at = (int64_t)ms * 1000;
+    keyframe.ramp = ramp * 1000;
+    keyframe.value = value;
+    keyframe.channel = channel;
+    return 1;
+}
+
+static bool validName(const char *name) {
+    size_t length = strlen(name);
+    if (length == 0 || length > SCENARIO_NAME_MAX || name[0] == '.') {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = name[i];
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float segmentValue(const Segment &segment, int64_t at) {
+    if (segment.ramp == 0 || at >= segment.start + segment.ramp) {
+        return segment.to;
+    }
+    if (at <= segment.start) {
+        return segment.from;
+    }
+    return segment.from + (segment.to - segment.from) * (float)(at - segment.start) / segment.ramp;
+}
+
+// Ramps start from the value the channel has at the keyframe's own time,
+// not at the tick that happened to pick it up
+static void applyKeyframe(const ScenarioKeyframe &keyframe) {
+    Segment &segment = segments[keyframe.channel];
+    segment.from = segment.driven ? segmentValue(segment, keyframe.at) : baseline[keyframe.channel];
+    segment.to = keyframe.value;
+    segment.start = keyframe.at;
+    segment.ramp = keyframe.ramp;
+    segment.driven = true;
+}
+
+// Next keyframe of the file in script time. Wraps to the top when looping.
+static bool readKeyframe(ScenarioKeyframe &keyframe) {
+    char line[SCENARIO_LINE_MAX];
+    while (!sourceEnded) {
+        if (!scenarioSourceReadLine(line, sizeof(line))) {
+            // An empty or zero-length script has nothing to repeat
+            if (!looping || lastMs == 0) {
+                sourceEnded = true;
+                break;
+            }
+            portENTER_CRITICAL(&scenarioLock);
+            if (lengthUs < 0) {
+                lengthUs = (int64_t)lastMs * 1000;
+            }
+            stats.passes++;
+            portEXIT_CRITICAL(&scenarioLock);
+            scenarioSourceRewind();
+            passOffset += lengthUs;
+            lastMs = 0;
+            continue;
+        }
+
+        int parsed = scenarioParseLine(line, lastMs, keyframe);
+        if (parsed < 0) {
+            portENTER_CRITICAL(&scenarioLock);
+            stats.badLines++;
+            portEXIT_CRITICAL(&scenarioLock);
+            if (passOffset == 0) {
+                Serial.printf("Scenario: skipped line: %s\n", line);
+            }
+        } else if (parsed > 0) {
+            keyframe.at += passOffset;
+            return true;
+        }
+    }
+    portENTER_CRITICAL(&scenarioLock);
+    if (lengthUs < 0) {
+        lengthUs = (int64_t)lastMs * 1000;
+    }
+    portEXIT_CRITICAL(&scenarioLock);
+    return false;
+}
+
+static void closeSource() {
+    if (sourceOpen) {
+        scenarioSourceClose();
+        sourceOpen = false;
+    }
+    queueHead = 0;
+    queueCount = 0;
+}
+
+static void pushKeyframe(const ScenarioKeyframe &keyframe) {
+    queue[(queueHead + queueCount) % SCENARIO_QUEUE_LEN] = keyframe;
+    queueCount++;
+}
+
+// Opens the file and replays it silently up to target, so the channels
+// hold exactly what they would have had when playing through
+static void openAt(const char *name, int64_t target, int64_t now) {
+    closeSource();
+    sourceOpen = scenarioSourceOpen(name);
+    if (!sourceOpen) {
+        portENTER_CRITICAL(&scenarioLock);
+        current = SCENARIO_STOPPED;
+        lastError = "Cannot open scenario";
+        portEXIT_CRITICAL(&scenarioLock);
+        Serial.printf("Scenario: cannot open %s\n", name);
+        return;
+    }
+
+    portENTER_CRITICAL(&scenarioLock);
+    stats = {};
+    portEXIT_CRITICAL(&scenarioLock);
+    sourceEnded = false;
+    lastMs = 0;
+    passOffset = 0;
+    for (int i = 0; i < SCENARIO_CHANNEL_COUNT; i++) {
+        segments[i] = {};
+        segments[i].from = segments[i].to = baseline[i];
+        segments[i].potValue = -1;
+    }
+
+    ScenarioKeyframe keyframe;
+    while (readKeyframe(keyframe)) {
+        // From the second pass on every pass is the same, so skip whole ones
+        if (passOffset > 0 && lengthUs > 0 && target >= passOffset + lengthUs) {
+            passOffset += (target - passOffset) / lengthUs * lengthUs;
+        }
+        if (keyframe.at > target) {
+            pushKeyframe(keyframe);
+            break;
+        }
+        applyKeyframe(keyframe);
+    }
+    for (Segment &segment : segments) {
+        segment.dirty = segment.driven;
+    }
+
+    portENTER_CRITICAL(&scenarioLock);
+    if (current == SCENARIO_LOADING) {
+        current = playAfterLoad ? SCENARIO_PLAYING : SCENARIO_PAUSED;
+        origin = now - target;
+        heldPosition = target;
+    }
+    portEXIT_CRITICAL(&scenarioLock);
+    lastTickAt = -1;
+    Serial.printf("Scenario: %s from %lld ms\n", name, (long long)(target / 1000));
+}
+
+static void fill() {
+    ScenarioKeyframe keyframe;
+    while (sourceOpen && queueCount < SCENARIO_QUEUE_LEN && readKeyframe(keyframe)) {
+        pushKeyframe(keyframe);
+    }
+}
+
+static bool rampsDone(int64_t position) {
+    for (const Segment &segment : segments) {
+        if (segment.driven && position < segment.start + segment.ramp) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pushes every channel whose value moved: pots in one SPI burst, MCPWM once.
+// A slow ramp moves the value every tick but the wiper only now and then,
+// so the pot is written only when its step changes.
+static bool pushOutputs(int64_t position) {
+    PotBurst burst = {};
+    bool rpmChanged = false;
+    bool changed = false;
+    for (int i = 0; i < SCENARIO_CHANNEL_COUNT; i++) {
+        Segment &segment = segments[i];
+        if (!segment.driven) {
+            continue;
+        }
+        float value = segmentValue(segment, position);
+        if (value == segment.applied && !segment.dirty) {
+            continue;
+        }
+        if (segment.dirty) {
+            segment.potValue = -1;
+        }
+        segment.applied = value;
+        segment.dirty = false;
+        changed = true;
+        if (i >= SCENARIO_IND_RPM) {
+            state.*CHANNELS[i].field = value;
+            rpmChanged = true;
+            continue;
+        }
+        uint8_t potValue = CHANNELS[i].pressure ? mapPressureToPot(value) : mapTemperatureToPot(value);
+        if (potValue != segment.potValue) {
+            setSensorValue(CHANNELS[i].name, value, &burst);
+            segment.potValue = potValue;
+        } else {
+            state.*CHANNELS[i].field = value;
+        }
+    }
+    potBurstFlush(burst);
+    if (rpmChanged) {
+        updatePwmSignals();
+    }
+    return changed;
+}
+
+void scenarioTick(int64_t now) {
+    portENTER_CRITICAL(&scenarioLock);
+    bool load = loadRequested;
+    bool close = closeRequested;     // with load: a new play, not a seek
+    int64_t target = heldPosition;
+    char name[SCENARIO_NAME_MAX + 1];
+    strlcpy(name, playingName, sizeof(name));
+    loadRequested = false;
+    closeRequested = false;
+    if (lastTickAt >= 0) {
+        int64_t jitter = now - lastTickAt - SCENARIO_TICK_US;
+        jitter = jitter < 0 ? -jitter : jitter;
+        if (jitter > stats.jitterMaxUs) {
+            stats.jitterMaxUs = jitter;
+        }
+    }
+    portEXIT_CRITICAL(&scenarioLock);
+    lastTickAt = now;
+
+    if (close) {
+        closeSource();
+    }
+    if (load && close) {
+        // Where ramps start from before a channel's first keyframe. Seeks
+        // replay from the same values.
+        for (int i = 0; i < SCENARIO_CHANNEL_COUNT; i++) {
+            baseline[i] = state.*CHANNELS[i].field;
+        }
+    }
+    if (load) {
+        openAt(name, target, now);
+    }
+
+    portENTER_CRITICAL(&scenarioLock);
+    ScenarioState playing = current;
+    int64_t position = now - origin;
+    portEXIT_CRITICAL(&scenarioLock);
+
+    if (playing == SCENARIO_PLAYING) {
+        int64_t started = hal.clock->micros();
+        uint32_t events = 0;
+        int64_t lateMax = 0;
+        int64_t lateSum = 0;
+        while (queueCount > 0 && queue[queueHead].at <= position) {
+            const ScenarioKeyframe &keyframe = queue[queueHead];
+            int64_t late = position - keyframe.at;
+            lateMax = late > lateMax ? late : lateMax;
+            lateSum += late;
+            events++;
+            applyKeyframe(keyframe);
+            queueHead = (queueHead + 1) % SCENARIO_QUEUE_LEN;
+            queueCount--;
+        }
+        bool starved = queueCount == 0 && !sourceEnded;
+        bool changed = pushOutputs(position);
+        bool ended = queueCount == 0 && sourceEnded && rampsDone(position);
+        int64_t applied = hal.clock->micros() - started;
+
+        portENTER_CRITICAL(&scenarioLock);
+        stats.events += events;
+        stats.lateSumUs += lateSum;
+        stats.lateMaxUs = lateMax > stats.lateMaxUs ? lateMax : stats.lateMaxUs;
+        stats.applyMaxUs = applied > stats.applyMaxUs ? applied : stats.applyMaxUs;
+        stats.starvedTicks += starved;
+        if (ended && current == SCENARIO_PLAYING) {
+            current = SCENARIO_ENDED;
+            heldPosition = position;
+        }
+        portEXIT_CRITICAL(&scenarioLock);
+
+        if (ended) {
+            closeSource();
+            Serial.printf("Scenario: %s ended after %u keyframes\n", name, stats.events);
+        }
+        if (ended || (changed && now - lastNotifyAt >= SCENARIO_NOTIFY_US)) {
+            notifyClients();
+            lastNotifyAt = now;
+        }
+    }
+
+    fill();
+
+    portENTER_CRITICAL(&scenarioLock);
+    bool idle = current == SCENARIO_STOPPED || current == SCENARIO_ENDED;
+    portEXIT_CRITICAL(&scenarioLock);
+    if (idle) {
+        scenarioTimerStop();
+    }
+}
+
+void scenarioBegin() {
+    portENTER_CRITICAL(&scenarioLock);
+    current = SCENARIO_STOPPED;
+    playingName[0] = 0;
+    loadRequested = false;
+    closeRequested = false;
+    lastError = nullptr;
+    stats = {};
+    portEXIT_CRITICAL(&scenarioLock);
+    closeSource();
+    lastTickAt = -1;
+    lastNotifyAt = 0;
+    scenarioTimerBegin();
+}
+
+// Hands a play or seek to the scenario task
+static void requestLoad(int64_t position, bool play) {
+    portENTER_CRITICAL(&scenarioLock);
+    current = SCENARIO_LOADING;
+    heldPosition = position;
+    playAfterLoad = play;
+    loadRequested = true;
+    lastError = nullptr;
+    portEXIT_CRITICAL(&scenarioLock);
+    scenarioTimerStart();
+}
+
+bool scenarioPlay(const char *name, bool loop) {
+    if (!validName(name) || !scenarioSourceExists(name)) {
+        return false;
+    }
+    portENTER_CRITICAL(&scenarioLock);
+    strlcpy(playingName, name, sizeof(playingName));
+    looping = loop;
+    lengthUs = -1;
+    closeRequested = true;
+    portEXIT_CRITICAL(&scenarioLock);
+    requestLoad(0, true);
+    return true;
+}
+
+bool scenarioPause() {
+    bool ok = false;
+    portENTER_CRITICAL(&scenarioLock);
+    if (current == SCENARIO_PLAYING) {
+        heldPosition = hal.clock->micros() - origin;
+        current = SCENARIO_PAUSED;
+        ok = true;
+    } else if (current == SCENARIO_LOADING) {
+        playAfterLoad = false;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&scenarioLock);
+    return ok;
+}
+
+bool scenarioResume() {
+    bool ok = false;
+    portENTER_CRITICAL(&scenarioLock);
+    if (current == SCENARIO_PAUSED) {
+        origin = hal.clock->micros() - heldPosition;
+        current = SCENARIO_PLAYING;
+        ok = true;
+    } else if (current == SCENARIO_LOADING) {
+        playAfterLoad = true;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&scenarioLock);
+    return ok;
+}
+
+bool scenarioSeek(uint32_t positionMs) {
+    portENTER_CRITICAL(&scenarioLock);
+    ScenarioState now = current;
+    bool play = now == SCENARIO_PLAYING || (now == SCENARIO_LOADING && playAfterLoad);
+    portEXIT_CRITICAL(&scenarioLock);
+    if (now == SCENARIO_STOPPED) {
+        return false;
+    }
+    // An ended scenario plays again from the new position
+    requestLoad((int64_t)positionMs * 1000, play || now == SCENARIO_ENDED);
+    return true;
+}
+
+void scenarioStop() {
+    portENTER_CRITICAL(&scenarioLock);
+    bool wasActive = current != SCENARIO_STOPPED;
+    current = SCENARIO_STOPPED;
+    loadRequested = false;
+    closeRequested = true;
+    portEXIT_CRITICAL(&scenarioLock);
+    if (wasActive) {
+        // The task closes the file on its next tick, then stops the timer
+        scenarioTimerStart();
+    }
+}
+
+ScenarioState scenarioState() {
+    return current;
+}
+
+size_t serializeScenarioStatus(char *out, size_t size) {
+    portENTER_CRITICAL(&scenarioLock);
+    ScenarioState now = current;
+    int64_t position = now == SCENARIO_PLAYING ? hal.clock->micros() - origin : heldPosition;
+    int64_t length = lengthUs;
+    bool loop = looping;
+    const char *error = lastError;
+    ScenarioStats copy = stats;
+    char name[SCENARIO_NAME_MAX + 1];
+    strlcpy(name, playingName, sizeof(name));
+    portEXIT_CRITICAL(&scenarioLock);
+
+    uint32_t pass = 0;
+    if (loop && length > 0) {
+        pass = position / length;
+        position %= length;
+    }
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "scenario";
+    doc["state"] = STATE_NAMES[now];
+    doc["name"] = name;
+    doc["loop"] = loop;
+    doc["positionMs"] = (uint32_t)(position / 1000);
+    doc["lengthMs"] = length >= 0 ? (int32_t)(length / 1000) : -1;
+    doc["pass"] = pass;
+    doc["events"] = copy.events;
+    doc["badLines"] = copy.badLines;
+    // Timing error against the script and the cost of applying it
+    doc["lateMaxUs"] = copy.lateMaxUs;
+    doc["lateMeanUs"] = copy.events ? copy.lateSumUs / copy.events : 0;
+    doc["tickJitterMaxUs"] = copy.jitterMaxUs;
+    doc["applyMaxUs"] = copy.applyMaxUs;
+    doc["starvedTicks"] = copy.starvedTicks;
+    if (error) {
+        doc["error"] = error;
+    }
+    return serializeJson(doc, out, size);
+}
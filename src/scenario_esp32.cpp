@@ -0,0 +1,95 @@
+#include "scenario.h"
+
+#if !HAL_NATIVE
+
+#include <SPIFFS.h>
+#include "esp_timer.h"
+
+// Device side of scenario.h: files come from SPIFFS, and a periodic
+// esp_timer wakes the scenario task once per tick. The tick itself runs on
+// the task, not in the timer callback, so SPI writes, SPIFFS reads and the
+// status broadcast stay off the shared esp_timer task.
+
+TaskHandle_t scenarioTaskHandle = NULL;
+
+static esp_timer_handle_t tickTimer = NULL;
+static File file;
+
+static void scenarioPath(char *out, size_t size, const char *name) {
+    snprintf(out, size, SCENARIO_DIR "/%s", name);
+}
+
+bool scenarioSourceExists(const char *name) {
+    char path[sizeof(SCENARIO_DIR) + SCENARIO_NAME_MAX + 1];
+    scenarioPath(path, sizeof(path), name);
+    return SPIFFS.exists(path);
+}
+
+bool scenarioSourceOpen(const char *name) {
+    char path[sizeof(SCENARIO_DIR) + SCENARIO_NAME_MAX + 1];
+    scenarioPath(path, sizeof(path), name);
+    file = SPIFFS.open(path, "r");
+    return file && !file.isDirectory();
+}
+
+// The rest of an overlong line is dropped, so it fails to parse on its own
+// instead of turning into a second line
+bool scenarioSourceReadLine(char *line, size_t size) {
+    if (!file.available()) {
+        return false;
+    }
+    size_t length = 0;
+    while (file.available()) {
+        int c = file.read();
+        if (c < 0 || c == '\n') {
+            break;
+        }
+        if (length + 1 < size) {
+            line[length++] = (char)c;
+        }
+    }
+    line[length] = 0;
+    return true;
+}
+
+void scenarioSourceRewind() {
+    file.seek(0);
+}
+
+void scenarioSourceClose() {
+    file.close();
+}
+
+static void onTickTimer(void *arg) {
+    if (scenarioTaskHandle) {
+        xTaskNotifyGive(scenarioTaskHandle);
+    }
+}
+
+void scenarioTimerBegin() {
+    if (tickTimer) {
+        return;
+    }
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onTickTimer;
+    timerArgs.name = "scenario";
+    esp_timer_create(&timerArgs, &tickTimer);
+}
+
+void scenarioTimerStart() {
+    // Already running is fine; the period stays where it was
+    esp_timer_start_periodic(tickTimer, SCENARIO_TICK_US);
+}
+
+void scenarioTimerStop() {
+    esp_timer_stop(tickTimer);
+}
+
+void scenarioTask(void *parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        scenarioTick(esp_timer_get_time());
+    }
+}
+
+#endif // !HAL_NATIVE
@@ -0,0 +1,91 @@
+#include "scenario.h"
+
+#if HAL_NATIVE
+
+#include <stdio.h>
+#include <string>
+
+// Host side of scenario.h: files come from <root>/scenarios on disk, and
+// the periodic timer is a deadline the simulator services, the same way it
+// drives the debounce timer.
+
+static std::string root = "data";
+static FILE *file = nullptr;
+static int64_t nextTickAt = -1;
+
+void scenarioSetRoot(const char *path) {
+    root = path;
+}
+
+static std::string scenarioPath(const char *name) {
+    return root + SCENARIO_DIR + "/" + name;
+}
+
+bool scenarioSourceExists(const char *name) {
+    FILE *probe = fopen(scenarioPath(name).c_str(), "r");
+    if (!probe) {
+        return false;
+    }
+    fclose(probe);
+    return true;
+}
+
+bool scenarioSourceOpen(const char *name) {
+    file = fopen(scenarioPath(name).c_str(), "r");
+    return file != nullptr;
+}
+
+// Same as the device: the rest of an overlong line is dropped
+bool scenarioSourceReadLine(char *line, size_t size) {
+    int c = fgetc(file);
+    if (c == EOF) {
+        return false;
+    }
+    size_t length = 0;
+    while (c != EOF && c != '\n') {
+        if (length + 1 < size) {
+            line[length++] = (char)c;
+        }
+        c = fgetc(file);
+    }
+    line[length] = 0;
+    return true;
+}
+
+void scenarioSourceRewind() {
+    rewind(file);
+}
+
+void scenarioSourceClose() {
+    fclose(file);
+    file = nullptr;
+}
+
+void scenarioTimerBegin() {
+    nextTickAt = -1;
+}
+
+void scenarioTimerStart() {
+    // A periodic esp_timer fires one period after it is started
+    if (nextTickAt < 0) {
+        nextTickAt = hal.clock->micros() + SCENARIO_TICK_US;
+    }
+}
+
+void scenarioTimerStop() {
+    nextTickAt = -1;
+}
+
+void scenarioServiceTimer(int64_t micros) {
+    if (nextTickAt < 0 || micros < nextTickAt) {
+        return;
+    }
+    nextTickAt += SCENARIO_TICK_US;
+    scenarioTick(micros);
+}
+
+int64_t scenarioNextDeadline() {
+    return nextTickAt;
+}
+
+#endif // HAL_NATIVE
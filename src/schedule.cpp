@@ -0,0 +1,345 @@
+#include "schedule.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "commands.h"
+#include "protocol.h"
+#include "latency.h"
+#include "histogram.h"
+#include "json_alloc.h"
+
+typedef struct {
+    int64_t at;
+    uint32_t id;            // 0 when the entry is free
+    ClientId client;
+    int8_t next;            // next entry in the same wheel slot, -1 ends
+    uint8_t length;
+    char command[SCHEDULE_COMMAND_MAX + 1];
+} ScheduleEntry;
+
+typedef struct {
+    uint32_t fired;
+    uint32_t cancelled;
+    int32_t errorMinUs;     // signed: negative would be early
+    int32_t errorMaxUs;
+} ScheduleStats;
+
+static portMUX_TYPE scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+static ScheduleEntry entries[SCHEDULE_MAX];
+static int8_t slots[SCHEDULE_WHEEL_SLOTS];
+static uint64_t occupied = 0;       // bit per non-empty slot
+// Slot tick of the last service. Every pending entry is at or after it,
+// so a walk from here meets them in time order.
+static int64_t cursor = 0;
+static uint32_t nextId = 1;
+static ScheduleStats stats;
+// Bumped whenever an entry is linked or unlinked, so rearm() can tell that
+// the deadline it armed may already be stale
+static uint32_t changes = 0;
+
+// |fired - at| of every entry that ran
+static LatencyHistogram errors;
+
+static_assert(SCHEDULE_WHEEL_SLOTS == 64, "occupied is a 64-bit map");
+
+static uint8_t slotFor(int64_t at) {
+    return (at / SCHEDULE_SLOT_US) % SCHEDULE_WHEEL_SLOTS;
+}
+
+// Callers hold scheduleLock
+static void link(int8_t index) {
+    uint8_t slot = slotFor(entries[index].at);
+    entries[index].next = slots[slot];
+    slots[slot] = index;
+    occupied |= 1ull << slot;
+    changes++;
+}
+
+static void unlink(int8_t index) {
+    uint8_t slot = slotFor(entries[index].at);
+    for (int8_t *chain = &slots[slot]; *chain >= 0; chain = &entries[*chain].next) {
+        if (*chain == index) {
+            *chain = entries[index].next;
+            break;
+        }
+    }
+    if (slots[slot] < 0) {
+        occupied &= ~(1ull << slot);
+    }
+    entries[index].id = 0;
+    changes++;
+}
+
+static int8_t soonestIn(uint8_t slot, int64_t before) {
+    int8_t best = -1;
+    for (int8_t i = slots[slot]; i >= 0; i = entries[i].next) {
+        if (entries[i].at < before && (best < 0 || entries[i].at < entries[best].at)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Walks the occupied slots of one turn from the cursor; an entry counts
+// only in the turn its time falls in. When the whole turn is empty the
+// soonest entry is further out and every entry is compared.
+static int8_t soonest() {
+    if (!occupied) {
+        return -1;
+    }
+    uint8_t start = cursor % SCHEDULE_WHEEL_SLOTS;
+    uint64_t ahead = (occupied >> start) | (start ? occupied << (SCHEDULE_WHEEL_SLOTS - start) : 0);
+    while (ahead) {
+        uint8_t distance = __builtin_ctzll(ahead);
+        ahead &= ahead - 1;
+        int8_t best = soonestIn((start + distance) % SCHEDULE_WHEEL_SLOTS,
+                                (cursor + distance + 1) * SCHEDULE_SLOT_US);
+        if (best >= 0) {
+            return best;
+        }
+    }
+
+    int8_t best = -1;
+    for (int8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (entries[i].id && (best < 0 || entries[i].at < entries[best].at)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Arms the timer for the soonest entry. esp_timer takes a lock of its own,
+// so the deadline is worked out under scheduleLock and armed after it. When
+// another task changed the entries meanwhile, the deadline just armed may
+// be stale (possibly armed over a fresher one), so it is worked out again.
+static void rearm() {
+    for (;;) {
+        portENTER_CRITICAL(&scheduleLock);
+        uint32_t seen = changes;
+        int8_t next = soonest();
+        int64_t at = next < 0 ? -1 : entries[next].at;
+        portEXIT_CRITICAL(&scheduleLock);
+
+        scheduleTimerArm(at);
+
+        portENTER_CRITICAL(&scheduleLock);
+        bool current = changes == seen;
+        portEXIT_CRITICAL(&scheduleLock);
+        if (current) {
+            return;
+        }
+    }
+}
+
+void scheduleBegin() {
+    portENTER_CRITICAL(&scheduleLock);
+    memset(entries, 0, sizeof(entries));
+    memset(slots, -1, sizeof(slots));
+    occupied = 0;
+    cursor = hal.clock->micros() / SCHEDULE_SLOT_US;
+    nextId = 1;
+    stats = {};
+    portEXIT_CRITICAL(&scheduleLock);
+    errors.reset();
+    scheduleTimerBegin();
+}
+
+uint32_t scheduleAdd(ClientId client, int64_t at, const char *command, size_t length, const char *&reason) {
+    int64_t now = hal.clock->micros();
+    if (at <= now) {
+        reason = "Time is in the past";
+        return 0;
+    }
+    if (at - now > SCHEDULE_HORIZON_US) {
+        reason = "Time is too far ahead";
+        return 0;
+    }
+    if (length > SCHEDULE_COMMAND_MAX) {
+        reason = "Command too large";
+        return 0;
+    }
+
+    // Rejected now rather than when nobody is waiting for the answer
+    JsonArenaScope arena;
+    char name[COMMAND_NAME_MAX];
+    CommandId commandId;
+    const CommandEntry *entry = nullptr;
+    if (!commandPeek(command, length, name, sizeof(name), commandId)) {
+        entry = commandLookup(name);
+    }
+    if (!entry || strcmp(entry->name, "schedule") == 0) {
+        reason = "Command cannot be scheduled";
+        return 0;
+    }
+    if (length > entry->maxLen) {
+        reason = "Command too large";
+        return 0;
+    }
+
+    portENTER_CRITICAL(&scheduleLock);
+    int8_t index = -1;
+    for (int8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (!entries[i].id) {
+            index = i;
+            break;
+        }
+    }
+    uint32_t id = 0;
+    if (index >= 0) {
+        ScheduleEntry &slot = entries[index];
+        id = nextId++;
+        slot.at = at;
+        slot.id = id;
+        slot.client = client;
+        slot.length = length;
+        memcpy(slot.command, command, length);
+        slot.command[length] = 0;
+        link(index);
+    }
+    portEXIT_CRITICAL(&scheduleLock);
+
+    if (!id) {
+        reason = "Schedule full";
+        return 0;
+    }
+    rearm();
+    return id;
+}
+
+bool scheduleCancel(uint32_t id) {
+    bool found = false;
+    portENTER_CRITICAL(&scheduleLock);
+    for (int8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (id && entries[i].id == id) {
+            unlink(i);
+            stats.cancelled++;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&scheduleLock);
+    if (found) {
+        rearm();
+    }
+    return found;
+}
+
+void scheduleCancelAll() {
+    portENTER_CRITICAL(&scheduleLock);
+    for (int8_t i = 0; i < SCHEDULE_MAX; i++) {
+        if (entries[i].id) {
+            unlink(i);
+            stats.cancelled++;
+        }
+    }
+    portEXIT_CRITICAL(&scheduleLock);
+    rearm();
+}
+
+size_t serializeScheduleStatus(char *out, size_t size, uint32_t added) {
+    // Copied under the lock, sorted outside it
+    int64_t at[SCHEDULE_MAX];
+    uint32_t ids[SCHEDULE_MAX];
+    uint8_t pending = 0;
+    portENTER_CRITICAL(&scheduleLock);
+    for (const ScheduleEntry &entry : entries) {
+        if (entry.id) {
+            at[pending] = entry.at;
+            ids[pending++] = entry.id;
+        }
+    }
+    ScheduleStats copy = stats;
+    portEXIT_CRITICAL(&scheduleLock);
+
+    for (uint8_t i = 1; i < pending; i++) {
+        for (uint8_t j = i; j > 0 && at[j - 1] > at[j]; j--) {
+            int64_t t = at[j];
+            at[j] = at[j - 1];
+            at[j - 1] = t;
+            uint32_t id = ids[j];
+            ids[j] = ids[j - 1];
+            ids[j - 1] = id;
+        }
+    }
+    uint8_t listed = pending < SCHEDULE_LIST_MAX ? pending : SCHEDULE_LIST_MAX;
+
+    JsonArenaScope arena;
+    JsonDocument doc(jsonAllocator());
+    doc["type"] = "schedule";
+    doc["nowUs"] = hal.clock->micros();
+    if (added) {
+        doc["added"] = added;
+    }
+    doc["pending"] = pending;
+    JsonArray list = doc["entries"].to<JsonArray>();
+    for (uint8_t i = 0; i < listed; i++) {
+        JsonObject entry = list.add<JsonObject>();
+        entry["id"] = ids[i];
+        entry["at"] = at[i];
+    }
+    doc["fired"] = copy.fired;
+    doc["cancelled"] = copy.cancelled;
+    doc["errorP50Us"] = errors.percentile(0.5f);
+    doc["errorP99Us"] = errors.percentile(0.99f);
+    doc["errorMinUs"] = copy.errorMinUs;
+    doc["errorMaxUs"] = copy.errorMaxUs;
+    return serializeJson(doc, out, size);
+}
+
+// The held command goes through the dispatcher as an internal command,
+// with its latency measured from the scheduled time. Client 0 keeps it away
+// from the command cache, which only the async_tcp task may touch; run as
+// the client, a held command reusing a commandId would also be answered
+// from the cache and never run.
+static void run(ScheduleEntry &entry, int64_t firedAt) {
+    latencyArrival(entry.at);
+    const CommandEntry *command = protocolRunCommand(0, entry.command, entry.length);
+
+    int32_t errorUs = (int32_t)(firedAt - entry.at);
+    errors.record(errorUs < 0 ? -errorUs : errorUs);
+    portENTER_CRITICAL(&scheduleLock);
+    if (stats.fired == 0 || errorUs < stats.errorMinUs) {
+        stats.errorMinUs = errorUs;
+    }
+    if (stats.fired == 0 || errorUs > stats.errorMaxUs) {
+        stats.errorMaxUs = errorUs;
+    }
+    stats.fired++;
+    portEXIT_CRITICAL(&scheduleLock);
+
+    if (entry.client) {
+        JsonArenaScope arena;
+        JsonDocument doc(jsonAllocator());
+        doc["type"] = "scheduleFired";
+        doc["id"] = entry.id;
+        doc["cmd"] = command ? command->name : "unknown";
+        doc["at"] = entry.at;
+        doc["firedAt"] = firedAt;
+        doc["errorUs"] = errorUs;
+        char message[WS_MESSAGE_MAX];
+        size_t length = serializeJson(doc, message, sizeof(message));
+        hal.transport->reply(entry.client, message, length);
+    }
+}
+
+void scheduleService(int64_t now) {
+    for (;;) {
+        ScheduleEntry due;
+        portENTER_CRITICAL(&scheduleLock);
+        int8_t next = soonest();
+        bool ready = next >= 0 && entries[next].at <= now + SCHEDULE_LEAD_US;
+        if (ready) {
+            due = entries[next];
+            unlink(next);
+        } else {
+            cursor = now / SCHEDULE_SLOT_US;
+        }
+        portEXIT_CRITICAL(&scheduleLock);
+        if (!ready) {
+            rearm();
+            return;
+        }
+
+        run(due, scheduleWaitUntil(due.at));
+        now = hal.clock->micros();
+    }
+}
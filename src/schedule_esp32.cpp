@@ -0,0 +1,61 @@
+#include "schedule.h"
+
+#if !HAL_NATIVE
+
+#include "esp_timer.h"
+
+// Device side of schedule.h. A one-shot esp_timer wakes the schedule task
+// SCHEDULE_LEAD_US before the soonest entry; the task spins out the rest
+// on esp_timer_get_time() and runs the command. Commands write SPI and
+// reply to clients, so they run on the task, never in the timer callback.
+
+TaskHandle_t scheduleTaskHandle = NULL;
+
+static esp_timer_handle_t wakeTimer = NULL;
+
+static void onWakeTimer(void *arg) {
+    if (scheduleTaskHandle) {
+        xTaskNotifyGive(scheduleTaskHandle);
+    }
+}
+
+void scheduleTimerBegin() {
+    if (wakeTimer) {
+        return;
+    }
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onWakeTimer;
+    timerArgs.name = "schedule";
+    esp_timer_create(&timerArgs, &wakeTimer);
+}
+
+// Called outside the schedule lock, from the async_tcp and schedule tasks
+// alike; schedule.cpp re-arms when the entries changed in between
+void scheduleTimerArm(int64_t at) {
+    esp_timer_stop(wakeTimer);
+    if (at < 0) {
+        return;
+    }
+    int64_t delay = at - SCHEDULE_LEAD_US - esp_timer_get_time();
+    // The other task may have started it again since the stop
+    while (esp_timer_start_once(wakeTimer, delay > 0 ? delay : 0) == ESP_ERR_INVALID_STATE) {
+        esp_timer_stop(wakeTimer);
+    }
+}
+
+int64_t scheduleWaitUntil(int64_t at) {
+    int64_t now = esp_timer_get_time();
+    while (now < at) {
+        now = esp_timer_get_time();
+    }
+    return now;
+}
+
+void scheduleTask(void *parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        scheduleService(esp_timer_get_time());
+    }
+}
+
+#endif // !HAL_NATIVE
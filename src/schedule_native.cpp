@@ -0,0 +1,35 @@
+#include "schedule.h"
+
+#if HAL_NATIVE
+
+// Host side of schedule.h: the one-shot timer is a deadline the simulator
+// services, like the scenario tick. It fires exactly on the entry's time,
+// so there is nothing to wait out.
+
+static int64_t deadline = -1;
+
+void scheduleTimerBegin() {
+    deadline = -1;
+}
+
+void scheduleTimerArm(int64_t at) {
+    deadline = at;
+}
+
+int64_t scheduleWaitUntil(int64_t at) {
+    return hal.clock->micros();
+}
+
+void scheduleServiceTimer(int64_t micros) {
+    if (deadline < 0 || micros < deadline) {
+        return;
+    }
+    deadline = -1;
+    scheduleService(micros);
+}
+
+int64_t scheduleNextDeadline() {
+    return deadline;
+}
+
+#endif // HAL_NATIVE
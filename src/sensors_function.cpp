@@ -1,7 +1,10 @@
 #include "sensors_function.h"
 #include "hardware_config.h"
-#include "web_server.h"
-#include <SPI.h>
+#include "protocol.h"
+#include "trace.h"
+#include "metrics.h"
+#include "latency.h"
+#include "pot_stream.h"
 #include <Preferences.h>
 #include <string.h>
 
@@ -9,9 +12,6 @@
 extern SystemState state;
 extern void loadSystemPreset(const char* systemType);
 
-// SPI settings for MCP4251 digital potentiometers
-SPISettings spiSettings(1000000, MSBFIRST, SPI_MODE0);
-
 // Preferences for storing calibration values
 Preferences preferences;
 
@@ -36,22 +36,8 @@ uint8_t mapPressureToPot(float pressure) {
 }
 
 void setupSensors() {
-    // Initialize SPI for MCP4251 digital potentiometers
-    SPI.begin(SPI_SCK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN);
-    
-    // Set CS pins as outputs
-    pinMode(SPI_CS_IC_1, OUTPUT);
-    pinMode(SPI_CS_IC_2, OUTPUT);
-    pinMode(SPI_CS_IC_3, OUTPUT);
-    pinMode(SPI_CS_IC_4, OUTPUT);
-    pinMode(SPI_CS_IC_5, OUTPUT);
-    
-    // Set CS pins high initially (inactive)
-    digitalWrite(SPI_CS_IC_1, HIGH);
-    digitalWrite(SPI_CS_IC_2, HIGH);
-    digitalWrite(SPI_CS_IC_3, HIGH);
-    digitalWrite(SPI_CS_IC_4, HIGH);
-    digitalWrite(SPI_CS_IC_5, HIGH);
+    // SPI bus for the MCP4251 digital potentiometers, CS pins inactive
+    hal.pots->begin();
     
     // Load default system preset (using the correct function name)
     loadSystemPreset(SYSTEM_CARRIER);
@@ -64,20 +50,44 @@ void setupSensors() {
 
 // Set a specific potentiometer value
 void setPotValue(uint8_t csPin, uint8_t wiper, uint8_t value) {
-    digitalWrite(csPin, LOW);
-    SPI.beginTransaction(spiSettings);
-    
-    // Command byte: 0x00 for write to wiper
-    SPI.transfer(wiper);
-    // Data byte: value 0-255
-    SPI.transfer(value);
-    
-    SPI.endTransaction();
-    digitalWrite(csPin, HIGH);
+    TRACE_SCOPE(TRACE_EVT_SET_POT, ((uint32_t)csPin << 16) | ((uint32_t)wiper << 8) | value);
+
+    // Command byte (wiper address) then data byte: value 0-255
+    PotWrite write = {csPin, wiper, value};
+    hal.pots->write(&write, 1);
+    metricsCountSpi();
+    latencyMark(LAT_STAGE_OUTPUT);
     
     Serial.printf("Set pot on pin %d, wiper 0x%02X to value %d\n", csPin, wiper, value);
 }
 
+void potBurstAdd(PotBurst &burst, uint8_t csPin, uint8_t wiper, uint8_t value) {
+    for (uint8_t i = 0; i < burst.count; i++) {
+        if (burst.writes[i].csPin == csPin && burst.writes[i].wiper == wiper) {
+            burst.writes[i].value = value;
+            return;
+        }
+    }
+    if (burst.count < sizeof(burst.writes) / sizeof(burst.writes[0])) {
+        burst.writes[burst.count++] = {csPin, wiper, value};
+    }
+}
+
+// All queued wiper writes inside one bus transaction, one log line
+void potBurstFlush(PotBurst &burst) {
+    if (burst.count == 0) {
+        return;
+    }
+    TRACE_SCOPE(TRACE_EVT_SET_POT, burst.count);
+
+    hal.pots->write(burst.writes, burst.count);
+    metrics.spiTransactions.fetch_add(burst.count, std::memory_order_relaxed);
+    latencyMark(LAT_STAGE_OUTPUT);
+
+    Serial.printf("Wrote %u pot wipers in one burst\n", burst.count);
+    burst.count = 0;
+}
+
 // Update all sensor values - this would be called periodically
 void updateSensorValues() {
     // In a real implementation, you would read from analog pins
@@ -91,104 +101,120 @@ void updateSensorValues() {
     // or by manual adjustments via the web interface
 }
 
-// Process WebSocket commands related to sensors
-void processSensorWSCommand(const JsonDocument &doc) {
-    const char* cmd = doc["cmd"];
-    
-    if (strcmp(cmd, "updateSensor") == 0) {
-        // Handle manual sensor value updates (for testing/simulation)
-        const char* sensorName = doc["sensor"];
-        float value = doc["value"];
-        
-        if (sensorName) {
-            if (strcmp(sensorName, "returnAirTemp") == 0) {
-                state.returnAirTemp = value;
-                // Map to appropriate IC and wiper based on your hardware setup
-                setPotValue(SPI_CS_IC_1, POT0_WIPER, mapTemperatureToPot(value));
-            } 
-            else if (strcmp(sensorName, "dischargeAirTemp") == 0) {
-                state.dischargeAirTemp = value;
-                setPotValue(SPI_CS_IC_1, POT1_WIPER, mapTemperatureToPot(value));
-            } 
-            else if (strcmp(sensorName, "ambientTemp") == 0) {
-                state.ambientTemp = value;
-                setPotValue(SPI_CS_IC_2, POT0_WIPER, mapTemperatureToPot(value));
-            } 
-            else if (strcmp(sensorName, "coolantTemp") == 0) {
-                state.coolantTemp = value;
-                setPotValue(SPI_CS_IC_2, POT1_WIPER, mapTemperatureToPot(value));
-            } 
-            else if (strcmp(sensorName, "coilTemp") == 0) {
-                state.coilTemp = value;
-                setPotValue(SPI_CS_IC_3, POT0_WIPER, mapTemperatureToPot(value));
-            } 
-            else if (strcmp(sensorName, "suctionPressure") == 0) {
-                state.suctionPressure = value;
-                setPotValue(SPI_CS_IC_3, POT1_WIPER, mapPressureToPot(value));
-            } 
-            else if (strcmp(sensorName, "dischargePressure") == 0) {
-                state.dischargePressure = value;
-                setPotValue(SPI_CS_IC_4, POT0_WIPER, mapPressureToPot(value));
-            } 
-            else if (strcmp(sensorName, "redundantAirTemp") == 0) {
-                state.redundantAirTemp = value;
-                setPotValue(SPI_CS_IC_4, POT1_WIPER, mapTemperatureToPot(value));
-            }
-            
-            Serial.printf("Updated sensor %s to %.2f\n", sensorName, value);
-        }
-    } 
-    else if (strcmp(cmd, "adjustMCP4251") == 0) {
-        // Handle direct digital potentiometer adjustments
-        uint8_t icIndex = doc["icIndex"];
-        uint8_t wiperIndex = doc["wiper"];
-        uint8_t value = doc["value"];
-        uint8_t csPin;
-        
-        // Map IC index to the correct CS pin
-        switch (icIndex) {
-            case 1: csPin = SPI_CS_IC_1; break;
-            case 2: csPin = SPI_CS_IC_2; break;
-            case 3: csPin = SPI_CS_IC_3; break;
-            case 4: csPin = SPI_CS_IC_4; break;
-            case 5: csPin = SPI_CS_IC_5; break;
-            default: 
-                Serial.printf("Invalid IC index: %d\n", icIndex);
-                return;
+// Simulated sensors and the pot wiper that drives each one
+typedef struct {
+    const char *name;
+    float SystemState::*field;
+    uint8_t csPin;
+    uint8_t wiper;
+    bool pressure;
+} SensorChannel;
+
+static const SensorChannel SENSOR_CHANNELS[] = {
+    {"returnAirTemp",     &SystemState::returnAirTemp,     SPI_CS_IC_1, POT0_WIPER, false},
+    {"dischargeAirTemp",  &SystemState::dischargeAirTemp,  SPI_CS_IC_1, POT1_WIPER, false},
+    {"ambientTemp",       &SystemState::ambientTemp,       SPI_CS_IC_2, POT0_WIPER, false},
+    {"coolantTemp",       &SystemState::coolantTemp,       SPI_CS_IC_2, POT1_WIPER, false},
+    {"coilTemp",          &SystemState::coilTemp,          SPI_CS_IC_3, POT0_WIPER, false},
+    {"suctionPressure",   &SystemState::suctionPressure,   SPI_CS_IC_3, POT1_WIPER, true},
+    {"dischargePressure", &SystemState::dischargePressure, SPI_CS_IC_4, POT0_WIPER, true},
+    {"redundantAirTemp",  &SystemState::redundantAirTemp,  SPI_CS_IC_4, POT1_WIPER, false},
+};
+
+static const uint8_t POT_CS_PINS[POT_IC_COUNT] = {SPI_CS_IC_1, SPI_CS_IC_2, SPI_CS_IC_3, SPI_CS_IC_4, SPI_CS_IC_5};
+
+static const SensorChannel *findSensor(const char *sensorName) {
+    for (const SensorChannel &channel : SENSOR_CHANNELS) {
+        if (strcmp(sensorName, channel.name) == 0) {
+            return &channel;
         }
-        
-        uint8_t wiperCmd = (wiperIndex == 0) ? POT0_WIPER : POT1_WIPER;
-        
-        setPotValue(csPin, wiperCmd, value);
-        
-        // Save to preferences
-        String key = "ic" + String(icIndex) + "wiper" + String(wiperIndex);
-        preferences.putUChar(key.c_str(), value);
-        
+    }
+    return nullptr;
+}
+
+// A streamed wiper takes the value as its stream's last frame instead
+static void writePot(uint8_t csPin, uint8_t wiper, uint8_t value, PotBurst *burst) {
+    if (potStreamRelease(csPin, wiper, value)) {
+        return;
+    }
+    if (burst) {
+        potBurstAdd(*burst, csPin, wiper, value);
+    } else {
+        setPotValue(csPin, wiper, value);
+    }
+}
+
+bool sensorExists(const char *sensorName) {
+    return findSensor(sensorName) != nullptr;
+}
+
+bool sensorPot(const char *sensorName, SensorPot &pot) {
+    const SensorChannel *channel = findSensor(sensorName);
+    if (!channel) {
+        return false;
+    }
+    pot = {channel->name, channel->csPin, channel->wiper, channel->pressure, state.*channel->field};
+    return true;
+}
+
+// Manual sensor value update (for testing/simulation)
+bool setSensorValue(const char *sensorName, float value, PotBurst *burst) {
+    const SensorChannel *channel = findSensor(sensorName);
+    if (!channel) {
+        Serial.printf("Unknown sensor: %s\n", sensorName);
+        return false;
+    }
+
+    state.*channel->field = value;
+    // A streamed sensor's waveform moves with the reading instead
+    if (potStreamRebase(channel->csPin, channel->wiper, value)) {
+        return true;
+    }
+    uint8_t potValue = channel->pressure ? mapPressureToPot(value) : mapTemperatureToPot(value);
+    writePot(channel->csPin, channel->wiper, potValue, burst);
+
+    if (!burst) {
+        Serial.printf("Updated sensor %s to %.2f\n", sensorName, value);
+    }
+    return true;
+}
+
+// Direct digital potentiometer adjustment, saved to preferences
+bool adjustPot(uint8_t icIndex, uint8_t wiperIndex, uint8_t value, PotBurst *burst) {
+    if (icIndex < 1 || icIndex > POT_IC_COUNT) {
+        Serial.printf("Invalid IC index: %d\n", icIndex);
+        return false;
+    }
+
+    uint8_t wiperCmd = (wiperIndex == 0) ? POT0_WIPER : POT1_WIPER;
+    writePot(POT_CS_PINS[icIndex - 1], wiperCmd, value, burst);
+
+    char key[16];
+    snprintf(key, sizeof(key), "ic%uwiper%u", icIndex, wiperIndex);
+    preferences.putUChar(key, value);
+
+    if (!burst) {
         Serial.printf("Adjusted IC %d, wiper %d to value %d\n", icIndex, wiperIndex, value);
     }
-    else if (strcmp(cmd, "resetPots") == 0) {
-        // Reset all pots to default values (middle position)
-        uint8_t defaultValue = MCP4251_MAX_VALUE / 2;
-        
-        // Reset all potentiometers to default value
-        setPotValue(SPI_CS_IC_1, POT0_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_1, POT1_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_2, POT0_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_2, POT1_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_3, POT0_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_3, POT1_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_4, POT0_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_4, POT1_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_5, POT0_WIPER, defaultValue);
-        setPotValue(SPI_CS_IC_5, POT1_WIPER, defaultValue);
-        
+    return true;
+}
+
+// Reset all pots to default values (middle position)
+void resetPots(PotBurst *burst) {
+    uint8_t defaultValue = MCP4251_MAX_VALUE / 2;
+
+    for (uint8_t csPin : POT_CS_PINS) {
+        writePot(csPin, POT0_WIPER, defaultValue, burst);
+        writePot(csPin, POT1_WIPER, defaultValue, burst);
+    }
+
+    if (!burst) {
         Serial.println("All potentiometers reset to default values");
     }
 }
 
 // Handle system preset changes for sensors
-void handleSensorSystemPresetChange(const char* systemType) {
+void handleSensorSystemPresetChange(const char* systemType, PotBurst *burst) {
     // Default value when a sensor is disabled (0 in the UI)
     const uint8_t defaultValue = MCP4251_MAX_VALUE / 2;
     
@@ -260,5 +286,20 @@ void handleSensorSystemPresetChange(const char* systemType) {
     Serial.printf(" - Suction Pressure: %.1f PSI -> %d\n", suctionPressure, suctionPressureValue);
     Serial.printf(" - Discharge Pressure: %.1f PSI -> %d\n", dischargePressure, dischargePressureValue);
     Serial.printf(" - Redundant Air: %.1f°F -> %d\n", redundantAirTemp, redundantAirValue);
+
+    // A disabled sensor (0) sits at mid scale; a streamed one keeps its
+    // waveform around the new reading
+    PotBurst own = {};
+    PotBurst &target = burst ? *burst : own;
+    for (const SensorChannel &channel : SENSOR_CHANNELS) {
+        float value = state.*channel.field;
+        if (potStreamRebase(channel.csPin, channel.wiper, value)) {
+            continue;
+        }
+        uint8_t potValue = value == 0 ? defaultValue
+                         : channel.pressure ? mapPressureToPot(value) : mapTemperatureToPot(value);
+        potBurstAdd(target, channel.csPin, channel.wiper, potValue);
+    }
+    potBurstFlush(own);
 }   
     
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "sim.h"
+
+#if HAL_NATIVE
+
+#include <Arduino.h>
+#include <queue>
+#include <vector>
+#include "hardware_config.h"
+#include "ckp_functions.h"
+#include "commands.h"
+#include "protocol.h"
+#include "static_alloc.h"
+#include "sim_server.h"
+#include "scenario.h"
+#include "reefer.h"
+#include "pot_stream.h"
+#include "schedule.h"
+
+extern SystemState state;
+
+typedef struct {
+    int64_t at;
+    uint64_t seq;       // tie-break: same-time events run in schedule order
+    SimHandler handler;
+    void *arg;
+} SimEvent;
+
+struct SimEventLater {
+    bool operator()(const SimEvent &a, const SimEvent &b) const {
+        return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+    }
+};
+
+static std::priority_queue<SimEvent, std::vector<SimEvent>, SimEventLater> events;
+static uint64_t nextSeq = 0;
+static uint64_t eventsRun = 0;
+
+// Only the newest debounce timer counts, as esp_timer_stop() would ensure
+static uintptr_t debounceGeneration = 0;
+// Same for the scenario tick timer, the pot stream timer and the schedule
+// timer
+static uintptr_t scenarioGeneration = 0;
+static uintptr_t potStreamGeneration = 0;
+static uintptr_t scheduleGeneration = 0;
+
+void simReset() {
+    events = decltype(events)();
+    nextSeq = 0;
+    eventsRun = 0;
+    debounceGeneration = 0;
+    scenarioGeneration = 0;
+    potStreamGeneration = 0;
+    scheduleGeneration = 0;
+}
+
+void simAt(int64_t at, SimHandler handler, void *arg) {
+    if (at < fakeClock.now) {
+        at = fakeClock.now;
+    }
+    events.push({at, nextSeq++, handler, arg});
+}
+
+int64_t simNextAt() {
+    return events.empty() ? -1 : events.top().at;
+}
+
+void simRunUntil(int64_t until) {
+    while (!events.empty() && events.top().at <= until) {
+        SimEvent event = events.top();
+        events.pop();
+        fakeClock.now = event.at;
+        event.handler(event.arg);
+        eventsRun++;
+    }
+    if (until > fakeClock.now) {
+        fakeClock.now = until;
+    }
+}
+
+uint64_t simEventsRun() {
+    return eventsRun;
+}
+
+// buttonTask: hand every debounced event to the state machine
+static void drainButtons() {
+    ButtonEvent event;
+    while (inputWaitEvent(event, 0)) {
+        handleButtonEvent(event);
+    }
+}
+
+static void onDebounceTimer(void *arg) {
+    if ((uintptr_t)arg != debounceGeneration) {
+        return;
+    }
+    inputServiceTimer(fakeClock.now);
+    drainButtons();
+    int64_t next = inputNextDeadline();
+    if (next >= 0) {
+        simAt(next, onDebounceTimer, (void *)++debounceGeneration);
+    }
+}
+
+static void armDebounceTimer() {
+    debounceGeneration++;
+    int64_t next = inputNextDeadline();
+    if (next >= 0) {
+        simAt(next, onDebounceTimer, (void *)debounceGeneration);
+    }
+}
+
+// scenarioTask, woken by the periodic tick timer while a scenario is loaded
+static void onScenarioTimer(void *arg) {
+    if ((uintptr_t)arg != scenarioGeneration) {
+        return;
+    }
+    scenarioServiceTimer(fakeClock.now);
+    int64_t next = scenarioNextDeadline();
+    if (next >= 0) {
+        simAt(next, onScenarioTimer, (void *)++scenarioGeneration);
+    }
+}
+
+// Any command may have started, stopped or moved a scenario
+static void armScenarioTimer() {
+    scenarioGeneration++;
+    int64_t next = scenarioNextDeadline();
+    if (next >= 0) {
+        simAt(next, onScenarioTimer, (void *)scenarioGeneration);
+    }
+}
+
+// The pot stream's esp_timer callback, every millisecond while streaming
+static void onPotStreamTimer(void *arg) {
+    if ((uintptr_t)arg != potStreamGeneration) {
+        return;
+    }
+    potStreamServiceTimer(fakeClock.now);
+    int64_t next = potStreamNextDeadline();
+    if (next >= 0) {
+        simAt(next, onPotStreamTimer, (void *)++potStreamGeneration);
+    }
+}
+
+static void armPotStreamTimer() {
+    potStreamGeneration++;
+    int64_t next = potStreamNextDeadline();
+    if (next >= 0) {
+        simAt(next, onPotStreamTimer, (void *)potStreamGeneration);
+    }
+}
+
+static void armScheduleTimer();
+
+// scheduleTask, woken by the one-shot timer at the soonest entry. The
+// commands it runs may start or stop anything, like a client's.
+static void onScheduleTimer(void *arg) {
+    if ((uintptr_t)arg != scheduleGeneration) {
+        return;
+    }
+    scheduleServiceTimer(fakeClock.now);
+    armScenarioTimer();
+    armPotStreamTimer();
+    armScheduleTimer();
+}
+
+static void armScheduleTimer() {
+    scheduleGeneration++;
+    int64_t next = scheduleNextDeadline();
+    if (next >= 0) {
+        simAt(next, onScheduleTimer, (void *)scheduleGeneration);
+    }
+}
+
+// arg packs the button and the level: (button << 1) | pressed
+static void onButtonEdge(void *arg) {
+    uintptr_t packed = (uintptr_t)arg;
+    ButtonId button = (ButtonId)(packed >> 1);
+    halFakeNote("edge %s %s", inputButtonName(button), (packed & 1) ? "down" : "up");
+    fakeGpio.levels[inputButtonPin(button)] = (packed & 1) ? LOW : HIGH;
+    inputInjectEdge(button, fakeClock.now);
+    drainButtons();
+    armDebounceTimer();
+}
+
+void simButton(ButtonId button, bool pressed, uint8_t bounces) {
+    // A bouncing contact toggles 2 * bounces times before it settles
+    for (int i = 0; i <= 2 * bounces; i++) {
+        bool level = (i % 2 == 0) ? pressed : !pressed;
+        simAt(fakeClock.now + (int64_t)i * SIM_BOUNCE_GAP_US, onButtonEdge,
+              (void *)(((uintptr_t)button << 1) | (uintptr_t)level));
+    }
+}
+
+void simCommand(ClientId client, const char *frame, size_t length) {
+    // The dispatcher expects a terminated, writable copy like the socket's
+    static char buffer[WS_MESSAGE_MAX + 1];
+    if (length > WS_MESSAGE_MAX) {
+        length = WS_MESSAGE_MAX;
+    }
+    memcpy(buffer, frame, length);
+    buffer[length] = 0;
+    halFakeNote("ws %u %s", client, buffer);
+    protocolHandleCommand(client, buffer, length);
+    armScenarioTimer();
+    armPotStreamTimer();
+    armScheduleTimer();
+}
+
+bool simHttp(HttpCommand command, const char *arg) {
+    static const char *const NAMES[HTTP_CMD_COUNT] = {"start", "stop", "rpm", "page"};
+    halFakeNote("http %s %s", command < HTTP_CMD_COUNT ? NAMES[command] : "?", arg ? arg : "-");
+    bool ok = protocolHttpCommand(command, arg);
+    armScenarioTimer();
+    armPotStreamTimer();
+    armScheduleTimer();
+    return ok;
+}
+
+void simClient(ClientId client, bool connected) {
+    halFakeNote("%s %u", connected ? "connect" : "disconnect", client);
+    if (connected) {
+        protocolClientConnected(client);
+    } else {
+        protocolClientGone(client);
+    }
+}
+
+// ckpTask
+static void ckpTick(void *arg) {
+    updatePwmSignals();
+    reeferService(fakeClock.now);
+    simAt(fakeClock.now + SIM_CKP_PERIOD_US, ckpTick, nullptr);
+}
+
+// webStatusTask. Only the snapshot pump applies; the once-a-second client
+// service pings and evicts sockets, which the localhost server leaves to TCP.
+static void webStatusTick(void *arg) {
+    simServerPump();
+    simAt(fakeClock.now + SIM_WEB_STATUS_PERIOD_US, webStatusTick, nullptr);
+}
+
+// ledTask
+static void ledTick(void *arg) {
+    if (state.systemRunning) {
+        state.ledState = !state.ledState;
+        hal.gpio->write(LED_PIN, state.ledState);
+        simAt(fakeClock.now + SIM_LED_RUNNING_US, ledTick, nullptr);
+    } else {
+        hal.gpio->write(LED_PIN, LOW);
+        simAt(fakeClock.now + SIM_LED_IDLE_US, ledTick, nullptr);
+    }
+}
+
+// Same bring-up as setup() and setupWebServer(), so a replayed recording
+// starts from the state the bench booted into
+void simBoot() {
+    simReset();
+    hal.pots->begin();
+    setupCKP();
+    inputBegin();
+    scenarioBegin();
+    reeferBegin();
+    potStreamBegin();
+    scheduleBegin();
+    commandsBegin();
+
+    // Creation order in setup(): web status, CKP, then LED
+    simAt(0, webStatusTick, nullptr);
+    simAt(0, ckpTick, nullptr);
+    simAt(0, ledTick, nullptr);
+}
+
+#endif // HAL_NATIVE
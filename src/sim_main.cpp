@@ -0,0 +1,501 @@
+#include "sim.h"
+
+#if HAL_NATIVE
+
+// Host entry point for env:sim, the virtual-time twin of the bench. A
+// scenario of WebSocket frames and button edges is played against the
+// firmware's tasks on a discrete-event clock, so half an hour of bench time
+// takes a second or so and the trace is identical on every run.
+//
+//   pio run -e sim
+//   .pio/build/sim/program native/scenarios/soak_30min.txt > trace.txt
+//   .pio/build/sim/program --serve 8080              UI at http://127.0.0.1:8080/
+//   .pio/build/sim/program scenario.txt --serve 8080 --speed 10
+//
+// With --serve the clock follows the wall clock (times --speed) and the
+// data/ UI, /status and /ws are served on localhost; the run ends on Ctrl-C.
+// {"cmd":"scenario"} playback reads its files from the same --data dir.
+// The trace goes to stdout (or -o), a RESULT summary to stderr.
+//
+// Recordings (GET /record on the bench, or --record here) replay with
+//   .pio/build/sim/program --replay record.bin [--expect trace.txt] [--bench N]
+// which reports whether the replay made the same output changes as the
+// recording, where a trace first differs from --expect (say, one saved from
+// an older build), and the replay rate in commands per second. --dump
+// prints a recording as text.
+//
+// Scenario lines, '#' starts a comment:
+//   <time> ws <client> <json frame>
+//   <time> button <rpm|stop|auto> <down|up> [bounce <n>]
+//   <time> press <rpm|stop|auto> <duration> [bounce <n>]
+//   <time> end
+// Times and durations take us, ms, s or m ("250ms", "1.5s", "30m"); a
+// leading '+' makes a time relative to the line before.
+
+#include <Arduino.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "sim_server.h"
+#include "recorder.h"
+#include "replay.h"
+#include "command_cache.h"
+#include "static_alloc.h"
+#include "scenario.h"
+
+enum StepKind : uint8_t {
+    STEP_WS = 0,
+    STEP_BUTTON,
+};
+
+typedef struct {
+    StepKind kind;
+    int64_t at;
+    ClientId client;
+    std::string frame;
+    ButtonId button;
+    bool pressed;
+    uint8_t bounces;
+} ScenarioStep;
+
+typedef struct {
+    std::vector<ScenarioStep> steps;
+    int64_t endAt;          // -1 = after the last step
+    uint32_t commands;
+    uint32_t edges;
+} Scenario;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static bool parseDuration(const char *text, int64_t &micros) {
+    char *unit;
+    double value = strtod(text, &unit);
+    if (unit == text || value < 0) {
+        return false;
+    }
+    double scale;
+    if (strcmp(unit, "us") == 0) {
+        scale = 1;
+    } else if (strcmp(unit, "ms") == 0) {
+        scale = 1e3;
+    } else if (strcmp(unit, "s") == 0) {
+        scale = 1e6;
+    } else if (strcmp(unit, "m") == 0) {
+        scale = 60e6;
+    } else {
+        return false;
+    }
+    micros = (int64_t)(value * scale + 0.5);
+    return true;
+}
+
+static bool parseButton(const char *text, ButtonId &button) {
+    static const struct {
+        const char *name;
+        ButtonId button;
+    } NAMES[] = {
+        {"rpm", BUTTON_RPM_INC},
+        {"stop", BUTTON_STOP},
+        {"auto", BUTTON_AUTO_RUN},
+    };
+    for (const auto &entry : NAMES) {
+        if (strcasecmp(text, entry.name) == 0 || strcasecmp(text, inputButtonName(entry.button)) == 0) {
+            button = entry.button;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Optional "bounce <n>" at the end of a button line
+static bool parseBounce(char *rest, uint8_t &bounces) {
+    bounces = 0;
+    char *word = strtok(rest, " \t");
+    if (!word) {
+        return true;
+    }
+    char *count = strtok(nullptr, " \t");
+    if (strcmp(word, "bounce") != 0 || !count) {
+        return false;
+    }
+    bounces = (uint8_t)constrain(atoi(count), 0, 50);
+    return true;
+}
+
+static bool loadScenario(const char *path, Scenario &scenario) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "sim: cannot open %s\n", path);
+        return false;
+    }
+
+    scenario.endAt = -1;
+    int64_t previous = 0;
+    char line[WS_MESSAGE_MAX + 128];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = 0;
+        char *text = line + strspn(line, " \t");
+        if (*text == 0 || *text == '#') {
+            continue;
+        }
+
+        char *timeText = strtok(text, " \t");
+        char *action = strtok(nullptr, " \t");
+        int64_t at;
+        bool relative = timeText[0] == '+';
+        if (!action || !parseDuration(timeText + relative, at)) {
+            ok = false;
+            break;
+        }
+        at += relative ? previous : 0;
+        previous = at;
+
+        ScenarioStep step = {};
+        step.at = at;
+        if (strcmp(action, "end") == 0) {
+            scenario.endAt = at;
+        } else if (strcmp(action, "ws") == 0) {
+            char *client = strtok(nullptr, " \t");
+            char *frame = client ? strtok(nullptr, "") : nullptr;
+            if (!frame) {
+                ok = false;
+                break;
+            }
+            step.kind = STEP_WS;
+            step.client = (ClientId)strtoul(client, nullptr, 10);
+            step.frame = frame + strspn(frame, " \t");
+            scenario.steps.push_back(step);
+            scenario.commands++;
+        } else if (strcmp(action, "button") == 0 || strcmp(action, "press") == 0) {
+            char *button = strtok(nullptr, " \t");
+            char *arg = button ? strtok(nullptr, " \t") : nullptr;
+            char *rest = arg ? strtok(nullptr, "") : nullptr;
+            step.kind = STEP_BUTTON;
+            if (!arg || !parseButton(button, step.button) || !parseBounce(rest, step.bounces)) {
+                ok = false;
+                break;
+            }
+            if (strcmp(action, "press") == 0) {
+                int64_t held;
+                if (!parseDuration(arg, held)) {
+                    ok = false;
+                    break;
+                }
+                step.pressed = true;
+                scenario.steps.push_back(step);
+                step.at += held;
+                step.pressed = false;
+                scenario.steps.push_back(step);
+                scenario.edges += 2;
+            } else {
+                step.pressed = strcmp(arg, "down") == 0;
+                if (!step.pressed && strcmp(arg, "up") != 0) {
+                    ok = false;
+                    break;
+                }
+                scenario.steps.push_back(step);
+                scenario.edges++;
+            }
+        } else {
+            ok = false;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "sim: %s:%d: cannot parse line\n", path, lineNumber);
+    }
+    return ok;
+}
+
+static void runStep(void *arg) {
+    const ScenarioStep *step = (const ScenarioStep *)arg;
+    if (step->kind == STEP_WS) {
+        simCommand(step->client, step->frame.data(), step->frame.size());
+    } else {
+        simButton(step->button, step->pressed, step->bounces);
+    }
+}
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+// FNV-1a, so two runs can be compared from the summary alone
+static uint64_t traceHash(const std::string &trace) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : trace) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool writeFile(const char *path, const void *data, size_t length) {
+    FILE *out = path ? fopen(path, "wb") : stdout;
+    if (!out) {
+        fprintf(stderr, "sim: cannot write %s\n", path);
+        return false;
+    }
+    fwrite(data, 1, length, out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return true;
+}
+
+static bool saveRecording(const char *path) {
+    std::vector<uint8_t> dump(recorderDumpSize());
+    size_t length = recorderDump(dump.data(), dump.size());
+    return writeFile(path, dump.data(), length);
+}
+
+// First line where the trace and the file at path differ; 0 if none
+static long compareTrace(const std::string &trace, const char *path, std::string &expectedLine,
+                         std::string &actualLine) {
+    std::string expected;
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "sim: cannot open %s\n", path);
+        return -1;
+    }
+    char chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        expected.append(chunk, got);
+    }
+    fclose(file);
+
+    size_t a = 0;
+    size_t b = 0;
+    for (long line = 1; a < expected.size() || b < trace.size(); line++) {
+        size_t aEnd = expected.find('\n', a);
+        size_t bEnd = trace.find('\n', b);
+        aEnd = aEnd == std::string::npos ? expected.size() : aEnd;
+        bEnd = bEnd == std::string::npos ? trace.size() : bEnd;
+        expectedLine = a < expected.size() ? expected.substr(a, aEnd - a) : "(end of file)";
+        actualLine = b < trace.size() ? trace.substr(b, bEnd - b) : "(end of trace)";
+        if (expectedLine != actualLine) {
+            return line;
+        }
+        a = aEnd + 1;
+        b = bEnd + 1;
+    }
+    return 0;
+}
+
+static int runReplay(const char *logPath, const char *expectPath, const char *outputPath, long benchRounds) {
+    Recording recorded;
+    if (!replayLoad(logPath, recorded)) {
+        return 1;
+    }
+    int64_t endAt = recorded.lastInputMicros + REPLAY_SETTLE_US;
+
+    // Boot order as in setup(): the recorder starts before the tasks
+    halFakeReset();
+    recorderBegin();
+    simBoot();
+    replaySchedule(recorded);
+    auto started = std::chrono::steady_clock::now();
+    simRunUntil(endAt);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const std::string &trace = halFakeTrace();
+    if (!writeFile(outputPath, trace.data(), trace.size())) {
+        return 1;
+    }
+
+    std::vector<uint8_t> dump(recorderDumpSize());
+    Recording replayed;
+    if (!replayParse(dump.data(), recorderDump(dump.data(), dump.size()), replayed)) {
+        return 1;
+    }
+    bool same = replayCompareOutputs(recorded, replayed, stderr);
+
+    if (expectPath) {
+        std::string expectedLine;
+        std::string actualLine;
+        long line = compareTrace(trace, expectPath, expectedLine, actualLine);
+        if (line == 0) {
+            fprintf(stderr, "trace: identical to %s\n", expectPath);
+        } else if (line > 0) {
+            fprintf(stderr, "trace: DIVERGED from %s at line %ld:\n  expected: %s\n  replayed: %s\n", expectPath,
+                    line, expectedLine.c_str(), actualLine.c_str());
+        }
+        same = same && line == 0;
+    }
+
+    fprintf(stderr,
+            "RESULT replay commands=%u edges=%u outputs=%u virtual_s=%.3f wall_s=%.4f commands_per_s=%.0f "
+            "speedup=%.0f trace_bytes=%zu trace_fnv=%016llx\n",
+            recorded.commands, recorded.edges, recorded.outputs, endAt / 1e6, seconds,
+            seconds > 0 ? recorded.commands / seconds : 0.0, seconds > 0 ? endAt / 1e6 / seconds : 0.0,
+            trace.size(), (unsigned long long)traceHash(trace));
+
+    if (benchRounds > 0) {
+        // Throughput only: nothing recorded, and every round starts over
+        halFakeRecord(false);
+        recorderStop();
+        started = std::chrono::steady_clock::now();
+        for (long round = 0; round < benchRounds; round++) {
+            halFakeReset();
+            simBoot();
+            replaySchedule(recorded);
+            simRunUntil(endAt);
+            for (const RecordEntry &entry : recorded.entries) {
+                if (entry.kind == RECORD_WS) {
+                    commandCacheForget(entry.client);
+                }
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        double commands = (double)recorded.commands * benchRounds;
+        fprintf(stderr, "RESULT replay_bench rounds=%ld commands=%.0f wall_s=%.3f commands_per_s=%.0f speedup=%.0f\n",
+                benchRounds, commands, seconds, commands / seconds, endAt / 1e6 * benchRounds / seconds);
+    }
+    return same ? 0 : 1;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program [scenario] [-o trace.txt] [-v] [--record record.bin]\n"
+            "               [--serve port] [--data dir] [--speed factor]\n"
+            "       program --replay record.bin [-o trace.txt] [--expect trace.txt] [--bench rounds]\n"
+            "       program --dump record.bin\n");
+}
+
+int main(int argc, char **argv) {
+    const char *scenarioPath = nullptr;
+    const char *outputPath = nullptr;
+    const char *dataDir = "data";
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    const char *expectPath = nullptr;
+    const char *dumpPath = nullptr;
+    long benchRounds = 0;
+    int port = 0;
+    double speed = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            Serial.enabled = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            dataDir = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--expect") == 0 && i + 1 < argc) {
+            expectPath = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            benchRounds = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpPath = argv[++i];
+        } else if (argv[i][0] != '-' && !scenarioPath) {
+            scenarioPath = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (dumpPath) {
+        Recording recording;
+        if (!replayLoad(dumpPath, recording)) {
+            return 1;
+        }
+        replayPrint(recording, stdout);
+        return 0;
+    }
+    if (replayPath) {
+        return runReplay(replayPath, expectPath, outputPath, benchRounds);
+    }
+    if ((!scenarioPath && port == 0) || speed <= 0) {
+        usage();
+        return 2;
+    }
+
+    Scenario scenario = {};
+    scenario.endAt = -1;
+    if (scenarioPath && !loadScenario(scenarioPath, scenario)) {
+        return 1;
+    }
+
+    halFakeReset();
+    scenarioSetRoot(dataDir);
+    if (recordPath) {
+        recorderBegin();
+    }
+    if (port != 0 && !simServerBegin((uint16_t)port, dataDir)) {
+        fprintf(stderr, "sim: cannot listen on 127.0.0.1:%d\n", port);
+        return 1;
+    }
+    simBoot();
+
+    // Steps are scheduled once the vector is final; events point into it
+    int64_t endAt = scenario.endAt;
+    for (ScenarioStep &step : scenario.steps) {
+        simAt(step.at, runStep, &step);
+        if (scenario.endAt < 0 && step.at > endAt) {
+            endAt = step.at;
+        }
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    if (port == 0) {
+        simRunUntil(endAt < 0 ? 0 : endAt);
+    } else {
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+        fprintf(stderr, "sim: serving %s on http://127.0.0.1:%d/ at %.1fx\n", dataDir, port, speed);
+        while (!stopRequested) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            int64_t now = (int64_t)(elapsed * speed * 1e6);
+            simRunUntil(now);
+            simServerService();
+
+            // Sleep until the next event is due in wall time, but keep
+            // answering sockets at least every 100 ms
+            int timeoutMs = 100;
+            int64_t next = simNextAt();
+            if (next >= 0) {
+                int64_t wait = (int64_t)((next - now) / speed / 1000);
+                timeoutMs = (int)constrain(wait, (int64_t)0, (int64_t)100);
+            }
+            simServerWait(timeoutMs);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const std::string &trace = halFakeTrace();
+    if (!writeFile(outputPath, trace.data(), trace.size())) {
+        return 1;
+    }
+    if (recordPath && !saveRecording(recordPath)) {
+        return 1;
+    }
+
+    double virtualSeconds = fakeClock.now / 1e6;
+    fprintf(stderr,
+            "RESULT virtual_s=%.3f wall_s=%.3f speedup=%.0f events=%llu commands=%u edges=%u "
+            "thermoking_cycles=%.0f carrier_cycles=%.0f pot_transactions=%u trace_bytes=%zu trace_fnv=%016llx\n",
+            virtualSeconds, seconds, seconds > 0 ? virtualSeconds / seconds : 0.0,
+            (unsigned long long)simEventsRun(), scenario.commands, scenario.edges,
+            fakePwm.cycles(PWM_THERMO_KING), fakePwm.cycles(PWM_CARRIER), fakePots.transactions, trace.size(),
+            (unsigned long long)traceHash(trace));
+    return 0;
+}
+
+#endif // HAL_NATIVE
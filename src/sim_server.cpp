@@ -0,0 +1,632 @@
+#include "sim_server.h"
+
+#if HAL_NATIVE
+
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <string>
+#include "protocol.h"
+#include "static_alloc.h"
+#include "sim.h"
+
+extern SystemState state;
+
+// Anything bigger is not a bench command; the connection is dropped
+#define SIM_FRAME_MAX   65536
+
+typedef struct {
+    int fd;                               // -1 = free slot
+    ClientId id;                          // 0 until upgraded to WebSocket
+    std::string in;
+    std::string out;
+    uint8_t topics;                       // WS_TOPIC_BIT mask
+    uint32_t sent[WS_SNAPSHOT_TOPICS];    // revision each snapshot was sent at
+    bool closing;                         // close once out has drained
+} SimConnection;
+
+typedef struct {
+    std::string message;
+    uint32_t revision;
+} SimSnapshot;
+
+SimTransport simTransport;
+
+static int listenFd = -1;
+static std::string dataRoot;
+static SimConnection connections[SIM_MAX_CONNECTIONS];
+static struct pollfd pollFds[SIM_MAX_CONNECTIONS + 1];
+static SimSnapshot latest[WS_SNAPSHOT_TOPICS];
+static ClientId lastClientId = SIM_LIVE_CLIENT_BASE;
+
+static inline uint32_t rol(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1(const uint8_t *data, size_t length, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // Message plus 0x80, zero pad and the 64-bit bit length
+    std::string message((const char *)data, length);
+    message += (char)0x80;
+    while (message.size() % 64 != 56) {
+        message += (char)0;
+    }
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 7; i >= 0; i--) {
+        message += (char)(bits >> (i * 8));
+    }
+
+    for (size_t block = 0; block < message.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t *p = (const uint8_t *)message.data() + block + i * 4;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = h[i] >> 24;
+        digest[i * 4 + 1] = h[i] >> 16;
+        digest[i * 4 + 2] = h[i] >> 8;
+        digest[i * 4 + 3] = h[i];
+    }
+}
+
+static std::string base64(const uint8_t *data, size_t length) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t chunk = (uint32_t)data[i] << 16;
+        if (i + 1 < length) chunk |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < length) chunk |= data[i + 2];
+        out += ALPHABET[(chunk >> 18) & 63];
+        out += ALPHABET[(chunk >> 12) & 63];
+        out += i + 1 < length ? ALPHABET[(chunk >> 6) & 63] : '=';
+        out += i + 2 < length ? ALPHABET[chunk & 63] : '=';
+    }
+    return out;
+}
+
+// Sec-WebSocket-Accept: base64(SHA-1(key + GUID))
+static std::string acceptKey(const std::string &key) {
+    std::string joined = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    sha1((const uint8_t *)joined.data(), joined.size(), digest);
+    return base64(digest, sizeof(digest));
+}
+
+static SimConnection *findClient(ClientId id) {
+    for (SimConnection &conn : connections) {
+        if (conn.fd >= 0 && conn.id == id) {
+            return &conn;
+        }
+    }
+    return nullptr;
+}
+
+static void flushOut(SimConnection &conn) {
+    while (!conn.out.empty()) {
+        ssize_t written = send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+        if (written <= 0) {
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            conn.out.clear();
+            conn.closing = true;
+            return;
+        }
+        conn.out.erase(0, written);
+    }
+}
+
+static void sendFrame(SimConnection &conn, uint8_t opcode, const char *payload, size_t length) {
+    char header[10];
+    size_t headerLength = 2;
+    header[0] = (char)(0x80 | opcode);
+    if (length < 126) {
+        header[1] = (char)length;
+    } else if (length <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (char)(length >> 8);
+        header[3] = (char)length;
+        headerLength = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (char)((uint64_t)length >> (56 - i * 8));
+        }
+        headerLength = 10;
+    }
+    conn.out.append(header, headerLength);
+    conn.out.append(payload, length);
+    flushOut(conn);
+}
+
+static void closeConnection(SimConnection &conn) {
+    close(conn.fd);
+    conn.fd = -1;
+    if (conn.id != 0) {
+        simClient(conn.id, false);
+    }
+    conn.id = 0;
+    conn.in.clear();
+    conn.out.clear();
+}
+
+// Snapshot topics a client just joined start from the next publish
+static void setTopics(SimConnection &conn, uint8_t topics) {
+    for (int topic = 0; topic < WS_SNAPSHOT_TOPICS; topic++) {
+        if (!(conn.topics & WS_TOPIC_BIT(topic))) {
+            conn.sent[topic] = latest[topic].revision;
+        }
+    }
+    conn.topics = topics & WS_TOPICS_ALL;
+}
+
+static std::string headerValue(const std::string &request, const char *name) {
+    size_t nameLength = strlen(name);
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < request.size()) {
+        size_t start = pos + 2;
+        size_t end = request.find("\r\n", start);
+        if (end == std::string::npos || end == start) {
+            break;
+        }
+        if (end - start > nameLength && request[start + nameLength] == ':' &&
+            strncasecmp(request.c_str() + start, name, nameLength) == 0) {
+            size_t value = start + nameLength + 1;
+            while (value < end && request[value] == ' ') {
+                value++;
+            }
+            return request.substr(value, end - value);
+        }
+        pos = end;
+    }
+    return "";
+}
+
+static const char *contentType(const std::string &path) {
+    static const struct {
+        const char *extension;
+        const char *type;
+    } TYPES[] = {
+        {".html", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".json", "application/json"},
+        {".png", "image/png"},
+        {".svg", "image/svg+xml"},
+        {".ico", "image/x-icon"},
+    };
+    for (const auto &entry : TYPES) {
+        size_t length = strlen(entry.extension);
+        if (path.size() >= length && path.compare(path.size() - length, length, entry.extension) == 0) {
+            return entry.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+static void sendHttp(SimConnection &conn, int code, const char *reason, const char *type, const std::string &body) {
+    char header[256];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+             "Cache-Control: no-cache\r\nConnection: close\r\n\r\n",
+             code, reason, type, body.size());
+    conn.out += header;
+    conn.out += body;
+    conn.closing = true;
+    flushOut(conn);
+}
+
+static bool readFile(const std::string &path, std::string &out) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        out.append(buffer, got);
+    }
+    fclose(file);
+    return true;
+}
+
+// Value of name in a query string, without URL decoding (the bench's
+// parameters are plain words)
+static bool queryParam(const std::string &query, const char *name, std::string &value) {
+    size_t nameLength = strlen(name);
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t end = query.find('&', pos);
+        end = end == std::string::npos ? query.size() : end;
+        if (query.compare(pos, nameLength, name) == 0 && pos + nameLength < end && query[pos + nameLength] == '=') {
+            value = query.substr(pos + nameLength + 1, end - pos - nameLength - 1);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// /start, /stop and /rpm with the replies web_server.cpp gives
+static void handleControl(SimConnection &conn, const std::string &path, const std::string &query) {
+    std::string value;
+    std::string message;
+    if (path == "/start") {
+        if (queryParam(query, "type", value)) {
+            simHttp(HTTP_CMD_START, value.c_str());
+            message = "System started with type: " + value;
+        } else {
+            simHttp(HTTP_CMD_START, nullptr);
+            message = "System started with default type (APU)";
+        }
+    } else if (path == "/stop") {
+        simHttp(HTTP_CMD_STOP, nullptr);
+        message = "System stopped";
+    } else {
+        bool running = state.systemRunning;
+        bool hasMode = queryParam(query, "mode", value);
+        simHttp(HTTP_CMD_RPM, hasMode ? value.c_str() : nullptr);
+        if (!running || !hasMode) {
+            message = "System not running or missing mode parameter";
+        } else if (value == "high" || value == "low") {
+            message = value + " RPM mode activated";
+        } else {
+            message = "Invalid RPM mode";
+        }
+    }
+    sendHttp(conn, 200, "OK", "text/plain", message);
+}
+
+static void upgrade(SimConnection &conn, const std::string &key) {
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                           "Connection: Upgrade\r\nSec-WebSocket-Accept: " +
+                           acceptKey(key) + "\r\n\r\n";
+    conn.out += response;
+    conn.id = ++lastClientId;
+    conn.topics = 0;
+    setTopics(conn, WS_TOPICS_ALL);
+    flushOut(conn);
+
+    simClient(conn.id, true);
+}
+
+// Returns false while the request headers are still incomplete
+static bool handleHttp(SimConnection &conn) {
+    size_t end = conn.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (conn.in.size() > SIM_HTTP_REQUEST_MAX) {
+            sendHttp(conn, 431, "Request Header Fields Too Large", "text/plain", "");
+        }
+        return false;
+    }
+    std::string request = conn.in.substr(0, end + 2);
+    conn.in.erase(0, end + 4);
+
+    char method[8] = "";
+    char target[512] = "";
+    sscanf(request.c_str(), "%7s %511s", method, target);
+    std::string path(target);
+    std::string query;
+    size_t mark = path.find('?');
+    if (mark != std::string::npos) {
+        query = path.substr(mark + 1);
+        path.erase(mark);
+    }
+
+    if (strcmp(method, "GET") != 0) {
+        sendHttp(conn, 405, "Method Not Allowed", "text/plain", "");
+        return true;
+    }
+
+    std::string key = headerValue(request, "Sec-WebSocket-Key");
+    if (path == "/ws" && !key.empty() && strcasecmp(headerValue(request, "Upgrade").c_str(), "websocket") == 0) {
+        upgrade(conn, key);
+        return true;
+    }
+
+    if (path == "/status") {
+        char body[WS_MESSAGE_MAX];
+        size_t length = serializeHttpStatus(body, sizeof(body), stateRevision());
+        sendHttp(conn, 200, "OK", "application/json", std::string(body, length));
+        return true;
+    }
+
+    if (path == "/start" || path == "/stop" || path == "/rpm") {
+        handleControl(conn, path, query);
+        return true;
+    }
+
+    if (path == "/") {
+        simHttp(HTTP_CMD_PAGE, nullptr);
+        path = "/index.html";
+    }
+    std::string content;
+    if (path.find("..") != std::string::npos || !readFile(dataRoot + path, content)) {
+        sendHttp(conn, 404, "Not Found", "text/plain", "Not found");
+        return true;
+    }
+    sendHttp(conn, 200, "OK", contentType(path), content);
+    return true;
+}
+
+// One frame from the client (always masked). Returns false once no
+// complete frame is buffered.
+static bool handleFrame(SimConnection &conn) {
+    const uint8_t *p = (const uint8_t *)conn.in.data();
+    size_t available = conn.in.size();
+    if (available < 2) {
+        return false;
+    }
+    bool final = p[0] & 0x80;
+    uint8_t opcode = p[0] & 0x0F;
+    bool masked = p[1] & 0x80;
+    uint64_t length = p[1] & 0x7F;
+    size_t pos = 2;
+    if (length == 126) {
+        if (available < 4) {
+            return false;
+        }
+        length = (uint64_t)p[2] << 8 | p[3];
+        pos = 4;
+    } else if (length == 127) {
+        if (available < 10) {
+            return false;
+        }
+        length = 0;
+        for (int i = 0; i < 8; i++) {
+            length = length << 8 | p[2 + i];
+        }
+        pos = 10;
+    }
+    if (!masked || length > SIM_FRAME_MAX) {
+        conn.in.clear();
+        conn.closing = true;
+        return false;
+    }
+    if (available < pos + 4 + length) {
+        return false;
+    }
+
+    std::string payload(conn.in, pos + 4, length);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] ^= p[pos + (i & 3)];
+    }
+    conn.in.erase(0, pos + 4 + length);
+
+    switch (opcode) {
+        case 0x1:
+            // Same filter as handleWebSocketMessage(): whole text frames that fit
+            if (final && payload.size() <= WS_MESSAGE_MAX) {
+                simCommand(conn.id, payload.data(), payload.size());
+            }
+            break;
+        case 0x8:
+            sendFrame(conn, 0x8, payload.data(), payload.size() < 2 ? 0 : 2);
+            conn.closing = true;
+            return false;
+        case 0x9:
+            sendFrame(conn, 0xA, payload.data(), payload.size());
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+void SimTransport::reply(ClientId client, const char *message, size_t length) {
+    FakeTransport::reply(client, message, length);
+    SimConnection *conn = findClient(client);
+    if (conn) {
+        sendFrame(*conn, 0x1, message, length);
+    }
+}
+
+void SimTransport::broadcast(WsTopic topic, const char *message, size_t length, uint32_t revision) {
+    FakeTransport::broadcast(topic, message, length, revision);
+    for (SimConnection &conn : connections) {
+        if (conn.fd >= 0 && conn.id != 0 && (conn.topics & WS_TOPIC_BIT(topic))) {
+            sendFrame(conn, 0x1, message, length);
+        }
+    }
+}
+
+// Latest-wins like wsPublishSnapshot(): a client still draining its output
+// only keeps the mark, and simServerPump() sends whatever is newest then
+void SimTransport::publish(WsTopic topic, const char *message, size_t length, uint32_t revision) {
+    FakeTransport::publish(topic, message, length, revision);
+    if (topic >= WS_SNAPSHOT_TOPICS) {
+        return;
+    }
+    latest[topic].message.assign(message, length);
+    latest[topic].revision = revision;
+    for (SimConnection &conn : connections) {
+        if (conn.fd >= 0 && conn.id != 0 && (conn.topics & WS_TOPIC_BIT(topic)) && conn.out.empty()) {
+            sendFrame(conn, 0x1, message, length);
+            conn.sent[topic] = revision;
+        }
+    }
+}
+
+void SimTransport::subscribe(ClientId client, uint8_t topics) {
+    FakeTransport::subscribe(client, topics);
+    SimConnection *conn = findClient(client);
+    if (conn) {
+        setTopics(*conn, topics);
+    }
+}
+
+bool simServerBegin(uint16_t port, const char *dataDir) {
+    dataRoot = dataDir;
+    for (SimConnection &conn : connections) {
+        conn.fd = -1;
+        conn.id = 0;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0) {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+
+    simTransport.wantedTopics = WS_TOPICS_ALL;
+    hal.transport = &simTransport;
+    return true;
+}
+
+void simServerWait(int timeoutMs) {
+    pollFds[0].fd = listenFd;
+    pollFds[0].events = POLLIN;
+    pollFds[0].revents = 0;
+    for (int i = 0; i < SIM_MAX_CONNECTIONS; i++) {
+        SimConnection &conn = connections[i];
+        pollFds[i + 1].fd = conn.fd;
+        pollFds[i + 1].events = POLLIN | (conn.out.empty() ? 0 : POLLOUT);
+        pollFds[i + 1].revents = 0;
+    }
+    poll(pollFds, SIM_MAX_CONNECTIONS + 1, timeoutMs);
+}
+
+void simServerService() {
+    if (listenFd < 0) {
+        return;
+    }
+
+    if (pollFds[0].revents & POLLIN) {
+        int fd;
+        while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+            SimConnection *slot = nullptr;
+            for (SimConnection &conn : connections) {
+                if (conn.fd < 0) {
+                    slot = &conn;
+                    break;
+                }
+            }
+            if (!slot) {
+                close(fd);
+                continue;
+            }
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            slot->fd = fd;
+            slot->id = 0;
+            slot->closing = false;
+        }
+    }
+
+    for (int i = 0; i < SIM_MAX_CONNECTIONS; i++) {
+        SimConnection &conn = connections[i];
+        if (conn.fd < 0 || pollFds[i + 1].fd != conn.fd) {
+            continue;
+        }
+        short revents = pollFds[i + 1].revents;
+
+        if (revents & POLLOUT) {
+            flushOut(conn);
+        }
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            char buffer[4096];
+            ssize_t got = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (got <= 0) {
+                if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    closeConnection(conn);
+                    continue;
+                }
+            } else if (!conn.closing) {
+                conn.in.append(buffer, got);
+            }
+        }
+
+        if (conn.id == 0) {
+            if (!conn.closing) {
+                handleHttp(conn);
+            }
+        } else {
+            while (!conn.closing && handleFrame(conn)) {
+            }
+        }
+
+        if (conn.closing && conn.out.empty()) {
+            closeConnection(conn);
+        }
+    }
+}
+
+void simServerPump() {
+    if (listenFd < 0) {
+        return;
+    }
+    for (SimConnection &conn : connections) {
+        if (conn.fd < 0 || conn.id == 0 || !conn.out.empty()) {
+            continue;
+        }
+        for (int topic = 0; topic < WS_SNAPSHOT_TOPICS; topic++) {
+            if ((conn.topics & WS_TOPIC_BIT(topic)) && conn.sent[topic] != latest[topic].revision) {
+                sendFrame(conn, 0x1, latest[topic].message.data(), latest[topic].message.size());
+                conn.sent[topic] = latest[topic].revision;
+            }
+        }
+    }
+}
+
+size_t simServerClients() {
+    size_t count = 0;
+    for (const SimConnection &conn : connections) {
+        if (conn.fd >= 0 && conn.id != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+#endif // HAL_NATIVE
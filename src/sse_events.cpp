@@ -0,0 +1,81 @@
+#include "sse_events.h"
+#include "web_server.h"
+#include "static_alloc.h"
+#include "freertos/FreeRTOS.h"
+
+static AsyncEventSource events("/events");
+
+typedef struct {
+    uint32_t revision;        // 0 = empty
+    uint16_t length;
+    char text[SSE_EVENT_TEXT_MAX + 1];
+} BacklogEvent;
+
+// Ring of the latest events, oldest overwritten first
+static BacklogEvent backlog[SSE_EVENT_BACKLOG];
+static uint8_t backlogNext = 0;
+static portMUX_TYPE backlogLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void onConnect(AsyncEventSourceClient *client) {
+    if (events.count() > SSE_MAX_CLIENTS) {
+        Serial.println("SSE client rejected, too many dashboards");
+        client->close();
+        return;
+    }
+
+    uint32_t lastId = client->lastId();
+    uint32_t revision = stateRevision();
+
+    // Missed events first, oldest to newest, so the status sent last
+    // leaves the browser's Last-Event-ID at the newest revision
+    if (lastId != 0) {
+        for (uint8_t i = 0; i < SSE_EVENT_BACKLOG; i++) {
+            BacklogEvent event;
+            portENTER_CRITICAL(&backlogLock);
+            event = backlog[(backlogNext + i) % SSE_EVENT_BACKLOG];
+            portEXIT_CRITICAL(&backlogLock);
+            if (event.revision > lastId) {
+                client->send(event.text, wsTopicName(WS_TOPIC_EVENTS), event.revision);
+            }
+        }
+    }
+
+    // State is latest-wins: one full status covers every missed delta
+    if (lastId != revision) {
+        char text[WS_MESSAGE_MAX];
+        serializeStatus(text, sizeof(text));
+        client->send(text, wsTopicName(WS_TOPIC_STATUS), revision, SSE_RECONNECT_MS);
+    }
+}
+
+void sseBegin(AsyncWebServer &server) {
+    events.onConnect(onConnect);
+    server.addHandler(&events);
+}
+
+size_t sseClientCount() {
+    return events.count();
+}
+
+void ssePublish(WsTopic topic, const char *message, size_t length, uint32_t revision) {
+    if (topic == WS_TOPIC_EVENTS && length <= SSE_EVENT_TEXT_MAX) {
+        portENTER_CRITICAL(&backlogLock);
+        BacklogEvent &slot = backlog[backlogNext];
+        memcpy(slot.text, message, length);
+        slot.text[length] = 0;
+        slot.length = length;
+        slot.revision = revision;
+        backlogNext = (backlogNext + 1) % SSE_EVENT_BACKLOG;
+        portEXIT_CRITICAL(&backlogLock);
+    }
+
+    if (events.count() == 0 || length > WS_MESSAGE_MAX) {
+        return;
+    }
+
+    // AsyncEventSource wants a terminated string
+    char text[WS_MESSAGE_MAX + 1];
+    memcpy(text, message, length);
+    text[length] = 0;
+    events.send(text, wsTopicName(topic), revision);
+}
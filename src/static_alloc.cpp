@@ -0,0 +1,52 @@
+#include "static_alloc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if STATIC_ALLOC_MODE
+
+static StackType_t stackArena[STATIC_TASK_STACK_BYTES] __attribute__((aligned(16)));
+static size_t stackUsed = 0;
+static StaticTask_t taskBlocks[STATIC_MAX_TASKS];
+static uint8_t taskCount = 0;
+
+BaseType_t createPinnedTask(TaskFunction_t function, const char *name, uint32_t stackBytes,
+                            void *parameter, UBaseType_t priority, TaskHandle_t *handle,
+                            BaseType_t core) {
+    // Keep every stack 16-byte aligned
+    size_t size = (stackBytes + 15) & ~(size_t)15;
+
+    // The arena is sized for exactly our tasks, so running out is a build
+    // mistake; a missing task would otherwise only show as a dead feature
+    if (taskCount >= STATIC_MAX_TASKS || stackUsed + size > sizeof(stackArena)) {
+        Serial.printf("FATAL: no static storage for task %s (%u bytes, %u of %u used, task %u of %u)\n", name,
+                      (unsigned)size, (unsigned)stackUsed, (unsigned)sizeof(stackArena), taskCount + 1,
+                      STATIC_MAX_TASKS);
+        abort();
+    }
+
+    TaskHandle_t created = xTaskCreateStaticPinnedToCore(
+        function, name, size, parameter, priority,
+        &stackArena[stackUsed], &taskBlocks[taskCount], core);
+
+    if (created == NULL) {
+        Serial.printf("FATAL: could not create task %s\n", name);
+        abort();
+    }
+
+    stackUsed += size;
+    taskCount++;
+    if (handle) {
+        *handle = created;
+    }
+    return pdPASS;
+}
+
+#else
+
+BaseType_t createPinnedTask(TaskFunction_t function, const char *name, uint32_t stackBytes,
+                            void *parameter, UBaseType_t priority, TaskHandle_t *handle,
+                            BaseType_t core) {
+    return xTaskCreatePinnedToCore(function, name, stackBytes, parameter, priority, handle, core);
+}
+
+#endif // STATIC_ALLOC_MODE
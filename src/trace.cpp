@@ -0,0 +1,154 @@
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_ipc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TRACE_NUM_CORES 2
+
+// Per-core ring. Only tasks pinned to (or currently running on) a core write
+// to its ring, so the slot index is claimed with a single atomic add.
+typedef struct {
+    TraceEvent events[TRACE_RING_SIZE];
+    volatile uint32_t head;   // total events written since clear
+} TraceRing;
+
+static TraceRing rings[TRACE_NUM_CORES];
+
+// Task table - appended the first time a task records an event
+static TaskHandle_t taskHandles[TRACE_MAX_TASKS];
+static char taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_LEN];
+static volatile uint8_t taskCount = 0;
+static portMUX_TYPE taskMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Recording is paused while a dump copies the rings
+static volatile bool recording = false;
+
+static uint8_t lookupTask() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint8_t count = taskCount;
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (taskHandles[i] == self) {
+            return i;
+        }
+    }
+
+    // Not seen yet - register it. Rare, so a spinlock is fine here.
+    uint8_t index = TRACE_MAX_TASKS - 1;
+    portENTER_CRITICAL_SAFE(&taskMux);
+    if (taskCount < TRACE_MAX_TASKS) {
+        index = taskCount;
+        taskHandles[index] = self;
+        const char *name = self ? pcTaskGetName(self) : "isr";
+        strncpy(taskNames[index], name ? name : "?", TRACE_TASK_NAME_LEN - 1);
+        taskNames[index][TRACE_TASK_NAME_LEN - 1] = '\0';
+        taskCount = index + 1;
+    }
+    portEXIT_CRITICAL_SAFE(&taskMux);
+    return index;
+}
+
+void traceInit() {
+    traceClear();
+    recording = true;
+    Serial.printf("Trace recorder enabled (%d events/core)\n", TRACE_RING_SIZE);
+}
+
+void traceClear() {
+    bool wasRecording = recording;
+    recording = false;
+    for (int core = 0; core < TRACE_NUM_CORES; core++) {
+        rings[core].head = 0;
+    }
+    recording = wasRecording;
+}
+
+void IRAM_ATTR traceRecord(uint16_t id, uint8_t phase, uint32_t arg) {
+    if (!recording) {
+        return;
+    }
+
+    uint32_t cycles = XTHAL_GET_CCOUNT();
+    TraceRing &ring = rings[xPortGetCoreID()];
+    uint32_t slot = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED) % TRACE_RING_SIZE;
+
+    TraceEvent &ev = ring.events[slot];
+    ev.cycles = cycles;
+    ev.id = id;
+    ev.task = lookupTask();
+    ev.phase = phase;
+    ev.arg = arg;
+}
+
+size_t traceDumpSize() {
+    return sizeof(TraceFileHeader)
+         + TRACE_MAX_TASKS * TRACE_TASK_NAME_LEN
+         + TRACE_NUM_CORES * (sizeof(TraceCoreHeader) + sizeof(TraceEvent) * TRACE_RING_SIZE);
+}
+
+// CCOUNT is per core and not synchronized, so each ring gets its own anchor
+// pairing the local cycle counter with the shared esp_timer clock.
+static void captureAnchor(void *arg) {
+    TraceCoreHeader *hdr = (TraceCoreHeader *)arg;
+    hdr->anchorCycles = XTHAL_GET_CCOUNT();
+    hdr->anchorMicros = esp_timer_get_time();
+}
+
+size_t traceDump(uint8_t *out, size_t maxLen) {
+    if (maxLen < traceDumpSize()) {
+        return 0;
+    }
+
+    bool wasRecording = recording;
+    recording = false;
+
+    uint8_t *p = out;
+
+    TraceFileHeader fh;
+    fh.magic = TRACE_MAGIC;
+    fh.version = TRACE_FORMAT_VERSION;
+    fh.numCores = TRACE_NUM_CORES;
+    fh.cpuMhz = getCpuFrequencyMhz();
+    fh.taskCount = taskCount;
+    fh.eventSize = sizeof(TraceEvent);
+    memcpy(p, &fh, sizeof(fh));
+    p += sizeof(fh);
+
+    memcpy(p, taskNames, fh.taskCount * TRACE_TASK_NAME_LEN);
+    p += fh.taskCount * TRACE_TASK_NAME_LEN;
+
+    for (int core = 0; core < TRACE_NUM_CORES; core++) {
+        TraceRing &ring = rings[core];
+        uint32_t head = ring.head;
+        uint32_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+        TraceCoreHeader ch;
+        memset(&ch, 0, sizeof(ch));
+        if (core == xPortGetCoreID()) {
+            captureAnchor(&ch);
+        } else {
+            esp_ipc_call_blocking(core, captureAnchor, &ch);
+        }
+        ch.eventCount = count;
+        ch.dropped = head - count;
+        memcpy(p, &ch, sizeof(ch));
+        p += sizeof(ch);
+
+        // Oldest first
+        uint32_t start = head - count;
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(p, &ring.events[(start + i) % TRACE_RING_SIZE], sizeof(TraceEvent));
+            p += sizeof(TraceEvent);
+        }
+    }
+
+    recording = wasRecording;
+    return p - out;
+}
+
+#endif // TRACE_ENABLED
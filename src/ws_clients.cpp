@@ -0,0 +1,248 @@
+#include "ws_clients.h"
+#include "web_server.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// One slot per tracked client; two spare so a new connection can be
+// recorded before the cap decides who has to go
+#define WS_CLIENT_SLOTS (WS_MAX_CLIENTS + 2)
+
+typedef struct {
+    uint32_t id;              // 0 = free slot
+    WsClientRole role;
+    bool evicting;            // close() issued, waiting for the disconnect event
+    uint8_t overQueued;
+    uint32_t lastSeenMillis;  // Any data or pong
+    uint32_t lastPingMillis;
+    int64_t pingSentMicros;   // 0 = no ping outstanding
+    uint32_t rttMicros;
+    uint32_t rttAvgMicros;
+    uint32_t queueLen;
+} ClientRecord;
+
+static ClientRecord records[WS_CLIENT_SLOTS];
+static uint32_t evictions[WS_EVICT_COUNT];
+
+// Events arrive on the async_tcp task, the service pass runs on the web
+// status task. Never call into AsyncWebSocket while holding this.
+static portMUX_TYPE recordLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const EVICT_REASON_NAMES[WS_EVICT_COUNT] = {
+    "dead",
+    "slow",
+    "capacity",
+};
+
+static ClientRecord *findRecord(uint32_t id) {
+    for (ClientRecord &record : records) {
+        if (record.id == id) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+bool wsClientsOnConnect(AsyncWebSocketClient *client) {
+    uint32_t now = millis();
+    uint32_t victim = 0;
+    size_t active = 0;
+
+    portENTER_CRITICAL(&recordLock);
+    ClientRecord *record = findRecord(0);
+    if (record) {
+        memset(record, 0, sizeof(*record));
+        record->id = client->id();
+        record->role = WS_ROLE_VIEWER;
+        record->lastSeenMillis = now;
+        record->lastPingMillis = now;
+    }
+
+    // Over the cap: the viewer idle the longest makes room, never a control
+    ClientRecord *oldest = nullptr;
+    for (ClientRecord &other : records) {
+        if (other.id == 0 || other.evicting) {
+            continue;
+        }
+        active++;
+        if (&other != record && other.role == WS_ROLE_VIEWER &&
+            (!oldest || (int32_t)(other.lastSeenMillis - oldest->lastSeenMillis) < 0)) {
+            oldest = &other;
+        }
+    }
+    if (record && active > WS_MAX_CLIENTS && oldest) {
+        oldest->evicting = true;
+        victim = oldest->id;
+        evictions[WS_EVICT_CAPACITY]++;
+    } else if (!record || active > WS_MAX_CLIENTS) {
+        // Full of control clients: turn the newcomer away
+        if (record) {
+            record->evicting = true;
+        }
+        victim = client->id();
+        evictions[WS_EVICT_CAPACITY]++;
+    }
+    portEXIT_CRITICAL(&recordLock);
+
+    if (victim == client->id()) {
+        Serial.printf("WebSocket client #%u rejected, %u clients connected\n", victim, (unsigned)ws.count());
+        client->close(1013, "Server full");
+        return false;
+    } else if (victim) {
+        Serial.printf("WebSocket viewer #%u evicted to admit #%u\n", victim, client->id());
+        AsyncWebSocketClient *evicted = ws.client(victim);
+        if (evicted) {
+            evicted->close(1001, "Evicted");
+        }
+    }
+    return true;
+}
+
+void wsClientsOnDisconnect(AsyncWebSocketClient *client) {
+    portENTER_CRITICAL(&recordLock);
+    ClientRecord *record = findRecord(client->id());
+    if (record) {
+        record->id = 0;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void wsClientsOnData(AsyncWebSocketClient *client) {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&recordLock);
+    ClientRecord *record = findRecord(client->id());
+    if (record) {
+        record->lastSeenMillis = now;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void wsClientsOnPong(AsyncWebSocketClient *client) {
+    int64_t nowMicros = esp_timer_get_time();
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&recordLock);
+    ClientRecord *record = findRecord(client->id());
+    if (record) {
+        record->lastSeenMillis = now;
+        if (record->pingSentMicros != 0) {
+            uint32_t rtt = (uint32_t)(nowMicros - record->pingSentMicros);
+            record->rttMicros = rtt;
+            if (record->rttAvgMicros == 0) {
+                record->rttAvgMicros = rtt;
+            } else {
+                record->rttAvgMicros += ((int32_t)rtt - (int32_t)record->rttAvgMicros) / 8;
+            }
+            record->pingSentMicros = 0;
+        }
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void wsClientsMarkControl(AsyncWebSocketClient *client) {
+    portENTER_CRITICAL(&recordLock);
+    ClientRecord *record = findRecord(client->id());
+    if (record) {
+        record->role = WS_ROLE_CONTROL;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void wsClientsService() {
+    uint32_t now = millis();
+    int64_t nowMicros = esp_timer_get_time();
+
+    uint32_t ids[WS_CLIENT_SLOTS];
+    size_t count = 0;
+    portENTER_CRITICAL(&recordLock);
+    for (const ClientRecord &record : records) {
+        if (record.id != 0 && !record.evicting) {
+            ids[count++] = record.id;
+        }
+    }
+    portEXIT_CRITICAL(&recordLock);
+
+    for (size_t i = 0; i < count; i++) {
+        AsyncWebSocketClient *client = ws.client(ids[i]);
+        if (!client) {
+            continue;
+        }
+        uint32_t queued = client->queueLen();
+        WsEvictReason reason = WS_EVICT_COUNT;
+        bool ping = false;
+
+        portENTER_CRITICAL(&recordLock);
+        ClientRecord *record = findRecord(ids[i]);
+        if (record) {
+            record->queueLen = queued;
+            record->overQueued = queued > WS_QUEUE_EVICT_DEPTH ? record->overQueued + 1 : 0;
+
+            if (now - record->lastSeenMillis > WS_DEAD_AFTER_MS) {
+                reason = WS_EVICT_DEAD;
+            } else if (record->overQueued >= WS_QUEUE_EVICT_CHECKS) {
+                reason = WS_EVICT_SLOW;
+            } else if (now - record->lastPingMillis >= WS_PING_INTERVAL_MS) {
+                record->lastPingMillis = now;
+                record->pingSentMicros = nowMicros;
+                ping = true;
+            }
+
+            if (reason != WS_EVICT_COUNT) {
+                record->evicting = true;
+                evictions[reason]++;
+            }
+        }
+        portEXIT_CRITICAL(&recordLock);
+
+        if (reason != WS_EVICT_COUNT) {
+            Serial.printf("WebSocket client #%u evicted (%s, queue %u)\n", ids[i],
+                          EVICT_REASON_NAMES[reason], queued);
+            client->close();
+        } else if (ping) {
+            client->ping();
+        }
+    }
+
+    // Frees clients whose sockets have already closed
+    ws.cleanupClients(WS_MAX_CLIENTS);
+}
+
+size_t wsClientsIds(uint32_t *out, size_t max) {
+    size_t count = 0;
+    portENTER_CRITICAL(&recordLock);
+    for (const ClientRecord &record : records) {
+        if (record.id != 0 && !record.evicting && count < max) {
+            out[count++] = record.id;
+        }
+    }
+    portEXIT_CRITICAL(&recordLock);
+    return count;
+}
+
+size_t wsClientsSnapshot(WsClientInfo *out, size_t max) {
+    uint32_t now = millis();
+    size_t count = 0;
+
+    portENTER_CRITICAL(&recordLock);
+    for (const ClientRecord &record : records) {
+        if (record.id == 0 || count >= max) {
+            continue;
+        }
+        WsClientInfo &info = out[count++];
+        info.id = record.id;
+        info.role = record.role;
+        info.rttMicros = record.rttMicros;
+        info.rttAvgMicros = record.rttAvgMicros;
+        info.queueLen = record.queueLen;
+        info.idleMillis = now - record.lastSeenMillis;
+    }
+    portEXIT_CRITICAL(&recordLock);
+    return count;
+}
+
+uint32_t wsClientsEvictions(WsEvictReason reason) {
+    return reason < WS_EVICT_COUNT ? evictions[reason] : 0;
+}
+
+const char *wsEvictReasonName(WsEvictReason reason) {
+    return reason < WS_EVICT_COUNT ? EVICT_REASON_NAMES[reason] : "?";
+}
@@ -0,0 +1,210 @@
+#include "ws_outbound.h"
+#include "web_server.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#include "freertos/FreeRTOS.h"
+#include <atomic>
+
+typedef struct {
+    uint32_t revision;        // 0 = never published
+    uint16_t length;
+    char text[WS_MESSAGE_MAX];
+} Snapshot;
+
+// Subscriptions and the last snapshot revision each client was sent
+typedef struct {
+    uint32_t clientId;        // 0 = free
+    uint8_t topics;           // WS_TOPIC_BIT mask
+    uint32_t sent[WS_SNAPSHOT_TOPICS];
+} ClientOutbound;
+
+static Snapshot snapshots[WS_SNAPSHOT_TOPICS];
+static ClientOutbound clients[WS_OUTBOUND_CLIENTS];
+
+// Publishers run on several tasks; held only for copies, never across a send
+static portMUX_TYPE outboundLock = portMUX_INITIALIZER_UNLOCKED;
+
+// One pump at a time, so an older copy can never overtake a newer one
+static std::atomic<bool> pumping(false);
+static std::atomic<bool> pumpAgain(false);
+
+static ClientOutbound *findClient(uint32_t clientId) {
+    for (ClientOutbound &entry : clients) {
+        if (entry.clientId == clientId) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// A client seen for the first time got a full status on connect, and the
+// other snapshots are subsets of it, so it starts with nothing pending
+static ClientOutbound *claimClient(uint32_t clientId) {
+    ClientOutbound *entry = findClient(clientId);
+    if (!entry) {
+        entry = findClient(0);
+        if (!entry) {
+            return nullptr;
+        }
+        entry->clientId = clientId;
+        entry->topics = WS_TOPICS_ALL;
+        for (int topic = 0; topic < WS_SNAPSHOT_TOPICS; topic++) {
+            entry->sent[topic] = snapshots[topic].revision;
+        }
+    }
+    return entry;
+}
+
+// Untracked clients have not subscribed yet and get everything
+static bool subscribed(uint32_t clientId, WsTopic topic) {
+    const ClientOutbound *entry = findClient(clientId);
+    return !entry || (entry->topics & WS_TOPIC_BIT(topic));
+}
+
+void wsSendControl(AsyncWebSocketClient *client, const char *message, size_t length) {
+    metrics.wsReplyFrames.fetch_add(1, std::memory_order_relaxed);
+    metrics.wsReplyBytes.fetch_add(length, std::memory_order_relaxed);
+    client->text(message, length);
+}
+
+void wsBroadcastControl(WsTopic topic, const char *message, size_t length) {
+    uint32_t ids[WS_OUTBOUND_CLIENTS];
+    size_t count = wsClientsIds(ids, WS_OUTBOUND_CLIENTS);
+
+    for (size_t i = 0; i < count; i++) {
+        portENTER_CRITICAL(&outboundLock);
+        bool wanted = subscribed(ids[i], topic);
+        portEXIT_CRITICAL(&outboundLock);
+        if (!wanted) {
+            continue;
+        }
+
+        AsyncWebSocketClient *client = ws.client(ids[i]);
+        if (client && client->status() == WS_CONNECTED) {
+            metrics.wsBroadcastFrames.fetch_add(1, std::memory_order_relaxed);
+            metrics.wsBroadcastBytes.fetch_add(length, std::memory_order_relaxed);
+            client->text(message, length);
+        }
+    }
+}
+
+void wsPublishSnapshot(WsTopic topic, const char *message, size_t length) {
+    if (topic >= WS_SNAPSHOT_TOPICS || length > WS_MESSAGE_MAX) {
+        return;
+    }
+
+    uint32_t superseded = 0;
+    portENTER_CRITICAL(&outboundLock);
+    Snapshot &snapshot = snapshots[topic];
+    for (const ClientOutbound &entry : clients) {
+        if (entry.clientId != 0 && (entry.topics & WS_TOPIC_BIT(topic)) &&
+            entry.sent[topic] != snapshot.revision) {
+            superseded++;
+        }
+    }
+    memcpy(snapshot.text, message, length);
+    snapshot.length = length;
+    snapshot.revision++;
+    portEXIT_CRITICAL(&outboundLock);
+
+    metrics.wsSnapshotsSuperseded.fetch_add(superseded, std::memory_order_relaxed);
+    wsOutboundPump();
+}
+
+// Sends this client every subscribed snapshot it has not seen, while its
+// queue has room
+static void deliver(AsyncWebSocketClient *client) {
+    char text[WS_MESSAGE_MAX];
+
+    for (int topic = 0; topic < WS_SNAPSHOT_TOPICS; topic++) {
+        if (client->queueLen() >= WS_SNAPSHOT_QUEUE_MAX) {
+            return;
+        }
+
+        size_t length = 0;
+        portENTER_CRITICAL(&outboundLock);
+        ClientOutbound *entry = claimClient(client->id());
+        const Snapshot &snapshot = snapshots[topic];
+        if (entry && (entry->topics & WS_TOPIC_BIT(topic)) && entry->sent[topic] != snapshot.revision) {
+            length = snapshot.length;
+            memcpy(text, snapshot.text, length);
+            entry->sent[topic] = snapshot.revision;
+        }
+        portEXIT_CRITICAL(&outboundLock);
+
+        if (length > 0) {
+            metrics.wsSnapshotFrames.fetch_add(1, std::memory_order_relaxed);
+            metrics.wsSnapshotBytes.fetch_add(length, std::memory_order_relaxed);
+            client->text(text, length);
+        }
+    }
+}
+
+void wsOutboundPump() {
+    // Whoever holds the pump runs another pass for us
+    pumpAgain.store(true);
+    if (pumping.exchange(true)) {
+        return;
+    }
+
+    uint32_t ids[WS_OUTBOUND_CLIENTS];
+    while (pumpAgain.exchange(false)) {
+        size_t count = wsClientsIds(ids, WS_OUTBOUND_CLIENTS);
+        for (size_t i = 0; i < count; i++) {
+            AsyncWebSocketClient *client = ws.client(ids[i]);
+            if (client && client->status() == WS_CONNECTED) {
+                deliver(client);
+            }
+        }
+    }
+    pumping.store(false);
+
+    // A publish that raced with the release above
+    if (pumpAgain.load() && !pumping.load()) {
+        wsOutboundPump();
+    }
+}
+
+void wsSetTopics(uint32_t clientId, uint8_t topics) {
+    portENTER_CRITICAL(&outboundLock);
+    ClientOutbound *entry = claimClient(clientId);
+    if (entry) {
+        // Newly added snapshot topics start from the next publish; the slot
+        // may be stale if nobody was subscribed while state changed
+        for (int topic = 0; topic < WS_SNAPSHOT_TOPICS; topic++) {
+            if (!(entry->topics & WS_TOPIC_BIT(topic))) {
+                entry->sent[topic] = snapshots[topic].revision;
+            }
+        }
+        entry->topics = topics & WS_TOPICS_ALL;
+    }
+    portEXIT_CRITICAL(&outboundLock);
+}
+
+size_t wsTopicSubscribers(WsTopic topic) {
+    uint32_t ids[WS_OUTBOUND_CLIENTS];
+    size_t count = wsClientsIds(ids, WS_OUTBOUND_CLIENTS);
+
+    size_t subscribers = 0;
+    portENTER_CRITICAL(&outboundLock);
+    for (size_t i = 0; i < count; i++) {
+        if (subscribed(ids[i], topic)) {
+            subscribers++;
+        }
+    }
+    portEXIT_CRITICAL(&outboundLock);
+    return subscribers;
+}
+
+bool wsTopicHasSubscribers(WsTopic topic) {
+    return wsTopicSubscribers(topic) > 0;
+}
+
+void wsOutboundForget(uint32_t clientId) {
+    portENTER_CRITICAL(&outboundLock);
+    ClientOutbound *entry = findClient(clientId);
+    if (entry) {
+        entry->clientId = 0;
+    }
+    portEXIT_CRITICAL(&outboundLock);
+}
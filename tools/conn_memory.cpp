@@ -0,0 +1,141 @@
+// Per-connection heap cost of an /events (SSE) dashboard compared with a
+// WebSocket client. Reads reefer_heap_free_bytes from /metrics, opens N
+// connections of one kind, waits for them to settle and reads it again.
+// Then it closes them and does the same for the other kind. Heap readings
+// are noisy, so use several connections and a few runs.
+//
+// Build:  g++ -std=c++17 -O2 tools/conn_memory.cpp -o conn_memory
+// Usage:  ./conn_memory <host> [port=80] [connections=4]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ws_client.h"
+
+static int openTcp(const char *host, int port) {
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%d", port);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static long freeHeap(const char *host, int port) {
+    int fd = openTcp(host, port);
+    if (fd < 0) {
+        return -1;
+    }
+    char request[256];
+    int len = snprintf(request, sizeof(request),
+                       "GET /metrics HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", host);
+    ::send(fd, request, len, MSG_NOSIGNAL);
+
+    std::string response;
+    char chunk[2048];
+    ssize_t n;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        response.append(chunk, n);
+    }
+    ::close(fd);
+
+    size_t at = response.find("\nreefer_heap_free_bytes ");
+    return at == std::string::npos ? -1 : atol(response.c_str() + at + 24);
+}
+
+// Opens an SSE stream and waits for the first event so the device has
+// finished setting the connection up
+static int openEvents(const char *host, int port) {
+    int fd = openTcp(host, port);
+    if (fd < 0) {
+        return -1;
+    }
+    char request[256];
+    int len = snprintf(request, sizeof(request),
+                       "GET /events HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n", host);
+    ::send(fd, request, len, MSG_NOSIGNAL);
+
+    std::string received;
+    char chunk[1024];
+    while (received.find("\ndata:") == std::string::npos) {
+        pollfd pfd = {fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 3000) <= 0) {
+            ::close(fd);
+            return -1;
+        }
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            ::close(fd);
+            return -1;
+        }
+        received.append(chunk, n);
+    }
+    return fd;
+}
+
+static long settledHeap(const char *host, int port) {
+    usleep(500000);
+    return freeHeap(host, port);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <host> [port] [connections]\n", argv[0]);
+        return 1;
+    }
+    const char *host = argv[1];
+    int port = argc > 2 ? atoi(argv[2]) : 80;
+    int count = argc > 3 ? atoi(argv[3]) : 4;
+
+    long base = settledHeap(host, port);
+    if (base < 0) {
+        fprintf(stderr, "could not read reefer_heap_free_bytes\n");
+        return 1;
+    }
+
+    std::vector<int> streams;
+    for (int i = 0; i < count; i++) {
+        int fd = openEvents(host, port);
+        if (fd < 0) {
+            fprintf(stderr, "SSE connection %d failed\n", i);
+            return 1;
+        }
+        streams.push_back(fd);
+    }
+    long withEvents = settledHeap(host, port);
+    for (int fd : streams) {
+        ::close(fd);
+    }
+
+    // Give the device time to free the SSE clients before the next baseline
+    sleep(2);
+    long base2 = settledHeap(host, port);
+
+    std::vector<WsClient> sockets(count);
+    for (int i = 0; i < count; i++) {
+        if (!sockets[i].connect(host, port)) {
+            fprintf(stderr, "WebSocket connection %d failed\n", i);
+            return 1;
+        }
+    }
+    long withSockets = settledHeap(host, port);
+
+    double ssePer = (double)(base - withEvents) / count;
+    double wsPer = (double)(base2 - withSockets) / count;
+    printf("free heap  baseline %ld  with %d SSE %ld\n", base, count, withEvents);
+    printf("free heap  baseline %ld  with %d WS  %ld\n", base2, count, withSockets);
+    printf("RESULT connections=%d sse_bytes_per_conn=%.0f ws_bytes_per_conn=%.0f\n", count, ssePer, wsPer);
+    return 0;
+}
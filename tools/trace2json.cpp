@@ -0,0 +1,155 @@
+// Converts a /trace download into Chrome trace / Perfetto JSON.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude tools/trace2json.cpp -o trace2json
+// Usage:  ./trace2json trace.bin > trace.json
+//         then open trace.json in chrome://tracing or ui.perfetto.dev
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "trace_format.h"
+
+static bool readAll(const char *path, std::vector<uint8_t> &out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        out.insert(out.end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+// Task names come from the device and may hold any byte
+static std::string jsonEscape(const char *text) {
+    std::string out;
+    for (const char *c = text; *c; c++) {
+        unsigned char ch = (unsigned char)*c;
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += (char)ch;
+        } else if (ch < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", ch);
+            out += code;
+        } else {
+            out += (char)ch;
+        }
+    }
+    return out;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin > trace.json\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    if (!readAll(argv[1], data)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t pos = 0;
+    auto take = [&](void *dst, size_t len) {
+        if (pos + len > data.size()) {
+            return false;
+        }
+        memcpy(dst, data.data() + pos, len);
+        pos += len;
+        return true;
+    };
+
+    TraceFileHeader fh;
+    if (!take(&fh, sizeof(fh)) || fh.magic != TRACE_MAGIC) {
+        fprintf(stderr, "not a trace file\n");
+        return 1;
+    }
+    if (fh.version != TRACE_FORMAT_VERSION || fh.eventSize != sizeof(TraceEvent)) {
+        fprintf(stderr, "unsupported trace version %u\n", fh.version);
+        return 1;
+    }
+
+    std::vector<std::string> tasks(fh.taskCount);
+    for (uint16_t i = 0; i < fh.taskCount; i++) {
+        char name[TRACE_TASK_NAME_LEN + 1] = {0};
+        if (!take(name, TRACE_TASK_NAME_LEN)) {
+            fprintf(stderr, "truncated task table\n");
+            return 1;
+        }
+        tasks[i] = jsonEscape(name);
+    }
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    auto sep = [&]() {
+        if (!first) {
+            printf(",\n");
+        }
+        first = false;
+    };
+
+    for (uint16_t core = 0; core < fh.numCores; core++) {
+        TraceCoreHeader ch;
+        if (!take(&ch, sizeof(ch))) {
+            fprintf(stderr, "truncated core %u header\n", core);
+            return 1;
+        }
+
+        std::vector<TraceEvent> events(ch.eventCount);
+        if (ch.eventCount && !take(events.data(), ch.eventCount * sizeof(TraceEvent))) {
+            fprintf(stderr, "truncated core %u events\n", core);
+            return 1;
+        }
+
+        sep();
+        printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"core %u\"}}",
+               core, core);
+        for (uint16_t t = 0; t < fh.taskCount; t++) {
+            sep();
+            printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                   core, t, tasks[t].c_str());
+        }
+
+        // Walk backwards from the anchor so 32-bit CCOUNT wraps unwind
+        // naturally (each gap must be under 2^32 cycles, ~17 s at 240 MHz).
+        std::vector<double> micros(ch.eventCount);
+        uint64_t elapsed = 0;
+        uint32_t later = ch.anchorCycles;
+        for (size_t i = ch.eventCount; i-- > 0;) {
+            elapsed += (uint32_t)(later - events[i].cycles);
+            later = events[i].cycles;
+            micros[i] = (double)ch.anchorMicros - (double)elapsed / fh.cpuMhz;
+        }
+
+        for (size_t i = 0; i < ch.eventCount; i++) {
+            const TraceEvent &ev = events[i];
+            const char *name = ev.id < TRACE_EVT_COUNT ? TRACE_EVENT_NAMES[ev.id] : "unknown";
+            const char *ph = ev.phase == TRACE_PHASE_BEGIN ? "B"
+                           : ev.phase == TRACE_PHASE_END ? "E" : "i";
+            sep();
+            printf("{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u",
+                   name, ph, micros[i], core, ev.task);
+            if (ev.phase == TRACE_PHASE_INSTANT) {
+                printf(",\"s\":\"t\"");
+            }
+            if (ev.phase != TRACE_PHASE_END) {
+                printf(",\"args\":{\"arg\":%u}", ev.arg);
+            }
+            printf("}");
+        }
+
+        if (ch.dropped) {
+            fprintf(stderr, "core %u: %u older events were overwritten\n", core, ch.dropped);
+        }
+    }
+
+    printf("\n]}\n");
+    return 0;
+}
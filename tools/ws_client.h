@@ -0,0 +1,205 @@
+// Minimal blocking WebSocket client for the host tools (POSIX sockets, text
+// frames only). Enough to talk to the device's /ws endpoint; not a general
+// RFC 6455 implementation: no TLS, no extensions, no fragmented sends.
+
+#ifndef TOOLS_WS_CLIENT_H
+#define TOOLS_WS_CLIENT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+class WsClient {
+public:
+    WsClient() : fd(-1), rcvBuf(0), rxBytes(0), txBytes(0) {
+    }
+
+    ~WsClient() {
+        close();
+    }
+
+    // Shrinks the socket receive buffer (applied on the next connect) so a
+    // client that stops reading stalls the device's sends quickly
+    void setReceiveBuffer(int bytes) {
+        rcvBuf = bytes;
+    }
+
+    bool connect(const char *host, int port, const char *path = "/ws") {
+        char portStr[8];
+        snprintf(portStr, sizeof(portStr), "%d", port);
+
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *res = nullptr;
+        if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+            return false;
+        }
+        for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd >= 0 && rcvBuf > 0) {
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+            }
+            if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+        if (fd < 0) {
+            return false;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        // Fixed key: the tools do not check Sec-WebSocket-Accept
+        char request[512];
+        int len = snprintf(request, sizeof(request),
+                           "GET %s HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n",
+                           path, host, port);
+        if (!writeAll(request, len)) {
+            return false;
+        }
+
+        // Read byte by byte up to the end of the headers so no frame bytes are consumed
+        std::string headers;
+        char c;
+        while (headers.size() < 4096) {
+            if (::recv(fd, &c, 1, 0) != 1) {
+                return false;
+            }
+            headers += c;
+            if (headers.size() >= 4 && headers.compare(headers.size() - 4, 4, "\r\n\r\n") == 0) {
+                break;
+            }
+        }
+        return headers.compare(0, 12, "HTTP/1.1 101") == 0;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int socket() const {
+        return fd;
+    }
+
+    bool sendText(const std::string &text) {
+        return sendFrame(0x1, text.data(), text.size());
+    }
+
+    // Appends whatever is readable without blocking to the receive buffer
+    // and pops complete text frames into messages. Returns false on close.
+    bool poll(std::vector<std::string> &messages) {
+        uint8_t chunk[4096];
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n == 0) {
+            return false;
+        }
+        if (n > 0) {
+            rx.insert(rx.end(), chunk, chunk + n);
+        }
+
+        for (;;) {
+            if (rx.size() < 2) {
+                break;
+            }
+            uint8_t opcode = rx[0] & 0x0F;
+            uint64_t length = rx[1] & 0x7F;
+            size_t header = 2;
+            if (length == 126) {
+                if (rx.size() < 4) break;
+                length = ((uint64_t)rx[2] << 8) | rx[3];
+                header = 4;
+            } else if (length == 127) {
+                if (rx.size() < 10) break;
+                length = 0;
+                for (int i = 0; i < 8; i++) {
+                    length = (length << 8) | rx[2 + i];
+                }
+                header = 10;
+            }
+            if (rx.size() < header + length) {
+                break;
+            }
+
+            const char *payload = (const char *)&rx[header];
+            if (opcode == 0x1) {
+                messages.emplace_back(payload, (size_t)length);
+                rxBytes += length;
+            } else if (opcode == 0x9) {
+                sendFrame(0xA, payload, (size_t)length);
+            } else if (opcode == 0x8) {
+                return false;
+            }
+            rx.erase(rx.begin(), rx.begin() + header + length);
+        }
+        return true;
+    }
+
+    uint64_t receivedBytes() const { return rxBytes; }
+    uint64_t sentBytes() const { return txBytes; }
+
+private:
+    bool writeAll(const void *data, size_t len) {
+        const uint8_t *p = (const uint8_t *)data;
+        while (len > 0) {
+            ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Client frames must be masked; a constant mask is fine for testing
+    bool sendFrame(uint8_t opcode, const char *data, size_t len) {
+        std::vector<uint8_t> frame;
+        frame.push_back(0x80 | opcode);
+        if (len < 126) {
+            frame.push_back(0x80 | (uint8_t)len);
+        } else {
+            frame.push_back(0x80 | 126);
+            frame.push_back((uint8_t)(len >> 8));
+            frame.push_back((uint8_t)len);
+        }
+        const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+        frame.insert(frame.end(), mask, mask + 4);
+        for (size_t i = 0; i < len; i++) {
+            frame.push_back((uint8_t)data[i] ^ mask[i & 3]);
+        }
+        txBytes += len;
+        return writeAll(frame.data(), frame.size());
+    }
+
+    int fd;
+    int rcvBuf;
+    std::vector<uint8_t> rx;
+    uint64_t rxBytes;
+    uint64_t txBytes;
+};
+
+#endif // TOOLS_WS_CLIENT_H
@@ -0,0 +1,155 @@
+// Multi-client fan-out test. Opens several WebSocket clients against the
+// device. Each round, every client sends one command; the tool then waits
+// until every client has its own response back. It counts what each client
+// received: its own responses, responses meant for other clients, and
+// broadcasts. Run it before and after a firmware change to compare bytes
+// received per client.
+//
+// Build:  g++ -std=c++17 -O2 tools/ws_fanout.cpp -o ws_fanout
+// Usage:  ./ws_fanout <host> [port=80] [clients=4] [rounds=50]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include "ws_client.h"
+
+struct ClientStats {
+    WsClient ws;
+    std::set<unsigned long> pending;
+    std::set<unsigned long> sent;
+    uint64_t ownBytes = 0;
+    uint64_t foreignBytes = 0;
+    uint64_t broadcastBytes = 0;
+    uint32_t ownCount = 0;
+    uint32_t foreignCount = 0;
+    uint32_t broadcastCount = 0;
+};
+
+static unsigned long commandIdOf(const std::string &message) {
+    size_t at = message.find("\"commandId\":");
+    return at == std::string::npos ? 0 : strtoul(message.c_str() + at + 12, nullptr, 10);
+}
+
+static void classify(ClientStats &client, const std::string &message) {
+    if (message.find("\"type\":\"response\"") == std::string::npos) {
+        client.broadcastBytes += message.size();
+        client.broadcastCount++;
+        return;
+    }
+    unsigned long id = commandIdOf(message);
+    if (client.sent.count(id)) {
+        client.pending.erase(id);
+        client.ownBytes += message.size();
+        client.ownCount++;
+    } else {
+        client.foreignBytes += message.size();
+        client.foreignCount++;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <host> [port] [clients] [rounds]\n", argv[0]);
+        return 1;
+    }
+    const char *host = argv[1];
+    int port = argc > 2 ? atoi(argv[2]) : 80;
+    int clientCount = argc > 3 ? atoi(argv[3]) : 4;
+    int rounds = argc > 4 ? atoi(argv[4]) : 50;
+
+    std::vector<ClientStats> clients(clientCount);
+    for (int i = 0; i < clientCount; i++) {
+        if (!clients[i].ws.connect(host, port)) {
+            fprintf(stderr, "client %d: connect failed\n", i);
+            return 1;
+        }
+    }
+
+    static const char *const SENSORS[] = {"returnAirTemp", "ambientTemp", "coilTemp", "coolantTemp"};
+    unsigned long nextId = 1;
+    uint32_t timeouts = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < clientCount; i++) {
+            unsigned long id = nextId++;
+            char frame[160];
+            snprintf(frame, sizeof(frame),
+                     "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"updateSensor\",\"sensor\":\"%s\",\"value\":%d}",
+                     id, SENSORS[round % 4], 40 + (round % 20));
+            clients[i].sent.insert(id);
+            clients[i].pending.insert(id);
+            clients[i].ws.sendText(frame);
+        }
+
+        // Pump every socket until all responses for this round are in
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        for (;;) {
+            bool waiting = false;
+            for (ClientStats &client : clients) {
+                waiting = waiting || !client.pending.empty();
+            }
+            if (!waiting) {
+                break;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                for (ClientStats &client : clients) {
+                    timeouts += client.pending.size();
+                    client.pending.clear();
+                }
+                break;
+            }
+
+            std::vector<pollfd> fds;
+            for (ClientStats &client : clients) {
+                fds.push_back({client.ws.socket(), POLLIN, 0});
+            }
+            ::poll(fds.data(), fds.size(), 50);
+
+            for (ClientStats &client : clients) {
+                std::vector<std::string> messages;
+                if (!client.ws.poll(messages)) {
+                    fprintf(stderr, "connection closed by device\n");
+                    return 1;
+                }
+                for (const std::string &message : messages) {
+                    classify(client, message);
+                }
+            }
+        }
+    }
+
+    // Drain broadcasts still in flight
+    auto drainUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < drainUntil) {
+        for (ClientStats &client : clients) {
+            std::vector<std::string> messages;
+            client.ws.poll(messages);
+            for (const std::string &message : messages) {
+                classify(client, message);
+            }
+        }
+        usleep(20000);
+    }
+
+    uint64_t totalOwn = 0, totalForeign = 0, totalBroadcast = 0;
+    printf("client  own-resp  bytes   foreign-resp  bytes   broadcast  bytes\n");
+    for (int i = 0; i < clientCount; i++) {
+        const ClientStats &c = clients[i];
+        printf("%6d  %8u  %6llu  %12u  %6llu  %9u  %6llu\n", i, c.ownCount, (unsigned long long)c.ownBytes,
+               c.foreignCount, (unsigned long long)c.foreignBytes, c.broadcastCount,
+               (unsigned long long)c.broadcastBytes);
+        totalOwn += c.ownBytes;
+        totalForeign += c.foreignBytes;
+        totalBroadcast += c.broadcastBytes;
+    }
+    uint64_t total = totalOwn + totalForeign + totalBroadcast;
+    printf("timeouts %u\n", timeouts);
+    printf("RESULT clients=%d rounds=%d own_bytes=%llu foreign_bytes=%llu broadcast_bytes=%llu total_bytes=%llu\n",
+           clientCount, rounds, (unsigned long long)totalOwn, (unsigned long long)totalForeign,
+           (unsigned long long)totalBroadcast, (unsigned long long)total);
+    return timeouts ? 2 : 0;
+}
@@ -0,0 +1,423 @@
+// WebSocket load generator. Opens N clients against a bench or a local
+// simulator (env:sim --serve) and sends a weighted mix of run / stop /
+// preset / updateSensor commands at a fixed total rate, round-robin over
+// the clients. The schedule is open-loop: a slow acknowledgement does not
+// slow the sender down, so queueing on the device shows up as latency
+// rather than as a lower offered rate.
+//
+// Per run it reports the achieved command rate, acknowledgement latency
+// percentiles (send to matching "response" frame), commands that were never
+// acknowledged within the timeout ("dropped"), frames lost to closed
+// connections, and the bytes each client received. The last stdout line is
+// a RESULT line like the other tools; --json appends the same figures as one
+// JSON object per line, so runs against different firmware builds can be
+// collected in one file and compared.
+//
+// Build:  g++ -std=c++17 -O2 tools/ws_load.cpp -o ws_load
+// Usage:  ./ws_load <host> [--port 80] [--clients 4] [--rate 20] [--duration 10]
+//                   [--mix run=1,stop=1,preset=2,updateSensor=16] [--timeout-ms 2000]
+//                   [--subscribe] [--seed 1] [--label text] [--json results.jsonl]
+//
+// --rate is commands per second across all clients. --subscribe has every
+// client subscribe to status, rpmUpdate and event first, as a dashboard
+// does; without it clients get the default topics.
+//
+// Exits 0 when every command was acknowledged, 2 otherwise.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "ws_client.h"
+
+using Clock = std::chrono::steady_clock;
+
+enum LoadCommand { LOAD_RUN, LOAD_STOP, LOAD_PRESET, LOAD_UPDATE_SENSOR, LOAD_COMMAND_COUNT };
+
+static const char *const COMMAND_NAMES[LOAD_COMMAND_COUNT] = {"run", "stop", "preset", "updateSensor"};
+
+static const char *const SYSTEM_TYPES[] = {"thermoking", "carrier", "apu"};
+static const char *const SENSORS[] = {
+    "returnAirTemp", "dischargeAirTemp", "ambientTemp", "coolantTemp",
+    "coilTemp", "suctionPressure", "dischargePressure", "redundantAirTemp",
+};
+
+struct LoadClient {
+    WsClient ws;
+    bool open = true;
+    std::map<unsigned long, Clock::time_point> pending;  // commandId -> sent at
+    uint32_t sent = 0;
+    uint32_t acked = 0;
+    uint32_t failed = 0;        // acknowledged with status "error"
+    uint32_t frames = 0;
+    uint32_t responses = 0;
+    uint32_t broadcasts = 0;
+};
+
+struct Options {
+    const char *host = nullptr;
+    int port = 80;
+    int clients = 4;
+    double rate = 20;
+    double duration = 10;
+    int timeoutMs = 2000;
+    bool subscribe = false;
+    unsigned seed = 1;
+    const char *label = "";
+    const char *jsonPath = nullptr;
+    unsigned weights[LOAD_COMMAND_COUNT] = {1, 1, 2, 16};
+};
+
+// xorshift32; the mix has to be the same from run to run
+static uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static unsigned long commandIdOf(const std::string &message) {
+    size_t at = message.find("\"commandId\":");
+    return at == std::string::npos ? 0 : strtoul(message.c_str() + at + 12, nullptr, 10);
+}
+
+static bool parseMix(const char *text, unsigned *weights) {
+    unsigned parsed[LOAD_COMMAND_COUNT] = {0, 0, 0, 0};
+    std::string mix(text);
+    size_t pos = 0;
+    while (pos < mix.size()) {
+        size_t end = mix.find(',', pos);
+        end = end == std::string::npos ? mix.size() : end;
+        std::string item = mix.substr(pos, end - pos);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        int command = -1;
+        for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+            if (item.compare(0, eq, COMMAND_NAMES[i]) == 0 && strlen(COMMAND_NAMES[i]) == eq) {
+                command = i;
+            }
+        }
+        if (command < 0) {
+            return false;
+        }
+        parsed[command] = (unsigned)atoi(item.c_str() + eq + 1);
+        pos = end + 1;
+    }
+    unsigned total = 0;
+    for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+        total += parsed[i];
+    }
+    if (total == 0) {
+        return false;
+    }
+    memcpy(weights, parsed, sizeof(parsed));
+    return true;
+}
+
+static LoadCommand pickCommand(const Options &options, uint32_t &random) {
+    unsigned total = 0;
+    for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+        total += options.weights[i];
+    }
+    unsigned roll = nextRandom(random) % total;
+    for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+        if (roll < options.weights[i]) {
+            return (LoadCommand)i;
+        }
+        roll -= options.weights[i];
+    }
+    return LOAD_UPDATE_SENSOR;
+}
+
+static std::string buildCommand(LoadCommand command, unsigned long id, uint32_t &random) {
+    char frame[192];
+    const char *type = SYSTEM_TYPES[nextRandom(random) % 3];
+    switch (command) {
+        case LOAD_RUN:
+            snprintf(frame, sizeof(frame), "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"run\",\"systemType\":\"%s\"}",
+                     id, type);
+            break;
+        case LOAD_STOP:
+            snprintf(frame, sizeof(frame), "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"stop\"}", id);
+            break;
+        case LOAD_PRESET:
+            snprintf(frame, sizeof(frame),
+                     "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"preset\",\"systemType\":\"%s\"}", id, type);
+            break;
+        default:
+            snprintf(frame, sizeof(frame),
+                     "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"updateSensor\",\"sensor\":\"%s\",\"value\":%u}",
+                     id, SENSORS[nextRandom(random) % 8], 30 + nextRandom(random) % 60);
+            break;
+    }
+    return frame;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: ws_load <host> [--port 80] [--clients 4] [--rate 20] [--duration 10]\n"
+            "               [--mix run=1,stop=1,preset=2,updateSensor=16] [--timeout-ms 2000]\n"
+            "               [--subscribe] [--seed 1] [--label text] [--json results.jsonl]\n");
+}
+
+static bool parseArgs(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--port") == 0 && hasValue) {
+            options.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clients") == 0 && hasValue) {
+            options.clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && hasValue) {
+            options.rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && hasValue) {
+            options.duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout-ms") == 0 && hasValue) {
+            options.timeoutMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mix") == 0 && hasValue) {
+            if (!parseMix(argv[++i], options.weights)) {
+                fprintf(stderr, "bad --mix: use name=weight pairs of run, stop, preset, updateSensor\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--subscribe") == 0) {
+            options.subscribe = true;
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            options.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--label") == 0 && hasValue) {
+            options.label = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (argv[i][0] != '-' && !options.host) {
+            options.host = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return options.host && options.clients > 0 && options.rate > 0 && options.duration > 0;
+}
+
+// Reads whatever is there on every open client. Commands still pending on
+// a connection the device closed count as lost frames.
+static void pumpClients(std::vector<LoadClient> &clients, int waitMs, std::vector<double> &latencies,
+                        uint32_t &lostFrames) {
+    std::vector<pollfd> fds;
+    for (LoadClient &client : clients) {
+        fds.push_back({client.open ? client.ws.socket() : -1, POLLIN, 0});
+    }
+    ::poll(fds.data(), fds.size(), waitMs);
+
+    Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < clients.size(); i++) {
+        LoadClient &client = clients[i];
+        if (!client.open || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        std::vector<std::string> messages;
+        if (!client.ws.poll(messages)) {
+            fprintf(stderr, "client %zu: connection closed by device\n", i);
+            client.open = false;
+            lostFrames += client.pending.size();
+            client.pending.clear();
+        }
+        for (const std::string &message : messages) {
+            client.frames++;
+            if (message.find("\"type\":\"response\"") == std::string::npos) {
+                client.broadcasts++;
+                continue;
+            }
+            client.responses++;
+            auto it = client.pending.find(commandIdOf(message));
+            if (it == client.pending.end()) {
+                continue;  // late reply to a command already counted as dropped, or the subscribe ack
+            }
+            latencies.push_back(std::chrono::duration<double, std::milli>(now - it->second).count());
+            client.pending.erase(it);
+            client.acked++;
+            if (message.find("\"status\":\"success\"") == std::string::npos) {
+                client.failed++;
+            }
+        }
+    }
+}
+
+// Moves commands older than the timeout from pending to dropped
+static uint32_t expire(std::vector<LoadClient> &clients, int timeoutMs) {
+    uint32_t expired = 0;
+    Clock::time_point cutoff = Clock::now() - std::chrono::milliseconds(timeoutMs);
+    for (LoadClient &client : clients) {
+        for (auto it = client.pending.begin(); it != client.pending.end();) {
+            if (it->second < cutoff) {
+                it = client.pending.erase(it);
+                expired++;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return expired;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    std::vector<LoadClient> clients(options.clients);
+    for (int i = 0; i < options.clients; i++) {
+        if (!clients[i].ws.connect(options.host, options.port)) {
+            fprintf(stderr, "client %d: connect failed\n", i);
+            return 1;
+        }
+    }
+
+    std::vector<double> latencies;
+    uint32_t lostFrames = 0;
+    uint32_t dropped = 0;
+    uint32_t sendFailures = 0;
+    uint32_t sentByCommand[LOAD_COMMAND_COUNT] = {0, 0, 0, 0};
+    uint32_t random = options.seed ? options.seed : 1;
+    unsigned long nextId = 1;
+
+    if (options.subscribe) {
+        for (LoadClient &client : clients) {
+            char frame[128];
+            snprintf(frame, sizeof(frame),
+                     "{\"type\":\"command\",\"commandId\":%lu,\"cmd\":\"subscribe\",\"topics\":[\"status\",\"rpmUpdate\",\"event\"]}",
+                     nextId++);
+            client.ws.sendText(frame);
+        }
+    }
+
+    // Open-loop schedule: command k goes out at start + k / rate
+    uint64_t total = (uint64_t)(options.rate * options.duration + 0.5);
+    Clock::time_point start = Clock::now();
+    uint64_t issued = 0;
+    while (issued < total) {
+        Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+                                            std::chrono::duration<double>(issued / options.rate));
+        Clock::time_point now = Clock::now();
+        if (now < due) {
+            int waitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+            pumpClients(clients, std::max(waitMs, 0), latencies, lostFrames);
+            dropped += expire(clients, options.timeoutMs);
+            continue;
+        }
+
+        LoadClient &client = clients[issued % clients.size()];
+        issued++;
+        LoadCommand command = pickCommand(options, random);
+        unsigned long id = nextId++;
+        std::string frame = buildCommand(command, id, random);
+        sentByCommand[command]++;
+        if (!client.open || !client.ws.sendText(frame)) {
+            sendFailures++;
+            continue;
+        }
+        client.sent++;
+        client.pending[id] = Clock::now();
+    }
+    double sendSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Give the last commands their full timeout, then count the rest as dropped
+    Clock::time_point drainUntil = Clock::now() + std::chrono::milliseconds(options.timeoutMs);
+    for (;;) {
+        bool waiting = false;
+        for (const LoadClient &client : clients) {
+            waiting = waiting || (client.open && !client.pending.empty());
+        }
+        if (!waiting || Clock::now() >= drainUntil) {
+            break;
+        }
+        pumpClients(clients, 20, latencies, lostFrames);
+    }
+    for (LoadClient &client : clients) {
+        dropped += client.pending.size();
+        client.pending.clear();
+    }
+    double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) {
+        mean += latency;
+    }
+    mean = latencies.empty() ? 0 : mean / latencies.size();
+
+    uint32_t sent = 0, acked = 0, failed = 0;
+    uint64_t rxBytes = 0, minClientBytes = UINT64_MAX, maxClientBytes = 0;
+    printf("client  sent  acked  errors  frames  responses  broadcasts  rx_bytes\n");
+    for (size_t i = 0; i < clients.size(); i++) {
+        const LoadClient &c = clients[i];
+        uint64_t bytes = c.ws.receivedBytes();
+        printf("%6zu  %4u  %5u  %6u  %6u  %9u  %10u  %8llu%s\n", i, c.sent, c.acked, c.failed, c.frames, c.responses,
+               c.broadcasts, (unsigned long long)bytes, c.open ? "" : "  (closed)");
+        sent += c.sent;
+        acked += c.acked;
+        failed += c.failed;
+        rxBytes += bytes;
+        minClientBytes = std::min(minClientBytes, bytes);
+        maxClientBytes = std::max(maxClientBytes, bytes);
+    }
+    printf("mix");
+    for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+        printf(" %s=%u", COMMAND_NAMES[i], sentByCommand[i]);
+    }
+    printf("\n");
+
+    double achieved = sendSeconds > 0 ? sent / sendSeconds : 0;
+    double ackRate = wallSeconds > 0 ? acked / wallSeconds : 0;
+    double p50 = percentile(latencies, 50);
+    double p90 = percentile(latencies, 90);
+    double p99 = percentile(latencies, 99);
+    double maxLatency = latencies.empty() ? 0 : latencies.back();
+    printf("RESULT clients=%d target_rate=%.1f achieved_rate=%.1f ack_rate=%.1f sent=%u acked=%u errors=%u "
+           "dropped=%u send_failures=%u lost_frames=%u ack_ms_mean=%.2f ack_ms_p50=%.2f ack_ms_p90=%.2f "
+           "ack_ms_p99=%.2f ack_ms_max=%.2f rx_bytes=%llu rx_bytes_per_client_min=%llu rx_bytes_per_client_max=%llu\n",
+           options.clients, options.rate, achieved, ackRate, sent, acked, failed, dropped, sendFailures, lostFrames,
+           mean, p50, p90, p99, maxLatency, (unsigned long long)rxBytes, (unsigned long long)minClientBytes,
+           (unsigned long long)maxClientBytes);
+
+    if (options.jsonPath) {
+        FILE *json = fopen(options.jsonPath, "a");
+        if (!json) {
+            fprintf(stderr, "cannot open %s\n", options.jsonPath);
+            return 1;
+        }
+        fprintf(json,
+                "{\"tool\":\"ws_load\",\"label\":\"%s\",\"host\":\"%s\",\"clients\":%d,\"target_rate\":%.1f,"
+                "\"duration_s\":%.1f,\"subscribe\":%s,\"seed\":%u,\"mix\":{",
+                options.label, options.host, options.clients, options.rate, options.duration,
+                options.subscribe ? "true" : "false", options.seed);
+        for (int i = 0; i < LOAD_COMMAND_COUNT; i++) {
+            fprintf(json, "%s\"%s\":%u", i ? "," : "", COMMAND_NAMES[i], options.weights[i]);
+        }
+        fprintf(json,
+                "},\"achieved_rate\":%.1f,\"ack_rate\":%.1f,\"sent\":%u,\"acked\":%u,\"errors\":%u,\"dropped\":%u,"
+                "\"send_failures\":%u,\"lost_frames\":%u,\"ack_ms\":{\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,"
+                "\"p99\":%.3f,\"max\":%.3f},\"rx_bytes_per_client\":[",
+                achieved, ackRate, sent, acked, failed, dropped, sendFailures, lostFrames, mean, p50, p90, p99,
+                maxLatency);
+        for (size_t i = 0; i < clients.size(); i++) {
+            fprintf(json, "%s%llu", i ? "," : "", (unsigned long long)clients[i].ws.receivedBytes());
+        }
+        fprintf(json, "]}\n");
+        fclose(json);
+    }
+
+    return dropped || sendFailures || lostFrames ? 2 : 0;
+}
@@ -0,0 +1,165 @@
+// Stalled-client test. One WebSocket client connects with a tiny receive
+// buffer and never reads. A second client sends state-changing commands,
+// and every command makes the device publish a status snapshot. The tool
+// samples the device's per-client queue depth from /metrics and the ack
+// latency of the live client. With latest-wins snapshots the stalled
+// client's queue has to level off instead of growing with every command.
+//
+// Build:  g++ -std=c++17 -O2 tools/ws_stall.cpp -o ws_stall
+// Usage:  ./ws_stall <host> [port=80] [commands=200] [max-queue=4]
+//
+// Exits 0 if the deepest queue seen stays within max-queue and every
+// command was acknowledged, 2 otherwise.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ws_client.h"
+
+using Clock = std::chrono::steady_clock;
+
+// GET /metrics on a fresh connection; returns the body, or "" on failure
+static std::string fetchMetrics(const char *host, int port) {
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%d", port);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+        return "";
+    }
+    int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0 || ::connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        freeaddrinfo(res);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return "";
+    }
+    freeaddrinfo(res);
+
+    char request[256];
+    int len = snprintf(request, sizeof(request),
+                       "GET /metrics HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", host);
+    ::send(fd, request, len, MSG_NOSIGNAL);
+
+    std::string response;
+    char chunk[2048];
+    ssize_t n;
+    while ((n = ::recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        response.append(chunk, n);
+    }
+    ::close(fd);
+
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? "" : response.substr(body + 4);
+}
+
+// Deepest reefer_ws_client_queue sample in a /metrics body
+static int maxClientQueue(const std::string &metrics) {
+    static const char PREFIX[] = "reefer_ws_client_queue{";
+    int deepest = -1;
+    size_t at = 0;
+    while ((at = metrics.find(PREFIX, at)) != std::string::npos) {
+        size_t value = metrics.find("} ", at);
+        if (value == std::string::npos) {
+            break;
+        }
+        deepest = std::max(deepest, atoi(metrics.c_str() + value + 2));
+        at = value;
+    }
+    return deepest;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <host> [port] [commands] [max-queue]\n", argv[0]);
+        return 1;
+    }
+    const char *host = argv[1];
+    int port = argc > 2 ? atoi(argv[2]) : 80;
+    int commands = argc > 3 ? atoi(argv[3]) : 200;
+    int maxQueue = argc > 4 ? atoi(argv[4]) : 4;
+
+    WsClient stalled;
+    stalled.setReceiveBuffer(1024);
+    WsClient live;
+    if (!stalled.connect(host, port) || !live.connect(host, port)) {
+        fprintf(stderr, "connect failed\n");
+        return 1;
+    }
+
+    std::vector<double> ackMillis;
+    std::vector<int> queueSamples;
+    uint32_t timeouts = 0;
+    uint64_t nextId = 1;
+
+    for (int i = 0; i < commands; i++) {
+        uint64_t id = nextId++;
+        char frame[160];
+        snprintf(frame, sizeof(frame),
+                 "{\"type\":\"command\",\"commandId\":%llu,\"cmd\":\"updateSensor\",\"sensor\":\"ambientTemp\",\"value\":%d}",
+                 (unsigned long long)id, 20 + (i % 40));
+        char idField[40];
+        snprintf(idField, sizeof(idField), "\"commandId\":%llu", (unsigned long long)id);
+
+        Clock::time_point start = Clock::now();
+        live.sendText(frame);
+
+        bool acked = false;
+        while (!acked && Clock::now() - start < std::chrono::seconds(3)) {
+            pollfd pfd = {live.socket(), POLLIN, 0};
+            ::poll(&pfd, 1, 20);
+            std::vector<std::string> messages;
+            if (!live.poll(messages)) {
+                fprintf(stderr, "live client closed by device\n");
+                return 1;
+            }
+            for (const std::string &message : messages) {
+                if (message.find("\"type\":\"response\"") != std::string::npos &&
+                    message.find(idField) != std::string::npos) {
+                    acked = true;
+                }
+            }
+        }
+        if (acked) {
+            ackMillis.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        } else {
+            timeouts++;
+        }
+
+        if (i % 20 == 19) {
+            int depth = maxClientQueue(fetchMetrics(host, port));
+            queueSamples.push_back(depth);
+            printf("after %4d commands: deepest client queue %d\n", i + 1, depth);
+        }
+    }
+
+    // Let the stalled client read what was held for it
+    size_t stalledFrames = 0;
+    Clock::time_point drainUntil = Clock::now() + std::chrono::seconds(2);
+    while (Clock::now() < drainUntil) {
+        std::vector<std::string> messages;
+        if (!stalled.poll(messages)) {
+            break;
+        }
+        stalledFrames += messages.size();
+        usleep(20000);
+    }
+
+    std::sort(ackMillis.begin(), ackMillis.end());
+    double p50 = ackMillis.empty() ? 0 : ackMillis[ackMillis.size() / 2];
+    double p99 = ackMillis.empty() ? 0 : ackMillis[ackMillis.size() * 99 / 100];
+    int deepest = queueSamples.empty() ? -1 : *std::max_element(queueSamples.begin(), queueSamples.end());
+
+    printf("acks %zu/%d  p50 %.1f ms  p99 %.1f ms\n", ackMillis.size(), commands, p50, p99);
+    printf("stalled client received %zu frames after draining\n", stalledFrames);
+    printf("RESULT commands=%d timeouts=%u deepest_queue=%d stalled_frames=%zu ack_p99_ms=%.1f\n",
+           commands, timeouts, deepest, stalledFrames, p99);
+    return (timeouts == 0 && deepest >= 0 && deepest <= maxQueue) ? 0 : 2;
+}